@@ -0,0 +1,445 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_audio_ima_adpcm_codec.h: Public API declarations for ImaAdpcmEncoder, a dependency-free IMA-ADPCM
+// encoder, and its codec_c_interface implementation for the audio compression plugin ABI
+//
+
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include "speechapi_c_ext_audiocompression.h"
+#include "speechapi_cxx_common.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+namespace Audio {
+
+/// <summary>
+/// Encodes 16 bit PCM to IMA-ADPCM (4 bits per sample, WAVE_FORMAT_IMA_ADPCM) in a streaming WAV container,
+/// reducing the size of the audio about four times. The first output of a stream is the WAV header, followed by
+/// one output per encoded block.
+/// </summary>
+/// <remarks>
+/// Each output block starts with the exact sample, so a lost or corrupted block does not affect the next one.
+/// </remarks>
+class ImaAdpcmEncoder
+{
+public:
+
+    /// <summary>
+    /// Callback receiving encoded data and the duration of the audio it holds, in 100 nanosecond units.
+    /// </summary>
+    using DataCallback = std::function<void(const uint8_t* data, size_t size, uint64_t duration)>;
+
+    /// <summary>
+    /// Maximum number of channels.
+    /// </summary>
+    static constexpr uint8_t MaxChannels = 8;
+
+    /// <summary>
+    /// Creates an encoder.
+    /// </summary>
+    /// <param name="samplesPerSecond">Sample rate of the input audio.</param>
+    /// <param name="channels">Number of interleaved channels of the input audio.</param>
+    /// <param name="callback">Callback receiving the encoded data.</param>
+    /// <returns>A shared pointer to the encoder.</returns>
+    static std::shared_ptr<ImaAdpcmEncoder> Create(uint32_t samplesPerSecond, uint8_t channels, DataCallback callback)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, samplesPerSecond == 0 || channels == 0 || channels > MaxChannels || callback == nullptr);
+        return std::shared_ptr<ImaAdpcmEncoder>(new ImaAdpcmEncoder(samplesPerSecond, channels, std::move(callback)));
+    }
+
+    /// <summary>
+    /// Gets the MIME type of the encoded stream.
+    /// </summary>
+    /// <returns>The MIME type.</returns>
+    static const char* GetFormatType() { return "audio/x-wav"; }
+
+    /// <summary>
+    /// Gets the size in bytes of an encoded block.
+    /// </summary>
+    /// <returns>Block size in bytes.</returns>
+    uint32_t GetBlockAlign() const { return m_blockAlign; }
+
+    /// <summary>
+    /// Gets the number of sample frames in an encoded block.
+    /// </summary>
+    /// <returns>Sample frames per block.</returns>
+    uint32_t GetSamplesPerBlock() const { return m_samplesPerBlock; }
+
+    /// <summary>
+    /// Encodes 16 bit little-endian interleaved PCM. Complete blocks are passed to the callback; the rest is kept
+    /// until the next call.
+    /// </summary>
+    /// <param name="data">The PCM data.</param>
+    /// <param name="size">The size of the data in bytes.</param>
+    void Encode(const uint8_t* data, size_t size)
+    {
+        if (!m_headerWritten)
+        {
+            WriteHeader();
+        }
+
+        // Reassemble a sample split across calls.
+        if (m_partialByte >= 0 && size > 0)
+        {
+            m_pending[m_pendingSamples++] = static_cast<int16_t>(static_cast<uint16_t>(m_partialByte) | (static_cast<uint16_t>(data[0]) << 8));
+            m_partialByte = -1;
+            data++;
+            size--;
+            EncodeIfFull();
+        }
+
+        while (size >= 2)
+        {
+            auto take = std::min(size / 2, m_pending.size() - m_pendingSamples);
+            std::memcpy(m_pending.data() + m_pendingSamples, data, take * 2);
+            m_pendingSamples += take;
+            data += take * 2;
+            size -= take * 2;
+            EncodeIfFull();
+        }
+
+        if (size == 1)
+        {
+            m_partialByte = data[0];
+        }
+    }
+
+    /// <summary>
+    /// Encodes the pending audio as a final, padded block.
+    /// </summary>
+    void Flush()
+    {
+        auto frames = m_pendingSamples / m_channels;
+        if (frames == 0)
+        {
+            return;
+        }
+
+        // Pad by holding the last sample, which keeps the padding silent without a step back to zero.
+        for (size_t i = frames * m_channels; i < m_pending.size(); i++)
+        {
+            m_pending[i] = m_pending[i - m_channels];
+        }
+        EncodeBlock(frames);
+    }
+
+    /// <summary>
+    /// Ends the stream immediately, dropping the pending audio. The next call to <see cref="Encode"/> starts a new
+    /// stream with its own header.
+    /// </summary>
+    void EndStream()
+    {
+        m_pendingSamples = 0;
+        m_partialByte = -1;
+        m_headerWritten = false;
+    }
+
+private:
+
+    DISABLE_COPY_AND_MOVE(ImaAdpcmEncoder);
+
+    struct ChannelState
+    {
+        int32_t Predictor = 0;
+        int32_t Index = 0;
+    };
+
+    ImaAdpcmEncoder(uint32_t samplesPerSecond, uint8_t channels, DataCallback callback) :
+        m_samplesPerSecond(samplesPerSecond),
+        m_channels(channels),
+        m_callback(std::move(callback))
+    {
+        // The customary block size: 256 bytes per channel, doubled for every doubling of the rate above 11.025 kHz.
+        uint32_t blockPerChannel = 256;
+        for (uint32_t rate = 22050; rate <= samplesPerSecond && blockPerChannel < 2048; rate *= 2)
+        {
+            blockPerChannel *= 2;
+        }
+        m_blockAlign = blockPerChannel * channels;
+        m_samplesPerBlock = (blockPerChannel - 4) * 2 + 1;
+        m_pending.resize(static_cast<size_t>(m_samplesPerBlock) * channels);
+        m_block.resize(m_blockAlign);
+    }
+
+    static const int16_t* StepTable()
+    {
+        static const int16_t steps[89] = {
+            7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+            107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+            876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871,
+            5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+            27086, 29794, 32767 };
+        return steps;
+    }
+
+    // Quantizes one sample. The comparisons are turned into masks so the loop compiles without branches.
+    static uint8_t EncodeSample(ChannelState& state, int32_t sample)
+    {
+        static const int8_t indexAdjust[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+        int32_t step = StepTable()[state.Index];
+        int32_t diff = sample - state.Predictor;
+        int32_t sign = diff >> 31;
+        diff = (diff ^ sign) - sign;
+
+        int32_t delta = step >> 3;
+        int32_t code = 0;
+        int32_t mask = -static_cast<int32_t>(diff >= step);
+        code |= 4 & mask;
+        diff -= step & mask;
+        delta += step & mask;
+
+        step >>= 1;
+        mask = -static_cast<int32_t>(diff >= step);
+        code |= 2 & mask;
+        diff -= step & mask;
+        delta += step & mask;
+
+        step >>= 1;
+        mask = -static_cast<int32_t>(diff >= step);
+        code |= 1 & mask;
+        delta += step & mask;
+
+        state.Predictor += (delta ^ sign) - sign;
+        state.Predictor = std::min(std::max(state.Predictor, -32768), 32767);
+        state.Index = std::min(std::max(state.Index + indexAdjust[code], 0), 88);
+        return static_cast<uint8_t>(code | (sign & 8));
+    }
+
+    void EncodeIfFull()
+    {
+        if (m_pendingSamples == m_pending.size())
+        {
+            EncodeBlock(m_samplesPerBlock);
+        }
+    }
+
+    void EncodeBlock(size_t frames)
+    {
+        auto out = m_block.data();
+        for (size_t channel = 0; channel < m_channels; channel++)
+        {
+            // The block header carries the first sample exactly; the step index continues from the previous block.
+            auto& state = m_state[channel];
+            state.Predictor = m_pending[channel];
+            out[0] = static_cast<uint8_t>(state.Predictor & 0xFF);
+            out[1] = static_cast<uint8_t>((state.Predictor >> 8) & 0xFF);
+            out[2] = static_cast<uint8_t>(state.Index);
+            out[3] = 0;
+            out += 4;
+        }
+
+        // Then groups of 8 samples per channel, 4 bytes each, low nibble first.
+        for (size_t group = 0; group < (m_samplesPerBlock - 1) / 8; group++)
+        {
+            for (size_t channel = 0; channel < m_channels; channel++)
+            {
+                auto& state = m_state[channel];
+                auto samples = m_pending.data() + (1 + group * 8) * m_channels + channel;
+                for (size_t i = 0; i < 8; i += 2)
+                {
+                    auto low = EncodeSample(state, samples[i * m_channels]);
+                    auto high = EncodeSample(state, samples[(i + 1) * m_channels]);
+                    *out++ = static_cast<uint8_t>(low | (high << 4));
+                }
+            }
+        }
+
+        m_pendingSamples = 0;
+        m_callback(m_block.data(), m_block.size(), static_cast<uint64_t>(frames) * 10000000 / m_samplesPerSecond);
+    }
+
+    void WriteHeader()
+    {
+        uint8_t header[60];
+        auto put16 = [&header](size_t offset, uint32_t value) { header[offset] = static_cast<uint8_t>(value); header[offset + 1] = static_cast<uint8_t>(value >> 8); };
+        auto put32 = [&put16](size_t offset, uint32_t value) { put16(offset, value & 0xFFFF); put16(offset + 2, value >> 16); };
+
+        // The sizes are unknown while streaming and left at their maximum.
+        std::memcpy(header, "RIFF", 4);
+        put32(4, 0xFFFFFFFF);
+        std::memcpy(header + 8, "WAVEfmt ", 8);
+        put32(16, 20);
+        put16(20, 0x0011);
+        put16(22, m_channels);
+        put32(24, m_samplesPerSecond);
+        put32(28, static_cast<uint32_t>(static_cast<uint64_t>(m_blockAlign) * m_samplesPerSecond / m_samplesPerBlock));
+        put16(32, m_blockAlign);
+        put16(34, 4);
+        put16(36, 2);
+        put16(38, m_samplesPerBlock);
+        std::memcpy(header + 40, "fact", 4);
+        put32(44, 4);
+        put32(48, 0);
+        std::memcpy(header + 52, "data", 4);
+        put32(56, 0xFFFFFFFF);
+
+        m_headerWritten = true;
+        for (auto& state : m_state)
+        {
+            state = ChannelState();
+        }
+        m_callback(header, sizeof(header), 0);
+    }
+
+    uint32_t m_samplesPerSecond;
+    size_t m_channels;
+    DataCallback m_callback;
+    uint32_t m_blockAlign = 0;
+    uint32_t m_samplesPerBlock = 0;
+
+    ChannelState m_state[MaxChannels];
+    std::vector<int16_t> m_pending;
+    size_t m_pendingSamples = 0;
+    int32_t m_partialByte = -1;
+    std::vector<uint8_t> m_block;
+    bool m_headerWritten = false;
+};
+
+/// <summary>
+/// codec_c_interface implementation around <see cref="ImaAdpcmEncoder"/>, for the audio compression plugin ABI.
+/// Create it with <see cref="Create"/>, or export it as the plugin's codec_create by defining
+/// SPX_CONFIG_EXPORT_IMA_ADPCM_CODEC before including this header in exactly one source file.
+/// </summary>
+struct ImaAdpcmCodec : public codec_c_interface
+{
+    /// <summary>
+    /// Creates the codec object; it is released through its destroy function.
+    /// </summary>
+    /// <param name="codecId">Codec id; null, empty or "ima-adpcm".</param>
+    /// <returns>The codec object, or null if the id names another codec.</returns>
+    static SPXCODECCTYPE Create(const char* codecId)
+    {
+        if (codecId != nullptr && *codecId != '\0' && std::strcmp(codecId, "ima-adpcm") != 0)
+        {
+            return nullptr;
+        }
+        return new (std::nothrow) ImaAdpcmCodec();
+    }
+
+private:
+
+    ImaAdpcmCodec()
+    {
+        init = &Init;
+        get_format_type = &GetFormatType;
+        encode = &Encode;
+        flush = &Flush;
+        endstream = &EndStream;
+        destroy = &Destroy;
+    }
+
+    static ImaAdpcmEncoder* EncoderOf(SPXCODECCTYPE codec)
+    {
+        return codec == nullptr ? nullptr : static_cast<ImaAdpcmCodec*>(codec)->m_encoder.get();
+    }
+
+    static SPXAPI_RESULTTYPE SPXAPI_CALLTYPE Init(SPXCODECCTYPE codec, uint32_t inputSamplesPerSecond, uint8_t inputBitsPerSample, uint8_t inputChannels, AUDIO_ENCODER_ONENCODEDDATA datacallback, void* pContext)
+    {
+        if (codec == nullptr || datacallback == nullptr || inputSamplesPerSecond == 0 || inputChannels == 0)
+        {
+            return SPXERR_INVALID_ARG;
+        }
+        if (inputBitsPerSample != 16 || inputChannels > ImaAdpcmEncoder::MaxChannels)
+        {
+            return SPXERR_UNSUPPORTED_FORMAT;
+        }
+
+        try
+        {
+            static_cast<ImaAdpcmCodec*>(codec)->m_encoder = ImaAdpcmEncoder::Create(inputSamplesPerSecond, inputChannels,
+                [datacallback, pContext](const uint8_t* data, size_t size, uint64_t duration) { datacallback(data, size, duration, pContext); });
+        }
+        catch (...)
+        {
+            return SPXERR_RUNTIME_ERROR;
+        }
+        return SPX_NOERROR;
+    }
+
+    static SPXAPI_RESULTTYPE SPXAPI_CALLTYPE GetFormatType(SPXCODECCTYPE, char* buffer, uint64_t* buffersize)
+    {
+        if (buffersize == nullptr)
+        {
+            return SPXERR_INVALID_ARG;
+        }
+
+        auto type = ImaAdpcmEncoder::GetFormatType();
+        auto required = static_cast<uint64_t>(std::strlen(type) + 1);
+        if (buffer == nullptr)
+        {
+            *buffersize = required;
+            return SPX_NOERROR;
+        }
+        if (*buffersize < required)
+        {
+            return SPXERR_BUFFER_TOO_SMALL;
+        }
+        std::memcpy(buffer, type, static_cast<size_t>(required));
+        return SPX_NOERROR;
+    }
+
+    static SPXAPI_RESULTTYPE SPXAPI_CALLTYPE Encode(SPXCODECCTYPE codec, const uint8_t* pBuffer, size_t bytesToWrite)
+    {
+        auto encoder = EncoderOf(codec);
+        if (encoder == nullptr)
+        {
+            return SPXERR_UNINITIALIZED;
+        }
+        if (pBuffer == nullptr && bytesToWrite > 0)
+        {
+            return SPXERR_INVALID_ARG;
+        }
+        encoder->Encode(pBuffer, bytesToWrite);
+        return SPX_NOERROR;
+    }
+
+    static SPXAPI_RESULTTYPE SPXAPI_CALLTYPE Flush(SPXCODECCTYPE codec)
+    {
+        auto encoder = EncoderOf(codec);
+        if (encoder == nullptr)
+        {
+            return SPXERR_UNINITIALIZED;
+        }
+        encoder->Flush();
+        return SPX_NOERROR;
+    }
+
+    static SPXAPI_RESULTTYPE SPXAPI_CALLTYPE EndStream(SPXCODECCTYPE codec)
+    {
+        auto encoder = EncoderOf(codec);
+        if (encoder == nullptr)
+        {
+            return SPXERR_UNINITIALIZED;
+        }
+        encoder->EndStream();
+        return SPX_NOERROR;
+    }
+
+    static SPXAPI_RESULTTYPE SPXAPI_CALLTYPE Destroy(SPXCODECCTYPE codec)
+    {
+        delete static_cast<ImaAdpcmCodec*>(codec);
+        return SPX_NOERROR;
+    }
+
+    std::shared_ptr<ImaAdpcmEncoder> m_encoder;
+};
+
+} } } } // Microsoft::CognitiveServices::Speech::Audio
+
+#ifdef SPX_CONFIG_EXPORT_IMA_ADPCM_CODEC
+SPX_EXTERN_C SPXDLL_EXPORT SPXCODECCTYPE codec_create(const char* codecid, void*, SPX_CODEC_CLIENT_GET_PROPERTY)
+{
+    return Microsoft::CognitiveServices::Speech::Audio::ImaAdpcmCodec::Create(codecid);
+}
+#endif
@@ -0,0 +1,365 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_audio_mapped_wav_file.h: Public API declarations for MappedWavFilePullAudioInputStreamCallback, a
+// memory-mapped RIFF/RF64 WAV file reader serving a PullAudioInputStream
+//
+
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "speechapi_cxx_common.h"
+#include "speechapi_cxx_string_helpers.h"
+#include "speechapi_cxx_audio_stream_format.h"
+#include "speechapi_cxx_audio_stream.h"
+#include "speechapi_cxx_audio_sample_converter.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+namespace Audio {
+
+/// <summary>
+/// PullAudioInputStreamCallback that reads the audio of a WAV file (RIFF or RF64) through a memory mapping.
+/// Read() copies straight from the mapped pages into the SDK's buffer; the file is never read into an intermediate
+/// buffer. Pass it to <see cref="AudioInputStream::CreatePullStream"/> together with <see cref="GetStreamFormat"/>.
+/// </summary>
+/// <remarks>
+/// Intended for batch transcription of archived recordings. The data chunk is mapped one window at a time, so files
+/// above 4 GB work and address space use stays bounded; the kernel is asked for sequential read-ahead and pages
+/// behind the read cursor are released as reading progresses, keeping page cache pressure low when many files
+/// are processed in a row. Available on POSIX platforms.
+/// </remarks>
+class MappedWavFilePullAudioInputStreamCallback : public PullAudioInputStreamCallback
+{
+public:
+
+    /// <summary>
+    /// Opens a WAV file and parses its header.
+    /// </summary>
+    /// <param name="fileName">Path of the WAV file.</param>
+    /// <param name="windowSize">Size in bytes of the region mapped at a time; rounded up to a whole number of pages.</param>
+    /// <param name="releaseSize">Number of bytes read between two releases of the pages behind the read cursor.</param>
+    /// <returns>A shared pointer to the callback.</returns>
+    static std::shared_ptr<MappedWavFilePullAudioInputStreamCallback> Create(const SPXSTRING& fileName, size_t windowSize = 64 * 1024 * 1024, size_t releaseSize = 4 * 1024 * 1024)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, windowSize == 0);
+
+        auto fd = ::open(Utils::ToUTF8(fileName).c_str(), O_RDONLY | O_CLOEXEC);
+        SPX_THROW_HR_IF(SPXERR_FILE_OPEN_FAILED, fd < 0);
+
+        std::shared_ptr<MappedWavFilePullAudioInputStreamCallback> callback(new MappedWavFilePullAudioInputStreamCallback(fd, windowSize, releaseSize));
+        callback->ParseHeader();
+        return callback;
+    }
+
+    /// <summary>
+    /// Destructor, unmaps and closes the file.
+    /// </summary>
+    ~MappedWavFilePullAudioInputStreamCallback() override
+    {
+        Unmap();
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+        }
+    }
+
+    /// <summary>
+    /// Gets the format of the audio, e.g. to create the PullAudioInputStream.
+    /// </summary>
+    /// <returns>A shared pointer to AudioStreamFormat.</returns>
+    /// <remarks>Throws SPXERR_UNSUPPORTED_FORMAT for floating point files; use <see cref="GetSampleFormat"/> with
+    /// <see cref="ConvertingPullAudioInputStreamCallback"/> for those.</remarks>
+    std::shared_ptr<AudioStreamFormat> GetStreamFormat() const
+    {
+        switch (m_formatTag)
+        {
+        case FormatTagPcm:
+            return AudioStreamFormat::GetWaveFormat(m_samplesPerSecond, static_cast<uint8_t>(m_bitsPerSample), static_cast<uint8_t>(m_channels), AudioStreamWaveFormat::PCM);
+        case FormatTagALaw:
+            return AudioStreamFormat::GetWaveFormat(m_samplesPerSecond, static_cast<uint8_t>(m_bitsPerSample), static_cast<uint8_t>(m_channels), AudioStreamWaveFormat::ALAW);
+        case FormatTagMuLaw:
+            return AudioStreamFormat::GetWaveFormat(m_samplesPerSecond, static_cast<uint8_t>(m_bitsPerSample), static_cast<uint8_t>(m_channels), AudioStreamWaveFormat::MULAW);
+        default:
+            SPX_THROW_HR(SPXERR_UNSUPPORTED_FORMAT);
+        }
+        return nullptr;
+    }
+
+    /// <summary>
+    /// Gets the sample format of a PCM or floating point file, e.g. to convert it with
+    /// <see cref="ConvertingPullAudioInputStreamCallback"/>.
+    /// </summary>
+    /// <returns>The sample format.</returns>
+    AudioSampleFormat GetSampleFormat() const
+    {
+        SPX_THROW_HR_IF(SPXERR_UNSUPPORTED_FORMAT, m_formatTag != FormatTagPcm && m_formatTag != FormatTagFloat);
+        auto encoding = m_formatTag == FormatTagFloat ? AudioSampleEncoding::Float : AudioSampleEncoding::Integer;
+        return AudioSampleFormat(m_samplesPerSecond, static_cast<uint8_t>(m_bitsPerSample), static_cast<uint8_t>(m_channels), encoding);
+    }
+
+    /// <summary>
+    /// Gets the size in bytes of one sample frame (all channels).
+    /// </summary>
+    /// <returns>Frame size in bytes.</returns>
+    uint32_t GetBlockAlign() const { return m_blockAlign; }
+
+    /// <summary>
+    /// Gets the size in bytes of the audio data.
+    /// </summary>
+    /// <returns>Size of the audio data.</returns>
+    uint64_t GetDataSize() const { return m_dataSize; }
+
+    /// <summary>
+    /// Gets the number of audio bytes read so far.
+    /// </summary>
+    /// <returns>Read position within the audio data.</returns>
+    uint64_t GetPosition() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_position;
+    }
+
+    /// <summary>
+    /// Copies the next audio bytes from the mapped file.
+    /// </summary>
+    /// <param name="dataBuffer">The buffer to copy the audio data into.</param>
+    /// <param name="size">The size of the buffer.</param>
+    /// <returns>The number of bytes copied, or zero at the end of the audio data or after Close().</returns>
+    int Read(uint8_t* dataBuffer, uint32_t size) override
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_fd < 0)
+        {
+            return 0;
+        }
+
+        auto count = static_cast<size_t>(std::min<uint64_t>(size, m_dataSize - m_position));
+        size_t copied = 0;
+        while (copied < count)
+        {
+            auto offset = m_dataOffset + m_position;
+            if ((offset < m_windowOffset || offset >= m_windowOffset + m_windowLength) && !Map(offset))
+            {
+                SPX_TRACE_ERROR("MappedWavFilePullAudioInputStreamCallback: mapping failed at offset %llu, errno %d.", static_cast<unsigned long long>(offset), errno);
+                m_position = m_dataSize;
+                break;
+            }
+
+            auto chunk = static_cast<size_t>(std::min<uint64_t>(count - copied, m_windowOffset + m_windowLength - offset));
+            std::memcpy(dataBuffer + copied, m_window + (offset - m_windowOffset), chunk);
+            copied += chunk;
+            m_position += chunk;
+        }
+
+        ReleaseBehind(m_dataOffset + m_position, false);
+        return static_cast<int>(copied);
+    }
+
+    /// <summary>
+    /// Unmaps and closes the file; subsequent reads return zero.
+    /// </summary>
+    void Close() override
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        Unmap();
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+private:
+
+    DISABLE_DEFAULT_CTORS(MappedWavFilePullAudioInputStreamCallback);
+
+    static constexpr uint16_t FormatTagPcm = 0x0001;
+    static constexpr uint16_t FormatTagFloat = 0x0003;
+    static constexpr uint16_t FormatTagALaw = 0x0006;
+    static constexpr uint16_t FormatTagMuLaw = 0x0007;
+    static constexpr uint16_t FormatTagExtensible = 0xFFFE;
+    static constexpr uint32_t SizeUnknown = 0xFFFFFFFF;
+
+    MappedWavFilePullAudioInputStreamCallback(int fd, size_t windowSize, size_t releaseSize) :
+        m_fd(fd),
+        m_pageSize(static_cast<size_t>(::sysconf(_SC_PAGESIZE))),
+        m_releaseSize(releaseSize)
+    {
+        m_windowSize = (windowSize + m_pageSize - 1) / m_pageSize * m_pageSize;
+    }
+
+    static uint16_t ReadUInt16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+    static uint32_t ReadUInt32(const uint8_t* p) { return ReadUInt16(p) | (static_cast<uint32_t>(ReadUInt16(p + 2)) << 16); }
+    static uint64_t ReadUInt64(const uint8_t* p) { return ReadUInt32(p) | (static_cast<uint64_t>(ReadUInt32(p + 4)) << 32); }
+
+    bool ReadAt(uint64_t offset, uint8_t* buffer, size_t size) const
+    {
+        while (size > 0)
+        {
+            auto read = ::pread(m_fd, buffer, size, static_cast<off_t>(offset));
+            if (read <= 0)
+            {
+                return false;
+            }
+            buffer += read;
+            offset += static_cast<uint64_t>(read);
+            size -= static_cast<size_t>(read);
+        }
+        return true;
+    }
+
+    void ParseHeader()
+    {
+        struct stat info;
+        SPX_THROW_HR_IF(SPXERR_FILE_OPEN_FAILED, ::fstat(m_fd, &info) != 0);
+        m_fileSize = static_cast<uint64_t>(info.st_size);
+
+        uint8_t header[12];
+        SPX_THROW_HR_IF(SPXERR_INVALID_HEADER, !ReadAt(0, header, sizeof(header)));
+        auto isRf64 = std::memcmp(header, "RF64", 4) == 0;
+        SPX_THROW_HR_IF(SPXERR_INVALID_HEADER, (!isRf64 && std::memcmp(header, "RIFF", 4) != 0) || std::memcmp(header + 8, "WAVE", 4) != 0);
+
+        // Walk the chunks up to the data chunk; RF64 keeps the 64-bit data size in the ds64 chunk.
+        uint64_t ds64DataSize = 0;
+        bool haveFormat = false;
+        uint64_t offset = sizeof(header);
+        for (;;)
+        {
+            uint8_t chunk[8];
+            SPX_THROW_HR_IF(SPXERR_INVALID_HEADER, !ReadAt(offset, chunk, sizeof(chunk)));
+            uint64_t chunkSize = ReadUInt32(chunk + 4);
+            offset += sizeof(chunk);
+
+            if (std::memcmp(chunk, "ds64", 4) == 0)
+            {
+                uint8_t ds64[16];
+                SPX_THROW_HR_IF(SPXERR_INVALID_HEADER, !isRf64 || chunkSize < sizeof(ds64) || !ReadAt(offset, ds64, sizeof(ds64)));
+                ds64DataSize = ReadUInt64(ds64 + 8);
+            }
+            else if (std::memcmp(chunk, "fmt ", 4) == 0)
+            {
+                uint8_t format[40] = {};
+                SPX_THROW_HR_IF(SPXERR_INVALID_HEADER, chunkSize < 16 || !ReadAt(offset, format, static_cast<size_t>(std::min<uint64_t>(chunkSize, sizeof(format)))));
+                m_formatTag = ReadUInt16(format);
+                m_channels = ReadUInt16(format + 2);
+                m_samplesPerSecond = ReadUInt32(format + 4);
+                m_blockAlign = ReadUInt16(format + 12);
+                m_bitsPerSample = ReadUInt16(format + 14);
+                if (m_formatTag == FormatTagExtensible && chunkSize >= sizeof(format))
+                {
+                    // The first two bytes of the sub-format GUID carry the actual format tag.
+                    m_formatTag = ReadUInt16(format + 24);
+                }
+                haveFormat = true;
+            }
+            else if (std::memcmp(chunk, "data", 4) == 0)
+            {
+                m_dataOffset = offset;
+                m_dataSize = isRf64 && chunkSize == SizeUnknown ? ds64DataSize : chunkSize;
+                break;
+            }
+
+            offset += chunkSize + (chunkSize & 1);
+        }
+
+        SPX_THROW_HR_IF(SPXERR_INVALID_HEADER, !haveFormat || m_channels == 0 || m_blockAlign == 0 || m_bitsPerSample == 0);
+        SPX_THROW_HR_IF(SPXERR_UNSUPPORTED_FORMAT, m_channels > 255 || m_bitsPerSample > 255);
+
+        // Streamed writers leave the size unset, and plain RIFF files above 4 GB overflow it; read to the end of the file then.
+        auto available = m_fileSize > m_dataOffset ? m_fileSize - m_dataOffset : 0;
+        if (m_dataSize > available || (!isRf64 && m_dataSize == SizeUnknown) || (!isRf64 && available > SizeUnknown))
+        {
+            m_dataSize = available;
+        }
+        m_releasedOffset = m_dataOffset - m_dataOffset % m_pageSize;
+    }
+
+    bool Map(uint64_t offset)
+    {
+        ReleaseBehind(m_windowOffset + m_windowLength, true);
+        Unmap();
+
+        auto aligned = offset - offset % m_pageSize;
+        auto length = static_cast<size_t>(std::min<uint64_t>(m_windowSize, m_fileSize - aligned));
+        auto address = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, m_fd, static_cast<off_t>(aligned));
+        if (address == MAP_FAILED)
+        {
+            return false;
+        }
+
+        m_window = static_cast<uint8_t*>(address);
+        m_windowOffset = aligned;
+        m_windowLength = length;
+        m_releasedOffset = std::max(m_releasedOffset, aligned);
+        ::madvise(m_window, m_windowLength, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    void Unmap()
+    {
+        if (m_window != nullptr)
+        {
+            ::munmap(m_window, m_windowLength);
+            m_window = nullptr;
+            m_windowOffset = 0;
+            m_windowLength = 0;
+        }
+    }
+
+    // Drops the pages of the current window between the last release and the read cursor, once enough were read.
+    void ReleaseBehind(uint64_t cursor, bool force)
+    {
+        if (m_window == nullptr)
+        {
+            return;
+        }
+
+        auto end = std::min(cursor, m_windowOffset + m_windowLength);
+        end -= end % m_pageSize;
+        if (end <= m_releasedOffset || (!force && end - m_releasedOffset < m_releaseSize))
+        {
+            return;
+        }
+
+        auto length = static_cast<size_t>(end - m_releasedOffset);
+        ::madvise(m_window + (m_releasedOffset - m_windowOffset), length, MADV_DONTNEED);
+#if defined(POSIX_FADV_DONTNEED)
+        ::posix_fadvise(m_fd, static_cast<off_t>(m_releasedOffset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+#endif
+        m_releasedOffset = end;
+    }
+
+    mutable std::mutex m_mutex;
+    int m_fd;
+    size_t m_pageSize;
+    size_t m_windowSize = 0;
+    size_t m_releaseSize;
+    uint64_t m_fileSize = 0;
+
+    uint16_t m_formatTag = 0;
+    uint16_t m_channels = 0;
+    uint32_t m_samplesPerSecond = 0;
+    uint32_t m_blockAlign = 0;
+    uint16_t m_bitsPerSample = 0;
+    uint64_t m_dataOffset = 0;
+    uint64_t m_dataSize = 0;
+
+    uint8_t* m_window = nullptr;
+    uint64_t m_windowOffset = 0;
+    size_t m_windowLength = 0;
+    uint64_t m_position = 0;
+    uint64_t m_releasedOffset = 0;
+};
+
+} } } } // Microsoft::CognitiveServices::Speech::Audio
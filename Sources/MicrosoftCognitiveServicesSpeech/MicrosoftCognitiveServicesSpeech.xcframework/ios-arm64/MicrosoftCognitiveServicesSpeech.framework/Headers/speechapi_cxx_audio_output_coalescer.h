@@ -0,0 +1,262 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_audio_output_coalescer.h: Public API declarations for CoalescingPushAudioOutputStreamCallback,
+// which batches the small writes of a PushAudioOutputStream into fewer, larger ones
+//
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "speechapi_cxx_common.h"
+#include "speechapi_cxx_string_helpers.h"
+#include "speechapi_cxx_audio_stream.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+namespace Audio {
+
+/// <summary>
+/// PushAudioOutputStreamCallback that collects the audio written by synthesis, which arrives in whatever chunk
+/// sizes the engine produces, and forwards it to another callback in batches of a byte budget, for example to
+/// make one socket write per 20 ms of audio instead of one per chunk. Writes of a whole number of batches are
+/// passed through without copying when nothing is pending.
+/// Pass it to <see cref="AudioOutputStream::CreatePushStream"/>.
+/// </summary>
+/// <remarks>
+/// A batch is also forwarded once its oldest audio has waited for the maximum delay; as there is no timer, this is
+/// checked on the next write. The remaining audio is forwarded on Close(), or earlier through <see cref="Flush"/>.
+/// The callback is invoked one batch at a time, in order, without holding the lock guarding the pending audio, so it
+/// may block or call <see cref="Flush"/> itself; a concurrent Flush or Close waits for the batch in progress.
+/// </remarks>
+class CoalescingPushAudioOutputStreamCallback : public PushAudioOutputStreamCallback
+{
+public:
+
+    /// <summary>
+    /// Creates a coalescing callback.
+    /// </summary>
+    /// <param name="callback">The callback receiving the batches.</param>
+    /// <param name="budgetBytes">Size of a batch in bytes.</param>
+    /// <param name="maxDelay">Maximum time audio is held back, or zero for no limit.</param>
+    /// <returns>A shared pointer to the coalescing callback.</returns>
+    static std::shared_ptr<CoalescingPushAudioOutputStreamCallback> Create(std::shared_ptr<PushAudioOutputStreamCallback> callback, size_t budgetBytes, std::chrono::milliseconds maxDelay = std::chrono::milliseconds(0))
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, callback == nullptr || budgetBytes == 0 || maxDelay.count() < 0);
+        return std::shared_ptr<CoalescingPushAudioOutputStreamCallback>(new CoalescingPushAudioOutputStreamCallback(std::move(callback), budgetBytes, maxDelay));
+    }
+
+    /// <summary>
+    /// Creates a coalescing callback forwarding to Write() and Close() callback functions.
+    /// </summary>
+    /// <param name="writeCallback">Write callback receiving the batches.</param>
+    /// <param name="closeCallback">Close callback.</param>
+    /// <param name="budgetBytes">Size of a batch in bytes.</param>
+    /// <param name="maxDelay">Maximum time audio is held back, or zero for no limit.</param>
+    /// <returns>A shared pointer to the coalescing callback.</returns>
+    static std::shared_ptr<CoalescingPushAudioOutputStreamCallback> Create(AudioOutputStream::WriteCallbackFunction_Type writeCallback, AudioOutputStream::CloseCallbackFunction_Type closeCallback, size_t budgetBytes, std::chrono::milliseconds maxDelay = std::chrono::milliseconds(0))
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, writeCallback == nullptr);
+        return Create(std::make_shared<FunctionCallback>(std::move(writeCallback), std::move(closeCallback)), budgetBytes, maxDelay);
+    }
+
+    /// <summary>
+    /// Gets the batch size for a duration of PCM audio.
+    /// </summary>
+    /// <param name="duration">Duration of audio per batch, e.g. 20 ms.</param>
+    /// <param name="samplesPerSecond">Sample rate of the synthesized audio.</param>
+    /// <param name="bitsPerSample">Bits per sample of the synthesized audio.</param>
+    /// <param name="channels">Number of channels of the synthesized audio.</param>
+    /// <returns>The budget in bytes, in whole frames.</returns>
+    static size_t GetBudgetForDuration(std::chrono::milliseconds duration, uint32_t samplesPerSecond, uint16_t bitsPerSample = 16, uint16_t channels = 1)
+    {
+        auto frames = static_cast<uint64_t>(duration.count()) * samplesPerSecond / 1000;
+        return static_cast<size_t>(std::max<uint64_t>(frames, 1) * channels * ((bitsPerSample + 7) / 8));
+    }
+
+    /// <summary>
+    /// Called by the stream with synthesized audio. Forwards full batches.
+    /// </summary>
+    /// <param name="dataBuffer">The audio data.</param>
+    /// <param name="size">The size of the data in bytes.</param>
+    /// <returns>
+    /// The number of bytes consumed. Audio copied into a batch counts as consumed once copied, so what the callback
+    /// returns for a batch cannot be attributed to any one write and is not reported; for audio passed through
+    /// without copying, a short count from the callback is returned as is (offset by what this write consumed before).
+    /// </returns>
+    int Write(uint8_t* dataBuffer, uint32_t size) override
+    {
+        std::unique_lock<std::recursive_mutex> forwarding(m_forwardMutex);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_writes++;
+        if (!m_buffer.empty() && m_maxDelay.count() > 0 && std::chrono::steady_clock::now() - m_oldest >= m_maxDelay)
+        {
+            ForwardBuffer(lock);
+        }
+
+        auto data = dataBuffer;
+        size_t remaining = size;
+        while (remaining > 0)
+        {
+            if (m_buffer.empty() && remaining >= m_budget)
+            {
+                auto count = remaining - remaining % m_budget;
+                lock.unlock();
+                auto consumed = Forward(data, count);
+                lock.lock();
+                if (consumed < count)
+                {
+                    return static_cast<int>(static_cast<size_t>(data - dataBuffer) + consumed);
+                }
+                data += count;
+                remaining -= count;
+                continue;
+            }
+
+            if (m_buffer.empty())
+            {
+                m_oldest = std::chrono::steady_clock::now();
+            }
+            auto count = std::min(remaining, m_budget - m_buffer.size());
+            m_buffer.insert(m_buffer.end(), data, data + count);
+            data += count;
+            remaining -= count;
+            if (m_buffer.size() == m_budget)
+            {
+                ForwardBuffer(lock);
+            }
+        }
+        return static_cast<int>(size);
+    }
+
+    /// <summary>
+    /// Called by the stream when synthesis has ended. Forwards the remaining audio, then closes the callback.
+    /// </summary>
+    void Close() override
+    {
+        std::unique_lock<std::recursive_mutex> forwarding(m_forwardMutex);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ForwardBuffer(lock);
+        lock.unlock();
+        m_callback->Close();
+    }
+
+    /// <summary>
+    /// Forwards the audio collected so far.
+    /// </summary>
+    void Flush()
+    {
+        std::unique_lock<std::recursive_mutex> forwarding(m_forwardMutex);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ForwardBuffer(lock);
+    }
+
+    /// <summary>
+    /// Gets the number of writes received from the stream.
+    /// </summary>
+    /// <returns>Number of writes.</returns>
+    uint64_t GetWriteCount() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_writes;
+    }
+
+    /// <summary>
+    /// Gets the number of batches forwarded.
+    /// </summary>
+    /// <returns>Number of forwarded writes.</returns>
+    uint64_t GetForwardCount() const
+    {
+        return m_forwards;
+    }
+
+private:
+
+    DISABLE_DEFAULT_CTORS(CoalescingPushAudioOutputStreamCallback);
+
+    class FunctionCallback : public PushAudioOutputStreamCallback
+    {
+    public:
+        FunctionCallback(AudioOutputStream::WriteCallbackFunction_Type writeCallback, AudioOutputStream::CloseCallbackFunction_Type closeCallback) :
+            m_writeCallback(std::move(writeCallback)),
+            m_closeCallback(std::move(closeCallback))
+        {
+        }
+
+        int Write(uint8_t* dataBuffer, uint32_t size) override { return m_writeCallback(dataBuffer, size); }
+        void Close() override { if (m_closeCallback != nullptr) m_closeCallback(); }
+
+    private:
+        DISABLE_COPY_AND_MOVE(FunctionCallback);
+
+        AudioOutputStream::WriteCallbackFunction_Type m_writeCallback;
+        AudioOutputStream::CloseCallbackFunction_Type m_closeCallback;
+    };
+
+    CoalescingPushAudioOutputStreamCallback(std::shared_ptr<PushAudioOutputStreamCallback> callback, size_t budgetBytes, std::chrono::milliseconds maxDelay) :
+        m_callback(std::move(callback)),
+        m_budget(std::min<size_t>(budgetBytes, UINT32_MAX)),
+        m_maxDelay(maxDelay)
+    {
+        m_buffer.reserve(m_budget);
+        m_sending.reserve(m_budget);
+    }
+
+    // Must be called with m_forwardMutex held and the lock on m_mutex, which is released while the batch is forwarded.
+    void ForwardBuffer(std::unique_lock<std::mutex>& lock)
+    {
+        if (m_buffer.empty())
+        {
+            return;
+        }
+
+        // Only one batch is in flight at a time, so the two buffers alternate without allocating.
+        m_sending.swap(m_buffer);
+        lock.unlock();
+        Forward(m_sending.data(), m_sending.size());
+        m_sending.clear();
+        lock.lock();
+    }
+
+    // Returns the number of bytes the callback consumed.
+    size_t Forward(uint8_t* data, size_t size)
+    {
+        // Pass-through writes may exceed the budget; they are split to fit the callback's size type.
+        size_t forwarded = 0;
+        while (forwarded < size)
+        {
+            auto count = static_cast<uint32_t>(std::min<size_t>(size - forwarded, UINT32_MAX - UINT32_MAX % m_budget));
+            auto written = m_callback->Write(data + forwarded, count);
+            m_forwards++;
+            if (written < 0 || static_cast<uint32_t>(written) < count)
+            {
+                return forwarded + static_cast<size_t>(std::max(written, 0));
+            }
+            forwarded += count;
+        }
+        return forwarded;
+    }
+
+    std::shared_ptr<PushAudioOutputStreamCallback> m_callback;
+    const size_t m_budget;
+    const std::chrono::milliseconds m_maxDelay;
+
+    // Serializes forwarding so batches reach the callback in order; recursive so the callback may call Flush.
+    std::recursive_mutex m_forwardMutex;
+    std::vector<uint8_t> m_sending;
+
+    mutable std::mutex m_mutex;
+    std::vector<uint8_t> m_buffer;
+    std::chrono::steady_clock::time_point m_oldest;
+    uint64_t m_writes = 0;
+    std::atomic<uint64_t> m_forwards{ 0 };
+};
+
+} } } } // Microsoft::CognitiveServices::Speech::Audio
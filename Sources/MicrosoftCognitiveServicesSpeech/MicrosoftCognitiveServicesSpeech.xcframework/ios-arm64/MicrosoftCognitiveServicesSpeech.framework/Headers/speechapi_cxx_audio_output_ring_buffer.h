@@ -0,0 +1,340 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_audio_output_ring_buffer.h: Public API declarations for RingBufferPushAudioOutputStreamCallback, a
+// fixed-size single-producer/single-consumer ring buffer bridging synthesized audio to a real-time playback thread
+//
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include "speechapi_cxx_common.h"
+#include "speechapi_cxx_string_helpers.h"
+#include "speechapi_cxx_audio_stream.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+namespace Audio {
+
+/// <summary>
+/// PushAudioOutputStreamCallback that buffers synthesized audio in a fixed-size lock-free ring buffer, to be
+/// drained by a playback thread with <see cref="TryRead"/>, which never blocks, takes a lock or allocates.
+/// Pass it to <see cref="AudioOutputStream::CreatePushStream"/>.
+/// </summary>
+/// <remarks>
+/// The Speech SDK is the producer: once the buffered audio rises above the high watermark, its Write() calls wait
+/// until the consumer has drained the buffer to the low watermark, so synthesis cannot run ahead of playback by
+/// more than the buffer. Notifications are invoked on the writing thread, never on the consumer thread.
+/// Exactly one thread may call <see cref="TryRead"/>. Telemetry getters may be called from any thread.
+/// </remarks>
+class RingBufferPushAudioOutputStreamCallback : public PushAudioOutputStreamCallback
+{
+public:
+
+    /// <summary>
+    /// Callback invoked with true when the buffer rises above the high watermark, and with false when the
+    /// producer resumes after it has been drained to the low watermark.
+    /// </summary>
+    using BackpressureCallback = std::function<void(bool)>;
+
+    /// <summary>
+    /// Callback invoked when a write makes audio available in an empty buffer, and when the stream ends.
+    /// </summary>
+    using DataAvailableCallback = std::function<void()>;
+
+    /// <summary>
+    /// Creates a ring buffer callback.
+    /// </summary>
+    /// <param name="capacity">Capacity in bytes; rounded up to a power of two.</param>
+    /// <param name="highWatermark">Fill level in bytes above which the producer is held back; 0 for three quarters of the capacity.</param>
+    /// <param name="lowWatermark">Fill level in bytes the consumer must drain to before the producer resumes; 0 for a quarter of the capacity.</param>
+    /// <param name="blockAlign">Size in bytes of one sample frame (all channels). <see cref="TryRead"/> returns whole frames.</param>
+    /// <returns>A shared pointer to the callback.</returns>
+    static std::shared_ptr<RingBufferPushAudioOutputStreamCallback> Create(size_t capacity, size_t highWatermark = 0, size_t lowWatermark = 0, uint32_t blockAlign = 2)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, capacity == 0 || blockAlign == 0);
+        capacity = RoundUpToPowerOfTwo(capacity);
+        highWatermark = highWatermark != 0 ? highWatermark : capacity / 4 * 3;
+        lowWatermark = lowWatermark != 0 ? lowWatermark : capacity / 4;
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, highWatermark > capacity || lowWatermark >= highWatermark);
+        return std::shared_ptr<RingBufferPushAudioOutputStreamCallback>(new RingBufferPushAudioOutputStreamCallback(capacity, highWatermark, lowWatermark, blockAlign));
+    }
+
+    /// <summary>
+    /// Sets the backpressure notification. Must be set before synthesis starts.
+    /// </summary>
+    /// <param name="callback">The callback, or nullptr.</param>
+    void SetBackpressureCallback(BackpressureCallback callback) { m_backpressureCallback = std::move(callback); }
+
+    /// <summary>
+    /// Sets the data-available notification. Must be set before synthesis starts.
+    /// </summary>
+    /// <param name="callback">The callback, or nullptr.</param>
+    void SetDataAvailableCallback(DataAvailableCallback callback) { m_dataAvailableCallback = std::move(callback); }
+
+    /// <summary>
+    /// Called by the stream with synthesized audio. Waits while the buffer is above the high watermark, until the
+    /// consumer drains it or <see cref="Abort"/> is called, in which case the rest of the audio is dropped.
+    /// </summary>
+    /// <param name="dataBuffer">The audio data.</param>
+    /// <param name="size">The size of the data in bytes.</param>
+    /// <returns>The number of bytes consumed.</returns>
+    int Write(uint8_t* dataBuffer, uint32_t size) override
+    {
+        auto remaining = static_cast<size_t>(size);
+        while (remaining > 0 && !m_aborted.load(std::memory_order_acquire))
+        {
+            if (m_backpressured.load(std::memory_order_relaxed))
+            {
+                WaitForDrain();
+                if (m_aborted.load(std::memory_order_acquire))
+                {
+                    break;
+                }
+                m_backpressured.store(false, std::memory_order_relaxed);
+                if (m_backpressureCallback != nullptr)
+                {
+                    m_backpressureCallback(false);
+                }
+            }
+
+            auto head = m_head.load(std::memory_order_relaxed);
+            auto fill = head - m_tail.load(std::memory_order_acquire);
+            auto count = std::min(remaining, m_capacity - fill);
+            CopyIn(head, dataBuffer, count);
+            m_head.store(head + count, std::memory_order_release);
+            m_writtenBytes.fetch_add(count, std::memory_order_relaxed);
+            dataBuffer += count;
+            remaining -= count;
+
+            fill += count;
+            if (fill > m_peakFill.load(std::memory_order_relaxed))
+            {
+                m_peakFill.store(fill, std::memory_order_relaxed);
+            }
+            if (fill == count && count > 0 && m_dataAvailableCallback != nullptr)
+            {
+                m_dataAvailableCallback();
+            }
+            if (fill > m_highWatermark || remaining > 0)
+            {
+                m_backpressured.store(true, std::memory_order_seq_cst);
+                m_backpressureEvents.fetch_add(1, std::memory_order_relaxed);
+                if (m_backpressureCallback != nullptr)
+                {
+                    m_backpressureCallback(true);
+                }
+            }
+        }
+        return static_cast<int>(size);
+    }
+
+    /// <summary>
+    /// Called by the stream when synthesis has ended. <see cref="TryRead"/> returns the rest of the buffered audio,
+    /// including a trailing partial frame.
+    /// </summary>
+    void Close() override
+    {
+        m_endOfStream.store(true, std::memory_order_release);
+        if (m_dataAvailableCallback != nullptr)
+        {
+            m_dataAvailableCallback();
+        }
+    }
+
+    /// <summary>
+    /// Consumer side. Copies buffered audio without blocking.
+    /// </summary>
+    /// <param name="dataBuffer">The buffer to copy the audio into.</param>
+    /// <param name="size">The size of the buffer.</param>
+    /// <returns>The number of bytes copied; less than requested if not enough audio was buffered.</returns>
+    size_t TryRead(uint8_t* dataBuffer, size_t size) noexcept
+    {
+        // The end of the stream is checked first, so that all audio written before it is visible.
+        auto endOfStream = m_endOfStream.load(std::memory_order_acquire);
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        auto fill = m_head.load(std::memory_order_acquire) - tail;
+        auto count = std::min(size, fill);
+        if (!endOfStream || count < fill)
+        {
+            count -= count % m_blockAlign;
+        }
+
+        auto offset = tail & (m_capacity - 1);
+        auto first = std::min(count, m_capacity - offset);
+        std::memcpy(dataBuffer, m_buffer.get() + offset, first);
+        std::memcpy(dataBuffer + first, m_buffer.get(), count - first);
+        m_tail.store(tail + count, std::memory_order_release);
+        m_readBytes.fetch_add(count, std::memory_order_relaxed);
+
+        if (count < size - size % m_blockAlign && !endOfStream)
+        {
+            m_underruns.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (fill - count <= m_lowWatermark && m_producerWaiting.load(std::memory_order_seq_cst))
+        {
+            m_drained.notify_one();
+        }
+        return count;
+    }
+
+    /// <summary>
+    /// Consumer side. Stops playback: a waiting or later Write() drops its audio instead of waiting.
+    /// </summary>
+    void Abort() noexcept
+    {
+        m_aborted.store(true, std::memory_order_release);
+        m_drained.notify_one();
+    }
+
+    /// <summary>
+    /// Indicates whether synthesis has ended and all audio has been read.
+    /// </summary>
+    /// <returns>true at the end of the stream.</returns>
+    bool IsEndOfStream() const
+    {
+        return m_endOfStream.load(std::memory_order_acquire) && GetBufferedBytes() == 0;
+    }
+
+    /// <summary>
+    /// Indicates whether the producer is being held back.
+    /// </summary>
+    /// <returns>true between rising above the high watermark and resuming.</returns>
+    bool IsBackpressured() const { return m_backpressured.load(std::memory_order_relaxed); }
+
+    /// <summary>
+    /// Gets the capacity.
+    /// </summary>
+    /// <returns>Capacity in bytes.</returns>
+    size_t GetCapacity() const { return m_capacity; }
+
+    /// <summary>
+    /// Gets the number of bytes currently buffered.
+    /// </summary>
+    /// <returns>Fill level in bytes.</returns>
+    size_t GetBufferedBytes() const
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        auto head = m_head.load(std::memory_order_relaxed);
+        return head > tail ? head - tail : 0;
+    }
+
+    /// <summary>
+    /// Gets the highest fill level observed.
+    /// </summary>
+    /// <returns>Peak fill level in bytes.</returns>
+    size_t GetPeakBufferedBytes() const { return m_peakFill.load(std::memory_order_relaxed); }
+
+    /// <summary>
+    /// Gets the number of bytes written by the stream.
+    /// </summary>
+    /// <returns>Number of bytes written.</returns>
+    uint64_t GetWrittenBytes() const { return m_writtenBytes.load(std::memory_order_relaxed); }
+
+    /// <summary>
+    /// Gets the number of bytes read by the consumer.
+    /// </summary>
+    /// <returns>Number of bytes read.</returns>
+    uint64_t GetReadBytes() const { return m_readBytes.load(std::memory_order_relaxed); }
+
+    /// <summary>
+    /// Gets the number of reads that found less audio than requested before the end of the stream.
+    /// </summary>
+    /// <returns>Number of underruns.</returns>
+    uint64_t GetUnderrunCount() const { return m_underruns.load(std::memory_order_relaxed); }
+
+    /// <summary>
+    /// Gets the number of times the producer was held back.
+    /// </summary>
+    /// <returns>Number of backpressure events.</returns>
+    uint64_t GetBackpressureCount() const { return m_backpressureEvents.load(std::memory_order_relaxed); }
+
+private:
+
+    DISABLE_DEFAULT_CTORS(RingBufferPushAudioOutputStreamCallback);
+
+    static constexpr size_t CacheLineSize = 64;
+
+    RingBufferPushAudioOutputStreamCallback(size_t capacity, size_t highWatermark, size_t lowWatermark, uint32_t blockAlign) :
+        m_capacity(capacity),
+        m_highWatermark(highWatermark),
+        m_lowWatermark(lowWatermark),
+        m_blockAlign(blockAlign),
+        m_buffer(new uint8_t[capacity])
+    {
+    }
+
+    static size_t RoundUpToPowerOfTwo(size_t value)
+    {
+        size_t result = 1;
+        while (result < value)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    void CopyIn(size_t head, const uint8_t* data, size_t size)
+    {
+        auto offset = head & (m_capacity - 1);
+        auto first = std::min(size, m_capacity - offset);
+        std::memcpy(m_buffer.get() + offset, data, first);
+        std::memcpy(m_buffer.get(), data + first, size - first);
+    }
+
+    void WaitForDrain()
+    {
+        // Waits in short slices: the consumer wakes the producer without taking the mutex, so a wake-up that races
+        // with going to sleep costs at most one slice instead of being lost.
+        const auto slice = std::chrono::milliseconds(5);
+        std::unique_lock<std::mutex> lock(m_waitMutex);
+        while (GetBufferedBytes() > m_lowWatermark && !m_aborted.load(std::memory_order_acquire))
+        {
+            m_producerWaiting.store(true, std::memory_order_seq_cst);
+            if (GetBufferedBytes() > m_lowWatermark && !m_aborted.load(std::memory_order_acquire))
+            {
+                m_drained.wait_for(lock, slice);
+            }
+            m_producerWaiting.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    const size_t m_capacity;
+    const size_t m_highWatermark;
+    const size_t m_lowWatermark;
+    const uint32_t m_blockAlign;
+    std::unique_ptr<uint8_t[]> m_buffer;
+
+    BackpressureCallback m_backpressureCallback;
+    DataAvailableCallback m_dataAvailableCallback;
+
+    // Producer and consumer positions are padded onto separate cache lines so the two threads do not contend.
+    char m_padding0[CacheLineSize];
+    std::atomic<size_t> m_head{ 0 };
+    char m_padding1[CacheLineSize - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> m_tail{ 0 };
+    char m_padding2[CacheLineSize - sizeof(std::atomic<size_t>)];
+
+    std::atomic<size_t> m_peakFill{ 0 };
+    std::atomic<uint64_t> m_writtenBytes{ 0 };
+    std::atomic<uint64_t> m_readBytes{ 0 };
+    std::atomic<uint64_t> m_underruns{ 0 };
+    std::atomic<uint64_t> m_backpressureEvents{ 0 };
+    std::atomic<bool> m_backpressured{ false };
+    std::atomic<bool> m_endOfStream{ false };
+    std::atomic<bool> m_aborted{ false };
+
+    std::atomic<bool> m_producerWaiting{ false };
+    std::mutex m_waitMutex;
+    std::condition_variable m_drained;
+};
+
+} } } } // Microsoft::CognitiveServices::Speech::Audio
@@ -0,0 +1,127 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_coroutine.h: Public API declarations for C++20 coroutine support (co_await on AsyncOperation<T>)
+//
+
+#pragma once
+#include "speechapi_cxx_async_operation.h"
+
+// Coroutine support is only compiled when the compiler and standard library provide it; the rest of the
+// API does not depend on it.
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define SPX_CONFIG_CXX_COROUTINES 1
+#endif
+#endif
+
+#ifdef SPX_CONFIG_CXX_COROUTINES
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <utility>
+#include "speechapi_cxx_executor.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+
+/// <summary>
+/// Awaiter that suspends a coroutine until an <see cref="AsyncOperation"/> completes, then resumes it on an executor.
+/// </summary>
+/// <typeparam name="T">The result type of the operation.</typeparam>
+template <class T>
+class AsyncOperationAwaiter
+{
+public:
+    /// <summary>
+    /// Creates an awaiter.
+    /// </summary>
+    /// <param name="operation">The operation to await.</param>
+    /// <param name="executor">Executor to resume the coroutine on.</param>
+    AsyncOperationAwaiter(AsyncOperation<T> operation, std::shared_ptr<Executor> executor) :
+        m_operation(std::move(operation)),
+        m_executor(std::move(executor))
+    {
+    }
+
+    /// <summary>
+    /// Indicates whether the operation has already completed, in which case the coroutine is not suspended.
+    /// </summary>
+    /// <returns>true if the operation has completed.</returns>
+    bool await_ready() const
+    {
+        return m_operation.IsReady();
+    }
+
+    /// <summary>
+    /// Arranges for the suspended coroutine to be resumed on the executor once the operation completes.
+    /// If the executor fails to accept the work, the coroutine is resumed inline and the failure is rethrown
+    /// from await_resume, so the coroutine is never left suspended.
+    /// </summary>
+    /// <param name="coroutine">The suspended coroutine.</param>
+    void await_suspend(std::coroutine_handle<> coroutine)
+    {
+        // The awaiter lives in the suspended coroutine's frame, so it is valid until the coroutine resumes.
+        (void)m_operation.Then([this, coroutine](const AsyncOperation<T>&) {
+            try
+            {
+                m_executor->Post([coroutine]() { coroutine.resume(); });
+            }
+            catch (...)
+            {
+                m_resumeError = std::current_exception();
+                coroutine.resume();
+            }
+        });
+    }
+
+    /// <summary>
+    /// Returns the result of the operation, or rethrows its exception, in the resumed coroutine.
+    /// Rethrows the executor's exception instead if the coroutine could not be resumed on it.
+    /// </summary>
+    /// <returns>The result of the operation.</returns>
+    T await_resume() const
+    {
+        if (m_resumeError != nullptr)
+        {
+            std::rethrow_exception(m_resumeError);
+        }
+        return m_operation.Get();
+    }
+
+private:
+    AsyncOperation<T> m_operation;
+    std::shared_ptr<Executor> m_executor;
+    std::exception_ptr m_resumeError;
+};
+
+/// <summary>
+/// Makes an <see cref="AsyncOperation"/> awaitable with co_await. The awaiting coroutine resumes on the default executor.
+/// </summary>
+/// <param name="operation">The operation to await.</param>
+/// <returns>The awaiter.</returns>
+template <class T>
+AsyncOperationAwaiter<T> operator co_await(AsyncOperation<T> operation)
+{
+    return AsyncOperationAwaiter<T>(std::move(operation), Executor::GetDefault());
+}
+
+/// <summary>
+/// Awaits an <see cref="AsyncOperation"/> and resumes the awaiting coroutine on the given executor,
+/// e.g. <c>auto result = co_await ResumeOn(recognizer->RecognizeOnceAsyncOperation(), sessionExecutor);</c>
+/// </summary>
+/// <param name="operation">The operation to await.</param>
+/// <param name="executor">Executor to resume the coroutine on.</param>
+/// <returns>The awaiter.</returns>
+template <class T>
+AsyncOperationAwaiter<T> ResumeOn(AsyncOperation<T> operation, std::shared_ptr<Executor> executor)
+{
+    SPX_THROW_HR_IF(SPXERR_INVALID_ARG, executor == nullptr);
+    return AsyncOperationAwaiter<T>(std::move(operation), std::move(executor));
+}
+
+} } } // Microsoft::CognitiveServices::Speech
+
+#endif // SPX_CONFIG_CXX_COROUTINES
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <memory>
 #include <string>
+#include <vector>
 #include "speechapi_cxx_common.h"
 #include "speechapi_cxx_string_helpers.h"
 #include "speechapi_cxx_enums.h"
@@ -14,6 +18,102 @@ namespace Speech {
 
 class KeywordRecognizer;
 
+/// <summary>
+/// Immutable copy of a chosen set of properties, taken in one pass with <see cref="PropertyCollection::Snapshot"/>.
+/// Values are stored back to back in a single buffer; lookups do not call into the property bag again, so a
+/// snapshot can be shared and read from any number of threads.
+/// </summary>
+class PropertySnapshot
+{
+public:
+
+    /// <summary>
+    /// Indicates whether the snapshot holds a non-empty value for the property.
+    /// </summary>
+    /// <param name="propertyID">The id of the property. See <see cref="PropertyId"/></param>
+    /// <returns>true if the property has a value in the snapshot.</returns>
+    bool Contains(PropertyId propertyID) const
+    {
+        return Find(propertyID) != m_entries.end();
+    }
+
+    /// <summary>
+    /// Returns value of a property.
+    /// If the property was not captured or has no value, the specified default value is returned.
+    /// </summary>
+    /// <param name="propertyID">The id of the property. See <see cref="PropertyId"/></param>
+    /// <param name="defaultValue">The default value which is returned if no value is captured for the property (empty string by default).</param>
+    /// <returns>value of the property.</returns>
+    SPXSTRING GetProperty(PropertyId propertyID, const SPXSTRING& defaultValue = SPXSTRING()) const
+    {
+        auto entry = Find(propertyID);
+        return entry == m_entries.end() ? defaultValue : Utils::ToSPXString(m_buffer.substr(entry->offset, entry->length));
+    }
+
+#ifdef SPX_CONFIG_CXX_STRING_VIEW
+    /// <summary>
+    /// Returns value of a property as a view over the snapshot's buffer, without copying.
+    /// </summary>
+    /// <param name="propertyID">The id of the property. See <see cref="PropertyId"/></param>
+    /// <returns>UTF-8 value of the property, valid as long as the snapshot; empty if no value was captured.</returns>
+    std::string_view GetPropertyView(PropertyId propertyID) const
+    {
+        auto entry = Find(propertyID);
+        return entry == m_entries.end() ? std::string_view() : std::string_view(m_buffer.data() + entry->offset, entry->length);
+    }
+#endif
+
+    /// <summary>
+    /// Gets the number of properties that have a value in the snapshot.
+    /// </summary>
+    /// <returns>Number of captured properties.</returns>
+    size_t Size() const
+    {
+        return m_entries.size();
+    }
+
+private:
+    friend class PropertyCollection;
+
+    DISABLE_COPY_AND_MOVE(PropertySnapshot);
+
+    struct Entry
+    {
+        PropertyId id;
+        size_t offset;
+        size_t length;
+    };
+
+    PropertySnapshot(SPXPROPERTYBAGHANDLE propbag, std::vector<PropertyId> propertyIds)
+    {
+        std::sort(propertyIds.begin(), propertyIds.end());
+        propertyIds.erase(std::unique(propertyIds.begin(), propertyIds.end()), propertyIds.end());
+        m_entries.reserve(propertyIds.size());
+
+        for (auto propertyID : propertyIds)
+        {
+            const char* value = property_bag_get_string(propbag, static_cast<int>(propertyID), nullptr, "");
+            auto length = value == nullptr ? 0 : std::strlen(value);
+            if (length > 0)
+            {
+                m_entries.push_back(Entry{ propertyID, m_buffer.size(), length });
+                m_buffer.append(value, length);
+            }
+            property_bag_free_string(value);
+        }
+    }
+
+    std::vector<Entry>::const_iterator Find(PropertyId propertyID) const
+    {
+        auto entry = std::lower_bound(m_entries.begin(), m_entries.end(), propertyID,
+            [](const Entry& item, PropertyId id) { return item.id < id; });
+        return entry != m_entries.end() && entry->id == propertyID ? entry : m_entries.end();
+    }
+
+    std::string m_buffer;
+    std::vector<Entry> m_entries;
+};
+
 /// <summary>
 /// Class to retrieve or set a property value from a property collection.
 /// </summary>
@@ -79,6 +179,20 @@ public:
         return Utils::ToSPXString(Utils::CopyAndFreePropertyString(propCch));
     }
 
+    /// <summary>
+    /// Copies the values of the given properties into an immutable snapshot, in one pass over the property bag.
+    /// Use this instead of repeated <see cref="GetProperty"/> calls when several properties are read per event.
+    /// </summary>
+    /// <remarks>
+    /// Properties whose value is empty or undefined are left out of the snapshot.
+    /// </remarks>
+    /// <param name="propertyIDs">The ids of the properties to capture. See <see cref="PropertyId"/></param>
+    /// <returns>A shared pointer to the snapshot.</returns>
+    std::shared_ptr<const PropertySnapshot> Snapshot(std::vector<PropertyId> propertyIDs) const
+    {
+        return std::shared_ptr<const PropertySnapshot>(new PropertySnapshot(m_propbag, std::move(propertyIDs)));
+    }
+
 protected:
     friend class KeywordRecognizer;
 
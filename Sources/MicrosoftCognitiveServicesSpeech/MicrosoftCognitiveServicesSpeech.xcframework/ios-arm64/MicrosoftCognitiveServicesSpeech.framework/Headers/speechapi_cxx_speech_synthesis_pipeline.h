@@ -0,0 +1,590 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_speech_synthesis_pipeline.h: Public API declarations for ParallelSpeechSynthesizer, which splits
+// long SSML documents into chunks synthesized concurrently and delivered in order
+//
+
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "speechapi_cxx_common.h"
+#include "speechapi_cxx_string_helpers.h"
+#include "speechapi_cxx_executor.h"
+#include "speechapi_cxx_async_operation.h"
+#include "speechapi_cxx_speech_synthesis_result.h"
+#include "speechapi_cxx_speech_synthesizer.h"
+#include "speechapi_cxx_speech_synthesis_cache.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+
+/// <summary>
+/// A self-contained SSML document holding one part of a larger document, see <see cref="ParallelSpeechSynthesizer::SplitSsml"/>.
+/// </summary>
+struct SsmlChunk
+{
+    /// <summary>
+    /// The SSML of the chunk: the root element and the elements open at the start of the part, the part itself,
+    /// and the end tags of the elements still open at its end.
+    /// </summary>
+    std::string Ssml;
+
+    /// <summary>
+    /// Offset of the part in the original document.
+    /// </summary>
+    size_t SourceOffset = 0;
+
+    /// <summary>
+    /// Offset of the part in <see cref="Ssml"/>, i.e. the length of the markup reopened in front of it.
+    /// </summary>
+    size_t PrefixLength = 0;
+};
+
+/// <summary>
+/// A synthesized chunk of a document, delivered by <see cref="ParallelSpeechSynthesizer"/>.
+/// </summary>
+struct SynthesizedSsmlChunk
+{
+    /// <summary>
+    /// Position of the chunk in the document.
+    /// </summary>
+    size_t Index = 0;
+
+    /// <summary>
+    /// Number of chunks of the document.
+    /// </summary>
+    size_t Count = 0;
+
+    /// <summary>
+    /// The synthesis result of the chunk. Its audio starts at <see cref="AudioOffset"/> in the document.
+    /// </summary>
+    std::shared_ptr<SpeechSynthesisResult> Result;
+
+    /// <summary>
+    /// Offset of the chunk's audio in the audio of the document, in ticks (100 nanoseconds).
+    /// </summary>
+    uint64_t AudioOffset = 0;
+
+    /// <summary>
+    /// Word boundaries of the chunk, with audio and text offsets relative to the whole document.
+    /// </summary>
+    std::vector<CachedWordBoundary> WordBoundaries;
+};
+
+/// <summary>
+/// Synthesizes long SSML documents on a pool of SpeechSynthesizer instances. The document is split at sentence
+/// and paragraph boundaries, the chunks are synthesized concurrently, one per synthesizer at a time, and delivered
+/// strictly in document order, so the first audio is ready after the first sentence rather than the whole document.
+/// </summary>
+/// <remarks>
+/// Use a raw output format (e.g. Raw24Khz16BitMonoPcm) to concatenate the audio of the chunks; with a RIFF format
+/// each chunk carries its own header. All synthesizers should use the same voice and output format.
+/// While it exists, the pipeline is connected to the WordBoundary event of each synthesizer.
+/// One document is synthesized at a time.
+/// </remarks>
+class ParallelSpeechSynthesizer
+{
+public:
+
+    /// <summary>
+    /// Callback receiving the synthesized chunks in order. Calls are serialized.
+    /// </summary>
+    using ChunkCallback = std::function<void(const SynthesizedSsmlChunk&)>;
+
+    /// <summary>
+    /// Creates a pipeline.
+    /// </summary>
+    /// <param name="synthesizers">The synthesizers to run chunks on; their number is the concurrency.</param>
+    /// <param name="targetChunkCharacters">Chunks end at the first boundary after this many characters; the first chunk at the first boundary after <see cref="FirstChunkCharacters"/>, if that is less.</param>
+    /// <param name="executor">Executor delivering the chunks, or nullptr for the default executor.</param>
+    /// <returns>A shared pointer to the pipeline.</returns>
+    static std::shared_ptr<ParallelSpeechSynthesizer> Create(std::vector<std::shared_ptr<SpeechSynthesizer>> synthesizers, size_t targetChunkCharacters = 300, std::shared_ptr<Executor> executor = nullptr)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, synthesizers.empty() || targetChunkCharacters == 0);
+        for (const auto& synthesizer : synthesizers)
+        {
+            SPX_THROW_HR_IF(SPXERR_INVALID_ARG, synthesizer == nullptr);
+        }
+        return std::shared_ptr<ParallelSpeechSynthesizer>(new ParallelSpeechSynthesizer(std::move(synthesizers), targetChunkCharacters, executor != nullptr ? std::move(executor) : Executor::GetDefault()));
+    }
+
+    /// <summary>
+    /// Destructor. Disconnects from the events of the synthesizers.
+    /// </summary>
+    ~ParallelSpeechSynthesizer()
+    {
+#ifndef AZAC_CONFIG_CXX_NO_RTTI
+        // Callbacks are matched by type, and the handler type is unique to this class.
+        for (const auto& synthesizer : m_synthesizers)
+        {
+            synthesizer->WordBoundary.Disconnect(OnWordBoundary(std::weak_ptr<State>()));
+        }
+#endif
+    }
+
+    /// <summary>
+    /// Synthesizes an SSML document, delivering the chunks in order as they become available.
+    /// </summary>
+    /// <param name="ssml">The SSML document.</param>
+    /// <param name="onChunk">Callback receiving the chunks.</param>
+    /// <returns>An operation that completes once all chunks are delivered, or with the first error. After an error no further chunks are delivered.</returns>
+    AsyncOperation<void> SpeakSsmlAsyncOperation(const std::string& ssml, ChunkCallback onChunk)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, onChunk == nullptr);
+
+        auto job = std::make_shared<Job>();
+        job->chunks = SplitSsml(ssml, m_targetChunkCharacters);
+        job->ready.resize(job->chunks.size());
+        job->onChunk = std::move(onChunk);
+        auto operation = job->promise.GetOperation();
+
+        {
+            std::unique_lock<std::mutex> lock(m_state->mutex);
+            SPX_THROW_HR_IF(SPXERR_ALREADY_IN_PROGRESS, m_state->busy);
+            m_state->busy = true;
+        }
+        if (job->chunks.empty())
+        {
+            Finish(*m_state, *job, nullptr);
+            return operation;
+        }
+        for (size_t i = 0; i < m_synthesizers.size() && i < job->chunks.size(); i++)
+        {
+            RunNext(m_state, job, m_synthesizers[i]);
+        }
+        return operation;
+    }
+
+    /// <summary>
+    /// Minimum length of the first chunk, unless the target chunk length is shorter. The first chunk is kept short so
+    /// that audio starts early, but long enough to carry natural prosody.
+    /// </summary>
+    static constexpr size_t FirstChunkCharacters = 60;
+
+    /// <summary>
+    /// Splits an SSML document into self-contained chunks at sentence ends and paragraph and sentence elements.
+    /// Chunks never split the content of elements other than voice, prosody, lang, emphasis, p, s and
+    /// mstts:express-as. Parts without text or empty elements are dropped.
+    /// </summary>
+    /// <remarks>
+    /// A sentence ends at '.', '!' or '?' followed by a line break, or by whitespace and an uppercase letter, unless the
+    /// word before it is an initial or a common abbreviation (such as "Dr.", "e.g." or "approx."), so "Dr. Smith
+    /// prescribed 5 mg. daily" stays in one piece.
+    /// </remarks>
+    /// <param name="ssml">The SSML document.</param>
+    /// <param name="targetChunkCharacters">Chunks end at the first boundary after this many characters; the first chunk at the first boundary after <see cref="FirstChunkCharacters"/>, if that is less.</param>
+    /// <returns>The chunks in document order.</returns>
+    static std::vector<SsmlChunk> SplitSsml(const std::string& ssml, size_t targetChunkCharacters)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, targetChunkCharacters == 0);
+
+        auto speak = ssml.find("<speak");
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, speak == std::string::npos);
+        auto bodyStart = SpeechSynthesisCache::FindMarkupEnd(ssml, speak);
+        auto bodyEnd = ssml.rfind("</speak>");
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, bodyEnd == std::string::npos || bodyEnd < bodyStart);
+        auto firstChunkCharacters = targetChunkCharacters < FirstChunkCharacters ? targetChunkCharacters : FirstChunkCharacters;
+
+        std::vector<SsmlChunk> chunks;
+        std::vector<OpenElement> open;
+        std::vector<OpenElement> chunkOpen;
+        size_t chunkStart = bodyStart;
+
+        auto split = [&](size_t position) {
+            if (HasContent(ssml, chunkStart, position))
+            {
+                SsmlChunk chunk;
+                chunk.Ssml.assign(ssml, 0, bodyStart);
+                for (const auto& element : chunkOpen)
+                {
+                    chunk.Ssml += element.tag;
+                }
+                chunk.PrefixLength = chunk.Ssml.size();
+                chunk.SourceOffset = chunkStart;
+                chunk.Ssml.append(ssml, chunkStart, position - chunkStart);
+                for (auto element = open.rbegin(); element != open.rend(); ++element)
+                {
+                    chunk.Ssml += "</" + element->name + ">";
+                }
+                chunk.Ssml += "</speak>";
+                chunks.push_back(std::move(chunk));
+            }
+            chunkStart = position;
+            chunkOpen = open;
+        };
+
+        auto boundary = [&](size_t position) {
+            for (const auto& element : open)
+            {
+                if (!IsSplittable(element.name))
+                {
+                    return;
+                }
+            }
+            if (position - chunkStart >= (chunks.empty() ? firstChunkCharacters : targetChunkCharacters))
+            {
+                split(position);
+            }
+        };
+
+        size_t i = bodyStart;
+        while (i < bodyEnd)
+        {
+            if (ssml[i] != '<')
+            {
+                auto ch = ssml[i++];
+                if ((ch == '.' || ch == '!' || ch == '?') && IsSentenceEnd(ssml, bodyStart, i, bodyEnd))
+                {
+                    boundary(i);
+                }
+                continue;
+            }
+
+            if (ssml.compare(i, 4, "<!--") == 0)
+            {
+                auto end = ssml.find("-->", i);
+                i = end == std::string::npos ? bodyEnd : end + 3;
+                continue;
+            }
+            auto end = SpeechSynthesisCache::FindMarkupEnd(ssml, i) - 1;
+            if (end >= bodyEnd)
+            {
+                break;
+            }
+
+            auto name = GetElementName(ssml, i, end);
+            auto isParagraph = name == "p" || name == "s";
+            if (ssml[i + 1] == '/')
+            {
+                if (!open.empty() && open.back().name == name)
+                {
+                    open.pop_back();
+                }
+                i = end + 1;
+                if (isParagraph)
+                {
+                    boundary(i);
+                }
+            }
+            else if (ssml[end - 1] == '/' || ssml[i + 1] == '?' || ssml[i + 1] == '!')
+            {
+                i = end + 1;
+            }
+            else
+            {
+                if (isParagraph)
+                {
+                    boundary(i);
+                }
+                open.push_back(OpenElement{ name, ssml.substr(i, end + 1 - i) });
+                i = end + 1;
+            }
+        }
+        split(bodyEnd);
+        return chunks;
+    }
+
+private:
+
+    DISABLE_COPY_AND_MOVE(ParallelSpeechSynthesizer);
+
+    struct OpenElement
+    {
+        std::string name;
+        std::string tag;
+    };
+
+    struct Job
+    {
+        std::vector<SsmlChunk> chunks;
+        ChunkCallback onChunk;
+        AsyncPromise<void> promise;
+
+        std::mutex mutex;
+        std::vector<std::unique_ptr<SynthesizedSsmlChunk>> ready;
+        size_t nextToStart = 0;
+        size_t nextToDeliver = 0;
+        uint64_t audioOffset = 0;
+        bool delivering = false;
+        bool finished = false;
+    };
+
+    // Word boundaries are recorded by result id while a document is being synthesized.
+    struct State
+    {
+        std::shared_ptr<Executor> executor;
+        std::mutex mutex;
+        bool busy = false;
+        std::unordered_map<SPXSTRING, std::vector<CachedWordBoundary>> wordBoundaries;
+    };
+
+    ParallelSpeechSynthesizer(std::vector<std::shared_ptr<SpeechSynthesizer>> synthesizers, size_t targetChunkCharacters, std::shared_ptr<Executor> executor) :
+        m_synthesizers(std::move(synthesizers)),
+        m_targetChunkCharacters(targetChunkCharacters),
+        m_state(std::make_shared<State>())
+    {
+        m_state->executor = std::move(executor);
+        std::weak_ptr<State> state = m_state;
+        for (const auto& synthesizer : m_synthesizers)
+        {
+            synthesizer->WordBoundary.Connect(OnWordBoundary(state));
+        }
+    }
+
+    static std::string GetElementName(const std::string& ssml, size_t start, size_t end)
+    {
+        auto first = start + (ssml[start + 1] == '/' ? 2 : 1);
+        auto last = first;
+        while (last < end && ssml[last] != '/' && !std::isspace(static_cast<unsigned char>(ssml[last])))
+        {
+            last++;
+        }
+        return ssml.substr(first, last - first);
+    }
+
+    static bool HasContent(const std::string& ssml, size_t start, size_t end)
+    {
+        // Text or an empty element such as a break; markup that only opens or closes elements is not content.
+        for (auto i = start; i < end; i++)
+        {
+            if (ssml[i] == '<')
+            {
+                auto close = SpeechSynthesisCache::FindMarkupEnd(ssml, i) - 1;
+                if (close >= end)
+                {
+                    return false;
+                }
+                if (ssml[close - 1] == '/')
+                {
+                    return true;
+                }
+                i = close;
+            }
+            else if (!std::isspace(static_cast<unsigned char>(ssml[i])))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Whether the punctuation just before position ends a sentence; see SplitSsml.
+    static bool IsSentenceEnd(const std::string& ssml, size_t bodyStart, size_t position, size_t bodyEnd)
+    {
+        auto next = position;
+        auto lineBreak = false;
+        while (next < bodyEnd && std::isspace(static_cast<unsigned char>(ssml[next])))
+        {
+            lineBreak = lineBreak || ssml[next] == '\n';
+            next++;
+        }
+        if (next == position)
+        {
+            return false;
+        }
+        if (ssml[position - 1] != '.')
+        {
+            return true;
+        }
+
+        auto wordStart = position - 1;
+        while (wordStart > bodyStart && !std::isspace(static_cast<unsigned char>(ssml[wordStart - 1])) && ssml[wordStart - 1] != '>')
+        {
+            wordStart--;
+        }
+        auto word = ssml.substr(wordStart, position - 1 - wordStart);
+        std::transform(word.begin(), word.end(), word.begin(), [](char ch) { return static_cast<char>(std::tolower(static_cast<unsigned char>(ch))); });
+        if (IsAbbreviation(word))
+        {
+            return false;
+        }
+
+        // Non-ASCII letters are taken as uppercase; most scripts without case do not end sentences with '.'.
+        auto first = next < bodyEnd ? static_cast<unsigned char>(ssml[next]) : 0;
+        return lineBreak || next == bodyEnd || std::isupper(first) || first >= 0x80;
+    }
+
+    static bool IsAbbreviation(const std::string& word)
+    {
+        // Initials ("J. Smith") and dotted abbreviations ("e.g.", "U.S.") as well as common titles and units.
+        static const char* words[] = { "dr", "mr", "mrs", "ms", "prof", "st", "sr", "jr", "vs", "etc", "no", "nr", "fig",
+            "approx", "ca", "cf", "dept", "inc", "ltd", "co", "corp", "vol", "pp", "ref", "resp", "sig", "tab", "cap" };
+        return (word.size() == 1 && std::isalpha(static_cast<unsigned char>(word[0]))) || word.find('.') != std::string::npos ||
+            std::any_of(std::begin(words), std::end(words), [&word](const char* abbreviation) { return word == abbreviation; });
+    }
+
+    static bool IsSplittable(const std::string& name)
+    {
+        static const char* names[] = { "voice", "prosody", "lang", "emphasis", "p", "s", "mstts:express-as" };
+        return std::any_of(std::begin(names), std::end(names), [&name](const char* splittable) { return name == splittable; });
+    }
+
+    static std::function<void(const SpeechSynthesisWordBoundaryEventArgs&)> OnWordBoundary(std::weak_ptr<State> weakState)
+    {
+        return [weakState](const SpeechSynthesisWordBoundaryEventArgs& e) {
+            auto state = weakState.lock();
+            if (state == nullptr)
+            {
+                return;
+            }
+            std::unique_lock<std::mutex> lock(state->mutex);
+            if (state->busy)
+            {
+                CachedWordBoundary boundary;
+                boundary.AudioOffset = e.AudioOffset;
+                boundary.Duration = e.Duration;
+                boundary.TextOffset = e.TextOffset;
+                boundary.WordLength = e.WordLength;
+                boundary.Text = e.Text;
+                boundary.BoundaryType = e.BoundaryType;
+                state->wordBoundaries[e.ResultId].push_back(std::move(boundary));
+            }
+        };
+    }
+
+    static void RunNext(std::shared_ptr<State> state, std::shared_ptr<Job> job, std::shared_ptr<SpeechSynthesizer> synthesizer)
+    {
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(job->mutex);
+            if (job->finished || job->nextToStart == job->chunks.size())
+            {
+                return;
+            }
+            index = job->nextToStart++;
+        }
+
+        try
+        {
+            synthesizer->SpeakSsmlAsyncOperation(job->chunks[index].Ssml).Then([state, job, synthesizer, index](const AsyncOperation<std::shared_ptr<SpeechSynthesisResult>>& operation) {
+                try
+                {
+                    auto result = operation.Get();
+                    if (result->Reason != ResultReason::SynthesizingAudioCompleted)
+                    {
+                        auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
+                        throw std::runtime_error("Speech synthesis canceled: " + Utils::ToUTF8(cancellation->ErrorDetails));
+                    }
+
+                    auto chunk = std::unique_ptr<SynthesizedSsmlChunk>(new SynthesizedSsmlChunk());
+                    chunk->Index = index;
+                    chunk->Count = job->chunks.size();
+                    chunk->Result = result;
+                    {
+                        std::unique_lock<std::mutex> lock(state->mutex);
+                        auto boundaries = state->wordBoundaries.find(result->ResultId);
+                        if (boundaries != state->wordBoundaries.end())
+                        {
+                            chunk->WordBoundaries = std::move(boundaries->second);
+                            state->wordBoundaries.erase(boundaries);
+                        }
+                    }
+                    {
+                        std::unique_lock<std::mutex> lock(job->mutex);
+                        job->ready[index] = std::move(chunk);
+                    }
+                    Deliver(*state, *job);
+                }
+                catch (...)
+                {
+                    Finish(*state, *job, std::current_exception());
+                    return;
+                }
+                RunNext(state, job, synthesizer);
+            }, state->executor);
+        }
+        catch (...)
+        {
+            Finish(*state, *job, std::current_exception());
+        }
+    }
+
+    static void Deliver(State& state, Job& job)
+    {
+        // Whoever finds the next chunk ready delivers it and every ready chunk after it; others leave theirs
+        // to that thread, which checks again after each callback.
+        std::unique_lock<std::mutex> lock(job.mutex);
+        if (job.delivering)
+        {
+            return;
+        }
+        job.delivering = true;
+        while (!job.finished && job.nextToDeliver < job.chunks.size() && job.ready[job.nextToDeliver] != nullptr)
+        {
+            auto chunk = std::move(job.ready[job.nextToDeliver]);
+            const auto& source = job.chunks[chunk->Index];
+            chunk->AudioOffset = job.audioOffset;
+            for (auto& boundary : chunk->WordBoundaries)
+            {
+                boundary.AudioOffset += job.audioOffset;
+                boundary.TextOffset = static_cast<uint32_t>(source.SourceOffset + (boundary.TextOffset > source.PrefixLength ? boundary.TextOffset - source.PrefixLength : 0));
+            }
+            job.audioOffset += static_cast<uint64_t>(chunk->Result->AudioDuration.count()) * 10000;
+
+            lock.unlock();
+            try
+            {
+                job.onChunk(*chunk);
+            }
+            catch (...)
+            {
+                lock.lock();
+                job.delivering = false;
+                throw;
+            }
+            lock.lock();
+            job.nextToDeliver++;
+        }
+        job.delivering = false;
+        auto done = job.nextToDeliver == job.chunks.size();
+        lock.unlock();
+
+        if (done)
+        {
+            Finish(state, job, nullptr);
+        }
+    }
+
+    static void Finish(State& state, Job& job, std::exception_ptr error)
+    {
+        {
+            std::unique_lock<std::mutex> lock(job.mutex);
+            if (job.finished)
+            {
+                return;
+            }
+            job.finished = true;
+        }
+        {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.busy = false;
+            state.wordBoundaries.clear();
+        }
+        if (error != nullptr)
+        {
+            job.promise.SetException(error);
+        }
+        else
+        {
+            job.promise.SetValue();
+        }
+    }
+
+    const std::vector<std::shared_ptr<SpeechSynthesizer>> m_synthesizers;
+    const size_t m_targetChunkCharacters;
+    std::shared_ptr<State> m_state;
+};
+
+} } } // Microsoft::CognitiveServices::Speech
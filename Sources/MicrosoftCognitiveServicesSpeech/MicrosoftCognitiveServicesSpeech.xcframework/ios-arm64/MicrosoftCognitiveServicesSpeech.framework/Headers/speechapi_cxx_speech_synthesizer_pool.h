@@ -0,0 +1,575 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_speech_synthesizer_pool.h: Public API declarations for SpeechSynthesizerPool, which hands out
+// SpeechSynthesizer instances whose service connections are already open
+//
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "speechapi_cxx_common.h"
+#include "speechapi_cxx_string_helpers.h"
+#include "speechapi_cxx_enums.h"
+#include "speechapi_cxx_speech_config.h"
+#include "speechapi_cxx_connection.h"
+#include "speechapi_cxx_speech_synthesis_result.h"
+#include "speechapi_cxx_speech_synthesizer.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+
+/// <summary>
+/// Sizing of a <see cref="SpeechSynthesizerPool"/>.
+/// </summary>
+struct SpeechSynthesizerPoolOptions
+{
+    /// <summary>
+    /// Maximum number of synthesizers; Acquire() waits once all are in use.
+    /// </summary>
+    size_t MaxSize = 8;
+
+    /// <summary>
+    /// Number of synthesizers created up front and kept connected while idle.
+    /// </summary>
+    size_t MinWarm = 2;
+
+    /// <summary>
+    /// Time after which synthesizers idle beyond <see cref="MinWarm"/> are closed and released.
+    /// </summary>
+    std::chrono::milliseconds IdleTimeout{ std::chrono::minutes(5) };
+
+    /// <summary>
+    /// Number of most recent latency samples the percentiles are computed from.
+    /// </summary>
+    size_t LatencySamples = 1024;
+};
+
+/// <summary>
+/// Percentiles of a latency reported by synthesis results.
+/// </summary>
+struct SynthesisLatencyPercentiles
+{
+    /// <summary>
+    /// Number of samples the percentiles are computed from.
+    /// </summary>
+    size_t Samples = 0;
+
+    /// <summary>
+    /// Median.
+    /// </summary>
+    std::chrono::milliseconds P50{ 0 };
+
+    /// <summary>
+    /// 90th percentile.
+    /// </summary>
+    std::chrono::milliseconds P90{ 0 };
+
+    /// <summary>
+    /// 99th percentile.
+    /// </summary>
+    std::chrono::milliseconds P99{ 0 };
+};
+
+/// <summary>
+/// Occupancy and latency of a <see cref="SpeechSynthesizerPool"/>.
+/// </summary>
+struct SpeechSynthesizerPoolStatistics
+{
+    /// <summary>
+    /// Number of synthesizers, idle or in use.
+    /// </summary>
+    size_t Size = 0;
+
+    /// <summary>
+    /// Number of synthesizers handed out.
+    /// </summary>
+    size_t InUse = 0;
+
+    /// <summary>
+    /// Highest number of synthesizers in use at once.
+    /// </summary>
+    size_t PeakInUse = 0;
+
+    /// <summary>
+    /// Number of idle synthesizers whose connection is open.
+    /// </summary>
+    size_t IdleConnected = 0;
+
+    /// <summary>
+    /// Number of synthesizers handed out.
+    /// </summary>
+    uint64_t Acquisitions = 0;
+
+    /// <summary>
+    /// Number of synthesizers handed out with their connection already open.
+    /// </summary>
+    uint64_t WarmAcquisitions = 0;
+
+    /// <summary>
+    /// Number of Acquire() calls that had to wait for a synthesizer to be released.
+    /// </summary>
+    uint64_t Waits = 0;
+
+    /// <summary>
+    /// Number of synthesizers created.
+    /// </summary>
+    uint64_t Created = 0;
+
+    /// <summary>
+    /// Number of synthesizers released after idling.
+    /// </summary>
+    uint64_t Evicted = 0;
+
+    /// <summary>
+    /// Connection latency, see <see cref="PropertyId::SpeechServiceResponse_SynthesisConnectionLatencyMs"/>.
+    /// </summary>
+    SynthesisLatencyPercentiles ConnectionLatency;
+
+    /// <summary>
+    /// First byte latency, see <see cref="PropertyId::SpeechServiceResponse_SynthesisFirstByteLatencyMs"/>.
+    /// </summary>
+    SynthesisLatencyPercentiles FirstByteLatency;
+};
+
+/// <summary>
+/// Pool of SpeechSynthesizer instances whose service connections are opened in advance with
+/// <see cref="Connection::Open"/>, so that short prompts do not pay for connection setup.
+/// </summary>
+/// <remarks>
+/// Synthesizers are handed out by <see cref="Acquire"/> and return to the pool when the last copy of the returned
+/// pointer is released; the most recently used idle synthesizer is handed out first, so rarely used ones age out.
+/// As there is no timer, idle eviction happens on Acquire() and on release; call <see cref="Maintain"/>
+/// periodically to also reopen connections the service closed while idle. All methods are thread-safe.
+/// </remarks>
+class SpeechSynthesizerPool : public std::enable_shared_from_this<SpeechSynthesizerPool>
+{
+public:
+
+    /// <summary>
+    /// Function creating a synthesizer for the pool.
+    /// </summary>
+    using SynthesizerFactory = std::function<std::shared_ptr<SpeechSynthesizer>()>;
+
+    /// <summary>
+    /// Creates a pool and warms up <see cref="SpeechSynthesizerPoolOptions::MinWarm"/> synthesizers.
+    /// </summary>
+    /// <param name="factory">Function creating the synthesizers.</param>
+    /// <param name="options">Sizing of the pool.</param>
+    /// <returns>A shared pointer to the pool.</returns>
+    static std::shared_ptr<SpeechSynthesizerPool> Create(SynthesizerFactory factory, const SpeechSynthesizerPoolOptions& options = SpeechSynthesizerPoolOptions())
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, factory == nullptr || options.MaxSize == 0 || options.MinWarm > options.MaxSize || options.LatencySamples == 0);
+        auto pool = std::shared_ptr<SpeechSynthesizerPool>(new SpeechSynthesizerPool(std::move(factory), options));
+        pool->Maintain();
+        return pool;
+    }
+
+    /// <summary>
+    /// Creates a pool of synthesizers without audio output; the audio is taken from the results.
+    /// </summary>
+    /// <param name="speechConfig">Speech configuration of the synthesizers.</param>
+    /// <param name="options">Sizing of the pool.</param>
+    /// <returns>A shared pointer to the pool.</returns>
+    static std::shared_ptr<SpeechSynthesizerPool> Create(std::shared_ptr<SpeechConfig> speechConfig, const SpeechSynthesizerPoolOptions& options = SpeechSynthesizerPoolOptions())
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, speechConfig == nullptr);
+        return Create([speechConfig]() { return SpeechSynthesizer::FromConfig(speechConfig, nullptr); }, options);
+    }
+
+    /// <summary>
+    /// Takes a synthesizer from the pool, creating one if none is idle and the pool is not full.
+    /// </summary>
+    /// <remarks>
+    /// When the last copy of the returned pointer is released, synthesis still in progress is stopped (the release
+    /// blocks until it has) and the handlers connected to the events of the synthesizer while it was acquired are
+    /// disconnected, so the next caller gets it clean. Handlers connected before, e.g. by the synthesizer factory,
+    /// stay connected. Do not release the last copy from one of its own event handlers. Other state, such as the
+    /// properties of the synthesizer, is kept.
+    /// </remarks>
+    /// <param name="timeout">Maximum time to wait for a synthesizer once the pool is full.</param>
+    /// <returns>The synthesizer, which returns to the pool when released, or nullptr on timeout.</returns>
+    std::shared_ptr<SpeechSynthesizer> Acquire(std::chrono::milliseconds timeout = std::chrono::milliseconds::max())
+    {
+        std::vector<std::shared_ptr<Entry>> evicted;
+        std::shared_ptr<Entry> entry;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            EvictIdleLocked(evicted);
+
+            auto waited = false;
+            auto deadline = timeout == std::chrono::milliseconds::max() ? std::chrono::steady_clock::time_point::max() : std::chrono::steady_clock::now() + timeout;
+            while (m_idle.empty() && m_size == m_options.MaxSize)
+            {
+                waited = true;
+                if (m_released.wait_until(lock, deadline) == std::cv_status::timeout && m_idle.empty() && m_size == m_options.MaxSize)
+                {
+                    return nullptr;
+                }
+            }
+            if (waited)
+            {
+                m_statistics.Waits++;
+            }
+
+            if (!m_idle.empty())
+            {
+                entry = std::move(m_idle.back());
+                m_idle.pop_back();
+            }
+            else
+            {
+                m_size++;
+            }
+            m_statistics.InUse++;
+            m_statistics.PeakInUse = std::max(m_statistics.PeakInUse, m_statistics.InUse);
+        }
+
+        if (entry == nullptr)
+        {
+            try
+            {
+                entry = CreateEntry();
+            }
+            catch (...)
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_size--;
+                m_statistics.InUse--;
+                m_released.notify_one();
+                throw;
+            }
+        }
+
+        auto warm = entry->connected->load();
+        if (!warm)
+        {
+            Open(*entry);
+        }
+        Mark(*entry);
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_statistics.Acquisitions++;
+            m_statistics.WarmAcquisitions += warm ? 1 : 0;
+        }
+
+        std::weak_ptr<SpeechSynthesizerPool> weakPool = shared_from_this();
+        auto synthesizer = entry->synthesizer.get();
+        return std::shared_ptr<SpeechSynthesizer>(synthesizer, [weakPool, entry](SpeechSynthesizer*) mutable {
+            auto pool = weakPool.lock();
+            if (pool != nullptr)
+            {
+                pool->Release(std::move(entry));
+            }
+        });
+    }
+
+    /// <summary>
+    /// Releases synthesizers idle beyond the timeout, creates synthesizers up to the warm minimum and reopens
+    /// connections of idle synthesizers the service has closed.
+    /// </summary>
+    void Maintain()
+    {
+        std::vector<std::shared_ptr<Entry>> evicted;
+        std::vector<std::shared_ptr<Entry>> reopen;
+        size_t missing = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            EvictIdleLocked(evicted);
+            for (const auto& entry : m_idle)
+            {
+                if (!entry->connected->load())
+                {
+                    reopen.push_back(entry);
+                }
+            }
+            missing = m_size < m_options.MinWarm ? m_options.MinWarm - m_size : 0;
+            m_size += missing;
+        }
+
+        for (const auto& entry : reopen)
+        {
+            Open(*entry);
+        }
+        for (size_t i = 0; i < missing; i++)
+        {
+            std::shared_ptr<Entry> entry;
+            try
+            {
+                entry = CreateEntry();
+                Open(*entry);
+            }
+            catch (...)
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_size -= missing - i;
+                throw;
+            }
+            Release(std::move(entry), false);
+        }
+    }
+
+    /// <summary>
+    /// Gets the occupancy and latency statistics of the pool.
+    /// </summary>
+    /// <returns>The statistics.</returns>
+    SpeechSynthesizerPoolStatistics GetStatistics() const
+    {
+        SpeechSynthesizerPoolStatistics statistics;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            statistics = m_statistics;
+            statistics.Size = m_size;
+            statistics.IdleConnected = static_cast<size_t>(std::count_if(m_idle.begin(), m_idle.end(), [](const std::shared_ptr<Entry>& entry) { return entry->connected->load(); }));
+        }
+        m_latencies->GetPercentiles(statistics.ConnectionLatency, statistics.FirstByteLatency);
+        return statistics;
+    }
+
+private:
+
+    DISABLE_COPY_AND_MOVE(SpeechSynthesizerPool);
+
+    // Latencies reported by the results of all synthesizers of the pool, kept in two rings of the latest samples.
+    struct LatencyRecorder
+    {
+        explicit LatencyRecorder(size_t capacity) : capacity(capacity) {}
+
+        void Add(std::vector<uint32_t>& samples, size_t& next, uint32_t value)
+        {
+            if (samples.size() < capacity)
+            {
+                samples.push_back(value);
+            }
+            else
+            {
+                samples[next] = value;
+            }
+            next = (next + 1) % capacity;
+        }
+
+        static void Compute(std::vector<uint32_t> samples, SynthesisLatencyPercentiles& percentiles)
+        {
+            percentiles.Samples = samples.size();
+            if (samples.empty())
+            {
+                return;
+            }
+            auto at = [&samples](double fraction) {
+                auto rank = static_cast<size_t>(fraction * static_cast<double>(samples.size()) + 0.999999);
+                auto nth = samples.begin() + static_cast<std::ptrdiff_t>(std::max<size_t>(rank, 1) - 1);
+                std::nth_element(samples.begin(), nth, samples.end());
+                return std::chrono::milliseconds(*nth);
+            };
+            percentiles.P50 = at(0.50);
+            percentiles.P90 = at(0.90);
+            percentiles.P99 = at(0.99);
+        }
+
+        void GetPercentiles(SynthesisLatencyPercentiles& connection, SynthesisLatencyPercentiles& firstByte) const
+        {
+            std::vector<uint32_t> connectionSamples, firstByteSamples;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                connectionSamples = connectionLatencies;
+                firstByteSamples = firstByteLatencies;
+            }
+            Compute(std::move(connectionSamples), connection);
+            Compute(std::move(firstByteSamples), firstByte);
+        }
+
+        const size_t capacity;
+        mutable std::mutex mutex;
+        std::vector<uint32_t> connectionLatencies;
+        std::vector<uint32_t> firstByteLatencies;
+        size_t nextConnection = 0;
+        size_t nextFirstByte = 0;
+    };
+
+    struct Entry
+    {
+        std::shared_ptr<SpeechSynthesizer> synthesizer;
+        std::shared_ptr<Connection> connection;
+        std::shared_ptr<std::atomic<bool>> connected = std::make_shared<std::atomic<bool>>(false);
+        std::chrono::steady_clock::time_point idleSince;
+
+        // Connection marks taken on acquisition; handlers connected after them belong to the current user.
+        uint32_t synthesisStarted = 0;
+        uint32_t synthesizing = 0;
+        uint32_t synthesisCanceled = 0;
+        uint32_t wordBoundary = 0;
+        uint32_t visemeReceived = 0;
+        uint32_t bookmarkReached = 0;
+        uint32_t synthesisCompleted = 0;
+
+        ~Entry()
+        {
+            if (connection == nullptr)
+            {
+                return;
+            }
+#ifndef AZAC_CONFIG_CXX_NO_RTTI
+            // Callbacks are matched by type, and the handler type is unique to the pool.
+            synthesizer->SynthesisCompleted.Disconnect(OnCompleted(std::weak_ptr<LatencyRecorder>()));
+#endif
+            try
+            {
+                connection->Close();
+            }
+            catch (...)
+            {
+                SPX_TRACE_ERROR("SpeechSynthesizerPool: closing the connection of an evicted synthesizer failed.");
+            }
+        }
+    };
+
+    SpeechSynthesizerPool(SynthesizerFactory factory, const SpeechSynthesizerPoolOptions& options) :
+        m_factory(std::move(factory)),
+        m_options(options),
+        m_latencies(std::make_shared<LatencyRecorder>(options.LatencySamples))
+    {
+    }
+
+    static std::function<void(const SpeechSynthesisEventArgs&)> OnCompleted(std::weak_ptr<LatencyRecorder> weakLatencies)
+    {
+        return [weakLatencies](const SpeechSynthesisEventArgs& e) {
+            auto latencies = weakLatencies.lock();
+            if (latencies == nullptr)
+            {
+                return;
+            }
+            auto connection = e.Result->Properties.GetProperty(PropertyId::SpeechServiceResponse_SynthesisConnectionLatencyMs);
+            auto firstByte = e.Result->Properties.GetProperty(PropertyId::SpeechServiceResponse_SynthesisFirstByteLatencyMs);
+            std::unique_lock<std::mutex> lock(latencies->mutex);
+            if (!connection.empty())
+            {
+                latencies->Add(latencies->connectionLatencies, latencies->nextConnection, static_cast<uint32_t>(std::strtoul(connection.c_str(), nullptr, 10)));
+            }
+            if (!firstByte.empty())
+            {
+                latencies->Add(latencies->firstByteLatencies, latencies->nextFirstByte, static_cast<uint32_t>(std::strtoul(firstByte.c_str(), nullptr, 10)));
+            }
+        };
+    }
+
+    std::shared_ptr<Entry> CreateEntry()
+    {
+        auto entry = std::make_shared<Entry>();
+        entry->synthesizer = m_factory();
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, entry->synthesizer == nullptr);
+        entry->connection = Connection::FromSpeechSynthesizer(entry->synthesizer);
+
+        auto connected = entry->connected;
+        entry->connection->Connected.Connect([connected](const ConnectionEventArgs&) { connected->store(true); });
+        entry->connection->Disconnected.Connect([connected](const ConnectionEventArgs&) { connected->store(false); });
+        entry->synthesizer->SynthesisCompleted.Connect(OnCompleted(m_latencies));
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_statistics.Created++;
+        return entry;
+    }
+
+    static void Open(Entry& entry)
+    {
+        // Open() only starts connecting; it may fail while the synthesizer is busy, which is harmless here.
+        try
+        {
+            entry.connection->Open(false);
+        }
+        catch (...)
+        {
+            SPX_TRACE_ERROR("SpeechSynthesizerPool: opening a connection failed.");
+        }
+    }
+
+    void Release(std::shared_ptr<Entry> entry, bool inUse = true)
+    {
+        if (inUse)
+        {
+            Reset(*entry);
+        }
+
+        std::vector<std::shared_ptr<Entry>> evicted;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (inUse)
+            {
+                m_statistics.InUse--;
+            }
+            entry->idleSince = std::chrono::steady_clock::now();
+            m_idle.push_back(std::move(entry));
+            EvictIdleLocked(evicted);
+        }
+        m_released.notify_one();
+    }
+
+    static void Mark(Entry& entry)
+    {
+        auto& synthesizer = *entry.synthesizer;
+        entry.synthesisStarted = synthesizer.SynthesisStarted.GetConnectionMark();
+        entry.synthesizing = synthesizer.Synthesizing.GetConnectionMark();
+        entry.synthesisCanceled = synthesizer.SynthesisCanceled.GetConnectionMark();
+        entry.wordBoundary = synthesizer.WordBoundary.GetConnectionMark();
+        entry.visemeReceived = synthesizer.VisemeReceived.GetConnectionMark();
+        entry.bookmarkReached = synthesizer.BookmarkReached.GetConnectionMark();
+        entry.synthesisCompleted = synthesizer.SynthesisCompleted.GetConnectionMark();
+    }
+
+    // Stops the synthesis of the previous user and drops the handlers it connected, keeping those connected before.
+    static void Reset(Entry& entry)
+    {
+        auto& synthesizer = *entry.synthesizer;
+        try
+        {
+            synthesizer.StopSpeakingAsync().get();
+        }
+        catch (...)
+        {
+            SPX_TRACE_ERROR("SpeechSynthesizerPool: stopping a released synthesizer failed.");
+        }
+
+        synthesizer.SynthesisStarted.DisconnectSince(entry.synthesisStarted);
+        synthesizer.Synthesizing.DisconnectSince(entry.synthesizing);
+        synthesizer.SynthesisCanceled.DisconnectSince(entry.synthesisCanceled);
+        synthesizer.WordBoundary.DisconnectSince(entry.wordBoundary);
+        synthesizer.VisemeReceived.DisconnectSince(entry.visemeReceived);
+        synthesizer.BookmarkReached.DisconnectSince(entry.bookmarkReached);
+        synthesizer.SynthesisCompleted.DisconnectSince(entry.synthesisCompleted);
+    }
+
+    void EvictIdleLocked(std::vector<std::shared_ptr<Entry>>& evicted)
+    {
+        // The least recently used entries are at the front; they are destroyed by the caller after unlocking.
+        auto now = std::chrono::steady_clock::now();
+        while (!m_idle.empty() && m_size > m_options.MinWarm && now - m_idle.front()->idleSince >= m_options.IdleTimeout)
+        {
+            evicted.push_back(std::move(m_idle.front()));
+            m_idle.pop_front();
+            m_size--;
+            m_statistics.Evicted++;
+        }
+    }
+
+    const SynthesizerFactory m_factory;
+    const SpeechSynthesizerPoolOptions m_options;
+    const std::shared_ptr<LatencyRecorder> m_latencies;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_released;
+    std::deque<std::shared_ptr<Entry>> m_idle;
+    size_t m_size = 0;
+    SpeechSynthesizerPoolStatistics m_statistics;
+};
+
+} } } // Microsoft::CognitiveServices::Speech
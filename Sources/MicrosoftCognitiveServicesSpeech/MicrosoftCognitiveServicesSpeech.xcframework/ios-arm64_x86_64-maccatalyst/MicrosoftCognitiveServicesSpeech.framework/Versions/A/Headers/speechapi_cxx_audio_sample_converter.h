@@ -0,0 +1,589 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_audio_sample_converter.h: Public API declarations for AudioSampleFormat, AudioSampleConverter and the
+// converting PushAudioInputStream / PullAudioInputStreamCallback adapters
+//
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "speechapi_cxx_common.h"
+#include "speechapi_cxx_string_helpers.h"
+#include "speechapi_cxx_audio_stream_format.h"
+#include "speechapi_cxx_audio_stream.h"
+
+// Vector kernels are selected at compile time from the target architecture flags; other targets use the scalar code.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SPX_CONFIG_AUDIO_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPX_CONFIG_AUDIO_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SPX_CONFIG_AUDIO_NEON 1
+#endif
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+namespace Audio {
+
+/// <summary>
+/// Defines how samples are encoded in an <see cref="AudioSampleFormat"/>.
+/// </summary>
+enum class AudioSampleEncoding
+{
+    /// <summary>
+    /// Signed little-endian integers (16, 24 or 32 bits; 24 bit samples are packed in 3 bytes).
+    /// </summary>
+    Integer = 0,
+
+    /// <summary>
+    /// 32 bit IEEE float, nominally in the range [-1, 1].
+    /// </summary>
+    Float = 1
+};
+
+/// <summary>
+/// Describes interleaved uncompressed audio, using the same characteristics as <see cref="AudioStreamFormat::GetWaveFormat"/>.
+/// Unlike AudioStreamFormat, it can also describe float samples, as delivered by most capture APIs.
+/// </summary>
+class AudioSampleFormat
+{
+public:
+
+    /// <summary>
+    /// Creates an audio sample format.
+    /// </summary>
+    /// <param name="samplesPerSecond">Samples per second.</param>
+    /// <param name="bitsPerSample">Bits per sample.</param>
+    /// <param name="channels">Number of interleaved channels.</param>
+    /// <param name="encoding">Sample encoding.</param>
+    AudioSampleFormat(uint32_t samplesPerSecond, uint8_t bitsPerSample, uint8_t channels, AudioSampleEncoding encoding = AudioSampleEncoding::Integer) :
+        m_samplesPerSecond(samplesPerSecond),
+        m_bitsPerSample(bitsPerSample),
+        m_channels(channels),
+        m_encoding(encoding)
+    {
+    }
+
+    /// <summary>
+    /// Gets the default input format of the Speech SDK (16 kHz, 16 bit, mono PCM).
+    /// </summary>
+    /// <returns>The default input format.</returns>
+    static AudioSampleFormat GetDefaultInputFormat()
+    {
+        return AudioSampleFormat(16000, 16, 1);
+    }
+
+    /// <summary>
+    /// Gets the number of samples per second.
+    /// </summary>
+    /// <returns>Samples per second.</returns>
+    uint32_t GetSamplesPerSecond() const { return m_samplesPerSecond; }
+
+    /// <summary>
+    /// Gets the number of bits per sample.
+    /// </summary>
+    /// <returns>Bits per sample.</returns>
+    uint8_t GetBitsPerSample() const { return m_bitsPerSample; }
+
+    /// <summary>
+    /// Gets the number of channels.
+    /// </summary>
+    /// <returns>Number of channels.</returns>
+    uint8_t GetChannels() const { return m_channels; }
+
+    /// <summary>
+    /// Gets the sample encoding.
+    /// </summary>
+    /// <returns>Sample encoding.</returns>
+    AudioSampleEncoding GetEncoding() const { return m_encoding; }
+
+    /// <summary>
+    /// Gets the size in bytes of one frame (one sample for every channel).
+    /// </summary>
+    /// <returns>Frame size in bytes.</returns>
+    size_t GetBlockAlign() const { return static_cast<size_t>(m_bitsPerSample / 8) * m_channels; }
+
+    /// <summary>
+    /// Creates the equivalent AudioStreamFormat, e.g. to create the stream that receives converted audio.
+    /// </summary>
+    /// <returns>A shared pointer to AudioStreamFormat.</returns>
+    std::shared_ptr<AudioStreamFormat> ToStreamFormat() const
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, m_encoding != AudioSampleEncoding::Integer);
+        return AudioStreamFormat::GetWaveFormat(m_samplesPerSecond, m_bitsPerSample, m_channels, AudioStreamWaveFormat::PCM);
+    }
+
+private:
+
+    uint32_t m_samplesPerSecond;
+    uint8_t m_bitsPerSample;
+    uint8_t m_channels;
+    AudioSampleEncoding m_encoding;
+};
+
+/// <summary>
+/// Converts interleaved float32, int32, packed int24 or int16 audio to 16 bit PCM, downmixing to mono (or
+/// duplicating mono to several channels) and optionally adding TPDF dither. Source and target sample rates must match.
+/// </summary>
+/// <remarks>
+/// An instance keeps scratch buffers and dither state, so it must not be used from several threads at once.
+/// </remarks>
+class AudioSampleConverter
+{
+public:
+
+    /// <summary>
+    /// Creates a converter.
+    /// </summary>
+    /// <param name="source">Format of the audio to convert.</param>
+    /// <param name="target">16 bit PCM format to convert to; the default input format of the Speech SDK by default.</param>
+    /// <param name="dither">Whether to add triangular dither when reducing the resolution of 24 bit, 32 bit and float sources.</param>
+    /// <returns>A shared pointer to the converter.</returns>
+    static std::shared_ptr<AudioSampleConverter> Create(const AudioSampleFormat& source, const AudioSampleFormat& target = AudioSampleFormat::GetDefaultInputFormat(), bool dither = true)
+    {
+        auto sourceBits = source.GetBitsPerSample();
+        auto validSource = source.GetEncoding() == AudioSampleEncoding::Float
+            ? sourceBits == 32
+            : (sourceBits == 16 || sourceBits == 24 || sourceBits == 32);
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, !validSource || source.GetChannels() == 0);
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, target.GetEncoding() != AudioSampleEncoding::Integer || target.GetBitsPerSample() != 16 || target.GetChannels() == 0);
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, source.GetSamplesPerSecond() != target.GetSamplesPerSecond());
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, source.GetChannels() != target.GetChannels() && source.GetChannels() != 1 && target.GetChannels() != 1);
+
+        return std::shared_ptr<AudioSampleConverter>(new AudioSampleConverter(source, target, dither));
+    }
+
+    /// <summary>
+    /// Gets the source format.
+    /// </summary>
+    /// <returns>The source format.</returns>
+    const AudioSampleFormat& GetSourceFormat() const { return m_source; }
+
+    /// <summary>
+    /// Gets the target format.
+    /// </summary>
+    /// <returns>The target format.</returns>
+    const AudioSampleFormat& GetTargetFormat() const { return m_target; }
+
+    /// <summary>
+    /// Converts whole frames.
+    /// </summary>
+    /// <param name="source">Source audio, <paramref name="frames"/> times the source block align bytes.</param>
+    /// <param name="frames">Number of frames to convert.</param>
+    /// <param name="target">Receives <paramref name="frames"/> times the target block align bytes.</param>
+    /// <returns>The number of bytes written to <paramref name="target"/>.</returns>
+    size_t Convert(const uint8_t* source, size_t frames, uint8_t* target)
+    {
+        auto targetBytes = frames * m_target.GetBlockAlign();
+        if (m_passThrough)
+        {
+            std::memcpy(target, source, targetBytes);
+            return targetBytes;
+        }
+
+        const size_t blockFrames = 1024;
+        auto sourceBlockAlign = m_source.GetBlockAlign();
+        auto targetChannels = m_target.GetChannels();
+        m_samples.resize(blockFrames * targetChannels);
+
+        for (size_t done = 0; done < frames; done += blockFrames)
+        {
+            auto count = std::min(blockFrames, frames - done);
+            Decode(source + done * sourceBlockAlign, count, m_samples.data());
+            if (m_dither)
+            {
+                AddDither(m_samples.data(), count * targetChannels);
+            }
+            QuantizeToInt16(m_samples.data(), count * targetChannels, target + done * targetChannels * sizeof(int16_t));
+        }
+        return targetBytes;
+    }
+
+private:
+
+    DISABLE_DEFAULT_CTORS(AudioSampleConverter);
+
+    AudioSampleConverter(const AudioSampleFormat& source, const AudioSampleFormat& target, bool dither) :
+        m_source(source),
+        m_target(target),
+        m_dither(dither && !(source.GetEncoding() == AudioSampleEncoding::Integer && source.GetBitsPerSample() == 16)),
+        m_passThrough(source.GetEncoding() == AudioSampleEncoding::Integer && source.GetBitsPerSample() == 16 && source.GetChannels() == target.GetChannels())
+    {
+    }
+
+    // Sample readers return values scaled to 16 bit units, so dither and rounding work on the target's LSB.
+    struct Int16Sample
+    {
+        static float Read(const uint8_t* p) { int16_t v; std::memcpy(&v, p, sizeof(v)); return static_cast<float>(v); }
+    };
+
+    struct Int24Sample
+    {
+        static float Read(const uint8_t* p)
+        {
+            auto v = static_cast<int32_t>(static_cast<uint32_t>(p[0]) << 8 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 24);
+            return static_cast<float>(v) * (1.0f / 65536.0f);
+        }
+    };
+
+    struct Int32Sample
+    {
+        static float Read(const uint8_t* p) { int32_t v; std::memcpy(&v, p, sizeof(v)); return static_cast<float>(v) * (1.0f / 65536.0f); }
+    };
+
+    struct Float32Sample
+    {
+        static float Read(const uint8_t* p) { float v; std::memcpy(&v, p, sizeof(v)); return v * 32768.0f; }
+    };
+
+    void Decode(const uint8_t* source, size_t frames, float* samples)
+    {
+        auto bits = m_source.GetBitsPerSample();
+        if (m_source.GetEncoding() == AudioSampleEncoding::Float)
+        {
+            if (m_source.GetChannels() == 2 && m_target.GetChannels() == 1)
+            {
+                DownmixFloatStereo(source, frames, samples);
+                return;
+            }
+            DecodeWith<Float32Sample>(source, frames, samples);
+        }
+        else if (bits == 16)
+        {
+            DecodeWith<Int16Sample>(source, frames, samples);
+        }
+        else if (bits == 24)
+        {
+            DecodeWith<Int24Sample>(source, frames, samples);
+        }
+        else
+        {
+            DecodeWith<Int32Sample>(source, frames, samples);
+        }
+    }
+
+    template <class TSample>
+    void DecodeWith(const uint8_t* source, size_t frames, float* samples)
+    {
+        const size_t sampleSize = m_source.GetBitsPerSample() / 8;
+        const size_t sourceChannels = m_source.GetChannels();
+        const size_t targetChannels = m_target.GetChannels();
+
+        if (sourceChannels == targetChannels)
+        {
+            for (size_t i = 0; i < frames * sourceChannels; i++)
+            {
+                samples[i] = TSample::Read(source + i * sampleSize);
+            }
+        }
+        else if (targetChannels == 1)
+        {
+            const float gain = 1.0f / static_cast<float>(sourceChannels);
+            for (size_t frame = 0; frame < frames; frame++)
+            {
+                auto p = source + frame * sourceChannels * sampleSize;
+                float sum = 0.0f;
+                for (size_t channel = 0; channel < sourceChannels; channel++)
+                {
+                    sum += TSample::Read(p + channel * sampleSize);
+                }
+                samples[frame] = sum * gain;
+            }
+        }
+        else
+        {
+            for (size_t frame = 0; frame < frames; frame++)
+            {
+                auto value = TSample::Read(source + frame * sampleSize);
+                std::fill(samples + frame * targetChannels, samples + (frame + 1) * targetChannels, value);
+            }
+        }
+    }
+
+    static void DownmixFloatStereo(const uint8_t* source, size_t frames, float* samples)
+    {
+        size_t frame = 0;
+#if defined(SPX_CONFIG_AUDIO_AVX2) || defined(SPX_CONFIG_AUDIO_SSE2)
+        const __m128 gain = _mm_set1_ps(0.5f * 32768.0f);
+        for (; frame + 4 <= frames; frame += 4)
+        {
+            auto a = _mm_loadu_ps(reinterpret_cast<const float*>(source) + frame * 2);
+            auto b = _mm_loadu_ps(reinterpret_cast<const float*>(source) + frame * 2 + 4);
+            auto left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            auto right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(samples + frame, _mm_mul_ps(_mm_add_ps(left, right), gain));
+        }
+#elif defined(SPX_CONFIG_AUDIO_NEON)
+        const float32x4_t gain = vdupq_n_f32(0.5f * 32768.0f);
+        for (; frame + 4 <= frames; frame += 4)
+        {
+            auto stereo = vld2q_f32(reinterpret_cast<const float*>(source) + frame * 2);
+            vst1q_f32(samples + frame, vmulq_f32(vaddq_f32(stereo.val[0], stereo.val[1]), gain));
+        }
+#endif
+        for (; frame < frames; frame++)
+        {
+            auto left = Float32Sample::Read(source + frame * 8);
+            auto right = Float32Sample::Read(source + frame * 8 + 4);
+            samples[frame] = (left + right) * 0.5f;
+        }
+    }
+
+    void AddDither(float* samples, size_t count)
+    {
+        // Triangular PDF dither of +/- 1 LSB: the sum of two uniform variables, from a xorshift generator.
+        auto state = m_ditherState;
+        for (size_t i = 0; i < count; i++)
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            auto first = static_cast<float>(state >> 16) * (1.0f / 65536.0f);
+            auto second = static_cast<float>(state & 0xFFFF) * (1.0f / 65536.0f);
+            samples[i] += first - second;
+        }
+        m_ditherState = state;
+    }
+
+    static void QuantizeToInt16(const float* samples, size_t count, uint8_t* target)
+    {
+        size_t i = 0;
+#if defined(SPX_CONFIG_AUDIO_AVX2)
+        const __m256 low = _mm256_set1_ps(-32768.0f);
+        const __m256 high = _mm256_set1_ps(32767.0f);
+        for (; i + 16 <= count; i += 16)
+        {
+            // Clamp first: out of range conversions would yield INT32_MIN for large positive values.
+            auto a = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(samples + i), low), high));
+            auto b = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(samples + i + 8), low), high));
+            // packs works within 128 bit lanes; restore sample order afterwards.
+            auto packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + i * sizeof(int16_t)), packed);
+        }
+#elif defined(SPX_CONFIG_AUDIO_SSE2)
+        const __m128 low = _mm_set1_ps(-32768.0f);
+        const __m128 high = _mm_set1_ps(32767.0f);
+        for (; i + 8 <= count; i += 8)
+        {
+            // Clamp first: out of range conversions would yield INT32_MIN for large positive values.
+            auto a = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(samples + i), low), high));
+            auto b = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(samples + i + 4), low), high));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + i * sizeof(int16_t)), _mm_packs_epi32(a, b));
+        }
+#elif defined(SPX_CONFIG_AUDIO_NEON)
+        for (; i + 8 <= count; i += 8)
+        {
+            // Both the conversion and the narrowing saturate.
+            auto a = vqmovn_s32(vcvtnq_s32_f32(vld1q_f32(samples + i)));
+            auto b = vqmovn_s32(vcvtnq_s32_f32(vld1q_f32(samples + i + 4)));
+            vst1q_s16(reinterpret_cast<int16_t*>(target + i * sizeof(int16_t)), vcombine_s16(a, b));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            auto value = static_cast<int16_t>(std::lrint(std::min(std::max(samples[i], -32768.0f), 32767.0f)));
+            std::memcpy(target + i * sizeof(int16_t), &value, sizeof(value));
+        }
+    }
+
+    const AudioSampleFormat m_source;
+    const AudioSampleFormat m_target;
+    const bool m_dither;
+    const bool m_passThrough;
+
+    std::vector<float> m_samples;
+    uint32_t m_ditherState = 0x9E3779B9u;
+};
+
+/// <summary>
+/// Converts audio to the format of a <see cref="PushAudioInputStream"/> before writing it, so that capture code can
+/// write its native samples (e.g. float32 stereo) directly.
+/// </summary>
+class PushAudioInputStreamConverter
+{
+public:
+
+    /// <summary>
+    /// Creates a converting writer.
+    /// </summary>
+    /// <param name="stream">The stream to write to; it must have been created with <c>target.ToStreamFormat()</c>.</param>
+    /// <param name="source">Format of the audio passed to <see cref="Write"/>.</param>
+    /// <param name="target">16 bit PCM format of the stream; the default input format by default.</param>
+    /// <param name="dither">Whether to dither when reducing resolution.</param>
+    /// <returns>A shared pointer to the converting writer.</returns>
+    static std::shared_ptr<PushAudioInputStreamConverter> Create(std::shared_ptr<PushAudioInputStream> stream, const AudioSampleFormat& source, const AudioSampleFormat& target = AudioSampleFormat::GetDefaultInputFormat(), bool dither = true)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, stream == nullptr);
+        return std::shared_ptr<PushAudioInputStreamConverter>(new PushAudioInputStreamConverter(std::move(stream), AudioSampleConverter::Create(source, target, dither)));
+    }
+
+    /// <summary>
+    /// Converts the audio and writes it to the stream. A trailing partial frame is kept until the next call.
+    /// </summary>
+    /// <param name="dataBuffer">Audio in the source format, without any audio header.</param>
+    /// <param name="size">The size of the buffer in bytes.</param>
+    void Write(const uint8_t* dataBuffer, size_t size)
+    {
+        auto sourceBlockAlign = m_converter->GetSourceFormat().GetBlockAlign();
+        auto targetBlockAlign = m_converter->GetTargetFormat().GetBlockAlign();
+
+        if (!m_partial.empty())
+        {
+            auto take = std::min(size, sourceBlockAlign - m_partial.size());
+            m_partial.insert(m_partial.end(), dataBuffer, dataBuffer + take);
+            dataBuffer += take;
+            size -= take;
+            if (m_partial.size() < sourceBlockAlign)
+            {
+                return;
+            }
+            m_converted.resize(targetBlockAlign);
+            m_converter->Convert(m_partial.data(), 1, m_converted.data());
+            m_partial.clear();
+            m_stream->Write(m_converted.data(), static_cast<uint32_t>(targetBlockAlign));
+        }
+
+        auto frames = size / sourceBlockAlign;
+        if (frames > 0)
+        {
+            m_converted.resize(frames * targetBlockAlign);
+            auto converted = m_converter->Convert(dataBuffer, frames, m_converted.data());
+            m_stream->Write(m_converted.data(), static_cast<uint32_t>(converted));
+        }
+        m_partial.assign(dataBuffer + frames * sourceBlockAlign, dataBuffer + size);
+    }
+
+    /// <summary>
+    /// Closes the stream. A trailing partial frame is dropped.
+    /// </summary>
+    void Close()
+    {
+        m_partial.clear();
+        m_stream->Close();
+    }
+
+    /// <summary>
+    /// Gets the stream written to.
+    /// </summary>
+    /// <returns>The stream.</returns>
+    std::shared_ptr<PushAudioInputStream> GetStream() const { return m_stream; }
+
+private:
+
+    DISABLE_COPY_AND_MOVE(PushAudioInputStreamConverter);
+
+    PushAudioInputStreamConverter(std::shared_ptr<PushAudioInputStream> stream, std::shared_ptr<AudioSampleConverter> converter) :
+        m_stream(std::move(stream)),
+        m_converter(std::move(converter))
+    {
+    }
+
+    std::shared_ptr<PushAudioInputStream> m_stream;
+    std::shared_ptr<AudioSampleConverter> m_converter;
+    std::vector<uint8_t> m_partial;
+    std::vector<uint8_t> m_converted;
+};
+
+/// <summary>
+/// PullAudioInputStreamCallback that reads audio in another format from an inner callback and converts it,
+/// e.g. <c>AudioInputStream::CreatePullStream(target.ToStreamFormat(), ConvertingPullAudioInputStreamCallback::Create(capture, source))</c>.
+/// </summary>
+class ConvertingPullAudioInputStreamCallback : public PullAudioInputStreamCallback
+{
+public:
+
+    /// <summary>
+    /// Creates a converting callback.
+    /// </summary>
+    /// <param name="source">Callback that provides audio in the source format.</param>
+    /// <param name="sourceFormat">Format of the audio provided by <paramref name="source"/>.</param>
+    /// <param name="target">16 bit PCM format to provide; the default input format by default.</param>
+    /// <param name="dither">Whether to dither when reducing resolution.</param>
+    /// <returns>A shared pointer to the callback.</returns>
+    static std::shared_ptr<ConvertingPullAudioInputStreamCallback> Create(std::shared_ptr<PullAudioInputStreamCallback> source, const AudioSampleFormat& sourceFormat, const AudioSampleFormat& target = AudioSampleFormat::GetDefaultInputFormat(), bool dither = true)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, source == nullptr);
+        return std::shared_ptr<ConvertingPullAudioInputStreamCallback>(new ConvertingPullAudioInputStreamCallback(std::move(source), AudioSampleConverter::Create(sourceFormat, target, dither)));
+    }
+
+    /// <summary>
+    /// Reads audio from the inner callback and converts it.
+    /// </summary>
+    /// <param name="dataBuffer">The buffer to copy the converted audio into.</param>
+    /// <param name="size">The size of the buffer.</param>
+    /// <returns>The number of bytes copied, or zero to indicate end of stream.</returns>
+    int Read(uint8_t* dataBuffer, uint32_t size) override
+    {
+        auto sourceBlockAlign = m_converter->GetSourceFormat().GetBlockAlign();
+        auto targetBlockAlign = m_converter->GetTargetFormat().GetBlockAlign();
+        auto frames = size / targetBlockAlign;
+        if (frames == 0)
+        {
+            return 0;
+        }
+
+        // Keep a partial frame from the previous read in front of the new data.
+        auto have = m_partial.size();
+        m_scratch.resize(frames * sourceBlockAlign);
+        std::memcpy(m_scratch.data(), m_partial.data(), have);
+        m_partial.clear();
+
+        while (have < sourceBlockAlign)
+        {
+            auto read = m_source->Read(m_scratch.data() + have, static_cast<uint32_t>(m_scratch.size() - have));
+            if (read <= 0)
+            {
+                return 0;
+            }
+            have += static_cast<size_t>(read);
+        }
+
+        auto whole = have / sourceBlockAlign;
+        m_partial.assign(m_scratch.data() + whole * sourceBlockAlign, m_scratch.data() + have);
+        return static_cast<int>(m_converter->Convert(m_scratch.data(), whole, dataBuffer));
+    }
+
+    /// <summary>
+    /// Forwards the property request to the inner callback.
+    /// </summary>
+    /// <param name="id">The id of the property.</param>
+    /// <returns>The value of the property.</returns>
+    SPXSTRING GetProperty(PropertyId id) override
+    {
+        return m_source->GetProperty(id);
+    }
+
+    /// <summary>
+    /// Closes the inner callback.
+    /// </summary>
+    void Close() override
+    {
+        m_source->Close();
+    }
+
+private:
+
+    DISABLE_DEFAULT_CTORS(ConvertingPullAudioInputStreamCallback);
+
+    ConvertingPullAudioInputStreamCallback(std::shared_ptr<PullAudioInputStreamCallback> source, std::shared_ptr<AudioSampleConverter> converter) :
+        m_source(std::move(source)),
+        m_converter(std::move(converter))
+    {
+    }
+
+    std::shared_ptr<PullAudioInputStreamCallback> m_source;
+    std::shared_ptr<AudioSampleConverter> m_converter;
+    std::vector<uint8_t> m_partial;
+    std::vector<uint8_t> m_scratch;
+};
+
+} } } } // Microsoft::CognitiveServices::Speech::Audio
@@ -18,6 +18,14 @@
 #include "speechapi_cxx_enums.h"
 #include "speechapi_c_audio_stream.h"
 
+// The span based Write overloads are only declared when the standard library provides std::span.
+#if defined(__has_include)
+#if __has_include(<span>) && ((defined(_MSVC_LANG) && _MSVC_LANG >= 202002L) || __cplusplus >= 202002L)
+#include <span>
+#define SPX_CONFIG_CXX_SPAN 1
+#endif
+#endif
+
 
 namespace Microsoft {
 namespace CognitiveServices {
@@ -259,6 +267,88 @@ public:
         SPX_THROW_ON_FAIL(push_audio_input_stream_write(m_haudioStream, dataBuffer, size));
     }
 
+#ifdef SPX_CONFIG_CXX_SPAN
+    /// <summary>
+    /// Writes the audio data by making an internal copy of it, without throwing.
+    /// Note: The data should not contain any audio header. Writing no data is a no-op; use <see cref="Close"/> to end the stream.
+    /// </summary>
+    /// <param name="data">The audio data.</param>
+    /// <returns>SPX_NOERROR on success, otherwise the error code.</returns>
+    SPXHR Write(std::span<const uint8_t> data) noexcept
+    {
+        if (data.empty())
+        {
+            // A write of size zero would end the stream.
+            return SPX_NOERROR;
+        }
+        if (data.size() > UINT32_MAX)
+        {
+            return SPXERR_INVALID_ARG;
+        }
+        // The stream copies the data; the C API merely lacks the const qualifier.
+        return push_audio_input_stream_write(m_haudioStream, const_cast<uint8_t*>(data.data()), static_cast<uint32_t>(data.size()));
+    }
+
+    /// <summary>
+    /// Writes several buffers, e.g. frames from multiple capture sources, as one contiguous block in a single call
+    /// into the stream, without throwing.
+    /// Note: The buffers should not contain any audio header.
+    /// </summary>
+    /// <param name="buffers">The audio buffers, written in order.</param>
+    /// <returns>SPX_NOERROR on success, otherwise the error code.</returns>
+    SPXHR WriteV(std::span<const std::span<const uint8_t>> buffers) noexcept
+    {
+        size_t size = 0;
+        size_t nonEmpty = 0;
+        const std::span<const uint8_t>* last = nullptr;
+        for (auto& buffer : buffers)
+        {
+            if (!buffer.empty())
+            {
+                size += buffer.size();
+                nonEmpty++;
+                last = &buffer;
+            }
+        }
+
+        if (nonEmpty == 0)
+        {
+            return SPX_NOERROR;
+        }
+        if (nonEmpty == 1)
+        {
+            // Nothing to gather.
+            return Write(*last);
+        }
+        if (size > UINT32_MAX)
+        {
+            return SPXERR_INVALID_ARG;
+        }
+
+        // Gathered per thread, so concurrent writers need no lock and the buffer's capacity is reused across calls.
+        static thread_local std::vector<uint8_t> gathered;
+        try
+        {
+            gathered.resize(size);
+        }
+        catch (...)
+        {
+            return SPXERR_OUT_OF_MEMORY;
+        }
+
+        auto position = gathered.data();
+        for (auto& buffer : buffers)
+        {
+            if (!buffer.empty())
+            {
+                std::memcpy(position, buffer.data(), buffer.size());
+                position += buffer.size();
+            }
+        }
+        return Write(std::span<const uint8_t>(gathered.data(), size));
+    }
+#endif
+
     /// <summary>
     /// Set value of a property. The properties of the audio data should be set before writing the audio data.
     /// Added in version 1.5.0.
@@ -814,8 +904,6 @@ private:
 private:
 
     DISABLE_COPY_AND_MOVE(PullAudioOutputStream);
-
-    std::vector<uint8_t> m_audioData;
 };
 
 
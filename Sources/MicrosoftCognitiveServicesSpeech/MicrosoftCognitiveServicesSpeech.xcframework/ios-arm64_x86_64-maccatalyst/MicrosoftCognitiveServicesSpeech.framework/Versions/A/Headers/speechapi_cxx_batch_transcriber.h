@@ -0,0 +1,451 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_batch_transcriber.h: Public API declarations for BatchTranscriber, which transcribes a manifest of
+// audio files with a bounded number of concurrent recognizers
+//
+
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include "speechapi_cxx_common.h"
+#include "speechapi_cxx_string_helpers.h"
+#include "speechapi_cxx_speech_config.h"
+#include "speechapi_cxx_audio_config.h"
+#include "speechapi_cxx_audio_mapped_wav_file.h"
+#include "speechapi_cxx_speech_recognizer.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+
+/// <summary>
+/// Outcome of transcribing one file with <see cref="BatchTranscriber"/>.
+/// </summary>
+struct BatchTranscriptionResult
+{
+    /// <summary>
+    /// Path of the audio file.
+    /// </summary>
+    SPXSTRING FileName;
+
+    /// <summary>
+    /// Whether the file was transcribed without error.
+    /// </summary>
+    bool Succeeded = false;
+
+    /// <summary>
+    /// Recognized text of all utterances, separated by spaces.
+    /// </summary>
+    SPXSTRING Text;
+
+    /// <summary>
+    /// Error details if the transcription failed.
+    /// </summary>
+    SPXSTRING ErrorDetails;
+
+    /// <summary>
+    /// Duration of the audio in seconds, or 0 if unknown.
+    /// </summary>
+    double AudioSeconds = 0;
+
+    /// <summary>
+    /// Wall-clock time spent transcribing the file, in seconds.
+    /// </summary>
+    double ProcessingSeconds = 0;
+
+    /// <summary>
+    /// Gets the real-time factor, the processing time divided by the audio duration.
+    /// </summary>
+    /// <returns>The real-time factor, or 0 if the audio duration is unknown.</returns>
+    double GetRealTimeFactor() const
+    {
+        return AudioSeconds > 0 ? ProcessingSeconds / AudioSeconds : 0;
+    }
+};
+
+/// <summary>
+/// Transcribes a manifest of audio files, running several recognizers concurrently.
+/// Results are written as JSON lines in manifest order, each as soon as all earlier files are done.
+/// </summary>
+/// <remarks>
+/// Files are dealt to the workers largest first and an idle worker steals the smallest remaining file from
+/// another worker, so long files start early and the batch does not end waiting on one straggler.
+/// The transcription of a single file is a replaceable function, which allows running the engine against a local
+/// fake instead of the service.
+/// </remarks>
+class BatchTranscriber
+{
+public:
+
+    /// <summary>
+    /// Function transcribing one file. It fills in everything but <see cref="BatchTranscriptionResult::ProcessingSeconds"/>,
+    /// which the engine measures. It is called concurrently from several worker threads.
+    /// </summary>
+    using TranscribeFunction = std::function<BatchTranscriptionResult(const SPXSTRING& fileName)>;
+
+    /// <summary>
+    /// Creates a batch transcriber that recognizes each WAV file with its own <see cref="SpeechRecognizer"/>.
+    /// </summary>
+    /// <param name="speechConfig">Speech configuration shared by all recognizers.</param>
+    /// <param name="maxConcurrency">Maximum number of files transcribed at once; 0 for the number of hardware threads.</param>
+    /// <param name="maxConnections">Maximum number of concurrent service connections; 0 for no limit.</param>
+    /// <param name="fileTimeout">Maximum time to wait for one file, see <see cref="TranscribeFile"/>; 0 to derive it from the audio duration.</param>
+    /// <returns>A shared pointer to the batch transcriber.</returns>
+    static std::shared_ptr<BatchTranscriber> FromConfig(std::shared_ptr<SpeechConfig> speechConfig, size_t maxConcurrency = 0, size_t maxConnections = 0, std::chrono::milliseconds fileTimeout = std::chrono::milliseconds(0))
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, speechConfig == nullptr);
+        auto transcribe = [speechConfig, fileTimeout](const SPXSTRING& fileName) { return TranscribeFile(speechConfig, fileName, fileTimeout); };
+        return std::shared_ptr<BatchTranscriber>(new BatchTranscriber(transcribe, maxConcurrency, maxConnections));
+    }
+
+    /// <summary>
+    /// Creates a batch transcriber that uses the given function to transcribe each file.
+    /// </summary>
+    /// <param name="transcribe">Function transcribing one file.</param>
+    /// <param name="maxConcurrency">Maximum number of files transcribed at once; 0 for the number of hardware threads.</param>
+    /// <param name="maxConnections">Maximum number of concurrent service connections; 0 for no limit.</param>
+    /// <returns>A shared pointer to the batch transcriber.</returns>
+    static std::shared_ptr<BatchTranscriber> FromFunction(TranscribeFunction transcribe, size_t maxConcurrency = 0, size_t maxConnections = 0)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, transcribe == nullptr);
+        return std::shared_ptr<BatchTranscriber>(new BatchTranscriber(std::move(transcribe), maxConcurrency, maxConnections));
+    }
+
+    /// <summary>
+    /// Reads a manifest with one file path per line. Blank lines and lines starting with '#' are skipped.
+    /// </summary>
+    /// <param name="manifest">Stream with the manifest.</param>
+    /// <returns>The file paths.</returns>
+    static std::vector<SPXSTRING> ReadManifest(std::istream& manifest)
+    {
+        std::vector<SPXSTRING> files;
+        std::string line;
+        while (std::getline(manifest, line))
+        {
+            auto start = line.find_first_not_of(" \t\r");
+            if (start == std::string::npos || line[start] == '#')
+            {
+                continue;
+            }
+            auto end = line.find_last_not_of(" \t\r");
+            files.push_back(Utils::ToSPXString(line.substr(start, end - start + 1)));
+        }
+        return files;
+    }
+
+    /// <summary>
+    /// Gets the number of files transcribed at once.
+    /// </summary>
+    /// <returns>The concurrency.</returns>
+    size_t GetConcurrency() const { return m_concurrency; }
+
+    /// <summary>
+    /// Transcribes all files and writes one JSON object per file and line to the output, in manifest order.
+    /// Blocks until all files are done.
+    /// </summary>
+    /// <param name="files">Paths of the audio files.</param>
+    /// <param name="output">Stream receiving the JSON lines.</param>
+    /// <returns>The number of files transcribed successfully.</returns>
+    size_t Run(const std::vector<SPXSTRING>& files, std::ostream& output)
+    {
+        std::vector<std::pair<uint64_t, size_t>> bySize;
+        bySize.reserve(files.size());
+        for (size_t index = 0; index < files.size(); index++)
+        {
+            bySize.emplace_back(GetFileSize(files[index]), index);
+        }
+        std::stable_sort(bySize.begin(), bySize.end(), [](const std::pair<uint64_t, size_t>& a, const std::pair<uint64_t, size_t>& b) { return a.first > b.first; });
+
+        auto workers = std::max<size_t>(1, std::min(m_concurrency, files.size()));
+        std::vector<WorkQueue> queues(workers);
+        for (size_t i = 0; i < bySize.size(); i++)
+        {
+            queues[i % workers].Items.push_back(bySize[i].second);
+        }
+
+        RunState state(files, output);
+        std::vector<std::thread> threads;
+        for (size_t worker = 0; worker < workers; worker++)
+        {
+            threads.emplace_back([this, worker, &queues, &state]() { Work(worker, queues, state); });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        return state.Succeeded;
+    }
+
+    /// <summary>
+    /// Transcribes one WAV file with continuous recognition until the session stops. Used by <see cref="FromConfig"/>.
+    /// </summary>
+    /// <param name="speechConfig">Speech configuration.</param>
+    /// <param name="fileName">Path of the WAV file.</param>
+    /// <param name="timeout">
+    /// Maximum time to wait for the session to stop, after which recognition is stopped and the file is reported as failed;
+    /// 0 for one minute plus twice the audio duration.
+    /// </param>
+    /// <returns>The transcription result.</returns>
+    static BatchTranscriptionResult TranscribeFile(std::shared_ptr<SpeechConfig> speechConfig, const SPXSTRING& fileName, std::chrono::milliseconds timeout = std::chrono::milliseconds(0))
+    {
+        BatchTranscriptionResult result;
+        result.FileName = fileName;
+        result.AudioSeconds = GetWavDuration(fileName);
+        if (timeout.count() <= 0)
+        {
+            timeout = std::chrono::minutes(1) + std::chrono::milliseconds(static_cast<int64_t>(result.AudioSeconds * 2000));
+        }
+
+        auto recognizer = SpeechRecognizer::FromConfig(speechConfig, Audio::AudioConfig::FromWavFileInput(fileName));
+
+        // Event handlers may still be running on the recognizer's threads when a timeout gives up on the file,
+        // so everything they touch is owned jointly with them rather than living on this stack frame.
+        auto state = std::make_shared<FileState>();
+        auto stop = [state]()
+        {
+            std::unique_lock<std::mutex> lock(state->Mutex);
+            state->Done = true;
+            state->Stopped.notify_all();
+        };
+
+        recognizer->Recognized.Connect([state](const SpeechRecognitionEventArgs& e)
+        {
+            if (e.Result->Reason == ResultReason::RecognizedSpeech && !e.Result->GetText().empty())
+            {
+                std::unique_lock<std::mutex> lock(state->Mutex);
+                state->Text += state->Text.empty() ? e.Result->GetText() : " " + e.Result->GetText();
+            }
+        });
+        recognizer->Canceled.Connect([state, stop](const SpeechRecognitionCanceledEventArgs& e)
+        {
+            if (e.Reason == CancellationReason::Error)
+            {
+                std::unique_lock<std::mutex> lock(state->Mutex);
+                state->ErrorDetails = e.ErrorDetails;
+            }
+            stop();
+        });
+        recognizer->SessionStopped.Connect([stop](const SessionEventArgs&) { stop(); });
+
+        recognizer->StartContinuousRecognitionAsync().get();
+        bool timedOut;
+        {
+            std::unique_lock<std::mutex> lock(state->Mutex);
+            timedOut = !state->Stopped.wait_for(lock, timeout, [&state]() { return state->Done; });
+        }
+        recognizer->StopContinuousRecognitionAsync().get();
+
+        recognizer->Recognized.DisconnectAll();
+        recognizer->Canceled.DisconnectAll();
+        recognizer->SessionStopped.DisconnectAll();
+
+        std::unique_lock<std::mutex> lock(state->Mutex);
+        result.Text = state->Text;
+        result.ErrorDetails = state->ErrorDetails;
+        if (timedOut && result.ErrorDetails.empty())
+        {
+            result.ErrorDetails = Utils::ToSPXString("Timed out after " + std::to_string(timeout.count()) + " ms waiting for the session to stop");
+        }
+        result.Succeeded = result.ErrorDetails.empty();
+        return result;
+    }
+
+private:
+
+    DISABLE_COPY_AND_MOVE(BatchTranscriber);
+
+    // Shared between TranscribeFile and the event handlers of its recognizer.
+    struct FileState
+    {
+        std::mutex Mutex;
+        std::condition_variable Stopped;
+        bool Done = false;
+        SPXSTRING Text;
+        SPXSTRING ErrorDetails;
+    };
+
+    struct WorkQueue
+    {
+        std::mutex Mutex;
+        std::deque<size_t> Items;
+    };
+
+    struct RunState
+    {
+        RunState(const std::vector<SPXSTRING>& files, std::ostream& output) :
+            Files(files),
+            Output(output),
+            Results(files.size()),
+            Done(files.size(), false)
+        {
+        }
+
+        const std::vector<SPXSTRING>& Files;
+        std::ostream& Output;
+        std::mutex Mutex;
+        std::vector<BatchTranscriptionResult> Results;
+        std::vector<bool> Done;
+        size_t NextToWrite = 0;
+        size_t Succeeded = 0;
+    };
+
+    BatchTranscriber(TranscribeFunction transcribe, size_t maxConcurrency, size_t maxConnections) :
+        m_transcribe(std::move(transcribe))
+    {
+        m_concurrency = maxConcurrency != 0 ? maxConcurrency : std::max<size_t>(1, std::thread::hardware_concurrency());
+        if (maxConnections != 0)
+        {
+            m_concurrency = std::min(m_concurrency, maxConnections);
+        }
+    }
+
+    // Takes the largest file from the worker's own queue, or else steals the smallest file from another queue.
+    static bool TakeWork(size_t worker, std::vector<WorkQueue>& queues, size_t& index)
+    {
+        for (size_t i = 0; i < queues.size(); i++)
+        {
+            auto& queue = queues[(worker + i) % queues.size()];
+            std::unique_lock<std::mutex> lock(queue.Mutex);
+            if (!queue.Items.empty())
+            {
+                if (i == 0)
+                {
+                    index = queue.Items.front();
+                    queue.Items.pop_front();
+                }
+                else
+                {
+                    index = queue.Items.back();
+                    queue.Items.pop_back();
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Work(size_t worker, std::vector<WorkQueue>& queues, RunState& state)
+    {
+        size_t index = 0;
+        while (TakeWork(worker, queues, index))
+        {
+            BatchTranscriptionResult result;
+            auto start = std::chrono::steady_clock::now();
+            try
+            {
+                result = m_transcribe(state.Files[index]);
+            }
+            catch (const std::exception& ex)
+            {
+                result = BatchTranscriptionResult();
+                result.ErrorDetails = Utils::ToSPXString(ex.what());
+            }
+            catch (...)
+            {
+                result = BatchTranscriptionResult();
+                result.ErrorDetails = Utils::ToSPXString("Unknown exception");
+            }
+            result.FileName = state.Files[index];
+            result.ProcessingSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            // Whoever completes the next file in manifest order writes it and every completed file after it.
+            std::unique_lock<std::mutex> lock(state.Mutex);
+            state.Results[index] = std::move(result);
+            state.Done[index] = true;
+            while (state.NextToWrite < state.Files.size() && state.Done[state.NextToWrite])
+            {
+                auto& completed = state.Results[state.NextToWrite];
+                WriteJsonLine(state.Output, state.NextToWrite, completed);
+                state.Succeeded += completed.Succeeded ? 1 : 0;
+                completed = BatchTranscriptionResult();
+                state.NextToWrite++;
+            }
+            state.Output.flush();
+        }
+    }
+
+    static void WriteJsonLine(std::ostream& output, size_t index, const BatchTranscriptionResult& result)
+    {
+        std::ostringstream line;
+        line << "{\"index\":" << index
+             << ",\"file\":\"" << EscapeJson(Utils::ToUTF8(result.FileName))
+             << "\",\"succeeded\":" << (result.Succeeded ? "true" : "false")
+             << ",\"text\":\"" << EscapeJson(Utils::ToUTF8(result.Text))
+             << "\",\"error\":\"" << EscapeJson(Utils::ToUTF8(result.ErrorDetails))
+             << "\",\"audioSeconds\":" << result.AudioSeconds
+             << ",\"processingSeconds\":" << result.ProcessingSeconds
+             << ",\"realTimeFactor\":" << result.GetRealTimeFactor()
+             << "}\n";
+        output << line.str();
+    }
+
+    static std::string EscapeJson(const std::string& value)
+    {
+        std::string escaped;
+        escaped.reserve(value.size());
+        for (auto ch : value)
+        {
+            switch (ch)
+            {
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\r': escaped += "\\r"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(ch) < 0x20)
+                {
+                    char code[8];
+                    std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(ch));
+                    escaped += code;
+                }
+                else
+                {
+                    escaped += ch;
+                }
+                break;
+            }
+        }
+        return escaped;
+    }
+
+    static uint64_t GetFileSize(const SPXSTRING& fileName)
+    {
+        struct stat info;
+        return ::stat(Utils::ToUTF8(fileName).c_str(), &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+    }
+
+    static double GetWavDuration(const SPXSTRING& fileName)
+    {
+        try
+        {
+            auto wav = Audio::MappedWavFilePullAudioInputStreamCallback::Create(fileName);
+            auto format = wav->GetSampleFormat();
+            return static_cast<double>(wav->GetDataSize()) / (static_cast<double>(wav->GetBlockAlign()) * format.GetSamplesPerSecond());
+        }
+        catch (...)
+        {
+            return 0;
+        }
+    }
+
+    TranscribeFunction m_transcribe;
+    size_t m_concurrency;
+};
+
+} } } // Microsoft::CognitiveServices::Speech
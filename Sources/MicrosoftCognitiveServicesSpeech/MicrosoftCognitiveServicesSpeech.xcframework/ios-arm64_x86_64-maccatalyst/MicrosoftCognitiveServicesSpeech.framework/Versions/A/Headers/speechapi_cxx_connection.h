@@ -5,6 +5,8 @@
 
 #pragma once
 #include "speechapi_cxx_common.h"
+#include "speechapi_cxx_async_operation.h"
+#include "speechapi_cxx_executor.h"
 #include "speechapi_cxx_recognizer.h"
 #include "speechapi_cxx_eventsignal.h"
 #include "speechapi_cxx_connection_eventargs.h"
@@ -151,12 +153,22 @@ public:
     /// <returns>An empty future.</returns>
     std::future<void> SendMessageAsync(const SPXSTRING& path, const SPXSTRING& payload)
     {
-        auto keep_alive = this->shared_from_this();
-        auto future = std::async(std::launch::async, [keep_alive, this, path, payload]() -> void {
-            SPX_THROW_HR_IF(SPXERR_INVALID_HANDLE, m_connectionHandle == SPXHANDLE_INVALID);
-            SPX_THROW_ON_FAIL(::connection_send_message(m_connectionHandle, Utils::ToUTF8(path.c_str()), Utils::ToUTF8(payload.c_str())));
+        return SendMessageAsyncOperation(path, payload).ToFuture();
+    }
+
+    /// <summary>
+    /// Sends a message to the speech service without blocking a thread while waiting for it to be sent.
+    /// This method doesn't work for the connection of SpeechSynthesizer.
+    /// </summary>
+    /// <param name="path">The path of the message.</param>
+    /// <param name="payload">The payload of the message. This is a json string.</param>
+    /// <returns>An operation that completes once the message has been sent.</returns>
+    AsyncOperation<void> SendMessageAsyncOperation(const SPXSTRING& path, const SPXSTRING& payload)
+    {
+        auto message = std::make_shared<std::pair<std::string, std::string>>(Utils::ToUTF8(path), Utils::ToUTF8(payload));
+        return RunSendOperation(message, [this, message](SPXASYNCHANDLE* phasync) {
+            return ::connection_send_message_async(m_connectionHandle, message->first.c_str(), message->second.c_str(), phasync);
         });
-        return future;
     }
 
     /// <summary>
@@ -170,12 +182,23 @@ public:
     /// <returns>An empty future.</returns>
     std::future<void> SendMessageAsync(const SPXSTRING& path, uint8_t* payload, uint32_t size)
     {
-        auto keep_alive = this->shared_from_this();
-        auto future = std::async(std::launch::async, [keep_alive, this, path, payload, size]() -> void {
-            SPX_THROW_HR_IF(SPXERR_INVALID_HANDLE, m_connectionHandle == SPXHANDLE_INVALID);
-            SPX_THROW_ON_FAIL(::connection_send_message_data(m_connectionHandle, Utils::ToUTF8(path.c_str()), payload, size));
+        return SendMessageAsyncOperation(path, payload, size).ToFuture();
+    }
+
+    /// <summary>
+    /// Sends a binary message to the speech service without blocking a thread while waiting for it to be sent.
+    /// This method doesn't work for the connection of SpeechSynthesizer.
+    /// </summary>
+    /// <param name="path">The path of the message.</param>
+    /// <param name="payload">The binary payload of the message. Must stay valid until the operation completes.</param>
+    /// <param name="size">The size of the binary payload.</param>
+    /// <returns>An operation that completes once the message has been sent.</returns>
+    AsyncOperation<void> SendMessageAsyncOperation(const SPXSTRING& path, uint8_t* payload, uint32_t size)
+    {
+        auto message = std::make_shared<std::pair<std::string, std::string>>(Utils::ToUTF8(path), std::string());
+        return RunSendOperation(message, [this, message, payload, size](SPXASYNCHANDLE* phasync) {
+            return ::connection_send_message_data_async(m_connectionHandle, message->first.c_str(), payload, size, phasync);
         });
-        return future;
     }
 
     /// <summary>
@@ -241,6 +264,25 @@ private:
 
     SPXCONNECTIONHANDLE m_connectionHandle;
 
+    template <class Start>
+    AsyncOperation<void> RunSendOperation(std::shared_ptr<std::pair<std::string, std::string>> message, Start start)
+    {
+        auto keep_alive = this->shared_from_this();
+        auto hasync = std::make_shared<SPXASYNCHANDLE>(SPXHANDLE_INVALID);
+
+        // The message strings are kept alive until the operation completes.
+        return AsyncReactor::GetDefault()->Run<void>(
+            [this, start, hasync]() {
+                SPX_THROW_HR_IF(SPXERR_INVALID_HANDLE, m_connectionHandle == SPXHANDLE_INVALID);
+                SPX_THROW_ON_FAIL(start(hasync.get()));
+            },
+            [hasync]() { return ::connection_send_message_wait_for(*hasync, 0); },
+            [keep_alive, message, hasync](SPXHR hr) {
+                SPX_REPORT_ON_FAIL(::connection_async_handle_release(*hasync));
+                SPX_THROW_ON_FAIL(hr);
+            });
+    }
+
     static void FireConnectionEvent(bool firingConnectedEvent, SPXEVENTHANDLE event, void* context)
     {
         std::exception_ptr p;
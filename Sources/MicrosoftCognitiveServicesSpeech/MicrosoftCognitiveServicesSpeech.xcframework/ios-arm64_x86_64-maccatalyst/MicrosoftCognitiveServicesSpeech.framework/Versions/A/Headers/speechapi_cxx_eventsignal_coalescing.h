@@ -0,0 +1,282 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_eventsignal_coalescing.h: Public API declarations for the CoalescingSubscription<TKey, TValue> class,
+// an opt-in EventSignal subscription that keeps only the newest event per key until a consumer collects it.
+//
+
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+
+#include "speechapi_cxx_common.h"
+#include "speechapi_cxx_utils.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+
+template <class T>
+class EventSignal;
+
+/// <summary>
+/// Subscription created by <see cref="EventSignal::ConnectCoalescing"/>. Events are projected to a key and a value
+/// on the signalling thread; a pending value is replaced when a newer event with the same key arrives, so a slow
+/// consumer only ever sees the latest value per key. Values are delivered on the consumer's own thread through
+/// <see cref="Deliver"/>.
+/// </summary>
+/// <remarks>
+/// Intended for high-rate intermediate events such as Recognizing. Final events (Recognized) should be subscribed
+/// to normally; their handler should call <see cref="Discard"/> before delivering the final value, so that a stale
+/// intermediate value for the same utterance is not delivered after it.
+/// </remarks>
+/// <typeparam name="TKey">Key identifying events that supersede each other.</typeparam>
+/// <typeparam name="TValue">Value kept for each key.</typeparam>
+template <class TKey, class TValue>
+class CoalescingSubscription
+{
+public:
+    /// <summary>
+    /// Handler invoked by <see cref="Deliver"/> for each pending value.
+    /// </summary>
+    using Handler = std::function<void(const TKey& key, const TValue& value)>;
+
+    /// <summary>
+    /// Destructor. Disconnects the subscription from its event signal.
+    /// </summary>
+    ~CoalescingSubscription()
+    {
+        Disconnect();
+    }
+
+    /// <summary>
+    /// Disconnects the subscription from its event signal and wakes a consumer blocked in <see cref="Deliver"/>.
+    /// Safe to call after the event signal (e.g. its recognizer) has been destroyed; it then only wakes the consumer.
+    /// </summary>
+    void Disconnect()
+    {
+        std::function<void()> disconnect;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            disconnect.swap(m_disconnect);
+            m_connected = false;
+        }
+        m_available.notify_all();
+
+        if (disconnect != nullptr)
+        {
+            disconnect();
+        }
+    }
+
+    /// <summary>
+    /// Indicates whether the subscription is still connected to its event signal.
+    /// </summary>
+    /// <returns>true if connected.</returns>
+    bool IsConnected() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_connected;
+    }
+
+    /// <summary>
+    /// Waits up to the timeout for pending values, then invokes the handler for each of them on the calling thread,
+    /// in the order their keys first arrived.
+    /// </summary>
+    /// <param name="handler">Handler to invoke.</param>
+    /// <param name="timeout">Maximum time to wait when nothing is pending.</param>
+    /// <returns>The number of values delivered; 0 on timeout or after <see cref="Disconnect"/>.</returns>
+    size_t Deliver(const Handler& handler, std::chrono::milliseconds timeout)
+    {
+        std::deque<TKey> order;
+        std::map<TKey, TValue> values;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_available.wait_for(lock, timeout, [this] { return !m_order.empty() || !m_connected; });
+            order.swap(m_order);
+            values.swap(m_latest);
+            m_taken.insert(order.begin(), order.end());
+        }
+
+        // Values are handed over one at a time, so that a Discard for a key taken here still drops its value.
+        size_t delivered = 0;
+        auto thisThread = std::this_thread::get_id();
+        for (auto& key : order)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                auto taken = m_taken.find(key);
+                if (taken == m_taken.end())
+                {
+                    continue;
+                }
+                m_taken.erase(taken);
+                m_running.emplace(key, thisThread);
+                m_delivered++;
+            }
+
+            auto done = Utils::MakeScopeGuard([this, &key, thisThread]() {
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    auto range = m_running.equal_range(key);
+                    m_running.erase(std::find_if(range.first, range.second, [thisThread](const std::pair<const TKey, std::thread::id>& running) { return running.second == thisThread; }));
+                }
+                m_idle.notify_all();
+            });
+            handler(key, values.at(key));
+            delivered++;
+        }
+
+        // Anything left over was discarded by another thread after being taken; it must not linger.
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (auto& key : order)
+        {
+            auto taken = m_taken.find(key);
+            if (taken != m_taken.end())
+            {
+                m_taken.erase(taken);
+            }
+        }
+        return delivered;
+    }
+
+    /// <summary>
+    /// Invokes the handler for each pending value without waiting.
+    /// </summary>
+    /// <param name="handler">Handler to invoke.</param>
+    /// <returns>The number of values delivered.</returns>
+    size_t TryDeliver(const Handler& handler)
+    {
+        return Deliver(handler, std::chrono::milliseconds(0));
+    }
+
+    /// <summary>
+    /// Drops the pending value for the key, if any, e.g. when the final result for that key has arrived. This
+    /// includes a value already taken by <see cref="Deliver"/> but not yet handed to its handler; if the handler
+    /// is running for the key on another thread, waits for it to return. Once this returns, no value for the key
+    /// received before the call will be delivered.
+    /// </summary>
+    /// <param name="key">The key.</param>
+    /// <returns>true if a pending value was dropped.</returns>
+    bool Discard(const TKey& key)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto dropped = false;
+        if (m_latest.erase(key) != 0)
+        {
+            m_order.erase(std::find(m_order.begin(), m_order.end(), key));
+            dropped = true;
+        }
+        if (m_taken.erase(key) != 0)
+        {
+            dropped = true;
+        }
+        m_discarded += dropped ? 1 : 0;
+
+        // A handler discarding its own key, e.g. from Deliver on the same thread, must not wait for itself.
+        auto thisThread = std::this_thread::get_id();
+        m_idle.wait(lock, [this, &key, thisThread] {
+            auto range = m_running.equal_range(key);
+            return std::all_of(range.first, range.second, [thisThread](const std::pair<const TKey, std::thread::id>& running) { return running.second == thisThread; });
+        });
+        return dropped;
+    }
+
+    /// <summary>
+    /// Gets the number of events received from the signal.
+    /// </summary>
+    /// <returns>Number of events received.</returns>
+    uint64_t GetReceivedCount() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_received;
+    }
+
+    /// <summary>
+    /// Gets the number of values delivered to the consumer.
+    /// </summary>
+    /// <returns>Number of values delivered.</returns>
+    uint64_t GetDeliveredCount() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_delivered;
+    }
+
+    /// <summary>
+    /// Gets the number of pending values that were replaced by a newer event with the same key before delivery.
+    /// </summary>
+    /// <returns>Number of superseded values.</returns>
+    uint64_t GetSupersededCount() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_superseded;
+    }
+
+    /// <summary>
+    /// Gets the number of pending values dropped through <see cref="Discard"/>.
+    /// </summary>
+    /// <returns>Number of discarded values.</returns>
+    uint64_t GetDiscardedCount() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_discarded;
+    }
+
+private:
+    template <class T>
+    friend class EventSignal;
+
+    CoalescingSubscription() = default;
+
+    DISABLE_COPY_AND_MOVE(CoalescingSubscription);
+
+    // Called on the signalling thread.
+    void Push(TKey key, TValue value)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_received++;
+
+            auto it = m_latest.find(key);
+            if (it != m_latest.end())
+            {
+                it->second = std::move(value);
+                m_superseded++;
+                return;
+            }
+
+            m_order.push_back(key);
+            m_latest.emplace(std::move(key), std::move(value));
+        }
+        m_available.notify_one();
+    }
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_available;
+    std::deque<TKey> m_order;
+    std::map<TKey, TValue> m_latest;
+
+    // Keys taken by Deliver whose handler has not started yet, and keys whose handler is running, with its thread.
+    std::multiset<TKey> m_taken;
+    std::multimap<TKey, std::thread::id> m_running;
+    std::condition_variable m_idle;
+    std::function<void()> m_disconnect;
+    bool m_connected = true;
+
+    uint64_t m_received = 0;
+    uint64_t m_delivered = 0;
+    uint64_t m_superseded = 0;
+    uint64_t m_discarded = 0;
+};
+
+} } } // Microsoft::CognitiveServices::Speech
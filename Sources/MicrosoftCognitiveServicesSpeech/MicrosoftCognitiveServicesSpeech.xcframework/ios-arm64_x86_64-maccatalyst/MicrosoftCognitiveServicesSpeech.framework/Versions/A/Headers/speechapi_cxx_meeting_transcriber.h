@@ -12,6 +12,7 @@
 #include <string>
 #include <cstring>
 #include "speechapi_cxx_common.h"
+#include "speechapi_cxx_executor.h"
 #include "speechapi_cxx_string_helpers.h"
 #include "speechapi_c.h"
 #include "speechapi_cxx_meeting.h"
@@ -58,7 +59,7 @@ public:
     std::future<void> JoinMeetingAsync(std::shared_ptr<Meeting> meeting)
     {
         auto keepAlive = this->shared_from_this();
-        auto future = std::async(std::launch::async, [keepAlive, this, meeting]() -> void {
+        auto future = Utils::RunAsync([keepAlive, this, meeting]() -> void {
             SPX_THROW_ON_FAIL(::recognizer_join_meeting(Utils::HandleOrInvalid<SPXMEETINGHANDLE, Meeting>(meeting), m_hreco));
         });
 
@@ -74,7 +75,7 @@ public:
     std::future<void> LeaveMeetingAsync()
     {
         auto keepAlive = this->shared_from_this();
-        auto future = std::async(std::launch::async, [keepAlive, this]() -> void {
+        auto future = Utils::RunAsync([keepAlive, this]() -> void {
             SPX_THROW_ON_FAIL(::recognizer_leave_meeting(m_hreco));
         });
 
@@ -88,7 +89,7 @@ public:
     std::future<void> StartTranscribingAsync()
     {
         auto keepAlive = this->shared_from_this();
-        auto future = std::async(std::launch::async, [keepAlive, this]() -> void {
+        auto future = Utils::RunAsync([keepAlive, this]() -> void {
             SPX_INIT_HR(hr);
             SPX_THROW_ON_FAIL(hr = recognizer_async_handle_release(m_hasyncStartContinuous)); // close any unfinished previous attempt
 
@@ -113,7 +114,7 @@ public:
     std::future<void> StopTranscribingAsync()
     {
         auto keepAlive = this->shared_from_this();
-        auto future = std::async(std::launch::async, [keepAlive, this]() -> void {
+        auto future = Utils::RunAsync([keepAlive, this]() -> void {
 
             SPX_THROW_ON_FAIL(::recognizer_leave_meeting(m_hreco));
 
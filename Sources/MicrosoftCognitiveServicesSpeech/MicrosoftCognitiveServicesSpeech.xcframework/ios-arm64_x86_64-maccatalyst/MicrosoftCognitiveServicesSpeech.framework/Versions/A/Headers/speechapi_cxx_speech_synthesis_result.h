@@ -8,10 +8,14 @@
 #pragma once
 #include <string>
 #include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include "speechapi_cxx_common.h"
 #include "speechapi_cxx_string_helpers.h"
 #include "speechapi_cxx_enums.h"
 #include "speechapi_cxx_properties.h"
+#include "speechapi_cxx_audio_stream.h"
 #include "speechapi_cxx_audio_data_stream.h"
 #include "speechapi_c_result.h"
 #include "speechapi_c_synthesizer.h"
@@ -82,18 +86,11 @@ public:
         SPX_THROW_ON_FAIL(synth_result_get_reason(hresult, &resultReason));
         m_reason = static_cast<ResultReason>(resultReason);
 
-        uint32_t audioLength = 0;
+        // The audio itself is only copied out of the result when it is asked for; callers streaming through
+        // AudioDataStream::FromResult never pay for it.
         uint64_t audioDuration = 0;
-        SPX_THROW_ON_FAIL(synth_result_get_audio_length_duration(m_hresult, &audioLength, &audioDuration));
+        SPX_THROW_ON_FAIL(synth_result_get_audio_length_duration(m_hresult, &m_audioLength, &audioDuration));
         m_audioDuration = std::chrono::milliseconds(audioDuration);
-
-        m_audioData = std::make_shared<std::vector<uint8_t>>(audioLength);
-
-        if (audioLength > 0)
-        {
-            uint32_t filledSize = 0;
-            SPX_THROW_ON_FAIL(synth_result_get_audio_data(m_hresult, m_audioData->data(), audioLength, &filledSize));
-        }
     }
 
     /// <summary>
@@ -102,18 +99,57 @@ public:
     /// <returns>Length of synthesized audio</returns>
     uint32_t GetAudioLength()
     {
-        return static_cast<uint32_t>(m_audioData->size());
+        return m_audioLength;
     }
 
     /// <summary>
-    /// Gets the synthesized audio.
+    /// Gets the synthesized audio. It is copied from the result on first access and shared afterwards.
     /// </summary>
     /// <returns>Synthesized audio data</returns>
     std::shared_ptr<std::vector<uint8_t>> GetAudioData()
     {
+        std::call_once(m_audioDataFetched, [this] {
+            auto audioData = std::make_shared<std::vector<uint8_t>>(m_audioLength);
+            if (m_audioLength > 0)
+            {
+                uint32_t filledSize = 0;
+                SPX_THROW_ON_FAIL(synth_result_get_audio_data(m_hresult, audioData->data(), m_audioLength, &filledSize));
+                audioData->resize(filledSize);
+            }
+            m_audioData = std::move(audioData);
+        });
         return m_audioData;
     }
 
+    /// <summary>
+    /// Copies the synthesized audio straight into a caller-supplied buffer, without keeping a copy in the result.
+    /// </summary>
+    /// <param name="buffer">The buffer to copy the audio into.</param>
+    /// <param name="bufferSize">The size of the buffer; at least <see cref="GetAudioLength"/> to receive all audio.</param>
+    /// <returns>The number of bytes copied.</returns>
+    uint32_t ReadAudioData(uint8_t* buffer, uint32_t bufferSize)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, buffer == nullptr && bufferSize > 0);
+        uint32_t filledSize = 0;
+        if (bufferSize > 0 && m_audioLength > 0)
+        {
+            SPX_THROW_ON_FAIL(synth_result_get_audio_data(m_hresult, buffer, bufferSize, &filledSize));
+        }
+        return filledSize;
+    }
+
+#ifdef SPX_CONFIG_CXX_SPAN
+    /// <summary>
+    /// Gets the synthesized audio as a view over the copy owned by the result. See <see cref="GetAudioData"/>.
+    /// </summary>
+    /// <returns>View that is valid as long as the result.</returns>
+    std::span<const uint8_t> AudioDataView()
+    {
+        auto& audioData = *GetAudioData();
+        return std::span<const uint8_t>(audioData.data(), audioData.size());
+    }
+#endif
+
     /// <summary>
     /// Explicit conversion operator.
     /// </summary>
@@ -165,9 +201,15 @@ private:
     ResultReason m_reason;
 
     /// <summary>
-    /// Internal member variable that holds the audio data
+    /// Internal member variable that holds the audio length in bytes.
+    /// </summary>
+    uint32_t m_audioLength = 0;
+
+    /// <summary>
+    /// Internal member variable that holds the audio data, once fetched.
     /// </summary>
     std::shared_ptr<std::vector<uint8_t>> m_audioData;
+    std::once_flag m_audioDataFetched;
 
     /// <summary>
     /// Internal member variable that holds the audio duration
@@ -8,7 +8,10 @@
 #pragma once
 #include <future>
 #include <memory>
+#include <mutex>
 #include "speechapi_cxx_common.h"
+#include "speechapi_cxx_async_operation.h"
+#include "speechapi_cxx_executor.h"
 #include "speechapi_cxx_string_helpers.h"
 #include "speechapi_c.h"
 #include "speechapi_cxx_properties.h"
@@ -21,6 +24,7 @@
 #include "speechapi_cxx_speech_synthesis_word_boundary_eventargs.h"
 #include "speechapi_cxx_speech_synthesis_viseme_eventargs.h"
 #include "speechapi_cxx_speech_synthesis_bookmark_eventargs.h"
+#include "speechapi_cxx_speech_synthesis_timeline.h"
 
 namespace Microsoft {
 namespace CognitiveServices {
@@ -42,6 +46,9 @@ private:
 
     std::shared_ptr<Audio::AudioConfig> m_audioConfig;
 
+    mutable std::mutex m_timelineMutex;
+    std::shared_ptr<SpeechSynthesisTimeline> m_timeline;
+
     /*! \cond PRIVATE */
 
     class PrivatePropertyCollection : public PropertyCollection
@@ -266,22 +273,20 @@ public:
     /// <returns>An asynchronous operation representing the synthesis. It returns a value of <see cref="SpeechSynthesisResult"/> as result.</returns>
     std::future<std::shared_ptr<SpeechSynthesisResult>> SpeakTextAsync(const std::string& text)
     {
-        auto keepAlive = this->shared_from_this();
-
-        auto future = std::async(std::launch::async, [keepAlive, this, text]() -> std::shared_ptr<SpeechSynthesisResult> {
-            SPXRESULTHANDLE hresult = SPXHANDLE_INVALID;
-            SPXASYNCHANDLE hasync = SPXHANDLE_INVALID;
-            SPX_THROW_ON_FAIL(::synthesizer_speak_text_async(m_hsynth, text.data(), static_cast<uint32_t>(text.length()), &hasync));
-            SPX_EXITFN_ON_FAIL(::synthesizer_speak_async_wait_for(hasync, UINT32_MAX, &hresult));
-
-        SPX_EXITFN_CLEANUP:
-            auto releaseHr = synthesizer_async_handle_release(hasync);
-            SPX_REPORT_ON_FAIL(releaseHr);
+        return SpeakTextAsyncOperation(text).ToFuture();
+    }
 
-            return std::make_shared<SpeechSynthesisResult>(hresult);
+    /// <summary>
+    /// Executes the speech synthesis on plain text without blocking a thread while waiting for the result.
+    /// </summary>
+    /// <param name="text">The plain text for synthesis.</param>
+    /// <returns>An operation that completes with the synthesis result.</returns>
+    AsyncOperation<std::shared_ptr<SpeechSynthesisResult>> SpeakTextAsyncOperation(const std::string& text)
+    {
+        auto input = std::make_shared<std::string>(text);
+        return RunSpeakOperation(input, [this, input](SPXASYNCHANDLE* phasync) {
+            return ::synthesizer_speak_text_async(m_hsynth, input->data(), static_cast<uint32_t>(input->length()), phasync);
         });
-
-        return future;
     }
 
     /// <summary>
@@ -302,22 +307,20 @@ public:
     /// <returns>An asynchronous operation representing the synthesis. It returns a value of <see cref="SpeechSynthesisResult"/> as result.</returns>
     std::future<std::shared_ptr<SpeechSynthesisResult>> SpeakSsmlAsync(const std::string& ssml)
     {
-        auto keepAlive = this->shared_from_this();
-
-        auto future = std::async(std::launch::async, [keepAlive, this, ssml]() -> std::shared_ptr<SpeechSynthesisResult> {
-            SPXRESULTHANDLE hresult = SPXHANDLE_INVALID;
-            SPXASYNCHANDLE hasync = SPXHANDLE_INVALID;
-            SPX_THROW_ON_FAIL(::synthesizer_speak_ssml_async(m_hsynth, ssml.data(), static_cast<uint32_t>(ssml.length()), &hasync));
-            SPX_EXITFN_ON_FAIL(::synthesizer_speak_async_wait_for(hasync, UINT32_MAX, &hresult));
-
-        SPX_EXITFN_CLEANUP:
-            auto releaseHr = synthesizer_async_handle_release(hasync);
-            SPX_REPORT_ON_FAIL(releaseHr);
+        return SpeakSsmlAsyncOperation(ssml).ToFuture();
+    }
 
-            return std::make_shared<SpeechSynthesisResult>(hresult);
+    /// <summary>
+    /// Executes the speech synthesis on SSML without blocking a thread while waiting for the result.
+    /// </summary>
+    /// <param name="ssml">The SSML for synthesis.</param>
+    /// <returns>An operation that completes with the synthesis result.</returns>
+    AsyncOperation<std::shared_ptr<SpeechSynthesisResult>> SpeakSsmlAsyncOperation(const std::string& ssml)
+    {
+        auto input = std::make_shared<std::string>(ssml);
+        return RunSpeakOperation(input, [this, input](SPXASYNCHANDLE* phasync) {
+            return ::synthesizer_speak_ssml_async(m_hsynth, input->data(), static_cast<uint32_t>(input->length()), phasync);
         });
-
-        return future;
     }
 
     /// <summary>
@@ -386,22 +389,20 @@ public:
     /// <returns>An asynchronous operation representing the synthesis. It returns a value of <see cref="SpeechSynthesisResult"/> as result.</returns>
     std::future<std::shared_ptr<SpeechSynthesisResult>> StartSpeakingTextAsync(const std::string& text)
     {
-        auto keepAlive = this->shared_from_this();
-
-        auto future = std::async(std::launch::async, [keepAlive, this, text]() -> std::shared_ptr<SpeechSynthesisResult> {
-            SPXRESULTHANDLE hresult = SPXHANDLE_INVALID;
-            SPXASYNCHANDLE hasync = SPXHANDLE_INVALID;
-            SPX_THROW_ON_FAIL(::synthesizer_start_speaking_text_async(m_hsynth, text.data(), static_cast<uint32_t>(text.length()), &hasync));
-            SPX_EXITFN_ON_FAIL(::synthesizer_speak_async_wait_for(hasync, UINT32_MAX, &hresult));
-
-        SPX_EXITFN_CLEANUP:
-            auto releaseHr = synthesizer_async_handle_release(hasync);
-            SPX_REPORT_ON_FAIL(releaseHr);
+        return StartSpeakingTextAsyncOperation(text).ToFuture();
+    }
 
-            return std::make_shared<SpeechSynthesisResult>(hresult);
+    /// <summary>
+    /// Starts the speech synthesis on plain text without blocking a thread while waiting for the result.
+    /// </summary>
+    /// <param name="text">The plain text for synthesis.</param>
+    /// <returns>An operation that completes once synthesis has started.</returns>
+    AsyncOperation<std::shared_ptr<SpeechSynthesisResult>> StartSpeakingTextAsyncOperation(const std::string& text)
+    {
+        auto input = std::make_shared<std::string>(text);
+        return RunSpeakOperation(input, [this, input](SPXASYNCHANDLE* phasync) {
+            return ::synthesizer_start_speaking_text_async(m_hsynth, input->data(), static_cast<uint32_t>(input->length()), phasync);
         });
-
-        return future;
     }
 
     /// <summary>
@@ -422,22 +423,20 @@ public:
     /// <returns>An asynchronous operation representing the synthesis. It returns a value of <see cref="SpeechSynthesisResult"/> as result.</returns>
     std::future<std::shared_ptr<SpeechSynthesisResult>> StartSpeakingSsmlAsync(const std::string& ssml)
     {
-        auto keepAlive = this->shared_from_this();
-
-        auto future = std::async(std::launch::async, [keepAlive, this, ssml]() -> std::shared_ptr<SpeechSynthesisResult> {
-            SPXRESULTHANDLE hresult = SPXHANDLE_INVALID;
-            SPXASYNCHANDLE hasync = SPXHANDLE_INVALID;
-            SPX_THROW_ON_FAIL(::synthesizer_start_speaking_ssml_async(m_hsynth, ssml.data(), static_cast<uint32_t>(ssml.length()), &hasync));
-            SPX_EXITFN_ON_FAIL(::synthesizer_speak_async_wait_for(hasync, UINT32_MAX, &hresult));
-
-        SPX_EXITFN_CLEANUP:
-            auto releaseHr = synthesizer_async_handle_release(hasync);
-            SPX_REPORT_ON_FAIL(releaseHr);
+        return StartSpeakingSsmlAsyncOperation(ssml).ToFuture();
+    }
 
-            return std::make_shared<SpeechSynthesisResult>(hresult);
+    /// <summary>
+    /// Starts the speech synthesis on SSML without blocking a thread while waiting for the result.
+    /// </summary>
+    /// <param name="ssml">The SSML for synthesis.</param>
+    /// <returns>An operation that completes once synthesis has started.</returns>
+    AsyncOperation<std::shared_ptr<SpeechSynthesisResult>> StartSpeakingSsmlAsyncOperation(const std::string& ssml)
+    {
+        auto input = std::make_shared<std::string>(ssml);
+        return RunSpeakOperation(input, [this, input](SPXASYNCHANDLE* phasync) {
+            return ::synthesizer_start_speaking_ssml_async(m_hsynth, input->data(), static_cast<uint32_t>(input->length()), phasync);
         });
-
-        return future;
     }
 
     /// <summary>
@@ -458,19 +457,25 @@ public:
     /// <returns>An empty future.</returns>
     std::future<void> StopSpeakingAsync()
     {
-        auto keepAlive = this->shared_from_this();
-
-        auto future = std::async(std::launch::async, [keepAlive, this]() -> void {
-            SPXASYNCHANDLE hasyncStop = SPXHANDLE_INVALID;
-            SPX_THROW_ON_FAIL(::synthesizer_stop_speaking_async(m_hsynth, &hasyncStop));
-            SPX_EXITFN_ON_FAIL(::synthesizer_stop_speaking_async_wait_for(hasyncStop, UINT32_MAX));
+        return StopSpeakingAsyncOperation().ToFuture();
+    }
 
-        SPX_EXITFN_CLEANUP:
-            auto releaseHr = synthesizer_async_handle_release(hasyncStop);
-            SPX_REPORT_ON_FAIL(releaseHr);
-        });
+    /// <summary>
+    /// Stops the speech synthesis without blocking a thread while waiting for it to stop.
+    /// </summary>
+    /// <returns>An operation that completes once synthesis has stopped.</returns>
+    AsyncOperation<void> StopSpeakingAsyncOperation()
+    {
+        auto keepAlive = this->shared_from_this();
+        auto hasync = std::make_shared<SPXASYNCHANDLE>(SPXHANDLE_INVALID);
 
-        return future;
+        return AsyncReactor::GetDefault()->Run<void>(
+            [this, hasync]() { SPX_THROW_ON_FAIL(::synthesizer_stop_speaking_async(m_hsynth, hasync.get())); },
+            [hasync]() { return ::synthesizer_stop_speaking_async_wait_for(*hasync, 0); },
+            [keepAlive, hasync](SPXHR hr) {
+                SPX_REPORT_ON_FAIL(synthesizer_async_handle_release(*hasync));
+                SPX_THROW_ON_FAIL(hr);
+            });
     }
 
     /// <summary>
@@ -483,7 +488,7 @@ public:
     {
         const auto keepAlive = this->shared_from_this();
 
-        auto future = std::async(std::launch::async, [keepAlive, locale, this]() -> std::shared_ptr<SynthesisVoicesResult> {
+        auto future = Utils::RunAsync([keepAlive, locale, this]() -> std::shared_ptr<SynthesisVoicesResult> {
             SPXRESULTHANDLE hresult = SPXHANDLE_INVALID;
             SPXASYNCHANDLE hasync = SPXHANDLE_INVALID;
             SPX_THROW_ON_FAIL(::synthesizer_get_voices_list_async(m_hsynth, Utils::ToUTF8(locale).c_str(), &hasync));
@@ -499,6 +504,28 @@ public:
         return future;
     }
 
+    /// <summary>
+    /// Gets the available voices without blocking a thread while the list is retrieved.
+    /// </summary>
+    /// <param name="locale">Specify the locale of voices, in BCP-47 format; or leave it empty to get all available voices.</param>
+    /// <returns>An operation representing the voices list. It returns a value of <see cref="SynthesisVoicesResult"/> as result.</returns>
+    AsyncOperation<std::shared_ptr<SynthesisVoicesResult>> GetVoicesAsyncOperation(const SPXSTRING& locale = SPXSTRING())
+    {
+        auto keepAlive = this->shared_from_this();
+        auto hasync = std::make_shared<SPXASYNCHANDLE>(SPXHANDLE_INVALID);
+        auto hresult = std::make_shared<SPXRESULTHANDLE>(SPXHANDLE_INVALID);
+        auto locale8 = Utils::ToUTF8(locale);
+
+        return AsyncReactor::GetDefault()->Run<std::shared_ptr<SynthesisVoicesResult>>(
+            [this, locale8, hasync]() { SPX_THROW_ON_FAIL(::synthesizer_get_voices_list_async(m_hsynth, locale8.c_str(), hasync.get())); },
+            [hasync, hresult]() { return ::synthesizer_get_voices_list_async_wait_for(*hasync, 0, hresult.get()); },
+            [keepAlive, hasync, hresult](SPXHR hr) {
+                SPX_REPORT_ON_FAIL(synthesizer_async_handle_release(*hasync));
+                SPX_THROW_ON_FAIL(hr);
+                return std::make_shared<SynthesisVoicesResult>(*hresult);
+            });
+    }
+
     /// <summary>
     /// Sets the authorization token that will be used for connecting to the service.
     /// Note: The caller needs to ensure that the authorization token is valid. Before the authorization token
@@ -522,6 +549,32 @@ public:
         return Properties.GetProperty(PropertyId::SpeechServiceAuthorization_Token, SPXSTRING());
     }
 
+    /// <summary>
+    /// Sets a timeline that records the word boundary and viseme events. While no handler is connected to
+    /// <see cref="WordBoundary"/> or <see cref="VisemeReceived"/>, the events are recorded without constructing
+    /// event arguments.
+    /// </summary>
+    /// <param name="timeline">The timeline, or nullptr to stop recording.</param>
+    void SetTimeline(std::shared_ptr<SpeechSynthesisTimeline> timeline)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_timelineMutex);
+            m_timeline = std::move(timeline);
+        }
+        UpdateWordBoundaryCallback();
+        UpdateVisemeCallback();
+    }
+
+    /// <summary>
+    /// Gets the timeline set with <see cref="SetTimeline"/>.
+    /// </summary>
+    /// <returns>The timeline, or nullptr.</returns>
+    std::shared_ptr<SpeechSynthesisTimeline> GetTimeline() const
+    {
+        std::unique_lock<std::mutex> lock(m_timelineMutex);
+        return m_timeline;
+    }
+
     /// <summary>
     /// Destructor.
     /// </summary>
@@ -529,6 +582,11 @@ public:
     {
         SPX_DBG_TRACE_SCOPE(__FUNCTION__, __FUNCTION__);
 
+        if (GetTimeline() != nullptr)
+        {
+            SetTimeline(nullptr);
+        }
+
         // Disconnect the event signals in reverse construction order
         BookmarkReached.DisconnectAll();
         VisemeReceived.DisconnectAll();
@@ -586,6 +644,24 @@ public:
 
 private:
 
+    template <class Start>
+    AsyncOperation<std::shared_ptr<SpeechSynthesisResult>> RunSpeakOperation(std::shared_ptr<std::string> input, Start start)
+    {
+        auto keepAlive = this->shared_from_this();
+        auto hasync = std::make_shared<SPXASYNCHANDLE>(SPXHANDLE_INVALID);
+        auto hresult = std::make_shared<SPXRESULTHANDLE>(SPXHANDLE_INVALID);
+
+        // The input is kept alive until the operation completes.
+        return AsyncReactor::GetDefault()->Run<std::shared_ptr<SpeechSynthesisResult>>(
+            [start, hasync]() { SPX_THROW_ON_FAIL(start(hasync.get())); },
+            [hasync, hresult]() { return ::synthesizer_speak_async_wait_for(*hasync, 0, hresult.get()); },
+            [keepAlive, input, hasync, hresult](SPXHR hr) {
+                SPX_REPORT_ON_FAIL(synthesizer_async_handle_release(*hasync));
+                SPX_THROW_ON_FAIL(hr);
+                return std::make_shared<SpeechSynthesisResult>(*hresult);
+            });
+    }
+
     /// <summary>
     /// Internal constructor. Creates a new instance using the provided handle.
     /// </summary>
@@ -632,7 +708,7 @@ private:
         return [=](const EventSignal<const SpeechSynthesisWordBoundaryEventArgs&>& eventSignal) {
             if (&eventSignal == &WordBoundary)
             {
-                synthesizer_word_boundary_set_callback(m_hsynth, WordBoundary.IsConnected() ? FireEvent_WordBoundary : nullptr, this);
+                UpdateWordBoundaryCallback();
             }
         };
     }
@@ -642,11 +718,23 @@ private:
         return [=](const EventSignal<const SpeechSynthesisVisemeEventArgs&>& eventSignal) {
             if (&eventSignal == &VisemeReceived)
             {
-                synthesizer_viseme_received_set_callback(m_hsynth, VisemeReceived.IsConnected() ? FireEvent_VisemeReceived : nullptr, this);
+                UpdateVisemeCallback();
             }
         };
     }
 
+    void UpdateWordBoundaryCallback()
+    {
+        auto needed = WordBoundary.IsConnected() || GetTimeline() != nullptr;
+        synthesizer_word_boundary_set_callback(m_hsynth, needed ? FireEvent_WordBoundary : nullptr, this);
+    }
+
+    void UpdateVisemeCallback()
+    {
+        auto needed = VisemeReceived.IsConnected() || GetTimeline() != nullptr;
+        synthesizer_viseme_received_set_callback(m_hsynth, needed ? FireEvent_VisemeReceived : nullptr, this);
+    }
+
     std::function<void(const EventSignal<const SpeechSynthesisBookmarkEventArgs&>&)> GetBookmarkEventConnectionsChangedCallback()
     {
         return [=](const EventSignal<const SpeechSynthesisBookmarkEventArgs&>& eventSignal) {
@@ -700,9 +788,13 @@ private:
     static void FireEvent_WordBoundary(SPXSYNTHHANDLE hsynth, SPXEVENTHANDLE hevent, void* pvContext)
     {
         UNUSED(hsynth);
+        auto pThis = static_cast<SpeechSynthesizer*>(pvContext);
+        if (!RecordOnTimeline(pThis, hevent, &SpeechSynthesisTimeline::AddWordBoundary, pThis->WordBoundary.IsConnected()))
+        {
+            return;
+        }
         std::unique_ptr<SpeechSynthesisWordBoundaryEventArgs> wordBoundaryEvent{ new SpeechSynthesisWordBoundaryEventArgs(hevent) };
 
-        auto pThis = static_cast<SpeechSynthesizer*>(pvContext);
         auto keepAlive = pThis->shared_from_this();
         pThis->WordBoundary.Signal(*wordBoundaryEvent.get());
     }
@@ -710,13 +802,40 @@ private:
     static void FireEvent_VisemeReceived(SPXSYNTHHANDLE hsynth, SPXEVENTHANDLE hevent, void* pvContext)
     {
         UNUSED(hsynth);
+        auto pThis = static_cast<SpeechSynthesizer*>(pvContext);
+        if (!RecordOnTimeline(pThis, hevent, &SpeechSynthesisTimeline::AddViseme, pThis->VisemeReceived.IsConnected()))
+        {
+            return;
+        }
         std::unique_ptr<SpeechSynthesisVisemeEventArgs> visemeReceivedEvent{ new SpeechSynthesisVisemeEventArgs(hevent) };
 
-        auto pThis = static_cast<SpeechSynthesizer*>(pvContext);
         auto keepAlive = pThis->shared_from_this();
         pThis->VisemeReceived.Signal(*visemeReceivedEvent.get());
     }
 
+    // Records the event on the timeline, if any. Returns whether the event still has to be signaled; if not, the
+    // event handle, which is otherwise owned by the event arguments, is released here.
+    static bool RecordOnTimeline(SpeechSynthesizer* pThis, SPXEVENTHANDLE hevent, void (SpeechSynthesisTimeline::*add)(SPXEVENTHANDLE), bool signal)
+    {
+        auto timeline = pThis->GetTimeline();
+        if (timeline != nullptr)
+        {
+            try
+            {
+                (timeline.get()->*add)(hevent);
+            }
+            catch (...)
+            {
+                SPX_TRACE_ERROR("SpeechSynthesizer: recording an event on the timeline failed.");
+            }
+        }
+        if (!signal)
+        {
+            SPX_REPORT_ON_FAIL(synthesizer_event_handle_release(hevent));
+        }
+        return signal;
+    }
+
     static void FireEvent_BookmarkReached(SPXSYNTHHANDLE hsynth, SPXEVENTHANDLE hevent, void* pvContext)
     {
         UNUSED(hsynth);
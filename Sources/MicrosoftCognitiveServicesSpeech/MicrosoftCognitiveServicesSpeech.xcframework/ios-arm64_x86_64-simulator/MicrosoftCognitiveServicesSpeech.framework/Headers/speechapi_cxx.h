@@ -8,12 +8,24 @@
 #pragma once
 
 #include "speechapi_cxx_common.h"
+#include "speechapi_cxx_executor.h"
+#include "speechapi_cxx_async_operation.h"
+#include "speechapi_cxx_coroutine.h"
 #include "speechapi_cxx_string_helpers.h"
 #include "speechapi_cxx_smart_handle.h"
 
 #include "speechapi_cxx_properties.h"
 #include "speechapi_cxx_audio_stream_format.h"
 #include "speechapi_cxx_audio_stream.h"
+#include "speechapi_cxx_audio_ring_buffer.h"
+#include "speechapi_cxx_audio_sample_converter.h"
+#include "speechapi_cxx_audio_resampler.h"
+#include "speechapi_cxx_audio_mapped_wav_file.h"
+#include "speechapi_cxx_audio_voice_activity_gate.h"
+#include "speechapi_cxx_audio_ima_adpcm_codec.h"
+#include "speechapi_cxx_audio_channel_mixer.h"
+#include "speechapi_cxx_audio_output_ring_buffer.h"
+#include "speechapi_cxx_audio_output_coalescer.h"
 #include "speechapi_cxx_speech_config.h"
 #include "speechapi_cxx_embedded_speech_config.h"
 #include "speechapi_cxx_hybrid_speech_config.h"
@@ -36,6 +48,7 @@
 #include "speechapi_cxx_speech_recognition_eventargs.h"
 #include "speechapi_cxx_speech_recognizer.h"
 #include "speechapi_cxx_speech_recognition_model.h"
+#include "speechapi_cxx_batch_transcriber.h"
 
 #include "speechapi_cxx_conversational_language_understanding_model.h"
 #include "speechapi_cxx_intent_recognition_result.h"
@@ -71,15 +84,21 @@
 #include "speechapi_cxx_connection_eventargs.h"
 
 #include "speechapi_cxx_audio_data_stream.h"
+#include "speechapi_cxx_audio_data_stream_reader.h"
 
 #include "speechapi_cxx_speech_synthesis_result.h"
 #include "speechapi_cxx_speech_synthesis_eventargs.h"
 #include "speechapi_cxx_speech_synthesis_word_boundary_eventargs.h"
 #include "speechapi_cxx_speech_synthesis_viseme_eventargs.h"
 #include "speechapi_cxx_speech_synthesis_bookmark_eventargs.h"
+#include "speechapi_cxx_speech_synthesis_timeline.h"
 #include "speechapi_cxx_speech_synthesizer.h"
 #include "speechapi_cxx_synthesis_voices_result.h"
 #include "speechapi_cxx_voice_info.h"
+#include "speechapi_cxx_speech_synthesis_cache.h"
+#include "speechapi_cxx_speech_synthesis_pipeline.h"
+#include "speechapi_cxx_speech_synthesizer_pool.h"
+#include "speechapi_cxx_voice_catalog.h"
 
 #include "speechapi_cxx_keyword_recognition_result.h"
 #include "speechapi_cxx_keyword_recognition_eventargs.h"
@@ -0,0 +1,546 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_async_operation.h: Public API declarations for AsyncOperation<T>, AsyncPromise<T> and AsyncReactor C++ classes
+//
+
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "speechapi_cxx_common.h"
+#include "speechapi_cxx_executor.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+
+template <class T>
+class AsyncOperation;
+
+template <class T>
+class AsyncPromise;
+
+namespace Details {
+
+template <class T>
+class AsyncValue
+{
+public:
+    void SetValue(T value) { m_value.reset(new T(std::move(value))); }
+    T GetValue() const { return *m_value; }
+
+private:
+    std::unique_ptr<T> m_value;
+};
+
+template <>
+class AsyncValue<void>
+{
+public:
+    void SetValue() {}
+    void GetValue() const {}
+};
+
+template <class T>
+class AsyncState : public AsyncValue<T>
+{
+public:
+    using Continuation = std::function<void()>;
+
+    std::mutex mutex;
+    std::condition_variable completed;
+    std::exception_ptr error;
+    std::vector<Continuation> continuations;
+    bool ready = false;
+    bool satisfied = false;
+
+    // Marks the state as satisfied while the value or error is stored; fails if it already was.
+    void BeginComplete()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        SPX_THROW_HR_IF(SPXERR_ALREADY_INITIALIZED, satisfied);
+        satisfied = true;
+    }
+
+    void EndComplete()
+    {
+        std::vector<Continuation> toRun;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready = true;
+            toRun.swap(continuations);
+        }
+        completed.notify_all();
+
+        // The operation is already complete, so a failing continuation cannot be reported through it; isolate
+        // each one so the rest still run and nothing escapes into SetValue/SetException (and from there, Fulfill).
+        for (auto& continuation : toRun)
+        {
+            try
+            {
+                continuation();
+            }
+            catch (...)
+            {
+                SPX_TRACE_ERROR("AsyncOperation continuation threw an exception; ignored.");
+            }
+        }
+    }
+
+    void OnCompleted(Continuation continuation)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!ready)
+        {
+            continuations.push_back(std::move(continuation));
+            return;
+        }
+        lock.unlock();
+        continuation();
+    }
+};
+
+// Stores the result of invoking fn (or the exception it throws) into promise; void results need their own overload.
+template <class P, class F>
+auto Fulfill(P& promise, F&& fn) -> typename std::enable_if<!std::is_void<decltype(fn())>::value>::type
+{
+    try
+    {
+        promise.SetValue(fn());
+    }
+    catch (...)
+    {
+        promise.SetException(std::current_exception());
+    }
+}
+
+template <class P, class F>
+auto Fulfill(P& promise, F&& fn) -> typename std::enable_if<std::is_void<decltype(fn())>::value>::type
+{
+    try
+    {
+        fn();
+        promise.SetValue();
+    }
+    catch (...)
+    {
+        promise.SetException(std::current_exception());
+    }
+}
+
+// Adapts std::promise to the member names used by Fulfill.
+template <class T>
+struct StdPromiseAdapter
+{
+    std::promise<T> promise;
+
+    template <class... V>
+    void SetValue(V&&... value) { promise.set_value(std::forward<V>(value)...); }
+    void SetException(std::exception_ptr error) { promise.set_exception(error); }
+};
+
+} // Details
+
+/// <summary>
+/// Result of an asynchronous operation that completes without holding a thread.
+/// Unlike std::future, completion can be observed through continuations registered with <see cref="Then"/>,
+/// and the result can be retrieved more than once.
+/// </summary>
+/// <typeparam name="T">The result type, or void.</typeparam>
+template <class T>
+class AsyncOperation
+{
+public:
+    /// <summary>
+    /// Creates an operation that has already completed with the given exception.
+    /// </summary>
+    /// <param name="error">The exception.</param>
+    /// <returns>The completed operation.</returns>
+    static AsyncOperation<T> FromException(std::exception_ptr error)
+    {
+        AsyncPromise<T> promise;
+        promise.SetException(error);
+        return promise.GetOperation();
+    }
+
+    /// <summary>
+    /// Indicates whether the operation has completed.
+    /// </summary>
+    /// <returns>true if a value or an exception is available.</returns>
+    bool IsReady() const
+    {
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        return m_state->ready;
+    }
+
+    /// <summary>
+    /// Blocks until the operation has completed.
+    /// </summary>
+    void Wait() const
+    {
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        m_state->completed.wait(lock, [this] { return m_state->ready; });
+    }
+
+    /// <summary>
+    /// Blocks until the operation has completed or the timeout elapses.
+    /// </summary>
+    /// <param name="timeout">Maximum time to wait.</param>
+    /// <returns>true if the operation has completed.</returns>
+    template <class Rep, class Period>
+    bool WaitFor(const std::chrono::duration<Rep, Period>& timeout) const
+    {
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        return m_state->completed.wait_for(lock, timeout, [this] { return m_state->ready; });
+    }
+
+    /// <summary>
+    /// Blocks until the operation has completed, then returns its result or rethrows its exception.
+    /// </summary>
+    /// <returns>The result of the operation.</returns>
+    T Get() const
+    {
+        Wait();
+        if (m_state->error != nullptr)
+        {
+            std::rethrow_exception(m_state->error);
+        }
+        return m_state->GetValue();
+    }
+
+    /// <summary>
+    /// Registers a continuation that is invoked with this operation once it has completed.
+    /// </summary>
+    /// <remarks>
+    /// Without an executor the continuation runs on the thread that completes the operation (for operations driven
+    /// by the reactor, a thread of the default executor), or immediately on the calling thread if the operation has
+    /// already completed, so it should be short and must not block.
+    /// </remarks>
+    /// <param name="continuation">Function taking the completed AsyncOperation; its result becomes the result of the returned operation.</param>
+    /// <param name="executor">Optional executor to run the continuation on.</param>
+    /// <returns>An operation representing the result of the continuation.</returns>
+    template <class F>
+    auto Then(F continuation, std::shared_ptr<Executor> executor = nullptr) const -> AsyncOperation<decltype(continuation(std::declval<const AsyncOperation<T>&>()))>
+    {
+        using Result = decltype(continuation(std::declval<const AsyncOperation<T>&>()));
+
+        auto promise = std::make_shared<AsyncPromise<Result>>();
+        auto operation = promise->GetOperation();
+        auto self = *this;
+        auto run = [self, promise, continuation]() mutable {
+            Details::Fulfill(*promise, [&]() { return continuation(self); });
+        };
+
+        if (executor == nullptr)
+        {
+            m_state->OnCompleted(std::move(run));
+        }
+        else
+        {
+            m_state->OnCompleted([executor, run, promise]() {
+                try
+                {
+                    executor->Post(run);
+                }
+                catch (...)
+                {
+                    // The continuation will never run; fail its operation instead of leaving it pending.
+                    promise->SetException(std::current_exception());
+                }
+            });
+        }
+        return operation;
+    }
+
+    /// <summary>
+    /// Adapts this operation to a std::future.
+    /// </summary>
+    /// <returns>A future that becomes ready when this operation completes.</returns>
+    std::future<T> ToFuture() const
+    {
+        auto promise = std::make_shared<Details::StdPromiseAdapter<T>>();
+        auto future = promise->promise.get_future();
+        auto self = *this;
+        m_state->OnCompleted([self, promise]() {
+            Details::Fulfill(*promise, [&self]() { return self.Get(); });
+        });
+        return future;
+    }
+
+private:
+    friend class AsyncPromise<T>;
+
+    explicit AsyncOperation(std::shared_ptr<Details::AsyncState<T>> state) : m_state(std::move(state)) {}
+
+    std::shared_ptr<Details::AsyncState<T>> m_state;
+};
+
+/// <summary>
+/// Producer side of an <see cref="AsyncOperation"/>.
+/// </summary>
+/// <typeparam name="T">The result type, or void.</typeparam>
+template <class T>
+class AsyncPromise
+{
+public:
+    /// <summary>
+    /// Creates a promise with a pending operation.
+    /// </summary>
+    AsyncPromise() : m_state(std::make_shared<Details::AsyncState<T>>()) {}
+
+    /// <summary>
+    /// Gets the operation completed by this promise.
+    /// </summary>
+    /// <returns>The operation.</returns>
+    AsyncOperation<T> GetOperation() const
+    {
+        return AsyncOperation<T>(m_state);
+    }
+
+    /// <summary>
+    /// Completes the operation with a value and runs its continuations.
+    /// </summary>
+    /// <param name="value">The value (omitted for void).</param>
+    template <class... V>
+    void SetValue(V&&... value)
+    {
+        m_state->BeginComplete();
+        m_state->SetValue(std::forward<V>(value)...);
+        m_state->EndComplete();
+    }
+
+    /// <summary>
+    /// Completes the operation with an exception and runs its continuations.
+    /// </summary>
+    /// <param name="error">The exception.</param>
+    void SetException(std::exception_ptr error)
+    {
+        m_state->BeginComplete();
+        m_state->error = error;
+        m_state->EndComplete();
+    }
+
+private:
+    std::shared_ptr<Details::AsyncState<T>> m_state;
+};
+
+/// <summary>
+/// Completes asynchronous operations started through the C API (SPXASYNCHANDLE) from a single polling thread,
+/// so any number of outstanding operations can be awaited without a thread per operation.
+/// </summary>
+/// <remarks>
+/// The polling thread only polls: producing the result of a finished operation and running its continuations
+/// is posted to <see cref="Executor::GetDefault"/>, so a slow continuation does not delay other operations.
+/// </remarks>
+class AsyncReactor
+{
+public:
+    /// <summary>
+    /// Polls an outstanding operation without blocking. Returns SPXERR_TIMEOUT while the operation is still pending.
+    /// </summary>
+    using PollFunction = std::function<SPXHR()>;
+
+    /// <summary>
+    /// Creates a reactor.
+    /// </summary>
+    /// <param name="minInterval">Polling interval after an operation is added or completes.</param>
+    /// <param name="maxInterval">Polling interval the reactor backs off to while nothing completes.</param>
+    /// <returns>A shared pointer to the new reactor.</returns>
+    static std::shared_ptr<AsyncReactor> Create(std::chrono::milliseconds minInterval = std::chrono::milliseconds(1), std::chrono::milliseconds maxInterval = std::chrono::milliseconds(16))
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, minInterval.count() <= 0 || maxInterval < minInterval);
+        return std::shared_ptr<AsyncReactor>(new AsyncReactor(minInterval, maxInterval));
+    }
+
+    /// <summary>
+    /// Gets the reactor shared by the C++ API.
+    /// </summary>
+    /// <returns>The default reactor.</returns>
+    static std::shared_ptr<AsyncReactor> GetDefault()
+    {
+        // Intentionally leaked; see Executor::GetDefault.
+        static auto instance = new std::shared_ptr<AsyncReactor>(Create());
+        return *instance;
+    }
+
+    /// <summary>
+    /// Destructor. Waits for the polling thread to exit; operations still outstanding are never completed.
+    /// </summary>
+    ~AsyncReactor()
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    /// <summary>
+    /// Starts an operation and completes the returned AsyncOperation once polling reports it has finished.
+    /// </summary>
+    /// <param name="start">Starts the operation on the calling thread. If it throws, the returned operation fails with that exception.</param>
+    /// <param name="poll">Polls the operation without blocking, see <see cref="PollFunction"/>.</param>
+    /// <param name="complete">Called once with the final result of poll, on the default executor; produces the value (or throws) and releases the handle.</param>
+    /// <returns>The operation.</returns>
+    template <class T, class Start, class Complete>
+    AsyncOperation<T> Run(Start start, PollFunction poll, Complete complete)
+    {
+        try
+        {
+            start();
+        }
+        catch (...)
+        {
+            return AsyncOperation<T>::FromException(std::current_exception());
+        }
+
+        auto promise = std::make_shared<AsyncPromise<T>>();
+        Add([poll, promise, complete]() {
+            SPXHR hr;
+            try
+            {
+                hr = poll();
+            }
+            catch (...)
+            {
+                // Nothing may escape to the polling thread; the operation fails with the exception instead.
+                promise->SetException(std::current_exception());
+                return true;
+            }
+            if (hr == SPXERR_TIMEOUT)
+            {
+                return false;
+            }
+
+            auto fulfill = [promise, complete, hr]() {
+                Details::Fulfill(*promise, [&]() { return complete(hr); });
+            };
+            try
+            {
+                Executor::GetDefault()->Post(fulfill);
+            }
+            catch (...)
+            {
+                // Without an executor to run on, completing here is still better than never completing.
+                fulfill();
+            }
+            return true;
+        });
+        return promise->GetOperation();
+    }
+
+    /// <summary>
+    /// Gets the number of operations the reactor is polling.
+    /// </summary>
+    /// <returns>Number of outstanding operations.</returns>
+    size_t GetPendingCount() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_outstanding;
+    }
+
+private:
+    DISABLE_COPY_AND_MOVE(AsyncReactor);
+
+    using Entry = std::function<bool()>;
+
+    AsyncReactor(std::chrono::milliseconds minInterval, std::chrono::milliseconds maxInterval) :
+        m_minInterval(minInterval),
+        m_maxInterval(maxInterval)
+    {
+    }
+
+    void Add(Entry entry)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_added.push_back(std::move(entry));
+        m_outstanding++;
+        if (!m_thread.joinable())
+        {
+            m_thread = std::thread([this]() { PollLoop(); });
+        }
+        lock.unlock();
+        m_wake.notify_one();
+    }
+
+    void PollLoop()
+    {
+        auto interval = m_minInterval;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stopping)
+        {
+            if (!m_added.empty())
+            {
+                m_pending.insert(m_pending.end(), std::make_move_iterator(m_added.begin()), std::make_move_iterator(m_added.end()));
+                m_added.clear();
+                interval = m_minInterval;
+            }
+
+            if (m_pending.empty())
+            {
+                m_wake.wait(lock, [this] { return m_stopping || !m_added.empty(); });
+                continue;
+            }
+
+            // m_pending is only touched by this thread; the lock is held only to hand over newly added entries.
+            lock.unlock();
+            auto before = m_pending.size();
+            m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(), [](Entry& entry) { return entry(); }), m_pending.end());
+            auto completed = before - m_pending.size();
+            interval = completed > 0 ? m_minInterval : std::min(interval * 2, m_maxInterval);
+            lock.lock();
+            m_outstanding -= completed;
+
+            m_wake.wait_for(lock, interval, [this] { return m_stopping || !m_added.empty(); });
+        }
+    }
+
+    const std::chrono::milliseconds m_minInterval;
+    const std::chrono::milliseconds m_maxInterval;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::vector<Entry> m_added;
+    std::vector<Entry> m_pending;
+    size_t m_outstanding = 0;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
+
+namespace Utils {
+
+/// <summary>
+/// Runs the function on the default executor as blocking work and returns an AsyncOperation for its result.
+/// Used for operations that have no asynchronous counterpart in the C API.
+/// </summary>
+/// <param name="fn">The function to run.</param>
+/// <returns>An operation that completes with the function's result or exception.</returns>
+template<typename F>
+AsyncOperation<decltype(std::declval<F&>()())> RunAsyncOperation(F fn)
+{
+    using Result = decltype(fn());
+    auto promise = std::make_shared<AsyncPromise<Result>>();
+    auto operation = promise->GetOperation();
+    Executor::GetDefault()->PostBlocking([promise, fn]() mutable {
+        Details::Fulfill(*promise, fn);
+    });
+    return operation;
+}
+
+} // Utils
+
+} } } // Microsoft::CognitiveServices::Speech
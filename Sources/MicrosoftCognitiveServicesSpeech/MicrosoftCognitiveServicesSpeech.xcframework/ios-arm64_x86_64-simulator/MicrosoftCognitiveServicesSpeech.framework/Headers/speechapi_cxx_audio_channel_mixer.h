@@ -0,0 +1,479 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_audio_channel_mixer.h: Public API declarations for MicrophoneArrayChannelMixer, deinterleave, channel
+// select and downmix kernels for microphone array audio, and the downmixing PushAudioInputStream adapter
+//
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "speechapi_cxx_common.h"
+#include "speechapi_cxx_string_helpers.h"
+#include "speechapi_cxx_audio_stream.h"
+#include "speechapi_cxx_audio_processing_options.h"
+#include "speechapi_cxx_audio_sample_converter.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+namespace Audio {
+
+/// <summary>
+/// Splits and mixes interleaved 16 bit PCM captured by a microphone array described by a
+/// <see cref="MicrophoneArrayGeometry"/>, for apps that process array audio themselves before writing it to a
+/// <see cref="PushAudioInputStream"/>.
+/// </summary>
+/// <remarks>
+/// Arrays of 2, 4 and 8 channels (including a speaker reference channel) use vector kernels; other channel
+/// counts use scalar code with identical results.
+/// </remarks>
+class MicrophoneArrayChannelMixer
+{
+public:
+
+    /// <summary>
+    /// Creates a mixer for audio with one channel per microphone of the geometry, in the order of its coordinates,
+    /// plus the speaker reference channel if any.
+    /// </summary>
+    /// <param name="geometry">Geometry of the microphone array.</param>
+    /// <param name="speakerReferenceChannel">Whether the last channel is a speaker reference.</param>
+    /// <returns>A shared pointer to the mixer.</returns>
+    static std::shared_ptr<MicrophoneArrayChannelMixer> Create(const MicrophoneArrayGeometry& geometry, SpeakerReferenceChannel speakerReferenceChannel = SpeakerReferenceChannel::None)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, geometry.microphoneCoordinates.empty());
+        return std::shared_ptr<MicrophoneArrayChannelMixer>(new MicrophoneArrayChannelMixer(ComputeGains(geometry, speakerReferenceChannel)));
+    }
+
+    /// <summary>
+    /// Computes downmix gains from the array type. A linear array is averaged uniformly. A planar array with a
+    /// microphone at its center (within 5 mm) gives half the weight to the center microphone and spreads the other
+    /// half over the ring; other planar arrays are averaged uniformly. A speaker reference channel gets no weight.
+    /// </summary>
+    /// <param name="geometry">Geometry of the microphone array.</param>
+    /// <param name="speakerReferenceChannel">Whether the last channel is a speaker reference.</param>
+    /// <returns>One gain per channel.</returns>
+    static std::vector<float> ComputeGains(const MicrophoneArrayGeometry& geometry, SpeakerReferenceChannel speakerReferenceChannel = SpeakerReferenceChannel::None)
+    {
+        auto& coordinates = geometry.microphoneCoordinates;
+        auto microphones = coordinates.size();
+        std::vector<float> gains(microphones, 1.0f / static_cast<float>(microphones));
+
+        if (geometry.microphoneArrayType == MicrophoneArrayType::Planar && microphones > 1)
+        {
+            auto center = std::find_if(coordinates.begin(), coordinates.end(), [](const MicrophoneCoordinates& c)
+            {
+                return static_cast<double>(c.X) * c.X + static_cast<double>(c.Y) * c.Y + static_cast<double>(c.Z) * c.Z <= 25.0;
+            });
+            if (center != coordinates.end())
+            {
+                std::fill(gains.begin(), gains.end(), 0.5f / static_cast<float>(microphones - 1));
+                gains[static_cast<size_t>(center - coordinates.begin())] = 0.5f;
+            }
+        }
+
+        if (speakerReferenceChannel == SpeakerReferenceChannel::LastChannel)
+        {
+            gains.push_back(0.0f);
+        }
+        return gains;
+    }
+
+    /// <summary>
+    /// Gets the number of interleaved channels.
+    /// </summary>
+    /// <returns>Number of channels.</returns>
+    size_t GetChannels() const { return m_channels; }
+
+    /// <summary>
+    /// Gets the downmix gains.
+    /// </summary>
+    /// <returns>One gain per channel.</returns>
+    std::vector<float> GetGains() const
+    {
+        std::vector<float> gains(m_channels);
+        for (size_t channel = 0; channel < m_channels; channel++)
+        {
+            gains[channel] = static_cast<float>(m_gains[channel]) / 32768.0f;
+        }
+        return gains;
+    }
+
+    /// <summary>
+    /// Replaces the downmix gains, e.g. to steer towards one microphone. Gains are limited to [-1, 1), and the
+    /// sum of their magnitudes must stay below 2.
+    /// </summary>
+    /// <param name="gains">One gain per channel.</param>
+    void SetGains(const std::vector<float>& gains)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, gains.size() != m_channels);
+
+        // Q15; the limit on the total keeps every partial sum of the vector kernels within 32 bits.
+        int16_t quantized[MaxChannels] = {};
+        int32_t total = 0;
+        for (size_t channel = 0; channel < m_channels; channel++)
+        {
+            quantized[channel] = static_cast<int16_t>(std::lrint(std::min(std::max(gains[channel] * 32768.0f, -32768.0f), 32767.0f)));
+            total += std::abs(static_cast<int32_t>(quantized[channel]));
+        }
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, total > 65535);
+        std::copy(quantized, quantized + m_channels, m_gains);
+    }
+
+    /// <summary>
+    /// Splits interleaved audio into one buffer per channel.
+    /// </summary>
+    /// <param name="interleaved">Interleaved samples of <paramref name="frames"/> frames.</param>
+    /// <param name="frames">Number of frames.</param>
+    /// <param name="planar">One buffer of at least <paramref name="frames"/> samples per channel.</param>
+    void Deinterleave(const int16_t* interleaved, size_t frames, int16_t* const* planar) const
+    {
+        switch (m_channels)
+        {
+        case 2: DeinterleaveBlocks<2>(interleaved, frames, planar, SIZE_MAX); break;
+        case 4: DeinterleaveBlocks<4>(interleaved, frames, planar, SIZE_MAX); break;
+        case 8: DeinterleaveBlocks<8>(interleaved, frames, planar, SIZE_MAX); break;
+        default: DeinterleaveScalar(interleaved, 0, frames, m_channels, planar, SIZE_MAX); break;
+        }
+    }
+
+    /// <summary>
+    /// Extracts one channel of interleaved audio.
+    /// </summary>
+    /// <param name="interleaved">Interleaved samples of <paramref name="frames"/> frames.</param>
+    /// <param name="frames">Number of frames.</param>
+    /// <param name="channel">The channel to extract.</param>
+    /// <param name="output">Buffer of at least <paramref name="frames"/> samples.</param>
+    void Select(const int16_t* interleaved, size_t frames, size_t channel, int16_t* output) const
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, channel >= m_channels);
+
+        // Only the selected entry is written to.
+        int16_t* planar[MaxChannels] = {};
+        planar[channel] = output;
+        switch (m_channels)
+        {
+        case 2: DeinterleaveBlocks<2>(interleaved, frames, planar, channel); break;
+        case 4: DeinterleaveBlocks<4>(interleaved, frames, planar, channel); break;
+        case 8: DeinterleaveBlocks<8>(interleaved, frames, planar, channel); break;
+        default:
+            for (size_t frame = 0; frame < frames; frame++)
+            {
+                output[frame] = interleaved[frame * m_channels + channel];
+            }
+            break;
+        }
+    }
+
+    /// <summary>
+    /// Mixes interleaved audio down to mono with the downmix gains, saturating at full scale.
+    /// </summary>
+    /// <param name="interleaved">Interleaved samples of <paramref name="frames"/> frames.</param>
+    /// <param name="frames">Number of frames.</param>
+    /// <param name="mono">Buffer of at least <paramref name="frames"/> samples. It may be the start of <paramref name="interleaved"/>.</param>
+    void Downmix(const int16_t* interleaved, size_t frames, int16_t* mono) const
+    {
+        switch (m_channels)
+        {
+        case 2: DownmixBlocks<2>(interleaved, frames, mono); break;
+        case 4: DownmixBlocks<4>(interleaved, frames, mono); break;
+        case 8: DownmixBlocks<8>(interleaved, frames, mono); break;
+        default: DownmixScalar(interleaved, 0, frames, mono); break;
+        }
+    }
+
+private:
+
+    DISABLE_COPY_AND_MOVE(MicrophoneArrayChannelMixer);
+
+    static constexpr size_t MaxChannels = 64;
+
+    explicit MicrophoneArrayChannelMixer(const std::vector<float>& gains) :
+        m_channels(gains.size())
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, m_channels == 0 || m_channels > MaxChannels);
+        SetGains(gains);
+    }
+
+    static void DeinterleaveScalar(const int16_t* interleaved, size_t first, size_t frames, size_t channels, int16_t* const* planar, size_t only)
+    {
+        for (size_t channel = 0; channel < channels; channel++)
+        {
+            if (only != SIZE_MAX && channel != only)
+            {
+                continue;
+            }
+            for (size_t frame = first; frame < frames; frame++)
+            {
+                planar[channel][frame] = interleaved[frame * channels + channel];
+            }
+        }
+    }
+
+    void DownmixScalar(const int16_t* interleaved, size_t first, size_t frames, int16_t* mono) const
+    {
+        for (size_t frame = first; frame < frames; frame++)
+        {
+            int64_t sum = 0;
+            for (size_t channel = 0; channel < m_channels; channel++)
+            {
+                sum += static_cast<int32_t>(interleaved[frame * m_channels + channel]) * m_gains[channel];
+            }
+            mono[frame] = static_cast<int16_t>(std::min<int64_t>(std::max<int64_t>((sum + (1 << 14)) >> 15, -32768), 32767));
+        }
+    }
+
+    // Splits 8 frames of C channels, held in C vectors, into one vector per channel. Each round separates the even
+    // and odd samples of every stream, halving the number of channels per stream; after log2(C) rounds the streams
+    // hold single channels in bit-reversed order. NEON has de-interleaving loads for this.
+    template <size_t C>
+    void DeinterleaveBlocks(const int16_t* interleaved, size_t frames, int16_t* const* planar, size_t only) const
+    {
+        size_t frame = 0;
+#if defined(SPX_CONFIG_AUDIO_AVX2) || defined(SPX_CONFIG_AUDIO_SSE2)
+        for (; frame + 8 <= frames; frame += 8)
+        {
+            __m128i streams[C];
+            for (size_t i = 0; i < C; i++)
+            {
+                streams[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(interleaved + frame * C + i * 8));
+            }
+            for (size_t vectors = C; vectors > 1; vectors /= 2)
+            {
+                // Each stream spans the given number of vectors; its even and odd samples become two streams of half as many.
+                __m128i split[C];
+                for (size_t stream = 0; stream < C; stream += vectors)
+                {
+                    for (size_t i = 0; i < vectors / 2; i++)
+                    {
+                        auto a = streams[stream + 2 * i];
+                        auto b = streams[stream + 2 * i + 1];
+                        split[stream + i] = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+                        split[stream + vectors / 2 + i] = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+                    }
+                }
+                std::copy(split, split + C, streams);
+            }
+            for (size_t i = 0; i < C; i++)
+            {
+                auto channel = BitReverse(i, C);
+                if (only == SIZE_MAX || channel == only)
+                {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(planar[channel] + frame), streams[i]);
+                }
+            }
+        }
+#elif defined(SPX_CONFIG_AUDIO_NEON)
+        for (; frame + 8 <= frames; frame += 8)
+        {
+            auto source = interleaved + frame * C;
+            // Sized for the largest case, as every branch is compiled for every channel count.
+            int16x8_t channels[8];
+            if (C == 2)
+            {
+                auto pair = vld2q_s16(source);
+                channels[0] = pair.val[0];
+                channels[1] = pair.val[1];
+            }
+            else if (C == 4)
+            {
+                auto quad = vld4q_s16(source);
+                for (size_t i = 0; i < 4; i++)
+                {
+                    channels[i] = quad.val[i];
+                }
+            }
+            else
+            {
+                // Each stream of a 4-way load alternates channel k and channel k + 4.
+                auto first = vld4q_s16(source);
+                auto second = vld4q_s16(source + 32);
+                for (size_t i = 0; i < 4; i++)
+                {
+                    channels[i] = vuzp1q_s16(first.val[i], second.val[i]);
+                    channels[i + C / 2] = vuzp2q_s16(first.val[i], second.val[i]);
+                }
+            }
+            for (size_t channel = 0; channel < C; channel++)
+            {
+                if (only == SIZE_MAX || channel == only)
+                {
+                    vst1q_s16(planar[channel] + frame, channels[channel]);
+                }
+            }
+        }
+#endif
+        DeinterleaveScalar(interleaved, frame, frames, C, planar, only);
+    }
+
+    static size_t BitReverse(size_t index, size_t count)
+    {
+        size_t reversed = 0;
+        for (size_t bit = 1; bit < count; bit <<= 1)
+        {
+            reversed = (reversed << 1) | ((index & bit) != 0 ? 1 : 0);
+        }
+        return reversed;
+    }
+
+#if defined(SPX_CONFIG_AUDIO_AVX2) || defined(SPX_CONFIG_AUDIO_SSE2)
+    // Adds adjacent 32 bit lanes: [a0 + a1, a2 + a3, b0 + b1, b2 + b3].
+    static __m128i AddPairs(__m128i a, __m128i b)
+    {
+        auto even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+        auto odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1)));
+        return _mm_add_epi32(even, odd);
+    }
+#endif
+
+    // Multiplies each vector of samples by the repeating gain pattern, summing pairs of products, then keeps
+    // adding neighbouring sums until one sum per frame remains.
+    template <size_t C>
+    void DownmixBlocks(const int16_t* interleaved, size_t frames, int16_t* mono) const
+    {
+        size_t frame = 0;
+#if defined(SPX_CONFIG_AUDIO_AVX2) || defined(SPX_CONFIG_AUDIO_SSE2)
+        int16_t pattern[8];
+        for (size_t i = 0; i < 8; i++)
+        {
+            pattern[i] = m_gains[i % C];
+        }
+        const __m128i gains = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern));
+        const __m128i rounding = _mm_set1_epi32(1 << 14);
+        for (; frame + 8 <= frames; frame += 8)
+        {
+            __m128i sums[C];
+            for (size_t i = 0; i < C; i++)
+            {
+                sums[i] = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(interleaved + frame * C + i * 8)), gains);
+            }
+            for (size_t count = C; count > 2; count /= 2)
+            {
+                for (size_t i = 0; i < count / 2; i++)
+                {
+                    sums[i] = AddPairs(sums[2 * i], sums[2 * i + 1]);
+                }
+            }
+            auto low = _mm_srai_epi32(_mm_add_epi32(sums[0], rounding), 15);
+            auto high = _mm_srai_epi32(_mm_add_epi32(sums[1], rounding), 15);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(mono + frame), _mm_packs_epi32(low, high));
+        }
+#elif defined(SPX_CONFIG_AUDIO_NEON)
+        int16_t pattern[8];
+        for (size_t i = 0; i < 8; i++)
+        {
+            pattern[i] = m_gains[i % C];
+        }
+        const int16x8_t gains = vld1q_s16(pattern);
+        for (; frame + 8 <= frames; frame += 8)
+        {
+            int32x4_t sums[2 * C];
+            for (size_t i = 0; i < C; i++)
+            {
+                auto samples = vld1q_s16(interleaved + frame * C + i * 8);
+                sums[2 * i] = vmull_s16(vget_low_s16(samples), vget_low_s16(gains));
+                sums[2 * i + 1] = vmull_high_s16(samples, gains);
+            }
+            for (size_t count = 2 * C; count > 2; count /= 2)
+            {
+                for (size_t i = 0; i < count / 2; i++)
+                {
+                    sums[i] = vpaddq_s32(sums[2 * i], sums[2 * i + 1]);
+                }
+            }
+            vst1q_s16(mono + frame, vcombine_s16(vqrshrn_n_s32(sums[0], 15), vqrshrn_n_s32(sums[1], 15)));
+        }
+#endif
+        DownmixScalar(interleaved, frame, frames, mono);
+    }
+
+    size_t m_channels;
+    int16_t m_gains[MaxChannels] = {};
+};
+
+/// <summary>
+/// Mixes microphone array audio down to mono with a <see cref="MicrophoneArrayChannelMixer"/> before writing it
+/// to a mono <see cref="PushAudioInputStream"/>.
+/// </summary>
+class PushAudioInputStreamDownmixer
+{
+public:
+
+    /// <summary>
+    /// Creates a downmixing writer.
+    /// </summary>
+    /// <param name="stream">The mono stream to write to.</param>
+    /// <param name="mixer">The mixer, which defines the channels and gains.</param>
+    /// <returns>A shared pointer to the downmixing writer.</returns>
+    static std::shared_ptr<PushAudioInputStreamDownmixer> Create(std::shared_ptr<PushAudioInputStream> stream, std::shared_ptr<MicrophoneArrayChannelMixer> mixer)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, stream == nullptr || mixer == nullptr);
+        return std::shared_ptr<PushAudioInputStreamDownmixer>(new PushAudioInputStreamDownmixer(std::move(stream), std::move(mixer)));
+    }
+
+    /// <summary>
+    /// Mixes the audio down and writes it to the stream. A trailing partial frame is kept until the next call.
+    /// </summary>
+    /// <param name="dataBuffer">Interleaved 16 bit PCM, without any audio header.</param>
+    /// <param name="size">The size of the buffer in bytes.</param>
+    void Write(const uint8_t* dataBuffer, size_t size)
+    {
+        while (size > 0)
+        {
+            // Fill the staging block to whole frames, then mix it in place; the staging buffer never grows.
+            auto take = std::min(size, m_input.size() * sizeof(int16_t) - m_inputBytes);
+            std::memcpy(reinterpret_cast<uint8_t*>(m_input.data()) + m_inputBytes, dataBuffer, take);
+            m_inputBytes += take;
+            dataBuffer += take;
+            size -= take;
+
+            auto frames = m_inputBytes / m_blockAlign;
+            if (frames == 0)
+            {
+                break;
+            }
+            auto consumed = frames * m_blockAlign;
+            m_mixer->Downmix(m_input.data(), frames, m_output.data());
+            std::memmove(m_input.data(), reinterpret_cast<uint8_t*>(m_input.data()) + consumed, m_inputBytes - consumed);
+            m_inputBytes -= consumed;
+            m_stream->Write(reinterpret_cast<uint8_t*>(m_output.data()), static_cast<uint32_t>(frames * sizeof(int16_t)));
+        }
+    }
+
+    /// <summary>
+    /// Closes the stream. A trailing partial frame is dropped.
+    /// </summary>
+    void Close()
+    {
+        m_inputBytes = 0;
+        m_stream->Close();
+    }
+
+private:
+
+    DISABLE_COPY_AND_MOVE(PushAudioInputStreamDownmixer);
+
+    static constexpr size_t BlockFrames = 1024;
+
+    PushAudioInputStreamDownmixer(std::shared_ptr<PushAudioInputStream> stream, std::shared_ptr<MicrophoneArrayChannelMixer> mixer) :
+        m_stream(std::move(stream)),
+        m_mixer(std::move(mixer)),
+        m_blockAlign(m_mixer->GetChannels() * sizeof(int16_t)),
+        m_input(BlockFrames * m_mixer->GetChannels()),
+        m_output(BlockFrames)
+    {
+    }
+
+    std::shared_ptr<PushAudioInputStream> m_stream;
+    std::shared_ptr<MicrophoneArrayChannelMixer> m_mixer;
+    const size_t m_blockAlign;
+    std::vector<int16_t> m_input;
+    size_t m_inputBytes = 0;
+    std::vector<int16_t> m_output;
+};
+
+} } } } // Microsoft::CognitiveServices::Speech::Audio
@@ -0,0 +1,480 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_audio_ring_buffer.h: Public API declarations for RingBufferPullAudioInputStreamCallback, a
+// single-producer/single-consumer ring buffer bridging an audio capture thread to a PullAudioInputStream
+//
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "speechapi_cxx_common.h"
+#include "speechapi_cxx_string_helpers.h"
+#include "speechapi_cxx_audio_stream.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+namespace Audio {
+
+/// <summary>
+/// Defines what <see cref="RingBufferPullAudioInputStreamCallback::Write"/> does when the ring buffer is full.
+/// </summary>
+enum class RingBufferOverflowPolicy
+{
+    /// <summary>
+    /// Keeps the buffered audio and drops the part of the new audio that does not fit.
+    /// </summary>
+    DropNewest = 0,
+
+    /// <summary>
+    /// Discards the oldest buffered audio to make room for the new audio, keeping latency bounded.
+    /// If the consumer is reading at that moment, the new audio that does not fit is dropped instead.
+    /// </summary>
+    DropOldest = 1,
+
+    /// <summary>
+    /// Reallocates a larger buffer, up to the maximum capacity. Allocates and may briefly wait for the consumer,
+    /// so it is not suitable for real-time threads.
+    /// </summary>
+    Grow = 2
+};
+
+/// <summary>
+/// PullAudioInputStreamCallback fed from a single producer thread, typically a real-time audio capture callback,
+/// through a lock-free ring buffer. The producer never waits for the consumer (except under
+/// <see cref="RingBufferOverflowPolicy::Grow"/>) and only takes a lock, for a moment, to wake a consumer that is
+/// waiting for audio; the stream's Read() blocks until audio arrives.
+/// Pass it to <see cref="AudioInputStream::CreatePullStream"/>.
+/// </summary>
+/// <remarks>
+/// Exactly one thread may call <see cref="Write"/> and <see cref="SignalEndOfStream"/>, and exactly one thread
+/// (normally the Speech SDK) may call Read() or <see cref="ReadFor"/>. Telemetry getters may be called from any thread.
+/// </remarks>
+class RingBufferPullAudioInputStreamCallback : public PullAudioInputStreamCallback
+{
+public:
+
+    /// <summary>
+    /// Creates a ring buffer callback.
+    /// </summary>
+    /// <param name="capacity">Capacity in bytes; rounded up to a power of two.</param>
+    /// <param name="policy">What to do when the buffer is full.</param>
+    /// <param name="blockAlign">Size in bytes of one sample frame (all channels). Dropped audio is always whole frames.</param>
+    /// <param name="maxCapacity">Maximum capacity in bytes under <see cref="RingBufferOverflowPolicy::Grow"/>.</param>
+    /// <returns>A shared pointer to the callback.</returns>
+    static std::shared_ptr<RingBufferPullAudioInputStreamCallback> Create(size_t capacity, RingBufferOverflowPolicy policy = RingBufferOverflowPolicy::DropNewest, uint32_t blockAlign = 2, size_t maxCapacity = 64 * 1024 * 1024)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, capacity == 0 || blockAlign == 0 || capacity > maxCapacity);
+        return std::shared_ptr<RingBufferPullAudioInputStreamCallback>(new RingBufferPullAudioInputStreamCallback(capacity, policy, blockAlign, maxCapacity));
+    }
+
+    /// <summary>
+    /// Producer side. Copies audio into the ring buffer without blocking. Only whole sample frames are written.
+    /// </summary>
+    /// <param name="data">The audio data; must not contain an audio header.</param>
+    /// <param name="size">The size of the data in bytes.</param>
+    /// <returns>The number of bytes accepted; the rest was dropped according to the overflow policy.</returns>
+    size_t Write(const uint8_t* data, size_t size) noexcept
+    {
+        size -= size % m_blockAlign;
+        if (size == 0 || m_closed.load(std::memory_order_acquire) || m_endOfStream.load(std::memory_order_relaxed))
+        {
+            return 0;
+        }
+
+        auto head = m_head.load(std::memory_order_relaxed);
+        auto capacity = m_capacity.load(std::memory_order_relaxed);
+        auto available = capacity - (head - m_tail.load(std::memory_order_acquire));
+        auto requested = size;
+
+        if (size > available)
+        {
+            m_overflows.fetch_add(1, std::memory_order_relaxed);
+            switch (m_policy)
+            {
+            case RingBufferOverflowPolicy::DropOldest:
+                if (size > capacity)
+                {
+                    // Only the newest capacity's worth of this write can be kept.
+                    auto skip = size - AlignDown(capacity);
+                    data += skip;
+                    size -= skip;
+                    requested -= skip;
+                    m_discardedBytes.fetch_add(skip, std::memory_order_relaxed);
+                }
+                if (TryDiscardOldest(head, size - available))
+                {
+                    available = capacity - (head - m_tail.load(std::memory_order_acquire));
+                }
+                break;
+
+            case RingBufferOverflowPolicy::Grow:
+                if (TryGrow(head, head - m_tail.load(std::memory_order_acquire) + size))
+                {
+                    capacity = m_capacity.load(std::memory_order_relaxed);
+                    available = capacity - (head - m_tail.load(std::memory_order_acquire));
+                }
+                break;
+
+            case RingBufferOverflowPolicy::DropNewest:
+            default:
+                break;
+            }
+
+            if (size > available)
+            {
+                size = AlignDown(available);
+            }
+        }
+
+        if (requested > size)
+        {
+            m_droppedBytes.fetch_add(requested - size, std::memory_order_relaxed);
+        }
+
+        CopyIn(head, data, size);
+        m_head.store(head + size, std::memory_order_release);
+        m_writtenBytes.fetch_add(size, std::memory_order_relaxed);
+
+        auto fill = head + size - m_tail.load(std::memory_order_relaxed);
+        if (fill > m_peakFill.load(std::memory_order_relaxed))
+        {
+            m_peakFill.store(fill, std::memory_order_relaxed);
+        }
+
+        WakeConsumer();
+        return size;
+    }
+
+    /// <summary>
+    /// Producer side. Marks the end of the audio; Read() returns 0 once the buffered audio has been consumed.
+    /// </summary>
+    void SignalEndOfStream() noexcept
+    {
+        m_endOfStream.store(true, std::memory_order_release);
+        WakeConsumer();
+    }
+
+    /// <summary>
+    /// Consumer side. Copies buffered audio, waiting up to the timeout for audio to arrive.
+    /// </summary>
+    /// <param name="dataBuffer">The buffer to copy the audio into.</param>
+    /// <param name="size">The size of the buffer.</param>
+    /// <param name="timeout">Maximum time to wait when no audio is buffered.</param>
+    /// <returns>The number of bytes copied; 0 on timeout or at the end of the stream.</returns>
+    size_t ReadFor(uint8_t* dataBuffer, size_t size, std::chrono::milliseconds timeout)
+    {
+        return ReadUntil(dataBuffer, size, true, std::chrono::steady_clock::now() + timeout);
+    }
+
+    /// <summary>
+    /// Called by the stream to get audio. Blocks until audio is available, the producer signals the end of the
+    /// stream, or the stream is closed.
+    /// </summary>
+    /// <param name="dataBuffer">The buffer to copy the audio into.</param>
+    /// <param name="size">The size of the buffer.</param>
+    /// <returns>The number of bytes copied, or zero to indicate end of stream.</returns>
+    int Read(uint8_t* dataBuffer, uint32_t size) override
+    {
+        return static_cast<int>(ReadUntil(dataBuffer, std::min<size_t>(size, INT32_MAX), false, std::chrono::steady_clock::time_point()));
+    }
+
+    /// <summary>
+    /// Called by the stream when it is closed. Later writes are rejected and a blocked Read() returns.
+    /// </summary>
+    void Close() override
+    {
+        m_closed.store(true, std::memory_order_release);
+        WakeConsumer();
+    }
+
+    /// <summary>
+    /// Gets the number of bytes currently buffered.
+    /// </summary>
+    /// <returns>Fill level in bytes.</returns>
+    size_t GetFillLevel() const
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        auto head = m_head.load(std::memory_order_relaxed);
+        return head > tail ? head - tail : 0;
+    }
+
+    /// <summary>
+    /// Gets the highest fill level observed.
+    /// </summary>
+    /// <returns>Peak fill level in bytes.</returns>
+    size_t GetPeakFillLevel() const { return m_peakFill.load(std::memory_order_relaxed); }
+
+    /// <summary>
+    /// Gets the current capacity; it only changes under <see cref="RingBufferOverflowPolicy::Grow"/>.
+    /// </summary>
+    /// <returns>Capacity in bytes.</returns>
+    size_t GetCapacity() const { return m_capacity.load(std::memory_order_relaxed); }
+
+    /// <summary>
+    /// Gets the number of bytes accepted by <see cref="Write"/>.
+    /// </summary>
+    /// <returns>Number of bytes written.</returns>
+    uint64_t GetWrittenBytes() const { return m_writtenBytes.load(std::memory_order_relaxed); }
+
+    /// <summary>
+    /// Gets the number of new bytes that were not accepted because the buffer was full.
+    /// </summary>
+    /// <returns>Number of dropped bytes.</returns>
+    uint64_t GetDroppedBytes() const { return m_droppedBytes.load(std::memory_order_relaxed); }
+
+    /// <summary>
+    /// Gets the number of old bytes discarded under <see cref="RingBufferOverflowPolicy::DropOldest"/>.
+    /// </summary>
+    /// <returns>Number of discarded bytes.</returns>
+    uint64_t GetDiscardedBytes() const { return m_discardedBytes.load(std::memory_order_relaxed); }
+
+    /// <summary>
+    /// Gets the number of writes that found the buffer too full.
+    /// </summary>
+    /// <returns>Number of overflows.</returns>
+    uint64_t GetOverflowCount() const { return m_overflows.load(std::memory_order_relaxed); }
+
+private:
+
+    DISABLE_DEFAULT_CTORS(RingBufferPullAudioInputStreamCallback);
+
+    // Ownership of the buffer's read side. The consumer holds it while copying out; the producer only takes it
+    // (without waiting) to discard old audio, or (waiting) to grow, so the two never touch the same bytes.
+    enum : int { Idle = 0, ConsumerReading = 1, ProducerResizing = 2 };
+
+    static constexpr size_t CacheLineSize = 64;
+
+    // Attempts to take ownership by spinning, then by yielding, before falling back to short sleeps.
+    static constexpr uint32_t OwnerSpinAttempts = 64;
+    static constexpr uint32_t OwnerYieldAttempts = 256;
+
+    RingBufferPullAudioInputStreamCallback(size_t capacity, RingBufferOverflowPolicy policy, uint32_t blockAlign, size_t maxCapacity) :
+        m_policy(policy),
+        m_blockAlign(blockAlign),
+        m_maxCapacity(maxCapacity)
+    {
+        capacity = RoundUpToPowerOfTwo(capacity);
+        m_buffer.reset(new uint8_t[capacity]);
+        m_capacity.store(capacity, std::memory_order_relaxed);
+    }
+
+    static size_t RoundUpToPowerOfTwo(size_t value)
+    {
+        size_t result = 1;
+        while (result < value)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    size_t AlignDown(size_t size) const
+    {
+        return size - size % m_blockAlign;
+    }
+
+    void CopyIn(size_t head, const uint8_t* data, size_t size)
+    {
+        auto capacity = m_capacity.load(std::memory_order_relaxed);
+        auto offset = head & (capacity - 1);
+        auto first = std::min(size, capacity - offset);
+        std::memcpy(m_buffer.get() + offset, data, first);
+        std::memcpy(m_buffer.get(), data + first, size - first);
+    }
+
+    bool TryDiscardOldest(size_t head, size_t needed)
+    {
+        auto expected = static_cast<int>(Idle);
+        if (!m_owner.compare_exchange_strong(expected, ProducerResizing, std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        // Stream positions are absolute, so rounding up keeps the consumer on a frame boundary.
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        auto newTail = std::min(head, tail + needed + m_blockAlign - 1);
+        newTail -= newTail % m_blockAlign;
+        m_tail.store(newTail, std::memory_order_release);
+        m_discardedBytes.fetch_add(newTail - tail, std::memory_order_relaxed);
+
+        m_owner.store(Idle, std::memory_order_release);
+        return true;
+    }
+
+    bool TryGrow(size_t head, size_t needed) noexcept
+    {
+        auto capacity = m_capacity.load(std::memory_order_relaxed);
+        auto newCapacity = capacity;
+        while (newCapacity < needed && newCapacity < m_maxCapacity)
+        {
+            newCapacity <<= 1;
+        }
+        if (newCapacity == capacity || newCapacity > m_maxCapacity)
+        {
+            return false;
+        }
+
+        std::unique_ptr<uint8_t[]> buffer(new (std::nothrow) uint8_t[newCapacity]);
+        if (buffer == nullptr)
+        {
+            return false;
+        }
+
+        // A consumer read is a bounded copy, so waiting for it here is short.
+        AcquireOwnership(ProducerResizing);
+
+        // At most three contiguous pieces, split where either ring wraps; keeps the consumer's wait short in turn.
+        for (auto position = m_tail.load(std::memory_order_relaxed); position < head;)
+        {
+            auto from = position & (capacity - 1);
+            auto to = position & (newCapacity - 1);
+            auto count = std::min(head - position, std::min(capacity - from, newCapacity - to));
+            std::memcpy(buffer.get() + to, m_buffer.get() + from, count);
+            position += count;
+        }
+        m_buffer = std::move(buffer);
+        m_capacity.store(newCapacity, std::memory_order_relaxed);
+
+        m_owner.store(Idle, std::memory_order_release);
+        return true;
+    }
+
+    void AcquireOwnership(int owner) noexcept
+    {
+        // The other side holds ownership for a few instructions or one bounded copy (a reallocation under Grow).
+        for (uint32_t attempt = 0;; attempt++)
+        {
+            auto expected = static_cast<int>(Idle);
+            if (m_owner.compare_exchange_weak(expected, owner, std::memory_order_acquire))
+            {
+                return;
+            }
+            if (attempt >= OwnerSpinAttempts + OwnerYieldAttempts)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+            else if (attempt >= OwnerSpinAttempts)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    size_t ReadAvailable(uint8_t* dataBuffer, size_t size)
+    {
+        AcquireOwnership(ConsumerReading);
+
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        auto head = m_head.load(std::memory_order_acquire);
+        auto capacity = m_capacity.load(std::memory_order_relaxed);
+        auto count = std::min(size, head - tail);
+
+        auto offset = tail & (capacity - 1);
+        auto first = std::min(count, capacity - offset);
+        std::memcpy(dataBuffer, m_buffer.get() + offset, first);
+        std::memcpy(dataBuffer + first, m_buffer.get(), count - first);
+
+        m_tail.store(tail + count, std::memory_order_release);
+        m_owner.store(Idle, std::memory_order_release);
+        return count;
+    }
+
+    size_t ReadUntil(uint8_t* dataBuffer, size_t size, bool timed, std::chrono::steady_clock::time_point deadline)
+    {
+        for (;;)
+        {
+            if (size == 0)
+            {
+                return 0;
+            }
+
+            auto count = ReadAvailable(dataBuffer, size);
+            if (count > 0 || m_closed.load(std::memory_order_acquire))
+            {
+                return count;
+            }
+            if (m_endOfStream.load(std::memory_order_acquire))
+            {
+                // Audio written before the end of the stream was signalled is visible now.
+                return ReadAvailable(dataBuffer, size);
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if (timed && now >= deadline)
+            {
+                return 0;
+            }
+
+            std::unique_lock<std::mutex> lock(m_waitMutex);
+            m_consumerWaiting.store(true, std::memory_order_relaxed);
+
+            // Pairs with the fence in WakeConsumer: either the producer sees the consumer waiting, or the consumer
+            // sees the producer's audio (or end of stream) here.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto ready = [this]() { return GetFillLevel() > 0 || m_closed.load(std::memory_order_acquire) || m_endOfStream.load(std::memory_order_acquire); };
+            if (timed)
+            {
+                m_dataAvailable.wait_until(lock, deadline, ready);
+            }
+            else
+            {
+                m_dataAvailable.wait(lock, ready);
+            }
+            m_consumerWaiting.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    void WakeConsumer() noexcept
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_consumerWaiting.load(std::memory_order_relaxed))
+        {
+            // The consumer holds the mutex from checking the buffer until it waits, so taking the mutex here
+            // keeps the notification from landing in between and being lost.
+            {
+                std::lock_guard<std::mutex> lock(m_waitMutex);
+            }
+            m_dataAvailable.notify_one();
+        }
+    }
+
+    const RingBufferOverflowPolicy m_policy;
+    const uint32_t m_blockAlign;
+    const size_t m_maxCapacity;
+
+    std::unique_ptr<uint8_t[]> m_buffer;
+    std::atomic<size_t> m_capacity{ 0 };
+
+    // Producer and consumer positions are padded onto separate cache lines so the two threads do not contend.
+    // Padding rather than alignas, so that allocation does not depend on C++17 over-aligned new.
+    char m_padding0[CacheLineSize];
+    std::atomic<size_t> m_head{ 0 };
+    char m_padding1[CacheLineSize - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> m_tail{ 0 };
+    char m_padding2[CacheLineSize - sizeof(std::atomic<size_t>)];
+    std::atomic<int> m_owner{ Idle };
+    char m_padding3[CacheLineSize - sizeof(std::atomic<int>)];
+
+    std::atomic<size_t> m_peakFill{ 0 };
+    std::atomic<uint64_t> m_writtenBytes{ 0 };
+    std::atomic<uint64_t> m_droppedBytes{ 0 };
+    std::atomic<uint64_t> m_discardedBytes{ 0 };
+    std::atomic<uint64_t> m_overflows{ 0 };
+    std::atomic<bool> m_endOfStream{ false };
+    std::atomic<bool> m_closed{ false };
+
+    std::atomic<bool> m_consumerWaiting{ false };
+    std::mutex m_waitMutex;
+    std::condition_variable m_dataAvailable;
+};
+
+} } } } // Microsoft::CognitiveServices::Speech::Audio
@@ -0,0 +1,478 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_audio_voice_activity_gate.h: Public API declarations for VoiceActivityDetector and
+// PushAudioInputStreamVoiceGate, a client-side voice activity gate in front of a PushAudioInputStream
+//
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "speechapi_cxx_common.h"
+#include "speechapi_cxx_string_helpers.h"
+#include "speechapi_cxx_enums.h"
+#include "speechapi_cxx_audio_stream.h"
+#include "speechapi_cxx_audio_sample_converter.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+namespace Audio {
+
+/// <summary>
+/// Tuning of <see cref="VoiceActivityDetector"/> and <see cref="PushAudioInputStreamVoiceGate"/>.
+/// The defaults suit 16 kHz speech captured at normal levels.
+/// </summary>
+struct VoiceActivityGateOptions
+{
+    /// <summary>
+    /// Length of an analysis frame in milliseconds (1 to 100).
+    /// </summary>
+    uint32_t FrameMilliseconds = 10;
+
+    /// <summary>
+    /// Lowest frame energy, in dB relative to full scale, that can count as speech.
+    /// </summary>
+    double EnergyThresholdDb = -50.0;
+
+    /// <summary>
+    /// How far above the tracked noise floor, in dB, a frame must be to count as speech.
+    /// </summary>
+    double NoiseMarginDb = 10.0;
+
+    /// <summary>
+    /// Frames with at least this zero-crossing rate (crossings per sample) count as speech at
+    /// <see cref="FricativeMarginDb"/> less energy, so that quiet unvoiced sounds such as fricatives are kept.
+    /// </summary>
+    double FricativeZeroCrossingRate = 0.25;
+
+    /// <summary>
+    /// Energy allowance in dB for frames with a high zero-crossing rate. Keep it below <see cref="NoiseMarginDb"/>,
+    /// as white noise also has a high zero-crossing rate.
+    /// </summary>
+    double FricativeMarginDb = 4.0;
+
+    /// <summary>
+    /// How long the gate stays open after the last speech frame, in milliseconds.
+    /// </summary>
+    uint32_t HangoverMilliseconds = 300;
+
+    /// <summary>
+    /// How much audio before the first speech frame is sent when the gate opens, in milliseconds.
+    /// </summary>
+    uint32_t PreRollMilliseconds = 200;
+};
+
+/// <summary>
+/// Classifies fixed-size frames of 16 bit PCM audio as speech or non-speech from their energy and zero-crossing
+/// rate, against an adaptive noise floor.
+/// </summary>
+class VoiceActivityDetector
+{
+public:
+
+    /// <summary>
+    /// Creates a detector.
+    /// </summary>
+    /// <param name="format">Format of the audio; must be 16 bit integer PCM.</param>
+    /// <param name="options">Tuning options.</param>
+    /// <returns>A shared pointer to the detector.</returns>
+    static std::shared_ptr<VoiceActivityDetector> Create(const AudioSampleFormat& format, const VoiceActivityGateOptions& options = VoiceActivityGateOptions())
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, format.GetEncoding() != AudioSampleEncoding::Integer || format.GetBitsPerSample() != 16);
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, format.GetChannels() == 0 || format.GetSamplesPerSecond() == 0);
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, options.FrameMilliseconds == 0 || options.FrameMilliseconds > 100);
+
+        auto frames = static_cast<size_t>(format.GetSamplesPerSecond()) * options.FrameMilliseconds / 1000;
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, frames < 2);
+        return std::shared_ptr<VoiceActivityDetector>(new VoiceActivityDetector(format, options, frames));
+    }
+
+    /// <summary>
+    /// Gets the number of sample frames (one sample for every channel) per analysis frame.
+    /// </summary>
+    /// <returns>Sample frames per analysis frame.</returns>
+    size_t GetFrameLength() const { return m_frameLength; }
+
+    /// <summary>
+    /// Gets the currently tracked noise floor.
+    /// </summary>
+    /// <returns>Noise floor in dB relative to full scale.</returns>
+    double GetNoiseFloorDb() const { return m_noiseFloorDb; }
+
+    /// <summary>
+    /// Classifies one analysis frame and updates the noise floor.
+    /// </summary>
+    /// <param name="samples">Interleaved samples of <see cref="GetFrameLength"/> sample frames.</param>
+    /// <returns>true if the frame contains speech.</returns>
+    bool IsSpeech(const int16_t* samples)
+    {
+        auto channels = static_cast<size_t>(m_format.GetChannels());
+        auto count = m_frameLength * channels;
+
+        uint64_t energy = 0;
+        uint32_t crossings = 0;
+        Analyze(samples, count, channels, energy, crossings);
+
+        auto meanSquare = static_cast<double>(energy) / static_cast<double>(count) / (32768.0 * 32768.0);
+        auto levelDb = 10.0 * std::log10(meanSquare + 1e-12);
+        auto crossingRate = static_cast<double>(crossings) / static_cast<double>(count - channels);
+
+        auto threshold = std::max(m_options.EnergyThresholdDb, m_noiseFloorDb + m_options.NoiseMarginDb);
+        auto speech = levelDb >= threshold ||
+            (levelDb >= threshold - m_options.FricativeMarginDb && crossingRate >= m_options.FricativeZeroCrossingRate);
+
+        // Follow the noise floor down quickly and up slowly; during speech only creep up, so that a lasting rise
+        // in background noise is eventually absorbed.
+        auto rate = speech ? 0.001 : (levelDb < m_noiseFloorDb ? 0.2 : 0.02);
+        m_noiseFloorDb += (levelDb - m_noiseFloorDb) * rate;
+        return speech;
+    }
+
+private:
+
+    DISABLE_COPY_AND_MOVE(VoiceActivityDetector);
+
+    VoiceActivityDetector(const AudioSampleFormat& format, const VoiceActivityGateOptions& options, size_t frameLength) :
+        m_format(format),
+        m_options(options),
+        m_frameLength(frameLength),
+        m_noiseFloorDb(options.EnergyThresholdDb - options.NoiseMarginDb)
+    {
+    }
+
+    // Sums the squares of all samples and counts sign changes between each sample and the next one of the same channel.
+    static void Analyze(const int16_t* samples, size_t count, size_t stride, uint64_t& energy, uint32_t& crossings)
+    {
+        size_t i = 0;
+#if defined(SPX_CONFIG_AUDIO_AVX2)
+        __m256i zero = _mm256_setzero_si256();
+        __m256i sum = _mm256_setzero_si256();
+        __m256i signs = _mm256_setzero_si256();
+        for (; i + stride + 16 <= count; i += 16)
+        {
+            __m256i current = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i));
+            __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i + stride));
+            // Pairwise sums of squares fit in 32 bits when read as unsigned.
+            __m256i squares = _mm256_madd_epi16(current, current);
+            sum = _mm256_add_epi64(sum, _mm256_unpacklo_epi32(squares, zero));
+            sum = _mm256_add_epi64(sum, _mm256_unpackhi_epi32(squares, zero));
+            signs = _mm256_add_epi16(signs, _mm256_srli_epi16(_mm256_xor_si256(current, next), 15));
+        }
+        __m128i sum128 = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        sum128 = _mm_add_epi64(sum128, _mm_unpackhi_epi64(sum128, sum128));
+        uint64_t lanes[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum128);
+        energy = lanes[0];
+        __m256i signs32 = _mm256_madd_epi16(signs, _mm256_set1_epi16(1));
+        __m128i signs128 = _mm_add_epi32(_mm256_castsi256_si128(signs32), _mm256_extracti128_si256(signs32, 1));
+        signs128 = _mm_add_epi32(signs128, _mm_shuffle_epi32(signs128, _MM_SHUFFLE(1, 0, 3, 2)));
+        signs128 = _mm_add_epi32(signs128, _mm_shuffle_epi32(signs128, _MM_SHUFFLE(2, 3, 0, 1)));
+        crossings = static_cast<uint32_t>(_mm_cvtsi128_si32(signs128));
+#elif defined(SPX_CONFIG_AUDIO_SSE2)
+        __m128i zero = _mm_setzero_si128();
+        __m128i sum = _mm_setzero_si128();
+        __m128i signs = _mm_setzero_si128();
+        for (; i + stride + 8 <= count; i += 8)
+        {
+            __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+            __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i + stride));
+            // Pairwise sums of squares fit in 32 bits when read as unsigned.
+            __m128i squares = _mm_madd_epi16(current, current);
+            sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(squares, zero));
+            sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(squares, zero));
+            signs = _mm_add_epi16(signs, _mm_srli_epi16(_mm_xor_si128(current, next), 15));
+        }
+        sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+        uint64_t lanes[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+        energy = lanes[0];
+        __m128i signs32 = _mm_madd_epi16(signs, _mm_set1_epi16(1));
+        signs32 = _mm_add_epi32(signs32, _mm_shuffle_epi32(signs32, _MM_SHUFFLE(1, 0, 3, 2)));
+        signs32 = _mm_add_epi32(signs32, _mm_shuffle_epi32(signs32, _MM_SHUFFLE(2, 3, 0, 1)));
+        crossings = static_cast<uint32_t>(_mm_cvtsi128_si32(signs32));
+#elif defined(SPX_CONFIG_AUDIO_NEON)
+        uint64x2_t sum = vdupq_n_u64(0);
+        uint16x8_t signs = vdupq_n_u16(0);
+        for (; i + stride + 8 <= count; i += 8)
+        {
+            int16x8_t current = vld1q_s16(samples + i);
+            int16x8_t next = vld1q_s16(samples + i + stride);
+            sum = vpadalq_u32(sum, vreinterpretq_u32_s32(vmull_s16(vget_low_s16(current), vget_low_s16(current))));
+            sum = vpadalq_u32(sum, vreinterpretq_u32_s32(vmull_high_s16(current, current)));
+            signs = vaddq_u16(signs, vshrq_n_u16(vreinterpretq_u16_s16(veorq_s16(current, next)), 15));
+        }
+        energy = vaddvq_u64(sum);
+        crossings = vaddlvq_u16(signs);
+#else
+        energy = 0;
+        crossings = 0;
+#endif
+        for (; i < count; i++)
+        {
+            energy += static_cast<uint64_t>(static_cast<int32_t>(samples[i]) * samples[i]);
+            if (i + stride < count)
+            {
+                crossings += static_cast<uint32_t>((samples[i] ^ samples[i + stride]) < 0);
+            }
+        }
+    }
+
+    AudioSampleFormat m_format;
+    VoiceActivityGateOptions m_options;
+    size_t m_frameLength;
+    double m_noiseFloorDb;
+};
+
+/// <summary>
+/// Counters of a <see cref="PushAudioInputStreamVoiceGate"/> since it was created.
+/// </summary>
+struct VoiceActivityGateStatistics
+{
+    /// <summary>
+    /// Bytes of whole frames passed to Write.
+    /// </summary>
+    uint64_t BytesReceived = 0;
+
+    /// <summary>
+    /// Bytes written to the stream.
+    /// </summary>
+    uint64_t BytesWritten = 0;
+
+    /// <summary>
+    /// Bytes held back as non-speech and never written, i.e. the transport and recognition saved.
+    /// </summary>
+    uint64_t BytesSuppressed = 0;
+
+    /// <summary>
+    /// Number of times the gate opened.
+    /// </summary>
+    uint64_t SpeechSegments = 0;
+};
+
+/// <summary>
+/// Voice activity gate in front of a PushAudioInputStream: passes speech (with hangover and pre-roll) and suppresses
+/// stretches of non-speech. When audio resumes after a suppressed stretch, the stream's
+/// <see cref="PropertyId::DataBuffer_TimeStamp"/> is set to the position of the resumed audio, so the service
+/// timeline still matches the captured audio.
+/// </summary>
+/// <remarks>
+/// Write() and Close() must be called from one thread at a time; GetStatistics() may be called from any thread.
+/// </remarks>
+class PushAudioInputStreamVoiceGate
+{
+public:
+
+    /// <summary>
+    /// Creates a voice gate.
+    /// </summary>
+    /// <param name="stream">The stream to write to; it must have been created with <c>format.ToStreamFormat()</c>.</param>
+    /// <param name="format">Format of the audio; must be 16 bit integer PCM.</param>
+    /// <param name="options">Tuning options.</param>
+    /// <param name="baseTimestamp">Timestamp of the first sample passed to Write, in 90 kHz units.</param>
+    /// <returns>A shared pointer to the voice gate.</returns>
+    static std::shared_ptr<PushAudioInputStreamVoiceGate> Create(std::shared_ptr<PushAudioInputStream> stream, const AudioSampleFormat& format = AudioSampleFormat::GetDefaultInputFormat(), const VoiceActivityGateOptions& options = VoiceActivityGateOptions(), uint64_t baseTimestamp = 0)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, stream == nullptr);
+        return std::shared_ptr<PushAudioInputStreamVoiceGate>(new PushAudioInputStreamVoiceGate(std::move(stream), format, options, baseTimestamp));
+    }
+
+    /// <summary>
+    /// Analyzes the audio and writes the parts to keep to the stream. A trailing partial frame is kept until the next call.
+    /// </summary>
+    /// <param name="dataBuffer">Audio without any audio header.</param>
+    /// <param name="size">The size of the buffer in bytes.</param>
+    void Write(const uint8_t* dataBuffer, size_t size)
+    {
+        if (!m_partial.empty())
+        {
+            auto take = std::min(size, m_frameBytes - m_partial.size());
+            m_partial.insert(m_partial.end(), dataBuffer, dataBuffer + take);
+            dataBuffer += take;
+            size -= take;
+            if (m_partial.size() < m_frameBytes)
+            {
+                return;
+            }
+            ProcessFrame(m_partial.data());
+            m_partial.clear();
+        }
+
+        for (; size >= m_frameBytes; dataBuffer += m_frameBytes, size -= m_frameBytes)
+        {
+            ProcessFrame(dataBuffer);
+        }
+        m_partial.assign(dataBuffer, dataBuffer + size);
+        Flush();
+    }
+
+    /// <summary>
+    /// Closes the stream. Pending pre-roll audio and a trailing partial frame are dropped.
+    /// </summary>
+    void Close()
+    {
+        Flush();
+        m_bytesSuppressed.fetch_add(m_preRollCount * m_frameBytes, std::memory_order_relaxed);
+        m_preRollCount = 0;
+        m_partial.clear();
+        m_stream->Close();
+    }
+
+    /// <summary>
+    /// Indicates whether the gate is currently passing audio.
+    /// </summary>
+    /// <returns>true while speech or its hangover is being passed.</returns>
+    bool IsOpen() const { return m_open; }
+
+    /// <summary>
+    /// Gets the counters of this gate, e.g. to report the bytes saved per session.
+    /// </summary>
+    /// <returns>The statistics.</returns>
+    VoiceActivityGateStatistics GetStatistics() const
+    {
+        VoiceActivityGateStatistics statistics;
+        statistics.BytesReceived = m_bytesReceived.load(std::memory_order_relaxed);
+        statistics.BytesWritten = m_bytesWritten.load(std::memory_order_relaxed);
+        statistics.BytesSuppressed = m_bytesSuppressed.load(std::memory_order_relaxed);
+        statistics.SpeechSegments = m_speechSegments.load(std::memory_order_relaxed);
+        return statistics;
+    }
+
+    /// <summary>
+    /// Gets the stream written to.
+    /// </summary>
+    /// <returns>The stream.</returns>
+    std::shared_ptr<PushAudioInputStream> GetStream() const { return m_stream; }
+
+private:
+
+    DISABLE_COPY_AND_MOVE(PushAudioInputStreamVoiceGate);
+
+    PushAudioInputStreamVoiceGate(std::shared_ptr<PushAudioInputStream> stream, const AudioSampleFormat& format, const VoiceActivityGateOptions& options, uint64_t baseTimestamp) :
+        m_stream(std::move(stream)),
+        m_detector(VoiceActivityDetector::Create(format, options)),
+        m_samplesPerSecond(format.GetSamplesPerSecond()),
+        m_frameBytes(m_detector->GetFrameLength() * format.GetBlockAlign()),
+        m_hangoverFrames((options.HangoverMilliseconds + options.FrameMilliseconds - 1) / options.FrameMilliseconds),
+        m_preRollFrames((options.PreRollMilliseconds + options.FrameMilliseconds - 1) / options.FrameMilliseconds),
+        m_baseTimestamp(baseTimestamp),
+        m_frame(m_detector->GetFrameLength() * format.GetChannels()),
+        m_preRoll(m_preRollFrames * m_frameBytes)
+    {
+    }
+
+    void ProcessFrame(const uint8_t* frame)
+    {
+        m_bytesReceived.fetch_add(m_frameBytes, std::memory_order_relaxed);
+
+        // Copied so that the detector reads aligned samples whatever the alignment of the caller's buffer.
+        std::memcpy(m_frame.data(), frame, m_frameBytes);
+        auto open = m_detector->IsSpeech(m_frame.data());
+        if (open)
+        {
+            m_hangoverLeft = m_hangoverFrames;
+        }
+        else if (m_hangoverLeft > 0)
+        {
+            m_hangoverLeft--;
+            open = true;
+        }
+
+        if (open)
+        {
+            if (!m_open)
+            {
+                Resume();
+            }
+            m_pending.insert(m_pending.end(), frame, frame + m_frameBytes);
+        }
+        else
+        {
+            HoldBack(frame);
+        }
+        m_open = open;
+        m_position++;
+    }
+
+    void Resume()
+    {
+        m_speechSegments.fetch_add(1, std::memory_order_relaxed);
+        if (m_gap)
+        {
+            // The timestamp applies to the audio written after it, so earlier audio must go out first.
+            Flush();
+            auto samples = static_cast<uint64_t>(m_position - m_preRollCount) * m_detector->GetFrameLength();
+            m_stream->SetProperty(PropertyId::DataBuffer_TimeStamp, std::to_string(m_baseTimestamp + samples * 90000 / m_samplesPerSecond));
+            m_gap = false;
+        }
+
+        for (; m_preRollCount > 0; m_preRollCount--)
+        {
+            auto slot = (m_preRollNext + m_preRollFrames - m_preRollCount) % m_preRollFrames;
+            m_pending.insert(m_pending.end(), m_preRoll.data() + slot * m_frameBytes, m_preRoll.data() + (slot + 1) * m_frameBytes);
+        }
+    }
+
+    void HoldBack(const uint8_t* frame)
+    {
+        if (m_preRollFrames == 0)
+        {
+            m_bytesSuppressed.fetch_add(m_frameBytes, std::memory_order_relaxed);
+            m_gap = true;
+            return;
+        }
+
+        if (m_preRollCount == m_preRollFrames)
+        {
+            // The oldest held-back frame is overwritten and never sent.
+            m_bytesSuppressed.fetch_add(m_frameBytes, std::memory_order_relaxed);
+            m_gap = true;
+            m_preRollCount--;
+        }
+        std::memcpy(m_preRoll.data() + m_preRollNext * m_frameBytes, frame, m_frameBytes);
+        m_preRollNext = (m_preRollNext + 1) % m_preRollFrames;
+        m_preRollCount++;
+    }
+
+    void Flush()
+    {
+        if (!m_pending.empty())
+        {
+            m_stream->Write(m_pending.data(), static_cast<uint32_t>(m_pending.size()));
+            m_bytesWritten.fetch_add(m_pending.size(), std::memory_order_relaxed);
+            m_pending.clear();
+        }
+    }
+
+    std::shared_ptr<PushAudioInputStream> m_stream;
+    std::shared_ptr<VoiceActivityDetector> m_detector;
+    uint32_t m_samplesPerSecond;
+    size_t m_frameBytes;
+    size_t m_hangoverFrames;
+    size_t m_preRollFrames;
+    uint64_t m_baseTimestamp;
+
+    std::vector<int16_t> m_frame;
+    std::vector<uint8_t> m_partial;
+    std::vector<uint8_t> m_pending;
+    std::vector<uint8_t> m_preRoll;
+    size_t m_preRollNext = 0;
+    size_t m_preRollCount = 0;
+    size_t m_hangoverLeft = 0;
+    uint64_t m_position = 0;
+    bool m_open = false;
+    bool m_gap = false;
+
+    std::atomic<uint64_t> m_bytesReceived{ 0 };
+    std::atomic<uint64_t> m_bytesWritten{ 0 };
+    std::atomic<uint64_t> m_bytesSuppressed{ 0 };
+    std::atomic<uint64_t> m_speechSegments{ 0 };
+};
+
+} } } } // Microsoft::CognitiveServices::Speech::Audio
@@ -10,10 +10,14 @@
 #pragma once
 #include <algorithm>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "speechapi_cxx_eventsignalbase.h"
+#include "speechapi_cxx_eventsignal_coalescing.h"
 
 // TODO: TFS#3671067 - Vision: Consider moving majority of EventSignal to AI::Core::Details namespace, and refactoring Vision::Core::Events to inherit, and relay to private base
 
@@ -77,6 +81,24 @@ public:
     {
     }
 
+    /// <summary>
+    /// Destructor.
+    /// <summary>
+    ~EventSignal()
+    {
+        // Coalescing subscriptions may outlive the signal; make their Disconnect a no-op from now on.
+        std::shared_ptr<Lifetime> lifetime;
+        {
+            std::unique_lock<std::recursive_mutex> lock(m_mutex);
+            lifetime = m_lifetime;
+        }
+        if (lifetime != nullptr)
+        {
+            std::unique_lock<std::mutex> lock(lifetime->mutex);
+            lifetime->signal = nullptr;
+        }
+    }
+
     /// <summary>
     /// Addition assignment operator overload.
     /// Connects the provided callback <paramref name="callback"/> to the event signal, see also <see cref="Connect"/>.
@@ -110,18 +132,7 @@ public:
     /// <param name="callback">Callback to connect.</param>
     void Connect(CallbackFunction callback)
     {
-        std::unique_lock<std::recursive_mutex> lock(m_mutex);
-
-        auto shouldFireFirstConnected = m_callbacks.empty() && m_firstConnectedCallback != nullptr;
-
-        (void)EventSignalBase<T>::RegisterCallback(callback);
-
-        lock.unlock();
-
-        if (shouldFireFirstConnected)
-        {
-            m_firstConnectedCallback(*this);
-        }
+        (void)ConnectWithToken(callback);
     }
 
 #ifndef AZAC_CONFIG_CXX_NO_RTTI
@@ -130,6 +141,7 @@ public:
     /// <summary>
     /// <remarks>
     /// When the number of connected clients changes from one to zero, the disconnect callback will be called, if provided.
+    /// Returns once the callback is no longer running on other threads; see <see cref="EventSignalBase"/>.
     /// </remarks>
     /// <param name="callback">Callback function.</param>
     void Disconnect(CallbackFunction callback)
@@ -139,17 +151,20 @@ public:
         auto itMatchingCallback = std::find_if(
             m_callbacks.begin(),
             m_callbacks.end(),
-            [&](const std::pair<CallbackToken, CallbackFunction>& item)
+            [&](const typename decltype(m_callbacks)::value_type& item)
             {
-                return callback.target_type() == item.second.target_type();
+                return callback.target_type() == item.second->callback.target_type();
             });
 
-        auto removeHappened = EventSignal<T>::UnregisterCallback(itMatchingCallback->first);
-        lock.unlock();
-        if (removeHappened && m_callbacks.empty() && m_lastDisconnectedCallback != nullptr)
+        if (itMatchingCallback == m_callbacks.end())
         {
-            m_lastDisconnectedCallback(*this);
+            return;
         }
+
+        // Unregistration waits for running callbacks, which may themselves take m_mutex.
+        auto token = itMatchingCallback->first;
+        lock.unlock();
+        DisconnectToken(token);
     }
 #else
     void Disconnect(CallbackFunction)
@@ -161,16 +176,16 @@ public:
 #endif
 
     /// <summary>
-    /// Disconnects all registered callbacks.
+    /// Disconnects all registered callbacks, returning once none of them is running on other threads.
     /// </summary>
     void DisconnectAll()
     {
         std::unique_lock<std::recursive_mutex> lock(m_mutex);
         auto shouldFireLastDisconnected = !m_callbacks.empty() && m_lastDisconnectedCallback != nullptr;
 
-        EventSignal<T>::UnregisterAllCallbacks();
-
+        // Unregistration waits for running callbacks, which may themselves take m_mutex.
         lock.unlock();
+        EventSignal<T>::UnregisterAllCallbacks();
 
         if (shouldFireLastDisconnected)
         {
@@ -178,6 +193,90 @@ public:
         }
     }
 
+    /// <summary>
+    /// Returns a mark for the callbacks connected so far, to be passed to <see cref="DisconnectSince"/> later.
+    /// </summary>
+    /// <returns>The mark.</returns>
+    CallbackToken GetConnectionMark() const
+    {
+        std::unique_lock<std::recursive_mutex> lock(m_mutex);
+        return EventSignalBase<T>::m_nextCallbackToken;
+    }
+
+    /// <summary>
+    /// Disconnects the callbacks connected after <paramref name="mark"/> was taken, leaving earlier ones connected;
+    /// returns once none of them is running on other threads.
+    /// </summary>
+    /// <param name="mark">Mark returned by <see cref="GetConnectionMark"/>.</param>
+    void DisconnectSince(CallbackToken mark)
+    {
+        std::vector<CallbackToken> tokens;
+        {
+            std::unique_lock<std::recursive_mutex> lock(m_mutex);
+            for (auto it = m_callbacks.lower_bound(mark); it != m_callbacks.end(); ++it)
+            {
+                tokens.push_back(it->first);
+            }
+        }
+
+        // Unregistration waits for running callbacks, which may themselves take m_mutex.
+        for (auto token : tokens)
+        {
+            DisconnectToken(token);
+        }
+    }
+
+    /// <summary>
+    /// Connects a coalescing subscription to the event signal. Each event is projected to a key and a value on the
+    /// signalling thread; only the newest value per key is kept until the consumer collects it with
+    /// <see cref="CoalescingSubscription::Deliver"/> on its own thread.
+    /// </summary>
+    /// <remarks>
+    /// Use this for high-rate intermediate events (e.g. Recognizing) whose older values are worthless once a newer
+    /// one arrives; never for final events. The projection must copy whatever it needs out of the event arguments,
+    /// which are only valid during the call, e.g.
+    /// <c>recognizer->Recognizing.ConnectCoalescing&lt;uint64_t, std::shared_ptr&lt;SpeechRecognitionResult&gt;&gt;(
+    /// [](const SpeechRecognitionEventArgs&amp; e) { return std::make_pair(e.Result->Offset(), e.Result); });</c>
+    /// The subscription disconnects when its last reference is dropped, and may safely outlive the signal.
+    /// </remarks>
+    /// <param name="project">Function mapping the event arguments to a key and a value.</param>
+    /// <returns>The subscription.</returns>
+    template <class TKey, class TValue>
+    std::shared_ptr<CoalescingSubscription<TKey, TValue>> ConnectCoalescing(std::function<std::pair<TKey, TValue>(T eventArgs)> project)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, project == nullptr);
+
+        auto subscription = std::shared_ptr<CoalescingSubscription<TKey, TValue>>(new CoalescingSubscription<TKey, TValue>());
+        std::weak_ptr<CoalescingSubscription<TKey, TValue>> weakSubscription = subscription;
+
+        auto token = ConnectWithToken([weakSubscription, project](T eventArgs)
+        {
+            auto keepAlive = weakSubscription.lock();
+            if (keepAlive != nullptr)
+            {
+                auto item = project(eventArgs);
+                keepAlive->Push(std::move(item.first), std::move(item.second));
+            }
+        });
+
+        std::weak_ptr<Lifetime> weakLifetime = GetLifetime();
+        std::unique_lock<std::mutex> lock(subscription->m_mutex);
+        subscription->m_disconnect = [weakLifetime, token]()
+        {
+            auto lifetime = weakLifetime.lock();
+            if (lifetime != nullptr)
+            {
+                // Held across the disconnect so the signal cannot be destroyed underneath it.
+                std::unique_lock<std::mutex> lifetimeLock(lifetime->mutex);
+                if (lifetime->signal != nullptr)
+                {
+                    lifetime->signal->DisconnectToken(token);
+                }
+            }
+        };
+        return subscription;
+    }
+
     /// <summary>
     /// Signals the event with given arguments <paramref name="t"/> to all connected callbacks.
     /// <summary>
@@ -191,8 +290,54 @@ private:
     using EventSignalBase<T>::m_mutex;
     using EventSignalBase<T>::m_callbacks;
 
+    // Lets subscriptions that outlive the signal find out that it is gone.
+    struct Lifetime
+    {
+        std::mutex mutex;
+        EventSignal<T>* signal;
+    };
+
+    std::shared_ptr<Lifetime> GetLifetime()
+    {
+        std::unique_lock<std::recursive_mutex> lock(m_mutex);
+        if (m_lifetime == nullptr)
+        {
+            m_lifetime = std::make_shared<Lifetime>();
+            m_lifetime->signal = this;
+        }
+        return m_lifetime;
+    }
+
+    CallbackToken ConnectWithToken(CallbackFunction callback)
+    {
+        std::unique_lock<std::recursive_mutex> lock(m_mutex);
+
+        auto shouldFireFirstConnected = m_callbacks.empty() && m_firstConnectedCallback != nullptr;
+
+        auto token = EventSignalBase<T>::RegisterCallback(callback);
+
+        lock.unlock();
+
+        if (shouldFireFirstConnected)
+        {
+            m_firstConnectedCallback(*this);
+        }
+        return token;
+    }
+
+    void DisconnectToken(CallbackToken token)
+    {
+        auto removeHappened = EventSignalBase<T>::UnregisterCallback(token);
+
+        if (removeHappened && !EventSignalBase<T>::IsConnected() && m_lastDisconnectedCallback != nullptr)
+        {
+            m_lastDisconnectedCallback(*this);
+        }
+    }
+
     NotifyCallback_Type m_firstConnectedCallback;
     NotifyCallback_Type m_lastDisconnectedCallback;
+    std::shared_ptr<Lifetime> m_lifetime;
 
     EventSignal(const EventSignal&) = delete;
     EventSignal(const EventSignal&&) = delete;
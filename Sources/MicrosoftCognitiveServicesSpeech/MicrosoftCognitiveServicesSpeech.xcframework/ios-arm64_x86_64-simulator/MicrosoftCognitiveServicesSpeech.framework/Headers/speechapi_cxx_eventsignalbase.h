@@ -7,14 +7,20 @@
 
 #pragma once
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 // TODO: TFS#3671067 - Vision: Consider moving majority of EventSignal to AI::Core::Details namespace, and refactoring Vision::Core::Events to inherit, and relay to private base
 
 #include "speechapi_cxx_common.h"
+#include "speechapi_cxx_utils.h"
 
 namespace Microsoft {
 namespace CognitiveServices {
@@ -26,6 +32,11 @@ namespace Speech {
 /// <remarks>
 /// At construction time, connect and disconnect callbacks can be provided that are called when
 /// the number of connected clients changes from zero to one or one to zero, respectively.
+/// Registration and unregistration publish an immutable copy of the callback list; signalling an event
+/// reads the published list without taking a lock or allocating.
+/// Once unregistration returns, the removed callback is no longer running on any other thread. A callback may
+/// unregister itself or any other callback; it is never waited for by its own thread. Destroying the signal from
+/// inside one of its own callbacks is not supported.
 /// </remarks>
 // <typeparam name="T">
 template <class T>
@@ -36,7 +47,10 @@ public:
     /// Constructs an event signal with empty connect and disconnect actions.
     /// <summary>
     EventSignalBase() :
-        m_nextCallbackToken(0)
+        m_nextCallbackToken(0),
+        m_published(nullptr),
+        m_activeSignals(0),
+        m_hasRetired(false)
     {
     }
 
@@ -46,6 +60,12 @@ public:
     virtual ~EventSignalBase()
     {
         UnregisterAllCallbacks();
+
+        // Signals that started before the last unpublish may still be walking a retired list.
+        WaitUntil([this]() { return m_activeSignals == CountOnThisThread(this); });
+
+        std::unique_lock<std::recursive_mutex> lock(m_mutex);
+        ReclaimRetiredCallbackLists(0);
     }
 
     /// <summary>
@@ -77,7 +97,8 @@ public:
         auto token = m_nextCallbackToken;
         m_nextCallbackToken++;
 
-        m_callbacks.emplace(token, callback);
+        m_callbacks.emplace(token, std::make_shared<CallbackEntry>(token, std::move(callback)));
+        PublishCallbackList();
 
         return token;
     }
@@ -91,10 +112,31 @@ public:
     /// RegisterCallback at the time of registration.
     /// </param>
     /// <returns> A value indicating whether any callback was unregistered in response to this request. </returns>
+    /// <remarks>
+    /// Waits until the callback is no longer running on other threads, so the caller must not hold a lock the
+    /// callback may take.
+    /// </remarks>
     bool UnregisterCallback(CallbackToken token)
     {
-        std::unique_lock<std::recursive_mutex> lock(m_mutex);
-        return (bool)m_callbacks.erase(token);
+        std::shared_ptr<CallbackEntry> entry;
+        {
+            std::unique_lock<std::recursive_mutex> lock(m_mutex);
+
+            auto it = m_callbacks.find(token);
+            if (it == m_callbacks.end())
+            {
+                return false;
+            }
+
+            // Signals already in flight still hold the previous list; the flag stops them from calling this entry.
+            entry = it->second;
+            entry->connected = false;
+            m_callbacks.erase(it);
+            PublishCallbackList();
+        }
+
+        WaitForCallback(*entry);
+        return true;
     }
 
     /// <summary>
@@ -108,12 +150,26 @@ public:
     }
 
     /// <summary>
-    /// Unregisters all registered callbacks.
+    /// Unregisters all registered callbacks, waiting until none of them is running on other threads.
     /// <summary>
     void UnregisterAllCallbacks()
     {
-        std::unique_lock<std::recursive_mutex> lock(m_mutex);
-        m_callbacks.clear();
+        decltype(m_callbacks) callbacks;
+        {
+            std::unique_lock<std::recursive_mutex> lock(m_mutex);
+
+            for (auto& item : m_callbacks)
+            {
+                item.second->connected = false;
+            }
+            callbacks.swap(m_callbacks);
+            PublishCallbackList();
+        }
+
+        for (auto& item : callbacks)
+        {
+            WaitForCallback(*item.second);
+        }
     }
 
     /// <summary>
@@ -122,21 +178,32 @@ public:
     /// <param name="t">Event arguments to signal.</param>
     void Signal(T t)
     {
-        std::unique_lock<std::recursive_mutex> lock(m_mutex);
+        // The callback list published at entry stays alive until every signal that may have observed it returns.
+        m_activeSignals++;
+        auto signalCompleted = Utils::MakeScopeGuard([this]() { SignalCompleted(); });
 
-        auto callbacksSnapshot = m_callbacks;
-        for (auto callbackCopyPair : callbacksSnapshot)
+        auto callbacks = m_published.load();
+        if (callbacks == nullptr)
         {
-            // now, while a callback is in progress, it can disconnect itself and any other connected
-            // callback. Check to see if the next one stored in the copy container is still connected.
-            bool stillConnected = (std::find_if(m_callbacks.begin(), m_callbacks.end(),
-                [&](const std::pair<CallbackToken, CallbackFunction> item) {
-                return callbackCopyPair.first == item.first;
-            }) != m_callbacks.end());
+            return;
+        }
 
-            if (stillConnected)
+        auto& dispatching = DispatchingOnThisThread();
+        dispatching.push_back(this);
+        auto popSignal = Utils::MakeScopeGuard([&dispatching]() { dispatching.pop_back(); });
+
+        for (auto& entry : *callbacks)
+        {
+            // now, while a callback is in progress, it can disconnect itself and any other connected
+            // callback. Check to see if the next one stored in the published list is still connected.
+            // Counting the call before the check lets unregistration wait for calls that passed it.
+            entry->running++;
+            auto callCompleted = Utils::MakeScopeGuard([&entry]() { entry->running--; });
+            if (entry->connected)
             {
-                callbackCopyPair.second(t);
+                dispatching.push_back(entry.get());
+                auto popEntry = Utils::MakeScopeGuard([&dispatching]() { dispatching.pop_back(); });
+                entry->callback(t);
             }
         }
     }
@@ -152,11 +219,133 @@ public:
     }
 
 protected:
-    std::map<CallbackToken, CallbackFunction> m_callbacks;
+    /// <summary>
+    /// A registered callback. Entries are shared between successive published callback lists.
+    /// </summary>
+    struct CallbackEntry
+    {
+        CallbackEntry(CallbackToken token, CallbackFunction&& callback) :
+            token(token),
+            callback(std::move(callback)),
+            connected(true),
+            running(0)
+        {
+        }
+
+        const CallbackToken token;
+        const CallbackFunction callback;
+        std::atomic<bool> connected;
+        std::atomic<uint32_t> running;
+    };
+
+    std::map<CallbackToken, std::shared_ptr<CallbackEntry>> m_callbacks;
     CallbackToken m_nextCallbackToken;
     mutable std::recursive_mutex m_mutex;
 
 private:
+    using CallbackList = std::vector<std::shared_ptr<CallbackEntry>>;
+
+    // Must be called with m_mutex held.
+    void PublishCallbackList()
+    {
+        const CallbackList* callbacks = nullptr;
+        if (!m_callbacks.empty())
+        {
+            auto list = new CallbackList();
+            list->reserve(m_callbacks.size());
+            for (auto& item : m_callbacks)
+            {
+                list->push_back(item.second);
+            }
+            callbacks = list;
+        }
+
+        auto previous = m_published.exchange(callbacks);
+        if (previous != nullptr)
+        {
+            m_retired.push_back(previous);
+            m_hasRetired = true;
+        }
+
+        ReclaimRetiredCallbackLists(0);
+    }
+
+    // Must be called with m_mutex held. Every retired list was unpublished before this check, so once no
+    // signal other than the caller's own finished one is active, no signal can still be reading one of them.
+    void ReclaimRetiredCallbackLists(uint32_t ownSignals)
+    {
+        if (m_activeSignals != ownSignals)
+        {
+            return;
+        }
+
+        for (auto list : m_retired)
+        {
+            delete list;
+        }
+        m_retired.clear();
+        m_hasRetired = false;
+    }
+
+    void SignalCompleted()
+    {
+        if (m_hasRetired && m_activeSignals == 1)
+        {
+            // Never block the signalling thread; a concurrent writer or the destructor reclaims instead.
+            std::unique_lock<std::recursive_mutex> lock(m_mutex, std::try_to_lock);
+            if (lock.owns_lock())
+            {
+                ReclaimRetiredCallbackLists(1);
+            }
+        }
+
+        // Must be the last access to this object: the destructor may proceed as soon as the count drains.
+        m_activeSignals--;
+    }
+
+    // Waits until the entry is no longer running on other threads. Calls made by this thread are still on
+    // its stack (the caller is one of them), so they are excluded rather than waited for.
+    void WaitForCallback(const CallbackEntry& entry) const
+    {
+        WaitUntil([&entry]() { return entry.running == CountOnThisThread(&entry); });
+    }
+
+    // Unregistration while another thread is inside a callback is rare and callbacks are short, so this
+    // backs off from yielding to sleeping rather than adding a wakeup to every signal.
+    template <class Predicate>
+    static void WaitUntil(Predicate done)
+    {
+        for (int spins = 0; !done(); spins++)
+        {
+            if (spins < 64)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    static uint32_t CountOnThisThread(const void* item)
+    {
+        auto& dispatching = DispatchingOnThisThread();
+        return static_cast<uint32_t>(std::count(dispatching.begin(), dispatching.end(), item));
+    }
+
+    // Signals and callback entries currently being dispatched by this thread, innermost last.
+    static std::vector<const void*>& DispatchingOnThisThread()
+    {
+        static thread_local std::vector<const void*> dispatching;
+        return dispatching;
+    }
+
+    std::atomic<const CallbackList*> m_published;
+    std::atomic<uint32_t> m_activeSignals;
+    std::atomic<bool> m_hasRetired;
+    std::vector<const CallbackList*> m_retired;
+
     EventSignalBase(const EventSignalBase&) = delete;
     EventSignalBase(const EventSignalBase&&) = delete;
     EventSignalBase& operator=(const EventSignalBase&) = delete;
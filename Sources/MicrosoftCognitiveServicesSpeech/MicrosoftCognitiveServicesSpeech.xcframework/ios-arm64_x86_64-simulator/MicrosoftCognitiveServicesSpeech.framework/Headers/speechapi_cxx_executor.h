@@ -0,0 +1,380 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_executor.h: Public API declarations for Executor and ThreadPoolExecutor C++ classes
+//
+
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "speechapi_cxx_common.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+
+/// <summary>
+/// Runs the work behind the asynchronous methods of recognizers, synthesizers, connections, meetings and
+/// voice profile clients. Applications can provide their own implementation through <see cref="SetDefault"/>.
+/// </summary>
+/// <remarks>
+/// Unlike futures from std::async, the futures these methods return do not block in their destructor: a discarded
+/// future no longer waits for the operation, which keeps running (and keeps its object alive) until it completes.
+/// </remarks>
+class Executor
+{
+public:
+    /// <summary>
+    /// Work item type.
+    /// </summary>
+    using Work = std::function<void()>;
+
+    /// <summary>
+    /// Destructor.
+    /// </summary>
+    virtual ~Executor() = default;
+
+    /// <summary>
+    /// Schedules the work item to run. Must not run the work item on the calling thread.
+    /// </summary>
+    /// <param name="work">The work item.</param>
+    virtual void Post(Work work) = 0;
+
+    /// <summary>
+    /// Schedules a work item that spends most of its time blocked, e.g. waiting for the service to answer.
+    /// Such work may wait on other work posted to the same executor, so it must not keep that work from running.
+    /// The default implementation calls <see cref="Post"/>; executors with a bounded number of threads should
+    /// run blocking work outside that bound.
+    /// </summary>
+    /// <param name="work">The work item.</param>
+    virtual void PostBlocking(Work work)
+    {
+        Post(std::move(work));
+    }
+
+    /// <summary>
+    /// Gets the executor used by the asynchronous methods of the C++ API.
+    /// Unless replaced, this is a <see cref="ThreadPoolExecutor"/> shared by the whole process.
+    /// </summary>
+    /// <returns>The current default executor.</returns>
+    static std::shared_ptr<Executor> GetDefault();
+
+    /// <summary>
+    /// Replaces the executor used by asynchronous methods started after this call.
+    /// </summary>
+    /// <param name="executor">The new default executor, or nullptr to restore the built-in thread pool.</param>
+    static void SetDefault(std::shared_ptr<Executor> executor);
+
+protected:
+    /// <summary>
+    /// Default constructor.
+    /// </summary>
+    Executor() = default;
+
+private:
+    DISABLE_COPY_AND_MOVE(Executor);
+
+    static std::shared_ptr<Executor> CreateBuiltIn();
+
+    static std::mutex& DefaultMutex()
+    {
+        // Intentionally leaked so that asynchronous work still running at process exit does not touch destroyed statics.
+        static auto mutex = new std::mutex();
+        return *mutex;
+    }
+
+    static std::shared_ptr<Executor>& DefaultInstance()
+    {
+        static auto instance = new std::shared_ptr<Executor>(CreateBuiltIn());
+        return *instance;
+    }
+};
+
+/// <summary>
+/// Executor with a bounded number of worker threads. Workers are started on demand and exit after being idle
+/// for the given timeout, so bursts of short operations reuse threads instead of creating one per call.
+/// </summary>
+/// <remarks>
+/// Workers running work posted with <see cref="PostBlocking"/> do not count towards the bound, so work queued behind
+/// blocked workers (such as the callbacks they are waiting for) always gets a thread.
+/// </remarks>
+class ThreadPoolExecutor : public Executor
+{
+public:
+    /// <summary>
+    /// Creates a thread pool executor.
+    /// </summary>
+    /// <param name="maxThreads">Maximum number of worker threads not running blocking work. Work posted while all of them are busy is queued.</param>
+    /// <param name="idleTimeout">How long an idle worker waits for new work before exiting.</param>
+    /// <returns>A shared pointer to the new executor.</returns>
+    static std::shared_ptr<ThreadPoolExecutor> Create(uint32_t maxThreads = DefaultMaxThreads(), std::chrono::milliseconds idleTimeout = std::chrono::seconds(30))
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, maxThreads == 0);
+        return std::shared_ptr<ThreadPoolExecutor>(new ThreadPoolExecutor(maxThreads, idleTimeout));
+    }
+
+    /// <summary>
+    /// Destructor. Stops accepting work and returns without waiting; the workers run the work already queued,
+    /// then exit on their own. Safe to call from one of this executor's own work items.
+    /// </summary>
+    ~ThreadPoolExecutor()
+    {
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        m_state->stopping = true;
+        m_state->workAvailable.notify_all();
+    }
+
+    /// <summary>
+    /// Schedules the work item to run on a worker thread.
+    /// </summary>
+    /// <param name="work">The work item.</param>
+    void Post(Work work) override
+    {
+        Enqueue(std::move(work), false);
+    }
+
+    /// <summary>
+    /// Schedules a work item that mostly blocks on a worker thread that does not count towards the maximum.
+    /// </summary>
+    /// <param name="work">The work item.</param>
+    void PostBlocking(Work work) override
+    {
+        Enqueue(std::move(work), true);
+    }
+
+    /// <summary>
+    /// Gets the number of worker threads currently alive.
+    /// </summary>
+    /// <returns>Number of worker threads.</returns>
+    uint32_t GetThreadCount() const
+    {
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        return m_state->threads;
+    }
+
+    /// <summary>
+    /// Gets the number of worker threads started since this executor was created.
+    /// </summary>
+    /// <returns>Number of worker threads started.</returns>
+    uint64_t GetThreadsCreated() const
+    {
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        return m_state->threadsCreated;
+    }
+
+    /// <summary>
+    /// Gets the number of worker threads currently running blocking work.
+    /// </summary>
+    /// <returns>Number of blocked worker threads.</returns>
+    uint32_t GetBlockingCount() const
+    {
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        return m_state->blocking;
+    }
+
+    /// <summary>
+    /// Gets the number of work items waiting for a worker.
+    /// </summary>
+    /// <returns>Number of queued work items.</returns>
+    size_t GetQueueLength() const
+    {
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        return m_state->queue.size();
+    }
+
+    /// <summary>
+    /// Gets the default maximum number of worker threads.
+    /// </summary>
+    /// <remarks>
+    /// Asynchronous operations mostly block waiting on the service, so the default allows several workers per core.
+    /// </remarks>
+    /// <returns>The default maximum number of worker threads.</returns>
+    static uint32_t DefaultMaxThreads()
+    {
+        return std::max(16u, 8u * std::thread::hardware_concurrency());
+    }
+
+private:
+    DISABLE_DEFAULT_CTORS(ThreadPoolExecutor);
+
+    // Shared with the (detached) workers so they can drain and exit independently of the executor's lifetime.
+    struct State
+    {
+        std::mutex mutex;
+        std::condition_variable workAvailable;
+        std::deque<std::pair<Work, bool>> queue;
+        uint32_t maxThreads = 0;
+        uint32_t threads = 0;
+        uint32_t idle = 0;
+        uint32_t blocking = 0;
+        uint64_t threadsCreated = 0;
+        std::chrono::milliseconds idleTimeout{ 0 };
+        bool stopping = false;
+    };
+
+    ThreadPoolExecutor(uint32_t maxThreads, std::chrono::milliseconds idleTimeout) :
+        m_state(std::make_shared<State>())
+    {
+        m_state->maxThreads = maxThreads;
+        m_state->idleTimeout = idleTimeout;
+    }
+
+    void Enqueue(Work work, bool blocking)
+    {
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        SPX_THROW_HR_IF(SPXERR_INVALID_STATE, m_state->stopping);
+
+        m_state->queue.emplace_back(std::move(work), blocking);
+        if (m_state->queue.size() <= m_state->idle)
+        {
+            m_state->workAvailable.notify_one();
+        }
+        else if (blocking || m_state->threads - m_state->blocking < m_state->maxThreads)
+        {
+            // Blocking work always gets a thread; it would otherwise sit behind work that may be waiting for it.
+            try
+            {
+                StartWorkerLocked(m_state);
+            }
+            catch (...)
+            {
+                m_state->queue.pop_back();
+                throw;
+            }
+        }
+    }
+
+    static void StartWorkerLocked(const std::shared_ptr<State>& state)
+    {
+        // Count the worker before it starts so that concurrent posts do not overshoot the limit.
+        state->threads++;
+        state->threadsCreated++;
+        try
+        {
+            std::thread([state]() { WorkerLoop(state); }).detach();
+        }
+        catch (...)
+        {
+            // Queued work is still run by the existing workers; only fail when there are none.
+            state->threads--;
+            if (state->threads == 0)
+            {
+                throw;
+            }
+        }
+    }
+
+    static void WorkerLoop(std::shared_ptr<State> state)
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        for (;;)
+        {
+            if (state->queue.empty())
+            {
+                if (state->stopping)
+                {
+                    break;
+                }
+
+                state->idle++;
+                auto hasWork = state->workAvailable.wait_for(lock, state->idleTimeout, [&state] { return !state->queue.empty() || state->stopping; });
+                state->idle--;
+                if (!hasWork)
+                {
+                    break;
+                }
+                continue;
+            }
+
+            auto work = std::move(state->queue.front().first);
+            auto blocking = state->queue.front().second;
+            state->queue.pop_front();
+            if (blocking)
+            {
+                // This worker leaves the bound while it blocks; hand its place to queued work that has no worker.
+                state->blocking++;
+                if (state->queue.size() > state->idle && state->threads - state->blocking < state->maxThreads)
+                {
+                    StartWorkerLocked(state);
+                }
+            }
+
+            lock.unlock();
+            try
+            {
+                work();
+            }
+            catch (...)
+            {
+                // Work items report failures through their own futures; never let one take down a worker.
+            }
+            work = nullptr;
+            lock.lock();
+            if (blocking)
+            {
+                state->blocking--;
+            }
+        }
+
+        state->threads--;
+    }
+
+    std::shared_ptr<State> m_state;
+};
+
+inline std::shared_ptr<Executor> Executor::GetDefault()
+{
+    std::unique_lock<std::mutex> lock(DefaultMutex());
+    return DefaultInstance();
+}
+
+inline void Executor::SetDefault(std::shared_ptr<Executor> executor)
+{
+    if (executor == nullptr)
+    {
+        executor = CreateBuiltIn();
+    }
+
+    // The previous executor may be the last reference; release it after unlocking, in case its destructor
+    // (or a work item it still owns) calls back into GetDefault.
+    std::unique_lock<std::mutex> lock(DefaultMutex());
+    std::swap(DefaultInstance(), executor);
+    lock.unlock();
+    executor = nullptr;
+}
+
+inline std::shared_ptr<Executor> Executor::CreateBuiltIn()
+{
+    return ThreadPoolExecutor::Create();
+}
+
+namespace Utils {
+
+/// <summary>
+/// Runs the function on the default executor as blocking work and returns a future for its result, in place of std::async.
+/// Unlike with std::async, the returned future does not wait for the function in its destructor.
+/// </summary>
+/// <param name="fn">The function to run.</param>
+/// <returns>A future that becomes ready with the function's result or exception.</returns>
+template<typename F>
+std::future<decltype(std::declval<F&>()())> RunAsync(F fn)
+{
+    using Result = decltype(fn());
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::move(fn));
+    auto future = task->get_future();
+    Executor::GetDefault()->PostBlocking([task]() { (*task)(); });
+    return future;
+}
+
+} // Utils
+
+} } } // Microsoft::CognitiveServices::Speech
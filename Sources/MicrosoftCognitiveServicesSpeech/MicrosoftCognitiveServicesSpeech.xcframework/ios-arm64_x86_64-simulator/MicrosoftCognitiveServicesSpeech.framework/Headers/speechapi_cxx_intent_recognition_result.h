@@ -37,7 +37,7 @@ public:
         IntentId(m_intentId)
     {
         PopulateIntentFields(hresult, &m_intentId);
-        SPX_DBG_TRACE_VERBOSE("%s (this=0x%p, handle=0x%p) -- resultid=%s; reason=0x%x; text=%s", __FUNCTION__, (void*)this, (void*)Handle, Utils::ToUTF8(ResultId).c_str(), Reason, Utils::ToUTF8(Text).c_str());
+        SPX_DBG_TRACE_VERBOSE("%s (this=0x%p, handle=0x%p) -- resultid=%s; reason=0x%x; text=%s", __FUNCTION__, (void*)this, (void*)Handle, Utils::ToUTF8(GetResultId()).c_str(), Reason, Utils::ToUTF8(GetText()).c_str());
     }
 
     /// <summary>
@@ -9,6 +9,8 @@
 #include <future>
 #include <memory>
 #include "speechapi_cxx_common.h"
+#include "speechapi_cxx_async_operation.h"
+#include "speechapi_cxx_executor.h"
 #include "speechapi_cxx_properties.h"
 #include "speechapi_cxx_eventsignal.h"
 #include "speechapi_cxx_recognizer.h"
@@ -62,6 +64,75 @@ public:
     /// <returns>An empty future.</returns>
     virtual std::future<void> StopKeywordRecognitionAsync() = 0;
 
+    /// <summary>
+    /// Performs recognition without blocking a thread while waiting for the result.
+    /// </summary>
+    /// <remarks>
+    /// The result is picked up by polling, which adds up to the reactor's maximum poll interval (16 ms by default)
+    /// of latency; <see cref="RecognizeOnceAsync"/> waits for it on a thread instead.
+    /// </remarks>
+    /// <returns>An operation that completes with the result of the recognition.</returns>
+    AsyncOperation<std::shared_ptr<RecoResult>> RecognizeOnceAsyncOperation()
+    {
+        auto keepAlive = this->shared_from_this();
+        auto hasync = std::make_shared<SPXASYNCHANDLE>(SPXHANDLE_INVALID);
+        auto hresult = std::make_shared<SPXRESULTHANDLE>(SPXHANDLE_INVALID);
+
+        return AsyncReactor::GetDefault()->Run<std::shared_ptr<RecoResult>>(
+            [this, hasync]() { SPX_THROW_ON_FAIL(recognizer_recognize_once_async(m_hreco, hasync.get())); },
+            [hasync, hresult]() { return recognizer_recognize_once_async_wait_for(*hasync, 0, hresult.get()); },
+            [keepAlive, hasync, hresult](SPXHR hr) {
+                SPX_REPORT_ON_FAIL(recognizer_async_handle_release(*hasync));
+                SPX_THROW_ON_FAIL(hr);
+                return std::make_shared<RecoResult>(*hresult);
+            });
+    }
+
+    /// <summary>
+    /// Initiates continuous recognition without blocking a thread while waiting for it to start.
+    /// </summary>
+    /// <returns>An operation that completes once recognition has started.</returns>
+    AsyncOperation<void> StartContinuousRecognitionAsyncOperation()
+    {
+        return RunRecognizerOperation(
+            [this](SPXASYNCHANDLE* phasync) { return recognizer_start_continuous_recognition_async(m_hreco, phasync); },
+            recognizer_start_continuous_recognition_async_wait_for);
+    }
+
+    /// <summary>
+    /// Terminates continuous recognition without blocking a thread while waiting for it to stop.
+    /// </summary>
+    /// <returns>An operation that completes once recognition has stopped.</returns>
+    AsyncOperation<void> StopContinuousRecognitionAsyncOperation()
+    {
+        return RunRecognizerOperation(
+            [this](SPXASYNCHANDLE* phasync) { return recognizer_stop_continuous_recognition_async(m_hreco, phasync); },
+            recognizer_stop_continuous_recognition_async_wait_for);
+    }
+
+    /// <summary>
+    /// Initiates keyword recognition without blocking a thread while waiting for it to start.
+    /// </summary>
+    /// <param name="model">The keyword recognition model that specifies the keyword to be recognized.</param>
+    /// <returns>An operation that completes once keyword recognition has started.</returns>
+    AsyncOperation<void> StartKeywordRecognitionAsyncOperation(std::shared_ptr<KeywordRecognitionModel> model)
+    {
+        return RunRecognizerOperation(
+            [this, model](SPXASYNCHANDLE* phasync) { return recognizer_start_keyword_recognition_async(m_hreco, (SPXKEYWORDHANDLE)(*model.get()), phasync); },
+            recognizer_start_keyword_recognition_async_wait_for);
+    }
+
+    /// <summary>
+    /// Terminates keyword recognition without blocking a thread while waiting for it to stop.
+    /// </summary>
+    /// <returns>An operation that completes once keyword recognition has stopped.</returns>
+    AsyncOperation<void> StopKeywordRecognitionAsyncOperation()
+    {
+        return RunRecognizerOperation(
+            [this](SPXASYNCHANDLE* phasync) { return recognizer_stop_keyword_recognition_async(m_hreco, phasync); },
+            recognizer_stop_keyword_recognition_async_wait_for);
+    }
+
     /// <summary>
     /// Signal for events indicating the start of a recognition session (operation).
     /// </summary>
@@ -113,12 +184,7 @@ protected:
         Recognizing(GetRecoEventConnectionsChangedCallback()),
         Recognized(GetRecoEventConnectionsChangedCallback()),
         Canceled(GetRecoCanceledEventConnectionsChangedCallback()),
-        m_properties(hreco),
-        m_hasyncRecognize(SPXHANDLE_INVALID),
-        m_hasyncStartContinuous(SPXHANDLE_INVALID),
-        m_hasyncStopContinuous(SPXHANDLE_INVALID),
-        m_hasyncStartKeyword(SPXHANDLE_INVALID),
-        m_hasyncStopKeyword(SPXHANDLE_INVALID)
+        m_properties(hreco)
     {
         SPX_DBG_TRACE_SCOPE(__FUNCTION__, __FUNCTION__);
     };
@@ -142,16 +208,6 @@ protected:
         SessionStopped.DisconnectAll();
         SessionStarted.DisconnectAll();
 
-        // Close the async handles we have open for Recognize, StartContinuous, and StopContinuous
-        for (auto handle : { &m_hasyncRecognize, &m_hasyncStartContinuous, &m_hasyncStopContinuous })
-        {
-            if (*handle != SPXHANDLE_INVALID && ::recognizer_async_handle_is_valid(*handle))
-            {
-                ::recognizer_async_handle_release(*handle);
-                *handle = SPXHANDLE_INVALID;
-            }
-        }
-
         // Ask the base to term
         Recognizer::TermRecognizer();
     }
@@ -159,7 +215,7 @@ protected:
     std::future<std::shared_ptr<RecoResult>> RecognizeOnceAsyncInternal()
     {
         auto keepAlive = this->shared_from_this();
-        auto future = std::async(std::launch::async, [keepAlive, this]() -> std::shared_ptr<RecoResult> {
+        auto future = Utils::RunAsync([keepAlive, this]() -> std::shared_ptr<RecoResult> {
             SPX_INIT_HR(hr);
 
             SPXRESULTHANDLE hresult = SPXHANDLE_INVALID;
@@ -173,87 +229,22 @@ protected:
 
     std::future<void> StartContinuousRecognitionAsyncInternal()
     {
-        auto keepAlive = this->shared_from_this();
-        auto future = std::async(std::launch::async, [keepAlive, this]() -> void {
-            SPX_INIT_HR(hr);
-            SPX_THROW_ON_FAIL(hr = recognizer_async_handle_release(m_hasyncStartContinuous)); // close any unfinished previous attempt
-
-            SPX_EXITFN_ON_FAIL(hr = recognizer_start_continuous_recognition_async(m_hreco, &m_hasyncStartContinuous));
-            SPX_EXITFN_ON_FAIL(hr = recognizer_start_continuous_recognition_async_wait_for(m_hasyncStartContinuous, UINT32_MAX));
-
-            SPX_EXITFN_CLEANUP:
-            auto releaseHr = recognizer_async_handle_release(m_hasyncStartContinuous);
-            SPX_REPORT_ON_FAIL(releaseHr);
-            m_hasyncStartContinuous = SPXHANDLE_INVALID;
-
-            SPX_THROW_ON_FAIL(hr);
-        });
-
-        return future;
+        return StartContinuousRecognitionAsyncOperation().ToFuture();
     };
 
     std::future<void> StopContinuousRecognitionAsyncInternal()
     {
-        auto keepAlive = this->shared_from_this();
-        auto future = std::async(std::launch::async, [keepAlive, this]() -> void {
-            SPX_INIT_HR(hr);
-            SPX_THROW_ON_FAIL(hr = recognizer_async_handle_release(m_hasyncStopContinuous)); // close any unfinished previous attempt
-
-            SPX_EXITFN_ON_FAIL(hr = recognizer_stop_continuous_recognition_async(m_hreco, &m_hasyncStopContinuous));
-            SPX_EXITFN_ON_FAIL(hr = recognizer_stop_continuous_recognition_async_wait_for(m_hasyncStopContinuous, UINT32_MAX));
-
-        SPX_EXITFN_CLEANUP:
-            auto releaseHr = recognizer_async_handle_release(m_hasyncStopContinuous);
-            SPX_REPORT_ON_FAIL(releaseHr);
-            m_hasyncStopContinuous = SPXHANDLE_INVALID;
-
-            SPX_THROW_ON_FAIL(hr);
-        });
-
-        return future;
+        return StopContinuousRecognitionAsyncOperation().ToFuture();
     }
 
     std::future<void> StartKeywordRecognitionAsyncInternal(std::shared_ptr<KeywordRecognitionModel> model)
     {
-        auto keepAlive = this->shared_from_this();
-        auto future = std::async(std::launch::async, [keepAlive, model, this]() -> void {
-            SPX_INIT_HR(hr);
-            SPX_THROW_ON_FAIL(hr = recognizer_async_handle_release(m_hasyncStartKeyword)); // close any unfinished previous attempt
-
-            auto hkeyword = (SPXKEYWORDHANDLE)(*model.get());
-            SPX_EXITFN_ON_FAIL(hr = recognizer_start_keyword_recognition_async(m_hreco, hkeyword, &m_hasyncStartKeyword));
-            SPX_EXITFN_ON_FAIL(hr = recognizer_start_keyword_recognition_async_wait_for(m_hasyncStartKeyword, UINT32_MAX));
-
-            SPX_EXITFN_CLEANUP:
-            auto releaseHr = recognizer_async_handle_release(m_hasyncStartKeyword);
-            SPX_REPORT_ON_FAIL(releaseHr);
-            m_hasyncStartKeyword = SPXHANDLE_INVALID;
-
-            SPX_THROW_ON_FAIL(hr);
-        });
-
-        return future;
+        return StartKeywordRecognitionAsyncOperation(model).ToFuture();
     };
 
     std::future<void> StopKeywordRecognitionAsyncInternal()
     {
-        auto keepAlive = this->shared_from_this();
-        auto future = std::async(std::launch::async, [keepAlive, this]() -> void {
-            SPX_INIT_HR(hr);
-            SPX_THROW_ON_FAIL(hr = recognizer_async_handle_release(m_hasyncStopKeyword)); // close any unfinished previous attempt
-
-            SPX_EXITFN_ON_FAIL(hr = recognizer_stop_keyword_recognition_async(m_hreco, &m_hasyncStopKeyword));
-            SPX_EXITFN_ON_FAIL(hr = recognizer_stop_keyword_recognition_async_wait_for(m_hasyncStopKeyword, UINT32_MAX));
-
-            SPX_EXITFN_CLEANUP:
-            auto releaseHr = recognizer_async_handle_release(m_hasyncStopKeyword);
-            SPX_REPORT_ON_FAIL(releaseHr);
-            m_hasyncStartKeyword = SPXHANDLE_INVALID;
-
-            SPX_THROW_ON_FAIL(hr);
-        });
-
-        return future;
+        return StopKeywordRecognitionAsyncOperation().ToFuture();
     };
 
     virtual void RecoEventConnectionsChanged(const EventSignal<const RecoEventArgs&>& recoEvent)
@@ -428,12 +419,6 @@ protected:
 
     PrivatePropertyCollection m_properties;
 
-    SPXASYNCHANDLE m_hasyncRecognize;
-    SPXASYNCHANDLE m_hasyncStartContinuous;
-    SPXASYNCHANDLE m_hasyncStopContinuous;
-    SPXASYNCHANDLE m_hasyncStartKeyword;
-    SPXASYNCHANDLE m_hasyncStopKeyword;
-
     template <typename Handle, typename Config>
     static Handle HandleOrInvalid(std::shared_ptr<Config> audioInput)
     {
@@ -446,6 +431,21 @@ protected:
 
 private:
 
+    template <class Start>
+    AsyncOperation<void> RunRecognizerOperation(Start start, SPXHR(SPXAPI_CALLTYPE* waitFor)(SPXASYNCHANDLE, uint32_t))
+    {
+        auto keepAlive = this->shared_from_this();
+        auto hasync = std::make_shared<SPXASYNCHANDLE>(SPXHANDLE_INVALID);
+
+        return AsyncReactor::GetDefault()->Run<void>(
+            [start, hasync]() { SPX_THROW_ON_FAIL(start(hasync.get())); },
+            [waitFor, hasync]() { return waitFor(*hasync, 0); },
+            [keepAlive, hasync](SPXHR hr) {
+                SPX_REPORT_ON_FAIL(recognizer_async_handle_release(*hasync));
+                SPX_THROW_ON_FAIL(hr);
+            });
+    }
+
     DISABLE_DEFAULT_CTORS(AsyncRecognizer);
 
     inline std::function<void(const EventSignal<const SessionEventArgs&>&)> GetSessionEventConnectionsChangedCallback()
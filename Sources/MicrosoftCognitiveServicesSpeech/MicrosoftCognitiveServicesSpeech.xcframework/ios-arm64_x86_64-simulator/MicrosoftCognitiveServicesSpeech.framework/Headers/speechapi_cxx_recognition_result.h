@@ -6,6 +6,8 @@
 //
 
 #pragma once
+#include <cstring>
+#include <mutex>
 #include <string>
 #include "speechapi_cxx_common.h"
 #include "speechapi_cxx_string_helpers.h"
@@ -14,6 +16,10 @@
 #include "speechapi_c_recognizer.h"
 #include "speechapi_c_result.h"
 
+// Defining SPX_CONFIG_CXX_LAZY_RESULT_FIELDS removes the eagerly populated RecognitionResult::ResultId and
+// RecognitionResult::Text members; the result id and text are then only fetched when GetResultId()/GetText()
+// (or ResultIdView()/TextView()) are first called, so results whose text is never read cost no string copies.
+
 
 namespace Microsoft {
 namespace CognitiveServices {
@@ -58,20 +64,59 @@ public:
         m_hresult = SPXHANDLE_INVALID;
     };
 
+#ifndef SPX_CONFIG_CXX_LAZY_RESULT_FIELDS
     /// <summary>
     /// Unique result id.
     /// </summary>
     const SPXSTRING& ResultId;
+#endif
 
     /// <summary>
     /// Recognition reason.
     /// </summary>
     const Speech::ResultReason& Reason;
 
+#ifndef SPX_CONFIG_CXX_LAZY_RESULT_FIELDS
     /// <summary>
     /// Normalized text generated by a speech recognition engine from recognized input.
     /// </summary>
     const SPXSTRING& Text;
+#endif
+
+    /// <summary>
+    /// Unique result id. Fetched on first access unless already populated for <see cref="ResultId"/>.
+    /// </summary>
+    /// <returns>The result id, owned by the result.</returns>
+    const SPXSTRING& GetResultId() const
+    {
+        std::call_once(m_resultIdFetched, [this] { GetResultString(m_hresult, result_get_result_id, m_resultId); });
+        return m_resultId;
+    }
+
+    /// <summary>
+    /// Normalized text generated by a speech recognition engine from recognized input.
+    /// Fetched on first access unless already populated for <see cref="Text"/>.
+    /// </summary>
+    /// <returns>The text, owned by the result.</returns>
+    const SPXSTRING& GetText() const
+    {
+        std::call_once(m_textFetched, [this] { GetResultString(m_hresult, result_get_text, m_text); });
+        return m_text;
+    }
+
+#ifdef SPX_CONFIG_CXX_STRING_VIEW
+    /// <summary>
+    /// Unique result id, as a view over a buffer owned by the result. See <see cref="GetResultId"/>.
+    /// </summary>
+    /// <returns>View that is valid as long as the result.</returns>
+    std::string_view ResultIdView() const { return GetResultId(); }
+
+    /// <summary>
+    /// Recognized text, as a view over a buffer owned by the result. See <see cref="GetText"/>.
+    /// </summary>
+    /// <returns>View that is valid as long as the result.</returns>
+    std::string_view TextView() const { return GetText(); }
+#endif
 
     /// <summary>
     /// Duration of recognized speech in ticks.
@@ -105,14 +150,22 @@ protected:
 
     explicit RecognitionResult(SPXRESULTHANDLE hresult) :
         m_properties(hresult),
+#ifndef SPX_CONFIG_CXX_LAZY_RESULT_FIELDS
         ResultId(m_resultId),
+#endif
         Reason(m_reason),
+#ifndef SPX_CONFIG_CXX_LAZY_RESULT_FIELDS
         Text(m_text),
+#endif
         Properties(m_properties),
         Handle(m_hresult),
         m_hresult(hresult)
     {
-        PopulateResultFields(hresult, &m_resultId, &m_reason, &m_text);
+        PopulateResultFields(hresult, &m_reason);
+#ifndef SPX_CONFIG_CXX_LAZY_RESULT_FIELDS
+        (void)GetResultId();
+        (void)GetText();
+#endif
     }
 
     const SPXRESULTHANDLE& Handle;
@@ -123,20 +176,13 @@ private:
 
     DISABLE_DEFAULT_CTORS(RecognitionResult);
 
-    void PopulateResultFields(SPXRESULTHANDLE hresult, SPXSTRING* resultId, Speech::ResultReason* reason, SPXSTRING* text)
+    using ResultStringGetter = SPXAPI_RESULTTYPE(SPXAPI_CALLTYPE*)(SPXRESULTHANDLE hresult, char* psz, uint32_t cch);
+
+    void PopulateResultFields(SPXRESULTHANDLE hresult, Speech::ResultReason* reason)
     {
 
         SPX_INIT_HR(hr);
 
-        const size_t maxCharCount = 2048;
-        char sz[maxCharCount + 1] = {};
-
-        if (resultId != nullptr)
-        {
-            SPX_THROW_ON_FAIL(hr = result_get_result_id(hresult, sz, maxCharCount));
-            *resultId = Utils::ToSPXString(sz);
-        }
-
         if (reason != nullptr)
         {
             Result_Reason resultReason;
@@ -144,21 +190,59 @@ private:
             *reason = (Speech::ResultReason)resultReason;
         }
 
-        if (text != nullptr)
+        SPX_THROW_ON_FAIL(hr = result_get_offset(hresult, &m_offset));
+        SPX_THROW_ON_FAIL(hr = result_get_duration(hresult, &m_duration));
+    }
+
+    static void GetResultString(SPXRESULTHANDLE hresult, ResultStringGetter getter, SPXSTRING& value)
+    {
+        // Most strings fit the stack buffer, costing one call and one exact-size copy. The getters truncate
+        // (or report SPXERR_BUFFER_TOO_SMALL) when the buffer is too small, so longer strings are fetched
+        // again into a growing buffer until they fit.
+        const size_t maxCharCount = 2048;
+        char sz[maxCharCount + 1] = {};
+
+        SPX_INIT_HR(hr);
+        hr = getter(hresult, sz, maxCharCount);
+        if (SPX_SUCCEEDED(hr) && std::strlen(sz) + 1 < maxCharCount)
+        {
+            value = Utils::ToSPXString(sz);
+            return;
+        }
+        if (hr != SPXERR_BUFFER_TOO_SMALL)
         {
-            SPX_THROW_ON_FAIL(hr = result_get_text(hresult, sz, maxCharCount));
-            *text = Utils::ToSPXString(sz);
+            SPX_THROW_ON_FAIL(hr);
         }
 
-        SPX_THROW_ON_FAIL(hr = result_get_offset(hresult, &m_offset));
-        SPX_THROW_ON_FAIL(hr = result_get_duration(hresult, &m_duration));
+        std::string buffer;
+        for (size_t charCount = 2 * maxCharCount; ; charCount *= 2)
+        {
+            SPX_THROW_HR_IF(SPXERR_OUT_OF_MEMORY, charCount > UINT32_MAX);
+            buffer.assign(charCount + 1, '\0');
+            hr = getter(hresult, &buffer[0], (uint32_t)charCount);
+            if (hr == SPXERR_BUFFER_TOO_SMALL)
+            {
+                continue;
+            }
+            SPX_THROW_ON_FAIL(hr);
+
+            auto length = std::strlen(buffer.c_str());
+            if (length + 1 < charCount)
+            {
+                buffer.resize(length);
+                value = Utils::ToSPXString(buffer);
+                return;
+            }
+        }
     }
 
     SPXRESULTHANDLE m_hresult;
 
-    SPXSTRING m_resultId;
+    mutable std::once_flag m_resultIdFetched;
+    mutable SPXSTRING m_resultId;
     Speech::ResultReason m_reason;
-    SPXSTRING m_text;
+    mutable std::once_flag m_textFetched;
+    mutable SPXSTRING m_text;
     uint64_t m_offset;
     uint64_t m_duration;
 };
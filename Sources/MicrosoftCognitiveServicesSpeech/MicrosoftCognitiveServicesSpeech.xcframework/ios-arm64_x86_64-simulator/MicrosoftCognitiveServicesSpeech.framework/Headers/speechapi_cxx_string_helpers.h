@@ -20,6 +20,12 @@
 #define SPXSTRING std::string
 #define SPXSTRING_EMPTY std::string()
 
+// Accessors returning std::string_view are only declared when the standard library provides it.
+#if defined(__cpp_lib_string_view) || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <string_view>
+#define SPX_CONFIG_CXX_STRING_VIEW 1
+#endif
+
 namespace Microsoft{
 namespace CognitiveServices {
 namespace Speech {
@@ -0,0 +1,586 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_voice_catalog.h: Public API declarations for VoiceCatalog, which caches and indexes the voices list
+// of a SpeechSynthesizer
+//
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+#include "speechapi_cxx_common.h"
+#include "speechapi_cxx_string_helpers.h"
+#include "speechapi_cxx_enums.h"
+#include "speechapi_cxx_executor.h"
+#include "speechapi_cxx_async_operation.h"
+#include "speechapi_cxx_synthesis_voices_result.h"
+#include "speechapi_cxx_speech_synthesizer.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+
+/// <summary>
+/// Voice of a <see cref="VoiceCatalogSnapshot"/>; a copy of <see cref="VoiceInfo"/> that does not hold a handle.
+/// </summary>
+struct CachedVoiceInfo
+{
+    /// <summary>
+    /// Voice name.
+    /// </summary>
+    SPXSTRING Name;
+
+    /// <summary>
+    /// Locale of the voice.
+    /// </summary>
+    SPXSTRING Locale;
+
+    /// <summary>
+    /// Short name.
+    /// </summary>
+    SPXSTRING ShortName;
+
+    /// <summary>
+    /// Local name.
+    /// </summary>
+    SPXSTRING LocalName;
+
+    /// <summary>
+    /// Gender.
+    /// </summary>
+    SynthesisVoiceGender Gender = SynthesisVoiceGender::Unknown;
+
+    /// <summary>
+    /// Voice type.
+    /// </summary>
+    SynthesisVoiceType VoiceType = SynthesisVoiceType::OnlineNeural;
+
+    /// <summary>
+    /// Style list.
+    /// </summary>
+    std::vector<SPXSTRING> StyleList;
+
+    /// <summary>
+    /// Voice path, only valid for offline voices.
+    /// </summary>
+    SPXSTRING VoicePath;
+};
+
+/// <summary>
+/// Immutable voices list retrieved at one point in time, indexed by short name, locale, gender and voice type.
+/// </summary>
+class VoiceCatalogSnapshot
+{
+public:
+
+    /// <summary>
+    /// Creates a snapshot of voices.
+    /// </summary>
+    /// <param name="voices">The voices.</param>
+    /// <param name="fetchTime">Time the voices were retrieved from the service.</param>
+    /// <returns>A shared pointer to the snapshot.</returns>
+    static std::shared_ptr<const VoiceCatalogSnapshot> Create(std::vector<CachedVoiceInfo> voices, std::chrono::system_clock::time_point fetchTime)
+    {
+        return std::shared_ptr<const VoiceCatalogSnapshot>(new VoiceCatalogSnapshot(std::move(voices), fetchTime));
+    }
+
+    /// <summary>
+    /// Gets all voices, in the order the service listed them.
+    /// </summary>
+    /// <returns>The voices.</returns>
+    const std::vector<CachedVoiceInfo>& GetVoices() const { return m_voices; }
+
+    /// <summary>
+    /// Gets the time the voices were retrieved from the service.
+    /// </summary>
+    /// <returns>The fetch time.</returns>
+    std::chrono::system_clock::time_point GetFetchTime() const { return m_fetchTime; }
+
+    /// <summary>
+    /// Gets the locales that have voices, sorted.
+    /// </summary>
+    /// <returns>The locales.</returns>
+    const std::vector<SPXSTRING>& GetLocales() const { return m_locales; }
+
+    /// <summary>
+    /// Finds a voice by short name, e.g. "en-US-JennyNeural", or by full name.
+    /// </summary>
+    /// <param name="name">The short or full name.</param>
+    /// <returns>The voice, or nullptr.</returns>
+    const CachedVoiceInfo* FindByName(const SPXSTRING& name) const
+    {
+        auto it = m_byName.find(Utils::ToUTF8(name));
+        return it == m_byName.end() ? nullptr : it->second;
+    }
+
+    /// <summary>
+    /// Gets the voices of a locale, compared case-insensitively.
+    /// </summary>
+    /// <param name="locale">The locale, in BCP-47 format.</param>
+    /// <returns>The voices.</returns>
+    const std::vector<const CachedVoiceInfo*>& GetVoicesByLocale(const SPXSTRING& locale) const
+    {
+        auto it = m_byLocale.find(ToLower(Utils::ToUTF8(locale)));
+        return it == m_byLocale.end() ? m_none : it->second;
+    }
+
+    /// <summary>
+    /// Gets the voices of a gender.
+    /// </summary>
+    /// <param name="gender">The gender.</param>
+    /// <returns>The voices.</returns>
+    const std::vector<const CachedVoiceInfo*>& GetVoicesByGender(SynthesisVoiceGender gender) const
+    {
+        auto index = static_cast<size_t>(gender);
+        return index < m_byGender.size() ? m_byGender[index] : m_none;
+    }
+
+    /// <summary>
+    /// Gets the voices of a voice type.
+    /// </summary>
+    /// <param name="voiceType">The voice type.</param>
+    /// <returns>The voices.</returns>
+    const std::vector<const CachedVoiceInfo*>& GetVoicesByType(SynthesisVoiceType voiceType) const
+    {
+        auto index = static_cast<size_t>(voiceType);
+        return index < m_byType.size() ? m_byType[index] : m_none;
+    }
+
+    /// <summary>
+    /// Gets the voices of a locale with a gender and voice type.
+    /// </summary>
+    /// <param name="locale">The locale, in BCP-47 format.</param>
+    /// <param name="gender">The gender.</param>
+    /// <param name="voiceType">The voice type.</param>
+    /// <returns>The voices.</returns>
+    std::vector<const CachedVoiceInfo*> Find(const SPXSTRING& locale, SynthesisVoiceGender gender, SynthesisVoiceType voiceType) const
+    {
+        std::vector<const CachedVoiceInfo*> voices;
+        for (auto voice : GetVoicesByLocale(locale))
+        {
+            if (voice->Gender == gender && voice->VoiceType == voiceType)
+            {
+                voices.push_back(voice);
+            }
+        }
+        return voices;
+    }
+
+private:
+
+    DISABLE_COPY_AND_MOVE(VoiceCatalogSnapshot);
+
+    static std::string ToLower(std::string value)
+    {
+        std::transform(value.begin(), value.end(), value.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+        return value;
+    }
+
+    VoiceCatalogSnapshot(std::vector<CachedVoiceInfo> voices, std::chrono::system_clock::time_point fetchTime) :
+        m_voices(std::move(voices)),
+        m_fetchTime(fetchTime)
+    {
+        // The indexes point into m_voices, which is never modified after this.
+        for (const auto& voice : m_voices)
+        {
+            m_byName.emplace(Utils::ToUTF8(voice.ShortName), &voice);
+            m_byName.emplace(Utils::ToUTF8(voice.Name), &voice);
+
+            auto& byLocale = m_byLocale[ToLower(Utils::ToUTF8(voice.Locale))];
+            if (byLocale.empty())
+            {
+                m_locales.push_back(voice.Locale);
+            }
+            byLocale.push_back(&voice);
+
+            auto gender = static_cast<size_t>(voice.Gender);
+            if (gender < m_byGender.size())
+            {
+                m_byGender[gender].push_back(&voice);
+            }
+            auto voiceType = static_cast<size_t>(voice.VoiceType);
+            if (voiceType < m_byType.size())
+            {
+                m_byType[voiceType].push_back(&voice);
+            }
+        }
+        std::sort(m_locales.begin(), m_locales.end());
+    }
+
+    const std::vector<CachedVoiceInfo> m_voices;
+    const std::chrono::system_clock::time_point m_fetchTime;
+
+    std::vector<SPXSTRING> m_locales;
+    std::unordered_map<std::string, const CachedVoiceInfo*> m_byName;
+    std::unordered_map<std::string, std::vector<const CachedVoiceInfo*>> m_byLocale;
+    std::array<std::vector<const CachedVoiceInfo*>, static_cast<size_t>(SynthesisVoiceGender::Male) + 1> m_byGender;
+    std::array<std::vector<const CachedVoiceInfo*>, static_cast<size_t>(SynthesisVoiceType::OfflineStandard) + 1> m_byType;
+    const std::vector<const CachedVoiceInfo*> m_none;
+};
+
+/// <summary>
+/// Cache of the voices list of a SpeechSynthesizer, so that app start and locale switches do not wait for
+/// <see cref="SpeechSynthesizer::GetVoicesAsync"/>.
+/// </summary>
+/// <remarks>
+/// The list is kept for a time to live and, when a cache file is given, stored there and loaded on creation, so that
+/// it survives restarts. Once the time to live has passed, the stale list is still returned while a refresh runs in
+/// the background. A refresh is a single request, shared by all callers that ask while it is outstanding.
+/// All methods are thread-safe.
+/// </remarks>
+class VoiceCatalog : public std::enable_shared_from_this<VoiceCatalog>
+{
+public:
+
+    /// <summary>
+    /// Creates a catalog of the voices of a synthesizer, loading the cache file if there is one.
+    /// </summary>
+    /// <param name="synthesizer">The synthesizer used to retrieve the voices.</param>
+    /// <param name="cacheFile">Path of the file the voices are stored in, or empty to keep them in memory only.</param>
+    /// <param name="timeToLive">Time after which the voices are retrieved again.</param>
+    /// <returns>A shared pointer to the catalog.</returns>
+    static std::shared_ptr<VoiceCatalog> Create(std::shared_ptr<SpeechSynthesizer> synthesizer, const SPXSTRING& cacheFile = SPXSTRING(), std::chrono::seconds timeToLive = std::chrono::hours(24))
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, synthesizer == nullptr || timeToLive.count() < 0);
+        auto catalog = std::shared_ptr<VoiceCatalog>(new VoiceCatalog(std::move(synthesizer), Utils::ToUTF8(cacheFile), timeToLive));
+        catalog->m_snapshot = catalog->Load();
+        return catalog;
+    }
+
+    /// <summary>
+    /// Gets the voices. Completes immediately when a list is cached, even an expired one, in which case a refresh
+    /// is started in the background; otherwise completes once the voices are retrieved.
+    /// </summary>
+    /// <returns>An operation returning the voices.</returns>
+    AsyncOperation<std::shared_ptr<const VoiceCatalogSnapshot>> GetVoicesAsyncOperation()
+    {
+        std::shared_ptr<const VoiceCatalogSnapshot> snapshot;
+        auto refresh = false;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            snapshot = m_snapshot;
+            refresh = snapshot == nullptr || IsExpired(*snapshot);
+        }
+        if (snapshot == nullptr)
+        {
+            return RefreshAsyncOperation();
+        }
+        if (refresh)
+        {
+            RefreshAsyncOperation();
+        }
+        AsyncPromise<std::shared_ptr<const VoiceCatalogSnapshot>> promise;
+        promise.SetValue(std::move(snapshot));
+        return promise.GetOperation();
+    }
+
+    /// <summary>
+    /// Retrieves the voices from the service, or joins the retrieval already outstanding.
+    /// </summary>
+    /// <returns>An operation returning the retrieved voices.</returns>
+    AsyncOperation<std::shared_ptr<const VoiceCatalogSnapshot>> RefreshAsyncOperation()
+    {
+        std::shared_ptr<AsyncPromise<std::shared_ptr<const VoiceCatalogSnapshot>>> promise;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_refresh != nullptr)
+            {
+                return m_refresh->GetOperation();
+            }
+            promise = std::make_shared<AsyncPromise<std::shared_ptr<const VoiceCatalogSnapshot>>>();
+            m_refresh = promise;
+            m_fetchCount++;
+        }
+
+        // The result is converted and stored on the executor rather than on the thread that completes the request.
+        std::weak_ptr<VoiceCatalog> weakThis = shared_from_this();
+        auto complete = [weakThis, promise](const AsyncOperation<std::shared_ptr<SynthesisVoicesResult>>& operation) {
+            std::shared_ptr<const VoiceCatalogSnapshot> snapshot;
+            std::exception_ptr error;
+            try
+            {
+                snapshot = ToSnapshot(*operation.Get());
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            auto self = weakThis.lock();
+            if (self != nullptr)
+            {
+                self->Completed(snapshot);
+            }
+            if (error != nullptr)
+            {
+                promise->SetException(error);
+            }
+            else
+            {
+                promise->SetValue(snapshot);
+            }
+        };
+
+        try
+        {
+            m_synthesizer->GetVoicesAsyncOperation().Then(complete, Executor::GetDefault());
+        }
+        catch (...)
+        {
+            Completed(nullptr);
+            promise->SetException(std::current_exception());
+        }
+        return promise->GetOperation();
+    }
+
+    /// <summary>
+    /// Gets the cached voices without retrieving them.
+    /// </summary>
+    /// <returns>The voices, possibly expired, or nullptr if none are cached.</returns>
+    std::shared_ptr<const VoiceCatalogSnapshot> GetSnapshot() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_snapshot;
+    }
+
+    /// <summary>
+    /// Gets the number of times the voices were requested from the service.
+    /// </summary>
+    /// <returns>Number of requests.</returns>
+    uint64_t GetFetchCount() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_fetchCount;
+    }
+
+private:
+
+    DISABLE_COPY_AND_MOVE(VoiceCatalog);
+
+    static constexpr size_t FileMagicSize = 8;
+
+    static const char* GetFileMagic() { return "SPXVOIC1"; }
+
+    VoiceCatalog(std::shared_ptr<SpeechSynthesizer> synthesizer, std::string cacheFile, std::chrono::seconds timeToLive) :
+        m_synthesizer(std::move(synthesizer)),
+        m_cacheFile(std::move(cacheFile)),
+        m_timeToLive(timeToLive)
+    {
+    }
+
+    bool IsExpired(const VoiceCatalogSnapshot& snapshot) const
+    {
+        auto age = std::chrono::system_clock::now() - snapshot.GetFetchTime();
+        return age >= m_timeToLive || age < std::chrono::system_clock::duration::zero();
+    }
+
+    static std::shared_ptr<const VoiceCatalogSnapshot> ToSnapshot(const SynthesisVoicesResult& result)
+    {
+        if (result.Reason != ResultReason::VoicesListRetrieved)
+        {
+            throw std::runtime_error("VoiceCatalog: retrieving the voices failed: " + Utils::ToUTF8(result.ErrorDetails));
+        }
+
+        std::vector<CachedVoiceInfo> voices;
+        voices.reserve(result.Voices.size());
+        for (const auto& info : result.Voices)
+        {
+            CachedVoiceInfo voice;
+            voice.Name = info->Name;
+            voice.Locale = info->Locale;
+            voice.ShortName = info->ShortName;
+            voice.LocalName = info->LocalName;
+            voice.Gender = info->Gender;
+            voice.VoiceType = info->VoiceType;
+            voice.StyleList = info->StyleList;
+            voice.VoicePath = info->VoicePath;
+            voices.push_back(std::move(voice));
+        }
+        return VoiceCatalogSnapshot::Create(std::move(voices), std::chrono::system_clock::now());
+    }
+
+    void Completed(std::shared_ptr<const VoiceCatalogSnapshot> snapshot)
+    {
+        if (snapshot != nullptr)
+        {
+            Store(*snapshot);
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (snapshot != nullptr)
+        {
+            m_snapshot = std::move(snapshot);
+        }
+        m_refresh = nullptr;
+    }
+
+    static void AppendUInt32(std::vector<uint8_t>& buffer, uint32_t value)
+    {
+        auto bytes = reinterpret_cast<const uint8_t*>(&value);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+    }
+
+    static void AppendString(std::vector<uint8_t>& buffer, const SPXSTRING& value)
+    {
+        auto utf8 = Utils::ToUTF8(value);
+        AppendUInt32(buffer, static_cast<uint32_t>(utf8.size()));
+        buffer.insert(buffer.end(), utf8.begin(), utf8.end());
+    }
+
+    class FileReader
+    {
+    public:
+        FileReader(const std::vector<uint8_t>& buffer) : m_position(buffer.data()), m_end(buffer.data() + buffer.size()) {}
+
+        bool Read(void* value, size_t size)
+        {
+            if (static_cast<size_t>(m_end - m_position) < size)
+            {
+                return false;
+            }
+            std::memcpy(value, m_position, size);
+            m_position += size;
+            return true;
+        }
+
+        bool ReadString(SPXSTRING& value)
+        {
+            uint32_t size = 0;
+            if (!Read(&size, sizeof(size)) || static_cast<size_t>(m_end - m_position) < size)
+            {
+                return false;
+            }
+            value = Utils::ToSPXString(std::string(reinterpret_cast<const char*>(m_position), size));
+            m_position += size;
+            return true;
+        }
+
+    private:
+        const uint8_t* m_position;
+        const uint8_t* m_end;
+    };
+
+    void Store(const VoiceCatalogSnapshot& snapshot) const
+    {
+        if (m_cacheFile.empty())
+        {
+            return;
+        }
+
+        std::vector<uint8_t> buffer(GetFileMagic(), GetFileMagic() + FileMagicSize);
+        auto fetchTime = static_cast<int64_t>(std::chrono::duration_cast<std::chrono::seconds>(snapshot.GetFetchTime().time_since_epoch()).count());
+        auto bytes = reinterpret_cast<const uint8_t*>(&fetchTime);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(fetchTime));
+        AppendUInt32(buffer, static_cast<uint32_t>(snapshot.GetVoices().size()));
+        for (const auto& voice : snapshot.GetVoices())
+        {
+            AppendString(buffer, voice.Name);
+            AppendString(buffer, voice.Locale);
+            AppendString(buffer, voice.ShortName);
+            AppendString(buffer, voice.LocalName);
+            AppendUInt32(buffer, static_cast<uint32_t>(voice.Gender));
+            AppendUInt32(buffer, static_cast<uint32_t>(voice.VoiceType));
+            AppendUInt32(buffer, static_cast<uint32_t>(voice.StyleList.size()));
+            for (const auto& style : voice.StyleList)
+            {
+                AppendString(buffer, style);
+            }
+            AppendString(buffer, voice.VoicePath);
+        }
+
+        // Written under a unique temporary name and renamed, so readers never see a partial file.
+        static std::atomic<uint64_t> counter{ 0 };
+        auto temporary = m_cacheFile + "." + std::to_string(::getpid()) + "." + std::to_string(counter++) + ".tmp";
+        auto file = std::fopen(temporary.c_str(), "wb");
+        auto written = file != nullptr && std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+        written = file != nullptr && std::fclose(file) == 0 && written;
+        if (!written || std::rename(temporary.c_str(), m_cacheFile.c_str()) != 0)
+        {
+            SPX_TRACE_ERROR("VoiceCatalog: failed to write %s, errno %d.", m_cacheFile.c_str(), errno);
+            std::remove(temporary.c_str());
+        }
+    }
+
+    std::shared_ptr<const VoiceCatalogSnapshot> Load() const
+    {
+        if (m_cacheFile.empty())
+        {
+            return nullptr;
+        }
+        auto file = std::fopen(m_cacheFile.c_str(), "rb");
+        if (file == nullptr)
+        {
+            return nullptr;
+        }
+        std::vector<uint8_t> buffer;
+        uint8_t chunk[4096];
+        size_t count;
+        while ((count = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+        {
+            buffer.insert(buffer.end(), chunk, chunk + count);
+        }
+        std::fclose(file);
+
+        FileReader reader(buffer);
+        char magic[FileMagicSize];
+        int64_t fetchTime = 0;
+        uint32_t voiceCount = 0;
+        if (!reader.Read(magic, sizeof(magic)) || std::memcmp(magic, GetFileMagic(), sizeof(magic)) != 0 ||
+            !reader.Read(&fetchTime, sizeof(fetchTime)) || !reader.Read(&voiceCount, sizeof(voiceCount)))
+        {
+            return nullptr;
+        }
+
+        std::vector<CachedVoiceInfo> voices;
+        for (uint32_t i = 0; i < voiceCount; i++)
+        {
+            CachedVoiceInfo voice;
+            uint32_t gender = 0, voiceType = 0, styleCount = 0;
+            if (!reader.ReadString(voice.Name) || !reader.ReadString(voice.Locale) || !reader.ReadString(voice.ShortName) || !reader.ReadString(voice.LocalName) ||
+                !reader.Read(&gender, sizeof(gender)) || !reader.Read(&voiceType, sizeof(voiceType)) || !reader.Read(&styleCount, sizeof(styleCount)))
+            {
+                return nullptr;
+            }
+            for (uint32_t j = 0; j < styleCount; j++)
+            {
+                SPXSTRING style;
+                if (!reader.ReadString(style))
+                {
+                    return nullptr;
+                }
+                voice.StyleList.push_back(std::move(style));
+            }
+            if (!reader.ReadString(voice.VoicePath))
+            {
+                return nullptr;
+            }
+            voice.Gender = static_cast<SynthesisVoiceGender>(gender);
+            voice.VoiceType = static_cast<SynthesisVoiceType>(voiceType);
+            voices.push_back(std::move(voice));
+        }
+        return VoiceCatalogSnapshot::Create(std::move(voices), std::chrono::system_clock::time_point(std::chrono::seconds(fetchTime)));
+    }
+
+    const std::shared_ptr<SpeechSynthesizer> m_synthesizer;
+    const std::string m_cacheFile;
+    const std::chrono::seconds m_timeToLive;
+
+    mutable std::mutex m_mutex;
+    std::shared_ptr<const VoiceCatalogSnapshot> m_snapshot;
+    std::shared_ptr<AsyncPromise<std::shared_ptr<const VoiceCatalogSnapshot>>> m_refresh;
+    uint64_t m_fetchCount = 0;
+};
+
+} } } // Microsoft::CognitiveServices::Speech
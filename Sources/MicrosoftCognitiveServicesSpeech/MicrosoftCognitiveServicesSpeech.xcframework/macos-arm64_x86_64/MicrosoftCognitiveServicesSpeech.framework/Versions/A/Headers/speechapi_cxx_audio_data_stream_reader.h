@@ -0,0 +1,438 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_audio_data_stream_reader.h: Public API declarations for AudioBufferPool, AudioDataChunk and the
+// AudioDataStreamReader C++ class, which reads AudioDataStreams in chunks without a thread per stream
+//
+
+#pragma once
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "speechapi_cxx_common.h"
+#include "speechapi_cxx_string_helpers.h"
+#include "speechapi_cxx_executor.h"
+#include "speechapi_cxx_async_operation.h"
+#include "speechapi_cxx_audio_data_stream.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+
+class AudioBufferPool;
+class AudioDataStreamReader;
+
+/// <summary>
+/// A chunk of audio read from an <see cref="AudioDataStream"/> into a buffer of an <see cref="AudioBufferPool"/>.
+/// The buffer returns to its pool once the last reference to the chunk is released.
+/// </summary>
+class AudioDataChunk
+{
+public:
+
+    /// <summary>
+    /// Gets the audio data.
+    /// </summary>
+    /// <returns>Pointer to the audio data.</returns>
+    const uint8_t* GetData() const { return m_buffer.get(); }
+
+    /// <summary>
+    /// Gets the size of the audio data.
+    /// </summary>
+    /// <returns>Size in bytes.</returns>
+    uint32_t GetSize() const { return m_size; }
+
+    /// <summary>
+    /// Gets the position of the audio data in the stream.
+    /// </summary>
+    /// <returns>Offset of the first byte from the start of the stream.</returns>
+    uint64_t GetOffset() const { return m_offset; }
+
+private:
+
+    friend class AudioBufferPool;
+    friend class AudioDataStreamReader;
+
+    DISABLE_COPY_AND_MOVE(AudioDataChunk);
+
+    explicit AudioDataChunk(uint32_t capacity) :
+        m_buffer(new uint8_t[capacity]),
+        m_capacity(capacity)
+    {
+    }
+
+    std::unique_ptr<uint8_t[]> m_buffer;
+    const uint32_t m_capacity;
+    uint32_t m_size = 0;
+    uint64_t m_offset = 0;
+};
+
+/// <summary>
+/// Recycles the buffers of <see cref="AudioDataChunk"/>s, so that steady-state reading does not allocate audio
+/// buffers. A pool can be shared by any number of readers.
+/// </summary>
+class AudioBufferPool : public std::enable_shared_from_this<AudioBufferPool>
+{
+public:
+
+    /// <summary>
+    /// Creates a pool.
+    /// </summary>
+    /// <param name="bufferSize">Size of each buffer in bytes.</param>
+    /// <param name="maxIdleBuffers">Number of released buffers kept for reuse; buffers released beyond that are freed.</param>
+    /// <returns>A shared pointer to the pool.</returns>
+    static std::shared_ptr<AudioBufferPool> Create(uint32_t bufferSize = 32768, size_t maxIdleBuffers = 64)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, bufferSize == 0);
+        return std::shared_ptr<AudioBufferPool>(new AudioBufferPool(bufferSize, maxIdleBuffers));
+    }
+
+    /// <summary>
+    /// Destructor. Chunks still in use free their buffers when released.
+    /// </summary>
+    ~AudioBufferPool()
+    {
+        for (auto chunk : m_idle)
+        {
+            delete chunk;
+        }
+    }
+
+    /// <summary>
+    /// Gets the size of the buffers.
+    /// </summary>
+    /// <returns>Size in bytes.</returns>
+    uint32_t GetBufferSize() const { return m_bufferSize; }
+
+    /// <summary>
+    /// Gets the number of buffers allocated by the pool so far; it stops growing once enough buffers circulate.
+    /// </summary>
+    /// <returns>Number of allocations.</returns>
+    size_t GetAllocationCount() const { return m_allocations.load(); }
+
+    /// <summary>
+    /// Takes an empty chunk from the pool, allocating one if none is idle.
+    /// </summary>
+    /// <returns>A shared pointer to the chunk.</returns>
+    std::shared_ptr<AudioDataChunk> Acquire()
+    {
+        AudioDataChunk* chunk = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (!m_idle.empty())
+            {
+                chunk = m_idle.back();
+                m_idle.pop_back();
+            }
+        }
+        if (chunk == nullptr)
+        {
+            chunk = new AudioDataChunk(m_bufferSize);
+            m_allocations++;
+        }
+        chunk->m_size = 0;
+        chunk->m_offset = 0;
+
+        std::weak_ptr<AudioBufferPool> weakPool = shared_from_this();
+        return std::shared_ptr<AudioDataChunk>(chunk, [weakPool](AudioDataChunk* released) {
+            auto pool = weakPool.lock();
+            if (pool == nullptr || !pool->Release(released))
+            {
+                delete released;
+            }
+        });
+    }
+
+private:
+
+    DISABLE_COPY_AND_MOVE(AudioBufferPool);
+
+    AudioBufferPool(uint32_t bufferSize, size_t maxIdleBuffers) :
+        m_bufferSize(bufferSize),
+        m_maxIdle(maxIdleBuffers)
+    {
+        m_idle.reserve(maxIdleBuffers);
+    }
+
+    bool Release(AudioDataChunk* chunk)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_idle.size() >= m_maxIdle)
+        {
+            return false;
+        }
+        m_idle.push_back(chunk);
+        return true;
+    }
+
+    const uint32_t m_bufferSize;
+    const size_t m_maxIdle;
+    std::mutex m_mutex;
+    std::vector<AudioDataChunk*> m_idle;
+    std::atomic<size_t> m_allocations{ 0 };
+};
+
+/// <summary>
+/// Reads an <see cref="AudioDataStream"/> in chunks as synthesis produces them, without blocking a thread per
+/// stream: readiness is polled by an <see cref="AsyncReactor"/>, which serves all outstanding reads from a single
+/// thread, and each chunk is copied into a buffer of an <see cref="AudioBufferPool"/>.
+/// </summary>
+/// <remarks>
+/// The reader consumes the stream from its current position; reads are served in order, one at a time.
+/// </remarks>
+class AudioDataStreamReader : public std::enable_shared_from_this<AudioDataStreamReader>
+{
+public:
+
+    /// <summary>
+    /// Callback invoked with each chunk.
+    /// </summary>
+    using ChunkCallback = std::function<void(const std::shared_ptr<AudioDataChunk>&)>;
+
+    /// <summary>
+    /// Creates a reader.
+    /// </summary>
+    /// <param name="stream">The stream to read.</param>
+    /// <param name="pool">Pool providing the buffers, or nullptr for a pool of 32 kB buffers owned by the reader.</param>
+    /// <param name="reactor">Reactor polling for readiness, or nullptr for <see cref="AsyncReactor::GetDefault"/>.</param>
+    /// <returns>A shared pointer to the reader.</returns>
+    static std::shared_ptr<AudioDataStreamReader> Create(std::shared_ptr<AudioDataStream> stream, std::shared_ptr<AudioBufferPool> pool = nullptr, std::shared_ptr<AsyncReactor> reactor = nullptr)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, stream == nullptr);
+        return std::shared_ptr<AudioDataStreamReader>(new AudioDataStreamReader(std::move(stream),
+            pool != nullptr ? std::move(pool) : AudioBufferPool::Create(),
+            reactor != nullptr ? std::move(reactor) : AsyncReactor::GetDefault()));
+    }
+
+    /// <summary>
+    /// Reads the next chunk once a whole buffer of audio is available or the stream has ended.
+    /// </summary>
+    /// <returns>An operation completing with the chunk, or with nullptr at the end of the stream.</returns>
+    AsyncOperation<std::shared_ptr<AudioDataChunk>> ReadChunkAsync()
+    {
+        auto self = shared_from_this();
+        return m_reactor->Run<std::shared_ptr<AudioDataChunk>>(
+            [self]() {
+                auto wasReading = self->m_reading.exchange(true);
+                SPX_THROW_HR_IF(SPXERR_ALREADY_IN_PROGRESS, wasReading);
+            },
+            [self]() { return self->PollReadable(); },
+            [self](SPXHR hr) { return self->ReadChunk(hr); });
+    }
+
+    /// <summary>
+    /// Reads chunks until the end of the stream, passing each one to the callback in stream order.
+    /// </summary>
+    /// <param name="callback">Invoked with each chunk; if it throws, reading stops and the operation fails.</param>
+    /// <param name="executor">Executor to invoke the callback on, or nullptr to invoke it on the thread that completed the read, in which case it should be short.</param>
+    /// <returns>An operation completing once the stream has been read to its end.</returns>
+    AsyncOperation<void> ReadAllAsync(ChunkCallback callback, std::shared_ptr<Executor> executor = nullptr)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, callback == nullptr);
+        auto promise = std::make_shared<AsyncPromise<void>>();
+        ReadNext(promise, std::make_shared<ChunkCallback>(std::move(callback)), std::move(executor));
+        return promise->GetOperation();
+    }
+
+    /// <summary>
+    /// Saves the audio to a WAV file, writing each chunk as soon as it has been synthesized rather than after
+    /// synthesis ends. The sizes in the header are filled in once the stream has ended.
+    /// </summary>
+    /// <param name="fileName">The file name with full path.</param>
+    /// <param name="samplesPerSecond">Sample rate of the synthesized audio.</param>
+    /// <param name="bitsPerSample">Bits per sample of the synthesized audio.</param>
+    /// <param name="channels">Number of channels of the synthesized audio.</param>
+    /// <returns>An operation completing once the file has been written and closed.</returns>
+    /// <remarks>The stream must carry headerless PCM, as it does for raw and RIFF synthesis output formats. File writes run on <see cref="Executor::GetDefault"/>.</remarks>
+    AsyncOperation<void> SaveToWavFileAsync(const SPXSTRING& fileName, uint32_t samplesPerSecond, uint16_t bitsPerSample = 16, uint16_t channels = 1)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, samplesPerSecond == 0 || bitsPerSample == 0 || bitsPerSample % 8 != 0 || channels == 0);
+
+        std::shared_ptr<WavFileWriter> writer;
+        try
+        {
+            writer = std::make_shared<WavFileWriter>(Utils::ToUTF8(fileName), samplesPerSecond, bitsPerSample, channels);
+        }
+        catch (...)
+        {
+            return AsyncOperation<void>::FromException(std::current_exception());
+        }
+
+        return ReadAllAsync([writer](const std::shared_ptr<AudioDataChunk>& chunk) { writer->Write(chunk->GetData(), chunk->GetSize()); }, Executor::GetDefault())
+            .Then([writer](const AsyncOperation<void>& read) {
+                read.Get();
+                writer->Finish();
+            });
+    }
+
+private:
+
+    DISABLE_COPY_AND_MOVE(AudioDataStreamReader);
+
+    AudioDataStreamReader(std::shared_ptr<AudioDataStream> stream, std::shared_ptr<AudioBufferPool> pool, std::shared_ptr<AsyncReactor> reactor) :
+        m_stream(std::move(stream)),
+        m_handle(static_cast<SPXAUDIOSTREAMHANDLE>(*m_stream)),
+        m_pool(std::move(pool)),
+        m_reactor(std::move(reactor))
+    {
+    }
+
+    SPXHR PollReadable()
+    {
+        if (audio_data_stream_can_read_data(m_handle, m_pool->GetBufferSize()))
+        {
+            return SPX_NOERROR;
+        }
+
+        // Once synthesis has finished, reads return the remainder without blocking.
+        Stream_Status status = StreamStatus_Unknown;
+        auto hr = audio_data_stream_get_status(m_handle, &status);
+        if (SPX_FAILED(hr))
+        {
+            return hr;
+        }
+        return status == StreamStatus_NoData || status == StreamStatus_PartialData ? SPXERR_TIMEOUT : SPX_NOERROR;
+    }
+
+    std::shared_ptr<AudioDataChunk> ReadChunk(SPXHR pollResult)
+    {
+        // Cleared before the operation completes, so continuations can start the next read.
+        struct ReadingGuard
+        {
+            std::atomic<bool>& reading;
+            ~ReadingGuard() { reading = false; }
+        } guard{ m_reading };
+
+        // A failed status query means the stream is unusable; reading it anyway could block.
+        SPX_THROW_ON_FAIL(pollResult);
+
+        auto chunk = m_pool->Acquire();
+        uint32_t filled = 0;
+        SPX_THROW_ON_FAIL(audio_data_stream_read(m_handle, chunk->m_buffer.get(), chunk->m_capacity, &filled));
+        if (filled == 0)
+        {
+            return nullptr;
+        }
+        chunk->m_size = filled;
+        chunk->m_offset = m_position;
+        m_position += filled;
+        return chunk;
+    }
+
+    void ReadNext(std::shared_ptr<AsyncPromise<void>> promise, std::shared_ptr<ChunkCallback> callback, std::shared_ptr<Executor> executor)
+    {
+        auto self = shared_from_this();
+        ReadChunkAsync().Then([self, promise, callback, executor](const AsyncOperation<std::shared_ptr<AudioDataChunk>>& read) {
+            try
+            {
+                auto chunk = read.Get();
+                if (chunk == nullptr)
+                {
+                    promise->SetValue();
+                    return;
+                }
+                (*callback)(chunk);
+            }
+            catch (...)
+            {
+                promise->SetException(std::current_exception());
+                return;
+            }
+            self->ReadNext(promise, callback, executor);
+        }, executor);
+    }
+
+    class WavFileWriter
+    {
+    public:
+        WavFileWriter(const std::string& fileName, uint32_t samplesPerSecond, uint16_t bitsPerSample, uint16_t channels)
+        {
+#ifdef _MSC_VER
+            SPX_THROW_HR_IF(SPXERR_FILE_OPEN_FAILED, fopen_s(&m_file, fileName.c_str(), "wb") != 0 || m_file == nullptr);
+#else
+            m_file = fopen(fileName.c_str(), "wb");
+            SPX_THROW_HR_IF(SPXERR_FILE_OPEN_FAILED, m_file == nullptr);
+#endif
+            // The sizes are unknown while streaming and left at their maximum until Finish.
+            uint16_t blockAlign = static_cast<uint16_t>(channels * bitsPerSample / 8);
+            uint8_t header[44];
+            std::memcpy(header, "RIFF", 4);
+            Put32(header + 4, 0xFFFFFFFF);
+            std::memcpy(header + 8, "WAVEfmt ", 8);
+            Put32(header + 16, 16);
+            Put16(header + 20, 1);
+            Put16(header + 22, channels);
+            Put32(header + 24, samplesPerSecond);
+            Put32(header + 28, samplesPerSecond * blockAlign);
+            Put16(header + 32, blockAlign);
+            Put16(header + 34, bitsPerSample);
+            std::memcpy(header + 36, "data", 4);
+            Put32(header + 40, 0xFFFFFFFF);
+            try
+            {
+                Write(header, sizeof(header));
+            }
+            catch (...)
+            {
+                // The destructor does not run for a constructor that throws.
+                fclose(m_file);
+                m_file = nullptr;
+                throw;
+            }
+            m_dataSize = 0;
+        }
+
+        ~WavFileWriter()
+        {
+            if (m_file != nullptr)
+            {
+                fclose(m_file);
+            }
+        }
+
+        void Write(const uint8_t* data, size_t size)
+        {
+            SPX_THROW_HR_IF(SPXERR_UNEXPECTED_EOF, fwrite(data, 1, size, m_file) != size);
+            m_dataSize += size;
+        }
+
+        void Finish()
+        {
+            // Sizes that do not fit stay at their maximum, which readers treat as "to the end of the file".
+            if (m_dataSize <= 0xFFFFFFFF - 36)
+            {
+                uint8_t size[4];
+                Put32(size, static_cast<uint32_t>(36 + m_dataSize));
+                SPX_THROW_HR_IF(SPXERR_UNEXPECTED_EOF, fseek(m_file, 4, SEEK_SET) != 0 || fwrite(size, 1, 4, m_file) != 4);
+                Put32(size, static_cast<uint32_t>(m_dataSize));
+                SPX_THROW_HR_IF(SPXERR_UNEXPECTED_EOF, fseek(m_file, 40, SEEK_SET) != 0 || fwrite(size, 1, 4, m_file) != 4);
+            }
+            auto file = m_file;
+            m_file = nullptr;
+            SPX_THROW_HR_IF(SPXERR_UNEXPECTED_EOF, fclose(file) != 0);
+        }
+
+    private:
+        DISABLE_COPY_AND_MOVE(WavFileWriter);
+
+        static void Put16(uint8_t* p, uint32_t value) { p[0] = static_cast<uint8_t>(value); p[1] = static_cast<uint8_t>(value >> 8); }
+        static void Put32(uint8_t* p, uint32_t value) { Put16(p, value & 0xFFFF); Put16(p + 2, value >> 16); }
+
+        FILE* m_file = nullptr;
+        uint64_t m_dataSize = 0;
+    };
+
+    std::shared_ptr<AudioDataStream> m_stream;
+    SPXAUDIOSTREAMHANDLE m_handle;
+    std::shared_ptr<AudioBufferPool> m_pool;
+    std::shared_ptr<AsyncReactor> m_reactor;
+    std::atomic<bool> m_reading{ false };
+    uint64_t m_position = 0;
+};
+
+} } } // Microsoft::CognitiveServices::Speech
@@ -0,0 +1,517 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_audio_resampler.h: Public API declarations for AudioResampler and the resampling
+// PushAudioInputStream / PullAudioInputStreamCallback adapters
+//
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "speechapi_cxx_common.h"
+#include "speechapi_cxx_string_helpers.h"
+#include "speechapi_cxx_audio_stream.h"
+#include "speechapi_cxx_audio_sample_converter.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+namespace Audio {
+
+/// <summary>
+/// Streaming polyphase resampler for interleaved 16 bit PCM, converting between any two sample rates whose reduced
+/// ratio has a numerator of at most <see cref="MaxPhases"/> (e.g. 8000, 11025, 22050, 44100 and 48000 Hz to 16000 Hz).
+/// </summary>
+/// <remarks>
+/// The passband reaches 90% of the lower of the two Nyquist frequencies and the stopband starts at that Nyquist frequency,
+/// so nothing above it folds back (e.g. 7.2 kHz and 8 kHz when producing 16 kHz). Output is aligned with the input: the
+/// filter delay of <see cref="GetDelayFrames"/> input frames is skipped at the start and released by <see cref="Flush"/>,
+/// so a stream of N input frames yields N * outputRate / inputRate output frames (rounded up).
+/// All buffers are allocated by <see cref="Create"/>; <see cref="Process"/> never allocates. An instance keeps filter
+/// state, so it must not be used from several threads at once.
+/// </remarks>
+class AudioResampler
+{
+public:
+
+    /// <summary>
+    /// Largest number of filter phases (the output rate divided by the greatest common divisor of both rates).
+    /// </summary>
+    static constexpr uint32_t MaxPhases = 1024;
+
+    /// <summary>
+    /// Largest number of input frames processed in one pass; longer inputs are processed in several passes.
+    /// </summary>
+    static constexpr size_t MaxBlockFrames = 1024;
+
+    /// <summary>
+    /// Creates a resampler.
+    /// </summary>
+    /// <param name="inputRate">Input samples per second.</param>
+    /// <param name="outputRate">Output samples per second.</param>
+    /// <param name="channels">Number of interleaved channels.</param>
+    /// <param name="tapsPerPhase">Filter length per phase when not decimating, a multiple of 8; it is scaled by the decimation
+    /// factor otherwise. The stopband attenuation is about <c>0.72 * tapsPerPhase + 8</c> dB (77 dB by default).</param>
+    /// <returns>A shared pointer to the resampler.</returns>
+    static std::shared_ptr<AudioResampler> Create(uint32_t inputRate, uint32_t outputRate, uint8_t channels = 1, uint32_t tapsPerPhase = 96)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, inputRate == 0 || outputRate == 0 || channels == 0);
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, tapsPerPhase == 0 || tapsPerPhase % 8 != 0 || tapsPerPhase > 256);
+
+        auto divisor = Gcd(inputRate, outputRate);
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, outputRate / divisor > MaxPhases);
+
+        // The transition band is a fixed fraction of the lower Nyquist frequency, which is narrower relative to the input
+        // the more it is decimated; the filter has to grow by the same factor to keep its attenuation.
+        auto upFactor = outputRate / divisor;
+        auto downFactor = inputRate / divisor;
+        auto scale = (downFactor + upFactor - 1) / upFactor;
+        auto taps = tapsPerPhase * scale;
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, taps > 2 * MaxBlockFrames);
+
+        return std::shared_ptr<AudioResampler>(new AudioResampler(upFactor, downFactor, channels, taps));
+    }
+
+    /// <summary>
+    /// Gets the number of output frames <see cref="Process"/> can produce at most for the given number of input frames.
+    /// </summary>
+    /// <param name="inputFrames">Number of input frames.</param>
+    /// <returns>Maximum number of output frames.</returns>
+    size_t GetMaxOutputFrames(size_t inputFrames) const
+    {
+        return (inputFrames * m_upFactor + m_downFactor - 1) / m_downFactor + 1;
+    }
+
+    /// <summary>
+    /// Gets the group delay of the filter, in input frames; this much input is held back until <see cref="Flush"/>.
+    /// </summary>
+    /// <returns>The delay in input frames.</returns>
+    uint32_t GetDelayFrames() const { return m_taps / 2; }
+
+    /// <summary>
+    /// Gets the number of interleaved channels.
+    /// </summary>
+    /// <returns>Number of channels.</returns>
+    uint8_t GetChannels() const { return m_channels; }
+
+    /// <summary>
+    /// Resamples a block of input. Output follows input continuously across calls.
+    /// </summary>
+    /// <param name="input">Interleaved input frames.</param>
+    /// <param name="inputFrames">Number of input frames.</param>
+    /// <param name="output">Receives interleaved output frames; must hold <see cref="GetMaxOutputFrames"/> frames.</param>
+    /// <returns>The number of output frames written.</returns>
+    size_t Process(const int16_t* input, size_t inputFrames, int16_t* output)
+    {
+        size_t produced = 0;
+        while (inputFrames > 0)
+        {
+            // Not std::min: it would odr-use MaxBlockFrames, which needs a definition before C++17.
+            auto count = inputFrames < MaxBlockFrames ? inputFrames : MaxBlockFrames;
+            produced += ProcessBlock(input, count, output + produced * m_channels);
+            input += count * m_channels;
+            inputFrames -= count;
+        }
+        return produced;
+    }
+
+    /// <summary>
+    /// Produces the output still held back by the filter delay, at the end of a stream, and resets the resampler.
+    /// </summary>
+    /// <param name="output">Receives interleaved output frames; must hold <c>GetMaxOutputFrames(GetDelayFrames())</c> frames.</param>
+    /// <returns>The number of output frames written.</returns>
+    size_t Flush(int16_t* output)
+    {
+        // Pushing the delay's worth of silence moves the last input sample past the center of the filter.
+        auto produced = ProcessBlock(nullptr, GetDelayFrames(), output);
+        Reset();
+        return produced;
+    }
+
+    /// <summary>
+    /// Clears the filter history, e.g. before resampling an unrelated stream. Output held back is dropped.
+    /// </summary>
+    void Reset()
+    {
+        std::fill(m_window.begin(), m_window.end(), 0.0f);
+        m_index = GetDelayFrames();
+        m_phase = 0;
+    }
+
+private:
+
+    DISABLE_DEFAULT_CTORS(AudioResampler);
+
+    AudioResampler(uint32_t upFactor, uint32_t downFactor, uint8_t channels, uint32_t taps) :
+        m_upFactor(upFactor),
+        m_downFactor(downFactor),
+        m_channels(channels),
+        m_taps(taps),
+        m_stride(taps - 1 + MaxBlockFrames),
+        m_coefficients(static_cast<size_t>(upFactor) * taps),
+        m_window(m_stride * channels),
+        m_index(taps / 2)
+    {
+        DesignFilter();
+    }
+
+    static uint32_t Gcd(uint32_t a, uint32_t b)
+    {
+        while (b != 0)
+        {
+            auto t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    static double BesselI0(double x)
+    {
+        double sum = 1.0;
+        double term = 1.0;
+        for (int k = 1; k < 50 && term > sum * 1e-12; k++)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    void DesignFilter()
+    {
+        // Kaiser windowed sinc at the upsampled rate. The transition band runs from 90% to 100% of the lower of the two
+        // Nyquist frequencies; the window is shaped for the attenuation this length achieves over it (Kaiser's formulas).
+        const double pi = 3.14159265358979323846;
+        const double nyquist = 0.5 / std::max(m_upFactor, m_downFactor);
+        const double transition = 0.1 * nyquist;
+        const double cutoff = nyquist - transition / 2.0;
+        const size_t length = static_cast<size_t>(m_upFactor) * m_taps;
+        const double center = (length - 1) / 2.0;
+        const double attenuation = 2.285 * 2.0 * pi * transition * (length - 1) + 7.95;
+        const double beta = attenuation > 50.0 ? 0.1102 * (attenuation - 8.7) :
+            attenuation > 21.0 ? 0.5842 * std::pow(attenuation - 21.0, 0.4) + 0.07886 * (attenuation - 21.0) : 0.0;
+
+        std::vector<double> prototype(length);
+        for (size_t i = 0; i < length; i++)
+        {
+            auto x = i - center;
+            auto sinc = x == 0.0 ? 2.0 * cutoff : std::sin(2.0 * pi * cutoff * x) / (pi * x);
+            auto ratio = 2.0 * i / (length - 1) - 1.0;
+            prototype[i] = sinc * BesselI0(beta * std::sqrt(std::max(0.0, 1.0 - ratio * ratio))) / BesselI0(beta);
+        }
+
+        // Phase p uses taps p, p + L, p + 2L, ...; store them reversed so each output is a dot product with a
+        // contiguous window of input ending at the newest sample. The gain of L restores the level lost to zero stuffing.
+        for (uint32_t phase = 0; phase < m_upFactor; phase++)
+        {
+            for (uint32_t j = 0; j < m_taps; j++)
+            {
+                auto k = m_taps - 1 - j;
+                m_coefficients[static_cast<size_t>(phase) * m_taps + j] = static_cast<float>(prototype[phase + static_cast<size_t>(k) * m_upFactor] * m_upFactor);
+            }
+        }
+    }
+
+    static float Dot(const float* a, const float* b, uint32_t count)
+    {
+#if defined(SPX_CONFIG_AUDIO_AVX2)
+        __m256 sum = _mm256_setzero_ps();
+        for (uint32_t i = 0; i < count; i += 8)
+        {
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        }
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+        half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+        return _mm_cvtss_f32(half);
+#elif defined(SPX_CONFIG_AUDIO_SSE2)
+        __m128 sum0 = _mm_setzero_ps();
+        __m128 sum1 = _mm_setzero_ps();
+        for (uint32_t i = 0; i < count; i += 8)
+        {
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+            sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        }
+        __m128 sum = _mm_add_ps(sum0, sum1);
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        return _mm_cvtss_f32(sum);
+#elif defined(SPX_CONFIG_AUDIO_NEON)
+        float32x4_t sum0 = vdupq_n_f32(0.0f);
+        float32x4_t sum1 = vdupq_n_f32(0.0f);
+        for (uint32_t i = 0; i < count; i += 8)
+        {
+            sum0 = vfmaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+            sum1 = vfmaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        }
+        return vaddvq_f32(vaddq_f32(sum0, sum1));
+#else
+        float sum = 0.0f;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            sum += a[i] * b[i];
+        }
+        return sum;
+#endif
+    }
+
+    size_t ProcessBlock(const int16_t* input, size_t frames, int16_t* output)
+    {
+        // Each channel's window holds taps - 1 frames of history followed by the new block, or silence without input.
+        const size_t history = m_taps - 1;
+        for (size_t channel = 0; channel < m_channels; channel++)
+        {
+            auto window = m_window.data() + channel * m_stride + history;
+            for (size_t frame = 0; frame < frames; frame++)
+            {
+                window[frame] = input != nullptr ? input[frame * m_channels + channel] : 0.0f;
+            }
+        }
+
+        size_t produced = 0;
+        while (m_index < frames)
+        {
+            auto coefficients = m_coefficients.data() + static_cast<size_t>(m_phase) * m_taps;
+            for (size_t channel = 0; channel < m_channels; channel++)
+            {
+                auto value = Dot(coefficients, m_window.data() + channel * m_stride + m_index, m_taps);
+                output[produced * m_channels + channel] = static_cast<int16_t>(std::lrint(std::min(std::max(value, -32768.0f), 32767.0f)));
+            }
+            produced++;
+
+            m_phase += m_downFactor;
+            m_index += m_phase / m_upFactor;
+            m_phase %= m_upFactor;
+        }
+        m_index -= frames;
+
+        for (size_t channel = 0; channel < m_channels; channel++)
+        {
+            auto window = m_window.data() + channel * m_stride;
+            std::memmove(window, window + frames, history * sizeof(float));
+        }
+        return produced;
+    }
+
+    const uint32_t m_upFactor;
+    const uint32_t m_downFactor;
+    const uint8_t m_channels;
+    const uint32_t m_taps;
+    const size_t m_stride;
+
+    std::vector<float> m_coefficients;
+    std::vector<float> m_window;
+    size_t m_index;
+    uint32_t m_phase = 0;
+};
+
+/// <summary>
+/// Resamples 16 bit PCM to the rate of a <see cref="PushAudioInputStream"/> before writing it.
+/// </summary>
+class PushAudioInputStreamResampler
+{
+public:
+
+    /// <summary>
+    /// Creates a resampling writer.
+    /// </summary>
+    /// <param name="stream">The stream to write to, created with the output rate.</param>
+    /// <param name="inputRate">Sample rate of the audio passed to <see cref="Write"/>.</param>
+    /// <param name="outputRate">Sample rate of the stream.</param>
+    /// <param name="channels">Number of interleaved channels.</param>
+    /// <returns>A shared pointer to the resampling writer.</returns>
+    static std::shared_ptr<PushAudioInputStreamResampler> Create(std::shared_ptr<PushAudioInputStream> stream, uint32_t inputRate, uint32_t outputRate = 16000, uint8_t channels = 1)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, stream == nullptr);
+        return std::shared_ptr<PushAudioInputStreamResampler>(new PushAudioInputStreamResampler(std::move(stream), AudioResampler::Create(inputRate, outputRate, channels)));
+    }
+
+    /// <summary>
+    /// Resamples the audio and writes it to the stream. A trailing partial frame is kept until the next call.
+    /// </summary>
+    /// <param name="dataBuffer">Interleaved 16 bit PCM, without any audio header.</param>
+    /// <param name="size">The size of the buffer in bytes.</param>
+    void Write(const uint8_t* dataBuffer, size_t size)
+    {
+        while (size > 0)
+        {
+            // Fill the staging block to whole frames, then resample it; the staging buffers never grow.
+            auto take = std::min(size, m_input.size() * sizeof(int16_t) - m_inputBytes);
+            std::memcpy(reinterpret_cast<uint8_t*>(m_input.data()) + m_inputBytes, dataBuffer, take);
+            m_inputBytes += take;
+            dataBuffer += take;
+            size -= take;
+
+            auto frames = m_inputBytes / m_blockAlign;
+            if (frames == 0)
+            {
+                break;
+            }
+            auto produced = m_resampler->Process(m_input.data(), frames, m_output.data());
+            auto consumed = frames * m_blockAlign;
+            std::memmove(m_input.data(), reinterpret_cast<uint8_t*>(m_input.data()) + consumed, m_inputBytes - consumed);
+            m_inputBytes -= consumed;
+
+            if (produced > 0)
+            {
+                m_stream->Write(reinterpret_cast<uint8_t*>(m_output.data()), static_cast<uint32_t>(produced * m_blockAlign));
+            }
+        }
+    }
+
+    /// <summary>
+    /// Writes the audio still held back by the filter and closes the stream. A trailing partial frame is dropped.
+    /// </summary>
+    void Close()
+    {
+        m_inputBytes = 0;
+        auto produced = m_resampler->Flush(m_output.data());
+        if (produced > 0)
+        {
+            m_stream->Write(reinterpret_cast<uint8_t*>(m_output.data()), static_cast<uint32_t>(produced * m_blockAlign));
+        }
+        m_stream->Close();
+    }
+
+private:
+
+    DISABLE_COPY_AND_MOVE(PushAudioInputStreamResampler);
+
+    PushAudioInputStreamResampler(std::shared_ptr<PushAudioInputStream> stream, std::shared_ptr<AudioResampler> resampler) :
+        m_stream(std::move(stream)),
+        m_resampler(std::move(resampler)),
+        m_blockAlign(m_resampler->GetChannels() * sizeof(int16_t)),
+        m_input(AudioResampler::MaxBlockFrames * m_resampler->GetChannels()),
+        m_output(m_resampler->GetMaxOutputFrames(AudioResampler::MaxBlockFrames) * m_resampler->GetChannels())
+    {
+    }
+
+    std::shared_ptr<PushAudioInputStream> m_stream;
+    std::shared_ptr<AudioResampler> m_resampler;
+    const size_t m_blockAlign;
+    std::vector<int16_t> m_input;
+    size_t m_inputBytes = 0;
+    std::vector<int16_t> m_output;
+};
+
+/// <summary>
+/// PullAudioInputStreamCallback that reads 16 bit PCM at another sample rate from an inner callback and resamples it,
+/// e.g. <c>AudioInputStream::CreatePullStream(AudioStreamFormat::GetDefaultInputFormat(), ResamplingPullAudioInputStreamCallback::Create(capture, 48000))</c>.
+/// Combine with <see cref="ConvertingPullAudioInputStreamCallback"/> for non-PCM16 sources.
+/// </summary>
+class ResamplingPullAudioInputStreamCallback : public PullAudioInputStreamCallback
+{
+public:
+
+    /// <summary>
+    /// Creates a resampling callback.
+    /// </summary>
+    /// <param name="source">Callback that provides interleaved 16 bit PCM at the input rate.</param>
+    /// <param name="inputRate">Sample rate of <paramref name="source"/>.</param>
+    /// <param name="outputRate">Sample rate to provide.</param>
+    /// <param name="channels">Number of interleaved channels.</param>
+    /// <returns>A shared pointer to the callback.</returns>
+    static std::shared_ptr<ResamplingPullAudioInputStreamCallback> Create(std::shared_ptr<PullAudioInputStreamCallback> source, uint32_t inputRate, uint32_t outputRate = 16000, uint8_t channels = 1)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, source == nullptr);
+        return std::shared_ptr<ResamplingPullAudioInputStreamCallback>(new ResamplingPullAudioInputStreamCallback(std::move(source), AudioResampler::Create(inputRate, outputRate, channels)));
+    }
+
+    /// <summary>
+    /// Reads audio from the inner callback and resamples it.
+    /// </summary>
+    /// <param name="dataBuffer">The buffer to copy the resampled audio into.</param>
+    /// <param name="size">The size of the buffer.</param>
+    /// <returns>The number of bytes copied, or zero to indicate end of stream.</returns>
+    int Read(uint8_t* dataBuffer, uint32_t size) override
+    {
+        size -= size % m_blockAlign;
+        if (size == 0)
+        {
+            return 0;
+        }
+
+        while (m_outputOffset == m_outputBytes)
+        {
+            // Read up to one block of input, keeping any partial frame left by the previous read.
+            auto capacity = m_input.size() * sizeof(int16_t);
+            auto read = m_flushed ? 0 : m_source->Read(reinterpret_cast<uint8_t*>(m_input.data()) + m_inputBytes, static_cast<uint32_t>(capacity - m_inputBytes));
+            if (read <= 0)
+            {
+                // At the end of the source, release the audio held back by the filter once, then report the end.
+                if (m_flushed)
+                {
+                    return 0;
+                }
+                m_flushed = true;
+                m_inputBytes = 0;
+                m_outputOffset = 0;
+                m_outputBytes = m_resampler->Flush(m_output.data()) * m_blockAlign;
+                continue;
+            }
+            m_inputBytes += static_cast<size_t>(read);
+
+            auto frames = m_inputBytes / m_blockAlign;
+            auto produced = m_resampler->Process(m_input.data(), frames, m_output.data());
+            auto consumed = frames * m_blockAlign;
+            std::memmove(m_input.data(), reinterpret_cast<uint8_t*>(m_input.data()) + consumed, m_inputBytes - consumed);
+            m_inputBytes -= consumed;
+
+            m_outputOffset = 0;
+            m_outputBytes = produced * m_blockAlign;
+        }
+
+        auto count = std::min<size_t>(size, m_outputBytes - m_outputOffset);
+        std::memcpy(dataBuffer, reinterpret_cast<uint8_t*>(m_output.data()) + m_outputOffset, count);
+        m_outputOffset += count;
+        return static_cast<int>(count);
+    }
+
+    /// <summary>
+    /// Forwards the property request to the inner callback.
+    /// </summary>
+    /// <param name="id">The id of the property.</param>
+    /// <returns>The value of the property.</returns>
+    SPXSTRING GetProperty(PropertyId id) override
+    {
+        return m_source->GetProperty(id);
+    }
+
+    /// <summary>
+    /// Closes the inner callback.
+    /// </summary>
+    void Close() override
+    {
+        m_source->Close();
+    }
+
+private:
+
+    DISABLE_DEFAULT_CTORS(ResamplingPullAudioInputStreamCallback);
+
+    ResamplingPullAudioInputStreamCallback(std::shared_ptr<PullAudioInputStreamCallback> source, std::shared_ptr<AudioResampler> resampler) :
+        m_source(std::move(source)),
+        m_resampler(std::move(resampler)),
+        m_blockAlign(m_resampler->GetChannels() * sizeof(int16_t)),
+        m_input(AudioResampler::MaxBlockFrames * m_resampler->GetChannels()),
+        m_output(m_resampler->GetMaxOutputFrames(AudioResampler::MaxBlockFrames) * m_resampler->GetChannels())
+    {
+    }
+
+    std::shared_ptr<PullAudioInputStreamCallback> m_source;
+    std::shared_ptr<AudioResampler> m_resampler;
+    const size_t m_blockAlign;
+    std::vector<int16_t> m_input;
+    size_t m_inputBytes = 0;
+    std::vector<int16_t> m_output;
+    size_t m_outputOffset = 0;
+    size_t m_outputBytes = 0;
+    bool m_flushed = false;
+};
+
+} } } } // Microsoft::CognitiveServices::Speech::Audio
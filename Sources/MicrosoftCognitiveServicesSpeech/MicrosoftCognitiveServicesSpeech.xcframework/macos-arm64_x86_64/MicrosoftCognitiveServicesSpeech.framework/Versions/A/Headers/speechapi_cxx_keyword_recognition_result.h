@@ -25,7 +25,7 @@ public:
     explicit KeywordRecognitionResult(SPXRESULTHANDLE hresult) :
         RecognitionResult(hresult)
     {
-        SPX_DBG_TRACE_VERBOSE("%s (this=0x%p, handle=0x%p) -- resultid=%s; reason=0x%x; text=%s", __FUNCTION__, (void*)this, (void*)Handle, Utils::ToUTF8(ResultId).c_str(), Reason, Utils::ToUTF8(Text).c_str());
+        SPX_DBG_TRACE_VERBOSE("%s (this=0x%p, handle=0x%p) -- resultid=%s; reason=0x%x; text=%s", __FUNCTION__, (void*)this, (void*)Handle, Utils::ToUTF8(GetResultId()).c_str(), Reason, Utils::ToUTF8(GetText()).c_str());
     }
 
     virtual ~KeywordRecognitionResult() = default;
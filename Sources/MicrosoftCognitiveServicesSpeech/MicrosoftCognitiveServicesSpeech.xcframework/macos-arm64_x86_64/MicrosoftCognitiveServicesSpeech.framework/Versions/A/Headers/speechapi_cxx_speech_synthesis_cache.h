@@ -0,0 +1,1455 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_speech_synthesis_cache.h: Public API declarations for SpeechSynthesisCache and CachingSpeechSynthesizer,
+// which serve repeated synthesis requests from memory or disk instead of the service
+//
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "speechapi_cxx_common.h"
+#include "speechapi_cxx_string_helpers.h"
+#include "speechapi_cxx_enums.h"
+#include "speechapi_cxx_executor.h"
+#include "speechapi_cxx_async_operation.h"
+#include "speechapi_cxx_audio_data_stream.h"
+#include "speechapi_cxx_speech_synthesis_result.h"
+#include "speechapi_cxx_speech_synthesizer.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+
+/// <summary>
+/// Word boundary recorded with a cached synthesis. See <see cref="SpeechSynthesisWordBoundaryEventArgs"/>.
+/// </summary>
+struct CachedWordBoundary
+{
+    /// <summary>
+    /// Audio offset, in ticks (100 nanoseconds).
+    /// </summary>
+    uint64_t AudioOffset = 0;
+
+    /// <summary>
+    /// Time duration of the audio.
+    /// </summary>
+    std::chrono::milliseconds Duration{ 0 };
+
+    /// <summary>
+    /// Text offset.
+    /// </summary>
+    uint32_t TextOffset = 0;
+
+    /// <summary>
+    /// Word length.
+    /// </summary>
+    uint32_t WordLength = 0;
+
+    /// <summary>
+    /// The text.
+    /// </summary>
+    SPXSTRING Text;
+
+    /// <summary>
+    /// Boundary type.
+    /// </summary>
+    SpeechSynthesisBoundaryType BoundaryType = SpeechSynthesisBoundaryType::Word;
+};
+
+/// <summary>
+/// Viseme recorded with a cached synthesis. See <see cref="SpeechSynthesisVisemeEventArgs"/>.
+/// </summary>
+struct CachedViseme
+{
+    /// <summary>
+    /// Audio offset, in ticks (100 nanoseconds).
+    /// </summary>
+    uint64_t AudioOffset = 0;
+
+    /// <summary>
+    /// Viseme ID.
+    /// </summary>
+    uint32_t VisemeId = 0;
+
+    /// <summary>
+    /// Animation, could be svg or other format.
+    /// </summary>
+    SPXSTRING Animation;
+};
+
+/// <summary>
+/// Synthesized audio and its events, as stored in a <see cref="SpeechSynthesisCache"/>. Immutable.
+/// </summary>
+class CachedSpeechSynthesis
+{
+public:
+
+    /// <summary>
+    /// Destructor. Unmaps the audio of an entry loaded from disk.
+    /// </summary>
+    ~CachedSpeechSynthesis()
+    {
+        if (m_mapping != nullptr)
+        {
+            ::munmap(m_mapping, m_length);
+        }
+    }
+
+    /// <summary>
+    /// Gets the synthesized audio, in the output format of the synthesizer (including the header for RIFF formats).
+    /// The memory is owned by this object.
+    /// </summary>
+    /// <returns>Pointer to the audio data.</returns>
+    const uint8_t* GetAudioData() const { return m_data; }
+
+    /// <summary>
+    /// Gets the size of the synthesized audio in bytes.
+    /// </summary>
+    /// <returns>Size of the audio data.</returns>
+    size_t GetAudioLength() const { return m_length; }
+
+    /// <summary>
+    /// Gets the duration of the synthesized audio.
+    /// </summary>
+    /// <returns>Duration of the audio.</returns>
+    std::chrono::milliseconds GetAudioDuration() const { return m_duration; }
+
+    /// <summary>
+    /// Gets the word boundaries raised during the synthesis, in audio offset order.
+    /// </summary>
+    /// <returns>The word boundaries.</returns>
+    const std::vector<CachedWordBoundary>& GetWordBoundaries() const { return m_wordBoundaries; }
+
+    /// <summary>
+    /// Gets the visemes raised during the synthesis, in audio offset order.
+    /// </summary>
+    /// <returns>The visemes.</returns>
+    const std::vector<CachedViseme>& GetVisemes() const { return m_visemes; }
+
+    /// <summary>
+    /// Indicates whether the audio can be served through <see cref="OpenStream"/>, i.e. it is RIFF audio stored
+    /// in the disk tier and its file has not been evicted since.
+    /// </summary>
+    /// <returns>true if OpenStream() can be called.</returns>
+    bool CanOpenStream() const
+    {
+        return !m_fileName.empty() && IsRiff() && ::access(Utils::ToUTF8(m_fileName).c_str(), R_OK) == 0;
+    }
+
+    /// <summary>
+    /// Opens the audio as an AudioDataStream, which reads it from the disk tier without the RIFF header,
+    /// like a stream obtained from a synthesis result.
+    /// </summary>
+    /// <remarks>
+    /// The disk tier may evict the file at any time (also from another process sharing the directory), even
+    /// while this entry is still in memory, in which case this throws; the in-memory audio stays valid.
+    /// </remarks>
+    /// <returns>A new audio data stream.</returns>
+    std::shared_ptr<AudioDataStream> OpenStream() const
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_STATE, m_fileName.empty());
+        SPX_THROW_HR_IF(SPXERR_UNSUPPORTED_FORMAT, !IsRiff());
+        return AudioDataStream::FromWavFileInput(m_fileName);
+    }
+
+    /// <summary>
+    /// Replays the recorded word boundaries and visemes in audio offset order, on the calling thread.
+    /// </summary>
+    /// <param name="wordBoundary">Callback for word boundaries, or nullptr.</param>
+    /// <param name="viseme">Callback for visemes, or nullptr.</param>
+    void Replay(std::function<void(const CachedWordBoundary&)> wordBoundary, std::function<void(const CachedViseme&)> viseme) const
+    {
+        auto boundary = m_wordBoundaries.begin();
+        auto visemeIt = m_visemes.begin();
+        while (boundary != m_wordBoundaries.end() || visemeIt != m_visemes.end())
+        {
+            if (visemeIt == m_visemes.end() || (boundary != m_wordBoundaries.end() && boundary->AudioOffset <= visemeIt->AudioOffset))
+            {
+                if (wordBoundary != nullptr)
+                {
+                    wordBoundary(*boundary);
+                }
+                ++boundary;
+            }
+            else
+            {
+                if (viseme != nullptr)
+                {
+                    viseme(*visemeIt);
+                }
+                ++visemeIt;
+            }
+        }
+    }
+
+private:
+
+    friend class SpeechSynthesisCache;
+
+    DISABLE_COPY_AND_MOVE(CachedSpeechSynthesis);
+
+    CachedSpeechSynthesis(std::string key, std::chrono::milliseconds duration, std::vector<CachedWordBoundary> wordBoundaries, std::vector<CachedViseme> visemes) :
+        m_key(std::move(key)),
+        m_duration(duration),
+        m_wordBoundaries(std::move(wordBoundaries)),
+        m_visemes(std::move(visemes))
+    {
+        std::stable_sort(m_wordBoundaries.begin(), m_wordBoundaries.end(), [](const CachedWordBoundary& a, const CachedWordBoundary& b) { return a.AudioOffset < b.AudioOffset; });
+        std::stable_sort(m_visemes.begin(), m_visemes.end(), [](const CachedViseme& a, const CachedViseme& b) { return a.AudioOffset < b.AudioOffset; });
+    }
+
+    bool IsRiff() const
+    {
+        return m_length >= 12 && std::memcmp(m_data, "RIFF", 4) == 0 && std::memcmp(m_data + 8, "WAVE", 4) == 0;
+    }
+
+    size_t GetFootprint() const
+    {
+        size_t size = m_length + m_key.size();
+        for (const auto& boundary : m_wordBoundaries)
+        {
+            size += sizeof(boundary) + boundary.Text.size();
+        }
+        for (const auto& viseme : m_visemes)
+        {
+            size += sizeof(viseme) + viseme.Animation.size();
+        }
+        return size;
+    }
+
+    const std::string m_key;
+    const std::chrono::milliseconds m_duration;
+    std::vector<CachedWordBoundary> m_wordBoundaries;
+    std::vector<CachedViseme> m_visemes;
+
+    std::vector<uint8_t> m_audio;
+    void* m_mapping = nullptr;
+    const uint8_t* m_data = nullptr;
+    size_t m_length = 0;
+    SPXSTRING m_fileName;
+};
+
+/// <summary>
+/// Counters of a <see cref="SpeechSynthesisCache"/> since it was created.
+/// </summary>
+struct SpeechSynthesisCacheStatistics
+{
+    /// <summary>
+    /// Number of lookups.
+    /// </summary>
+    uint64_t Lookups = 0;
+
+    /// <summary>
+    /// Lookups served from the memory tier.
+    /// </summary>
+    uint64_t MemoryHits = 0;
+
+    /// <summary>
+    /// Lookups served from the disk tier.
+    /// </summary>
+    uint64_t DiskHits = 0;
+
+    /// <summary>
+    /// Lookups that required a synthesis.
+    /// </summary>
+    uint64_t Misses = 0;
+
+    /// <summary>
+    /// Bytes of audio served from the cache, i.e. the synthesis output saved.
+    /// </summary>
+    uint64_t BytesSaved = 0;
+
+    /// <summary>
+    /// Entries evicted from the memory tier.
+    /// </summary>
+    uint64_t MemoryEvictions = 0;
+
+    /// <summary>
+    /// Entries evicted from the disk tier.
+    /// </summary>
+    uint64_t DiskEvictions = 0;
+
+    /// <summary>
+    /// Current size of the memory tier in bytes.
+    /// </summary>
+    uint64_t MemoryBytes = 0;
+
+    /// <summary>
+    /// Current size of the disk tier in bytes.
+    /// </summary>
+    uint64_t DiskBytes = 0;
+
+    /// <summary>
+    /// Gets the fraction of lookups served from either tier.
+    /// </summary>
+    /// <returns>The hit rate between 0 and 1, or 0 if there were no lookups.</returns>
+    double GetHitRate() const
+    {
+        return Lookups > 0 ? static_cast<double>(MemoryHits + DiskHits) / static_cast<double>(Lookups) : 0;
+    }
+};
+
+/// <summary>
+/// Two-tier cache of synthesized audio keyed by voice, output format, other audio settings and normalized input: a least recently used
+/// set of entries in memory in front of an optional directory of entries whose audio is memory-mapped when read.
+/// The disk tier is shared by all caches (and processes) using the same directory and survives restarts.
+/// Use it through <see cref="CachingSpeechSynthesizer"/>. All methods are thread-safe.
+/// </summary>
+class SpeechSynthesisCache
+{
+public:
+
+    /// <summary>
+    /// Creates a cache.
+    /// </summary>
+    /// <param name="memoryBudgetBytes">Maximum size of the memory tier in bytes.</param>
+    /// <param name="directory">Directory of the disk tier, created if missing, or empty for no disk tier.</param>
+    /// <param name="diskBudgetBytes">Maximum size of the disk tier in bytes.</param>
+    /// <returns>A shared pointer to the cache.</returns>
+    static std::shared_ptr<SpeechSynthesisCache> Create(size_t memoryBudgetBytes = 64 * 1024 * 1024, const SPXSTRING& directory = SPXSTRING(), uint64_t diskBudgetBytes = 1024ull * 1024 * 1024)
+    {
+        auto cache = std::shared_ptr<SpeechSynthesisCache>(new SpeechSynthesisCache(memoryBudgetBytes, Utils::ToUTF8(directory), diskBudgetBytes));
+        if (!cache->m_directory.empty())
+        {
+            cache->LoadDiskIndex();
+        }
+        return cache;
+    }
+
+    /// <summary>
+    /// Builds the cache key of a synthesis request.
+    /// </summary>
+    /// <param name="voiceName">Name of the voice, see <see cref="PropertyId::SpeechServiceConnection_SynthVoice"/>.</param>
+    /// <param name="outputFormat">Output format, see <see cref="PropertyId::SpeechServiceConnection_SynthOutputFormat"/>.</param>
+    /// <param name="input">Plain text or SSML.</param>
+    /// <param name="isSsml">Whether the input is SSML.</param>
+    /// <param name="settings">
+    /// Any other settings that change the synthesized audio, e.g. language, endpoint or custom voice deployment id,
+    /// in a stable form; see <see cref="CachingSpeechSynthesizer::GetKey"/>. Must not contain newlines.
+    /// </param>
+    /// <returns>The key.</returns>
+    static std::string MakeKey(const SPXSTRING& voiceName, const SPXSTRING& outputFormat, const std::string& input, bool isSsml, const std::string& settings = std::string())
+    {
+        std::string key = Utils::ToUTF8(voiceName);
+        key += '\n';
+        key += Utils::ToUTF8(outputFormat);
+        key += '\n';
+        key += settings;
+        key += isSsml ? "\nssml\n" : "\ntext\n";
+        key += NormalizeInput(input, isSsml);
+        return key;
+    }
+
+    /// <summary>
+    /// Normalizes text or SSML for use in a key by collapsing each run of whitespace to one space. Whitespace is
+    /// only dropped where it cannot be spoken: in SSML, around the structural elements (the XML declaration,
+    /// speak and voice) when nothing but other structural elements or the ends of the input surround it.
+    /// Markup itself (element names, attribute values such as phoneme ph="...", comments) is kept verbatim.
+    /// </summary>
+    /// <param name="input">Plain text or SSML.</param>
+    /// <param name="isSsml">Whether the input is SSML.</param>
+    /// <returns>The normalized input.</returns>
+    static std::string NormalizeInput(const std::string& input, bool isSsml)
+    {
+        std::string normalized;
+        normalized.reserve(input.size());
+        bool pendingSpace = false;
+        bool afterStructural = true;
+        for (size_t position = 0; position < input.size(); position++)
+        {
+            auto ch = input[position];
+            if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')
+            {
+                pendingSpace = true;
+                continue;
+            }
+
+            if (isSsml && ch == '<')
+            {
+                auto end = FindMarkupEnd(input, position);
+                auto structural = IsStructuralMarkup(input, position);
+                if (pendingSpace && !(afterStructural && structural))
+                {
+                    normalized += ' ';
+                }
+                normalized.append(input, position, end - position);
+                position = end - 1;
+                pendingSpace = false;
+                afterStructural = structural;
+                continue;
+            }
+
+            if (pendingSpace)
+            {
+                normalized += ' ';
+            }
+            normalized += ch;
+            pendingSpace = false;
+            afterStructural = false;
+        }
+        if (pendingSpace && !(isSsml && afterStructural))
+        {
+            normalized += ' ';
+        }
+        return normalized;
+    }
+
+    /// <summary>
+    /// Looks up an entry, first in memory, then on disk. Entries found on disk are moved into the memory tier.
+    /// </summary>
+    /// <param name="key">The key, see <see cref="MakeKey"/>.</param>
+    /// <returns>The entry, or nullptr on a miss.</returns>
+    std::shared_ptr<const CachedSpeechSynthesis> Find(const std::string& key)
+    {
+        auto name = GetFileName(key);
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_statistics.Lookups++;
+            auto item = m_memoryIndex.find(key);
+            if (item != m_memoryIndex.end())
+            {
+                m_memory.splice(m_memory.begin(), m_memory, item->second);
+                auto entry = *item->second;
+                auto touchFile = TouchDiskLocked(name);
+                m_statistics.MemoryHits++;
+                m_statistics.BytesSaved += entry->GetAudioLength();
+                lock.unlock();
+
+                // Keeps the file's place in the disk tier's order across restarts, as disk hits do.
+                if (touchFile)
+                {
+                    TouchMetadataFile(name);
+                }
+                return entry;
+            }
+            if (m_diskIndex.find(name) == m_diskIndex.end())
+            {
+                m_statistics.Misses++;
+                return nullptr;
+            }
+        }
+
+        auto entry = LoadFromDisk(key, name);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (entry == nullptr)
+        {
+            m_statistics.Misses++;
+            return nullptr;
+        }
+        TouchDiskLocked(name);
+        m_statistics.DiskHits++;
+        m_statistics.BytesSaved += entry->GetAudioLength();
+        return AddToMemoryLocked(entry);
+    }
+
+    /// <summary>
+    /// Adds the output of a synthesis to both tiers, replacing an existing entry with the same key.
+    /// Failures to write the disk tier are traced and otherwise ignored.
+    /// </summary>
+    /// <param name="key">The key, see <see cref="MakeKey"/>.</param>
+    /// <param name="audio">The synthesized audio.</param>
+    /// <param name="duration">Duration of the audio.</param>
+    /// <param name="wordBoundaries">Word boundaries raised during the synthesis.</param>
+    /// <param name="visemes">Visemes raised during the synthesis.</param>
+    /// <returns>The new entry.</returns>
+    std::shared_ptr<const CachedSpeechSynthesis> Insert(const std::string& key, std::vector<uint8_t> audio, std::chrono::milliseconds duration, std::vector<CachedWordBoundary> wordBoundaries = {}, std::vector<CachedViseme> visemes = {})
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, audio.empty());
+
+        auto entry = std::shared_ptr<CachedSpeechSynthesis>(new CachedSpeechSynthesis(key, duration, std::move(wordBoundaries), std::move(visemes)));
+        entry->m_audio = std::move(audio);
+        entry->m_data = entry->m_audio.data();
+        entry->m_length = entry->m_audio.size();
+
+        uint64_t diskSize = 0;
+        auto name = GetFileName(key);
+        if (!m_directory.empty() && WriteToDisk(*entry, name, diskSize))
+        {
+            entry->m_fileName = GetPath(name, ".audio");
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (diskSize > 0)
+        {
+            AddToDiskLocked(name, diskSize);
+        }
+        return AddToMemoryLocked(entry);
+    }
+
+    /// <summary>
+    /// Indicates whether the cache has a disk tier.
+    /// </summary>
+    /// <returns>true if a directory was given.</returns>
+    bool HasDiskTier() const { return !m_directory.empty(); }
+
+    /// <summary>
+    /// Removes all entries from the memory tier. The disk tier is kept.
+    /// </summary>
+    void ClearMemory()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_memory.clear();
+        m_memoryIndex.clear();
+        m_statistics.MemoryBytes = 0;
+    }
+
+    /// <summary>
+    /// Gets the counters of the cache.
+    /// </summary>
+    /// <returns>The counters.</returns>
+    SpeechSynthesisCacheStatistics GetStatistics() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_statistics;
+    }
+
+private:
+
+    friend class ParallelSpeechSynthesizer;
+
+    DISABLE_COPY_AND_MOVE(SpeechSynthesisCache);
+
+    struct DiskEntry
+    {
+        std::string name;
+        uint64_t size;
+        std::chrono::system_clock::time_point touched;
+    };
+
+    // Memory hits refresh the modification time of a file at most this often.
+    static std::chrono::system_clock::duration GetTouchInterval() { return std::chrono::minutes(1); }
+
+    static constexpr size_t MetadataMagicSize = 8;
+
+    static const char* GetMetadataMagic() { return "SPXSYNC1"; }
+
+    SpeechSynthesisCache(size_t memoryBudgetBytes, std::string directory, uint64_t diskBudgetBytes) :
+        m_memoryBudget(memoryBudgetBytes),
+        m_directory(std::move(directory)),
+        m_diskBudget(diskBudgetBytes)
+    {
+    }
+
+    static std::string GetFileName(const std::string& key)
+    {
+        // FNV-1a; the full key is stored with the entry, so a collision is a miss rather than a wrong answer.
+        uint64_t hash = 14695981039346656037ull;
+        for (auto ch : key)
+        {
+            hash = (hash ^ static_cast<uint8_t>(ch)) * 1099511628211ull;
+        }
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+        return name;
+    }
+
+    // Returns the position after the markup starting at start, skipping '>' inside comments and quoted attribute values.
+    static size_t FindMarkupEnd(const std::string& input, size_t start)
+    {
+        if (input.compare(start, 4, "<!--") == 0)
+        {
+            auto end = input.find("-->", start + 4);
+            return end == std::string::npos ? input.size() : end + 3;
+        }
+
+        char quote = 0;
+        for (auto position = start + 1; position < input.size(); position++)
+        {
+            auto ch = input[position];
+            if (quote != 0)
+            {
+                quote = ch == quote ? 0 : quote;
+            }
+            else if (ch == '"' || ch == '\'')
+            {
+                quote = ch;
+            }
+            else if (ch == '>')
+            {
+                return position + 1;
+            }
+        }
+        return input.size();
+    }
+
+    // Whether the markup starting at start is the XML declaration or a speak or voice tag, between which
+    // whitespace is not spoken.
+    static bool IsStructuralMarkup(const std::string& input, size_t start)
+    {
+        auto position = start + 1;
+        if (position < input.size() && input[position] == '?')
+        {
+            return true;
+        }
+        if (position < input.size() && input[position] == '/')
+        {
+            position++;
+        }
+        auto end = input.find_first_of(" \t\r\n/>", position);
+        auto name = input.substr(position, (end == std::string::npos ? input.size() : end) - position);
+        return name == "speak" || name == "voice";
+    }
+
+    std::string GetPath(const std::string& name, const char* extension) const
+    {
+        return m_directory + "/" + name + extension;
+    }
+
+    std::shared_ptr<const CachedSpeechSynthesis> AddToMemoryLocked(const std::shared_ptr<const CachedSpeechSynthesis>& entry)
+    {
+        auto existing = m_memoryIndex.find(entry->m_key);
+        if (existing != m_memoryIndex.end())
+        {
+            m_statistics.MemoryBytes -= (*existing->second)->GetFootprint();
+            m_memory.erase(existing->second);
+            m_memoryIndex.erase(existing);
+        }
+
+        auto size = entry->GetFootprint();
+        if (size > m_memoryBudget)
+        {
+            return entry;
+        }
+        while (m_statistics.MemoryBytes + size > m_memoryBudget)
+        {
+            m_statistics.MemoryBytes -= m_memory.back()->GetFootprint();
+            m_memoryIndex.erase(m_memory.back()->m_key);
+            m_memory.pop_back();
+            m_statistics.MemoryEvictions++;
+        }
+        m_memory.push_front(entry);
+        m_memoryIndex[entry->m_key] = m_memory.begin();
+        m_statistics.MemoryBytes += size;
+        return entry;
+    }
+
+    // Moves the file to the front of the disk tier; returns true if its modification time is due for a refresh,
+    // which the caller does after unlocking.
+    bool TouchDiskLocked(const std::string& name)
+    {
+        auto item = m_diskIndex.find(name);
+        if (item == m_diskIndex.end())
+        {
+            return false;
+        }
+        m_disk.splice(m_disk.begin(), m_disk, item->second);
+
+        auto now = std::chrono::system_clock::now();
+        auto& entry = *item->second;
+        if (now - entry.touched < GetTouchInterval())
+        {
+            return false;
+        }
+        entry.touched = now;
+        return true;
+    }
+
+    void TouchMetadataFile(const std::string& name) const
+    {
+        // Refreshes the modification time that orders the disk tier across restarts.
+        ::utimensat(AT_FDCWD, GetPath(name, ".meta").c_str(), nullptr, 0);
+    }
+
+    void AddToDiskLocked(const std::string& name, uint64_t size)
+    {
+        auto existing = m_diskIndex.find(name);
+        if (existing != m_diskIndex.end())
+        {
+            m_statistics.DiskBytes -= existing->second->size;
+            m_disk.erase(existing->second);
+            m_diskIndex.erase(existing);
+        }
+        m_disk.push_front(DiskEntry{ name, size, std::chrono::system_clock::now() });
+        m_diskIndex[name] = m_disk.begin();
+        m_statistics.DiskBytes += size;
+        EvictDiskLocked(1);
+    }
+
+    // Removes the least recently used files until the disk tier fits its budget, keeping at least minEntries.
+    // Memory entries may still name an evicted file; their audio stays valid, only OpenStream fails.
+    void EvictDiskLocked(size_t minEntries)
+    {
+        while (m_statistics.DiskBytes > m_diskBudget && m_disk.size() > minEntries)
+        {
+            const auto& victim = m_disk.back();
+            ::unlink(GetPath(victim.name, ".meta").c_str());
+            ::unlink(GetPath(victim.name, ".audio").c_str());
+            m_statistics.DiskBytes -= victim.size;
+            m_diskIndex.erase(victim.name);
+            m_disk.pop_back();
+            m_statistics.DiskEvictions++;
+        }
+    }
+
+    void LoadDiskIndex()
+    {
+        if (::mkdir(m_directory.c_str(), 0755) != 0)
+        {
+            SPX_THROW_HR_IF(SPXERR_FILE_OPEN_FAILED, errno != EEXIST);
+        }
+        auto dir = ::opendir(m_directory.c_str());
+        SPX_THROW_HR_IF(SPXERR_FILE_OPEN_FAILED, dir == nullptr);
+
+        // Entries are ordered by the modification time of their metadata, which is refreshed on every use.
+        std::vector<std::pair<int64_t, DiskEntry>> entries;
+        while (auto item = ::readdir(dir))
+        {
+            std::string fileName = item->d_name;
+            if (IsStaleTemporaryFile(fileName))
+            {
+                ::unlink((m_directory + "/" + fileName).c_str());
+                continue;
+            }
+            if (fileName.size() != 21 || fileName.compare(16, 5, ".meta") != 0)
+            {
+                continue;
+            }
+            auto name = fileName.substr(0, 16);
+            struct stat meta, audio;
+            if (::stat(GetPath(name, ".meta").c_str(), &meta) == 0 && ::stat(GetPath(name, ".audio").c_str(), &audio) == 0)
+            {
+                entries.emplace_back(static_cast<int64_t>(meta.st_mtime), DiskEntry{ name, static_cast<uint64_t>(meta.st_size + audio.st_size), std::chrono::system_clock::from_time_t(meta.st_mtime) });
+            }
+        }
+        ::closedir(dir);
+
+        std::sort(entries.begin(), entries.end(), [](const std::pair<int64_t, DiskEntry>& a, const std::pair<int64_t, DiskEntry>& b) { return a.first > b.first; });
+        for (auto& entry : entries)
+        {
+            m_disk.push_back(std::move(entry.second));
+            m_diskIndex[m_disk.back().name] = std::prev(m_disk.end());
+            m_statistics.DiskBytes += m_disk.back().size;
+        }
+
+        // The budget may have shrunk since the directory was last used.
+        std::unique_lock<std::mutex> lock(m_mutex);
+        EvictDiskLocked(0);
+    }
+
+    // Temporary files (see WriteFile) are left behind by writers that crashed. One is stale once the process
+    // named in it is gone, or, where that cannot be checked (sandboxes, reused pids), once it is an hour old.
+    bool IsStaleTemporaryFile(const std::string& fileName) const
+    {
+        if (fileName.size() < 4 || fileName.compare(fileName.size() - 4, 4, ".tmp") != 0)
+        {
+            return false;
+        }
+
+        auto counter = fileName.rfind('.', fileName.size() - 5);
+        auto pidStart = counter == std::string::npos || counter == 0 ? std::string::npos : fileName.rfind('.', counter - 1);
+        if (pidStart != std::string::npos)
+        {
+            auto pid = static_cast<pid_t>(std::strtol(fileName.c_str() + pidStart + 1, nullptr, 10));
+            if (pid == ::getpid())
+            {
+                return false;
+            }
+            if (pid > 0 && ::kill(pid, 0) != 0 && errno == ESRCH)
+            {
+                return true;
+            }
+        }
+
+        struct stat info;
+        return ::stat((m_directory + "/" + fileName).c_str(), &info) == 0 &&
+            std::chrono::system_clock::now() - std::chrono::system_clock::from_time_t(info.st_mtime) > std::chrono::hours(1);
+    }
+
+    static void AppendUInt32(std::vector<uint8_t>& buffer, uint32_t value)
+    {
+        auto bytes = reinterpret_cast<const uint8_t*>(&value);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+    }
+
+    static void AppendUInt64(std::vector<uint8_t>& buffer, uint64_t value)
+    {
+        auto bytes = reinterpret_cast<const uint8_t*>(&value);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+    }
+
+    static void AppendString(std::vector<uint8_t>& buffer, const std::string& value)
+    {
+        AppendUInt32(buffer, static_cast<uint32_t>(value.size()));
+        buffer.insert(buffer.end(), value.begin(), value.end());
+    }
+
+    class MetadataReader
+    {
+    public:
+        MetadataReader(const std::vector<uint8_t>& buffer) : m_position(buffer.data()), m_end(buffer.data() + buffer.size()) {}
+
+        bool Read(void* value, size_t size)
+        {
+            if (static_cast<size_t>(m_end - m_position) < size)
+            {
+                return false;
+            }
+            std::memcpy(value, m_position, size);
+            m_position += size;
+            return true;
+        }
+
+        bool ReadString(std::string& value)
+        {
+            uint32_t size = 0;
+            if (!Read(&size, sizeof(size)) || static_cast<size_t>(m_end - m_position) < size)
+            {
+                return false;
+            }
+            value.assign(reinterpret_cast<const char*>(m_position), size);
+            m_position += size;
+            return true;
+        }
+
+    private:
+        const uint8_t* m_position;
+        const uint8_t* m_end;
+    };
+
+    static bool WriteFile(const std::string& path, const uint8_t* data, size_t size)
+    {
+        // Written under a unique temporary name and renamed, so readers never see a partial file.
+        static std::atomic<uint64_t> counter{ 0 };
+        auto temporary = path + "." + std::to_string(::getpid()) + "." + std::to_string(counter++) + ".tmp";
+        auto file = std::fopen(temporary.c_str(), "wb");
+        if (file == nullptr)
+        {
+            return false;
+        }
+        auto written = std::fwrite(data, 1, size, file) == size;
+        written = std::fclose(file) == 0 && written;
+        if (!written || std::rename(temporary.c_str(), path.c_str()) != 0)
+        {
+            ::unlink(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool WriteToDisk(const CachedSpeechSynthesis& entry, const std::string& name, uint64_t& diskSize) const
+    {
+        std::vector<uint8_t> meta(GetMetadataMagic(), GetMetadataMagic() + MetadataMagicSize);
+        AppendString(meta, entry.m_key);
+        AppendUInt64(meta, entry.m_length);
+        AppendUInt64(meta, static_cast<uint64_t>(entry.m_duration.count()));
+        AppendUInt32(meta, static_cast<uint32_t>(entry.m_wordBoundaries.size()));
+        for (const auto& boundary : entry.m_wordBoundaries)
+        {
+            AppendUInt64(meta, boundary.AudioOffset);
+            AppendUInt64(meta, static_cast<uint64_t>(boundary.Duration.count()));
+            AppendUInt32(meta, boundary.TextOffset);
+            AppendUInt32(meta, boundary.WordLength);
+            AppendUInt32(meta, static_cast<uint32_t>(boundary.BoundaryType));
+            AppendString(meta, Utils::ToUTF8(boundary.Text));
+        }
+        AppendUInt32(meta, static_cast<uint32_t>(entry.m_visemes.size()));
+        for (const auto& viseme : entry.m_visemes)
+        {
+            AppendUInt64(meta, viseme.AudioOffset);
+            AppendUInt32(meta, viseme.VisemeId);
+            AppendString(meta, Utils::ToUTF8(viseme.Animation));
+        }
+
+        // The audio goes first: metadata without audio is never indexed, audio without metadata is overwritten.
+        if (!WriteFile(GetPath(name, ".audio"), entry.m_data, entry.m_length) || !WriteFile(GetPath(name, ".meta"), meta.data(), meta.size()))
+        {
+            SPX_TRACE_ERROR("SpeechSynthesisCache: failed to write entry %s, errno %d.", name.c_str(), errno);
+            return false;
+        }
+        diskSize = meta.size() + entry.m_length;
+        return true;
+    }
+
+    std::shared_ptr<CachedSpeechSynthesis> LoadFromDisk(const std::string& key, const std::string& name) const
+    {
+        auto metaPath = GetPath(name, ".meta");
+        std::vector<uint8_t> meta;
+        auto file = std::fopen(metaPath.c_str(), "rb");
+        if (file == nullptr)
+        {
+            return nullptr;
+        }
+        uint8_t buffer[4096];
+        size_t count;
+        while ((count = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        {
+            meta.insert(meta.end(), buffer, buffer + count);
+        }
+        std::fclose(file);
+
+        MetadataReader reader(meta);
+        char magic[MetadataMagicSize];
+        std::string storedKey;
+        uint64_t length = 0, duration = 0;
+        uint32_t boundaryCount = 0, visemeCount = 0;
+        if (!reader.Read(magic, sizeof(magic)) || std::memcmp(magic, GetMetadataMagic(), sizeof(magic)) != 0 ||
+            !reader.ReadString(storedKey) || storedKey != key ||
+            !reader.Read(&length, sizeof(length)) || !reader.Read(&duration, sizeof(duration)) ||
+            !reader.Read(&boundaryCount, sizeof(boundaryCount)))
+        {
+            return nullptr;
+        }
+
+        std::vector<CachedWordBoundary> wordBoundaries;
+        for (uint32_t i = 0; i < boundaryCount; i++)
+        {
+            CachedWordBoundary boundary;
+            uint64_t boundaryDuration = 0;
+            uint32_t type = 0;
+            std::string text;
+            if (!reader.Read(&boundary.AudioOffset, sizeof(boundary.AudioOffset)) || !reader.Read(&boundaryDuration, sizeof(boundaryDuration)) ||
+                !reader.Read(&boundary.TextOffset, sizeof(boundary.TextOffset)) || !reader.Read(&boundary.WordLength, sizeof(boundary.WordLength)) ||
+                !reader.Read(&type, sizeof(type)) || !reader.ReadString(text))
+            {
+                return nullptr;
+            }
+            boundary.Duration = std::chrono::milliseconds(static_cast<int64_t>(boundaryDuration));
+            boundary.BoundaryType = static_cast<SpeechSynthesisBoundaryType>(type);
+            boundary.Text = Utils::ToSPXString(text);
+            wordBoundaries.push_back(std::move(boundary));
+        }
+
+        std::vector<CachedViseme> visemes;
+        if (!reader.Read(&visemeCount, sizeof(visemeCount)))
+        {
+            return nullptr;
+        }
+        for (uint32_t i = 0; i < visemeCount; i++)
+        {
+            CachedViseme viseme;
+            std::string animation;
+            if (!reader.Read(&viseme.AudioOffset, sizeof(viseme.AudioOffset)) || !reader.Read(&viseme.VisemeId, sizeof(viseme.VisemeId)) || !reader.ReadString(animation))
+            {
+                return nullptr;
+            }
+            viseme.Animation = Utils::ToSPXString(animation);
+            visemes.push_back(std::move(viseme));
+        }
+
+        auto audioPath = GetPath(name, ".audio");
+        auto fd = ::open(audioPath.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+        struct stat info;
+        void* mapping = MAP_FAILED;
+        if (length > 0 && ::fstat(fd, &info) == 0 && static_cast<uint64_t>(info.st_size) == length)
+        {
+            mapping = ::mmap(nullptr, static_cast<size_t>(length), PROT_READ, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            return nullptr;
+        }
+
+        TouchMetadataFile(name);
+
+        auto entry = std::shared_ptr<CachedSpeechSynthesis>(new CachedSpeechSynthesis(key, std::chrono::milliseconds(static_cast<int64_t>(duration)), std::move(wordBoundaries), std::move(visemes)));
+        entry->m_mapping = mapping;
+        entry->m_data = static_cast<const uint8_t*>(mapping);
+        entry->m_length = static_cast<size_t>(length);
+        entry->m_fileName = Utils::ToSPXString(audioPath);
+        return entry;
+    }
+
+    const size_t m_memoryBudget;
+    const std::string m_directory;
+    const uint64_t m_diskBudget;
+
+    mutable std::mutex m_mutex;
+    std::list<std::shared_ptr<const CachedSpeechSynthesis>> m_memory;
+    std::unordered_map<std::string, std::list<std::shared_ptr<const CachedSpeechSynthesis>>::iterator> m_memoryIndex;
+    std::list<DiskEntry> m_disk;
+    std::unordered_map<std::string, std::list<DiskEntry>::iterator> m_diskIndex;
+    SpeechSynthesisCacheStatistics m_statistics;
+};
+
+/// <summary>
+/// Puts a <see cref="SpeechSynthesisCache"/> in front of a SpeechSynthesizer. A request whose key (voice, output
+/// format, other audio settings and normalized input, see <see cref="GetKey"/>) is cached is answered without contacting the service; otherwise the synthesizer
+/// runs and its audio, word boundaries and visemes are added to the cache.
+/// </summary>
+/// <remarks>
+/// While it exists, the wrapper is connected to the WordBoundary, VisemeReceived, SynthesisCompleted and
+/// SynthesisCanceled events of the synthesizer to record them. Events are not raised again for cache hits;
+/// replay them with <see cref="CachedSpeechSynthesis::Replay"/>. Wrap a synthesizer at most once.
+/// Cache hits never reach the synthesizer, so their audio is not sent to its configured AudioConfig output
+/// (e.g. the default speaker, a file or an output stream); only misses are. Play or write the returned audio
+/// yourself, or create the synthesizer without audio output so that hits and misses behave the same.
+/// </remarks>
+class CachingSpeechSynthesizer
+{
+public:
+
+    /// <summary>
+    /// Creates a caching front end for a synthesizer.
+    /// </summary>
+    /// <param name="synthesizer">The synthesizer used on cache misses.</param>
+    /// <param name="cache">The cache; it may be shared by several synthesizers.</param>
+    /// <returns>A shared pointer to the caching synthesizer.</returns>
+    static std::shared_ptr<CachingSpeechSynthesizer> Create(std::shared_ptr<SpeechSynthesizer> synthesizer, std::shared_ptr<SpeechSynthesisCache> cache)
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, synthesizer == nullptr || cache == nullptr);
+        return std::shared_ptr<CachingSpeechSynthesizer>(new CachingSpeechSynthesizer(std::move(synthesizer), std::move(cache)));
+    }
+
+    /// <summary>
+    /// Destructor. Disconnects from the events of the synthesizer.
+    /// </summary>
+    ~CachingSpeechSynthesizer()
+    {
+#ifndef AZAC_CONFIG_CXX_NO_RTTI
+        // Callbacks are matched by type, and each handler type is unique to this class.
+        std::weak_ptr<Recorder> none;
+        m_synthesizer->WordBoundary.Disconnect(OnWordBoundary(none));
+        m_synthesizer->VisemeReceived.Disconnect(OnViseme(none));
+        m_synthesizer->SynthesisCompleted.Disconnect(OnCompleted(none));
+        m_synthesizer->SynthesisCanceled.Disconnect(OnCanceled(none));
+#endif
+    }
+
+    /// <summary>
+    /// Gets the cache key the synthesizer's current voice, output format and other audio settings (language,
+    /// endpoint, host, region, custom voice deployment id, backend and offline voice) give to an input.
+    /// </summary>
+    /// <param name="input">Plain text or SSML.</param>
+    /// <param name="isSsml">Whether the input is SSML.</param>
+    /// <returns>The key.</returns>
+    std::string GetKey(const std::string& input, bool isSsml) const
+    {
+        // Any of these can select a different voice model for the same voice name, e.g. a custom voice deployment.
+        static const PropertyId settings[] = {
+            PropertyId::SpeechServiceConnection_SynthLanguage,
+            PropertyId::SpeechServiceConnection_EndpointId,
+            PropertyId::SpeechServiceConnection_Endpoint,
+            PropertyId::SpeechServiceConnection_Host,
+            PropertyId::SpeechServiceConnection_Region,
+            PropertyId::SpeechServiceConnection_SynthBackend,
+            PropertyId::SpeechServiceConnection_SynthOfflineVoice
+        };
+
+        std::string values;
+        for (auto id : settings)
+        {
+            values += std::to_string(static_cast<int>(id));
+            values += '=';
+            values += Utils::ToUTF8(m_synthesizer->Properties.GetProperty(id));
+            values += ';';
+        }
+        values.erase(std::remove_if(values.begin(), values.end(), [](char ch) { return ch == '\n' || ch == '\r'; }), values.end());
+
+        return SpeechSynthesisCache::MakeKey(
+            m_synthesizer->Properties.GetProperty(PropertyId::SpeechServiceConnection_SynthVoice),
+            m_synthesizer->Properties.GetProperty(PropertyId::SpeechServiceConnection_SynthOutputFormat),
+            input, isSsml, values);
+    }
+
+    /// <summary>
+    /// Synthesizes plain text, or returns the cached synthesis, synchronously.
+    /// </summary>
+    /// <param name="text">The plain text for synthesis.</param>
+    /// <returns>The synthesis. Throws std::runtime_error with the error details if the synthesis was canceled.</returns>
+    std::shared_ptr<const CachedSpeechSynthesis> SpeakText(const std::string& text)
+    {
+        return Speak(GetKey(text, false), [this, &text]() { return m_synthesizer->SpeakText(text); });
+    }
+
+    /// <summary>
+    /// Synthesizes SSML, or returns the cached synthesis, synchronously.
+    /// </summary>
+    /// <param name="ssml">The SSML for synthesis.</param>
+    /// <returns>The synthesis. Throws std::runtime_error with the error details if the synthesis was canceled.</returns>
+    std::shared_ptr<const CachedSpeechSynthesis> SpeakSsml(const std::string& ssml)
+    {
+        return Speak(GetKey(ssml, true), [this, &ssml]() { return m_synthesizer->SpeakSsml(ssml); });
+    }
+
+    /// <summary>
+    /// Synthesizes plain text, or returns the cached synthesis, without blocking a thread.
+    /// </summary>
+    /// <param name="text">The plain text for synthesis.</param>
+    /// <returns>An operation that completes with the synthesis.</returns>
+    AsyncOperation<std::shared_ptr<const CachedSpeechSynthesis>> SpeakTextAsyncOperation(const std::string& text)
+    {
+        auto synthesizer = m_synthesizer;
+        return SpeakAsync(GetKey(text, false), [synthesizer, text]() { return synthesizer->SpeakTextAsyncOperation(text); });
+    }
+
+    /// <summary>
+    /// Synthesizes SSML, or returns the cached synthesis, without blocking a thread.
+    /// </summary>
+    /// <param name="ssml">The SSML for synthesis.</param>
+    /// <returns>An operation that completes with the synthesis.</returns>
+    AsyncOperation<std::shared_ptr<const CachedSpeechSynthesis>> SpeakSsmlAsyncOperation(const std::string& ssml)
+    {
+        auto synthesizer = m_synthesizer;
+        return SpeakAsync(GetKey(ssml, true), [synthesizer, ssml]() { return synthesizer->SpeakSsmlAsyncOperation(ssml); });
+    }
+
+    /// <summary>
+    /// Starts synthesizing plain text and returns the audio as a stream, which is read from the disk tier on a
+    /// cache hit. The synthesis is added to the cache once it completes. Without a disk tier the cache is
+    /// filled but not read.
+    /// </summary>
+    /// <param name="text">The plain text for synthesis.</param>
+    /// <returns>An audio data stream.</returns>
+    std::shared_ptr<AudioDataStream> StartSpeakingText(const std::string& text)
+    {
+        return StartSpeaking(GetKey(text, false), [this, &text]() { return m_synthesizer->StartSpeakingText(text); });
+    }
+
+    /// <summary>
+    /// Starts synthesizing SSML and returns the audio as a stream, which is read from the disk tier on a
+    /// cache hit. The synthesis is added to the cache once it completes. Without a disk tier the cache is
+    /// filled but not read.
+    /// </summary>
+    /// <param name="ssml">The SSML for synthesis.</param>
+    /// <returns>An audio data stream.</returns>
+    std::shared_ptr<AudioDataStream> StartSpeakingSsml(const std::string& ssml)
+    {
+        return StartSpeaking(GetKey(ssml, true), [this, &ssml]() { return m_synthesizer->StartSpeakingSsml(ssml); });
+    }
+
+    /// <summary>
+    /// Gets the cache.
+    /// </summary>
+    /// <returns>The cache.</returns>
+    std::shared_ptr<SpeechSynthesisCache> GetCache() const { return m_cache; }
+
+private:
+
+    DISABLE_COPY_AND_MOVE(CachingSpeechSynthesizer);
+
+    struct Recording
+    {
+        std::vector<CachedWordBoundary> wordBoundaries;
+        std::vector<CachedViseme> visemes;
+        std::shared_ptr<SpeechSynthesisResult> completed;
+        bool canceled = false;
+    };
+
+    // Events are recorded by result id while at least one request is in flight; the recordings are dropped when
+    // the last one finishes, so results of requests not made through this wrapper do not accumulate.
+    struct Recorder
+    {
+        std::shared_ptr<SpeechSynthesisCache> cache;
+        std::mutex mutex;
+        size_t inFlight = 0;
+        std::unordered_map<SPXSTRING, Recording> recordings;
+        std::unordered_map<SPXSTRING, std::string> streaming;
+
+        void Begin()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            inFlight++;
+        }
+
+        Recording End(const SPXSTRING& resultId)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            Recording recording;
+            auto item = recordings.find(resultId);
+            if (item != recordings.end())
+            {
+                recording = std::move(item->second);
+                recordings.erase(item);
+            }
+            if (--inFlight == 0)
+            {
+                recordings.clear();
+                streaming.clear();
+            }
+            return recording;
+        }
+
+        void Abandon()
+        {
+            End(SPXSTRING());
+        }
+    };
+
+    CachingSpeechSynthesizer(std::shared_ptr<SpeechSynthesizer> synthesizer, std::shared_ptr<SpeechSynthesisCache> cache) :
+        m_synthesizer(std::move(synthesizer)),
+        m_cache(cache),
+        m_recorder(std::make_shared<Recorder>())
+    {
+        m_recorder->cache = std::move(cache);
+        std::weak_ptr<Recorder> recorder = m_recorder;
+        m_synthesizer->WordBoundary.Connect(OnWordBoundary(recorder));
+        m_synthesizer->VisemeReceived.Connect(OnViseme(recorder));
+        m_synthesizer->SynthesisCompleted.Connect(OnCompleted(recorder));
+        m_synthesizer->SynthesisCanceled.Connect(OnCanceled(recorder));
+    }
+
+    static std::function<void(const SpeechSynthesisWordBoundaryEventArgs&)> OnWordBoundary(std::weak_ptr<Recorder> weakRecorder)
+    {
+        return [weakRecorder](const SpeechSynthesisWordBoundaryEventArgs& e) {
+            auto recorder = weakRecorder.lock();
+            if (recorder == nullptr)
+            {
+                return;
+            }
+            std::unique_lock<std::mutex> lock(recorder->mutex);
+            if (recorder->inFlight > 0)
+            {
+                CachedWordBoundary boundary;
+                boundary.AudioOffset = e.AudioOffset;
+                boundary.Duration = e.Duration;
+                boundary.TextOffset = e.TextOffset;
+                boundary.WordLength = e.WordLength;
+                boundary.Text = e.Text;
+                boundary.BoundaryType = e.BoundaryType;
+                recorder->recordings[e.ResultId].wordBoundaries.push_back(std::move(boundary));
+            }
+        };
+    }
+
+    static std::function<void(const SpeechSynthesisVisemeEventArgs&)> OnViseme(std::weak_ptr<Recorder> weakRecorder)
+    {
+        return [weakRecorder](const SpeechSynthesisVisemeEventArgs& e) {
+            auto recorder = weakRecorder.lock();
+            if (recorder == nullptr)
+            {
+                return;
+            }
+            std::unique_lock<std::mutex> lock(recorder->mutex);
+            if (recorder->inFlight > 0)
+            {
+                CachedViseme viseme;
+                viseme.AudioOffset = e.AudioOffset;
+                viseme.VisemeId = e.VisemeId;
+                viseme.Animation = e.Animation;
+                recorder->recordings[e.ResultId].visemes.push_back(std::move(viseme));
+            }
+        };
+    }
+
+    static std::function<void(const SpeechSynthesisEventArgs&)> OnCompleted(std::weak_ptr<Recorder> weakRecorder)
+    {
+        return [weakRecorder](const SpeechSynthesisEventArgs& e) {
+            auto recorder = weakRecorder.lock();
+            if (recorder == nullptr)
+            {
+                return;
+            }
+            std::string key;
+            {
+                std::unique_lock<std::mutex> lock(recorder->mutex);
+                if (recorder->inFlight == 0)
+                {
+                    return;
+                }
+                auto item = recorder->streaming.find(e.Result->ResultId);
+                if (item == recorder->streaming.end())
+                {
+                    // Either a synchronous request, which caches its own result, or a streaming request that has
+                    // not registered its result id yet and picks the result up from here.
+                    recorder->recordings[e.Result->ResultId].completed = e.Result;
+                    return;
+                }
+                key = std::move(item->second);
+                recorder->streaming.erase(item);
+            }
+            StoreCompleted(*recorder, key, e.Result);
+        };
+    }
+
+    static std::function<void(const SpeechSynthesisEventArgs&)> OnCanceled(std::weak_ptr<Recorder> weakRecorder)
+    {
+        return [weakRecorder](const SpeechSynthesisEventArgs& e) {
+            auto recorder = weakRecorder.lock();
+            if (recorder == nullptr)
+            {
+                return;
+            }
+            {
+                std::unique_lock<std::mutex> lock(recorder->mutex);
+                if (recorder->inFlight == 0)
+                {
+                    return;
+                }
+                if (recorder->streaming.erase(e.Result->ResultId) == 0)
+                {
+                    recorder->recordings[e.Result->ResultId].canceled = true;
+                    return;
+                }
+            }
+            recorder->End(e.Result->ResultId);
+        };
+    }
+
+    static std::shared_ptr<const CachedSpeechSynthesis> Store(Recorder& recorder, const std::string& key, const std::shared_ptr<SpeechSynthesisResult>& result, Recording recording)
+    {
+        if (result->Reason != ResultReason::SynthesizingAudioCompleted)
+        {
+            auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
+            throw std::runtime_error("Speech synthesis canceled: " + Utils::ToUTF8(cancellation->ErrorDetails));
+        }
+        auto audio = result->GetAudioData();
+        SPX_THROW_HR_IF(SPXERR_UNEXPECTED_EOF, audio == nullptr || audio->empty());
+        return recorder.cache->Insert(key, std::move(*audio), result->AudioDuration, std::move(recording.wordBoundaries), std::move(recording.visemes));
+    }
+
+    static void StoreCompleted(Recorder& recorder, const std::string& key, const std::shared_ptr<SpeechSynthesisResult>& result)
+    {
+        // Runs on the event thread or after the stream was handed out; a failure only means the entry is not cached.
+        try
+        {
+            Store(recorder, key, result, recorder.End(result->ResultId));
+        }
+        catch (const std::exception& e)
+        {
+            SPX_TRACE_ERROR("CachingSpeechSynthesizer: failed to cache a streamed synthesis: %s", e.what());
+        }
+    }
+
+    template <class F>
+    std::shared_ptr<const CachedSpeechSynthesis> Speak(const std::string& key, F speak)
+    {
+        auto cached = m_cache->Find(key);
+        if (cached != nullptr)
+        {
+            return cached;
+        }
+
+        m_recorder->Begin();
+        std::shared_ptr<SpeechSynthesisResult> result;
+        try
+        {
+            result = speak();
+        }
+        catch (...)
+        {
+            m_recorder->Abandon();
+            throw;
+        }
+        return Store(*m_recorder, key, result, m_recorder->End(result->ResultId));
+    }
+
+    template <class F>
+    AsyncOperation<std::shared_ptr<const CachedSpeechSynthesis>> SpeakAsync(const std::string& key, F speak)
+    {
+        auto cached = m_cache->Find(key);
+        if (cached != nullptr)
+        {
+            AsyncPromise<std::shared_ptr<const CachedSpeechSynthesis>> promise;
+            promise.SetValue(cached);
+            return promise.GetOperation();
+        }
+
+        auto recorder = m_recorder;
+        recorder->Begin();
+        try
+        {
+            // Storing writes the disk tier, so it runs as its own work item rather than inline in the completion.
+            return speak().Then([recorder, key](const AsyncOperation<std::shared_ptr<SpeechSynthesisResult>>& operation) {
+                std::shared_ptr<SpeechSynthesisResult> result;
+                try
+                {
+                    result = operation.Get();
+                }
+                catch (...)
+                {
+                    recorder->Abandon();
+                    throw;
+                }
+                return Store(*recorder, key, result, recorder->End(result->ResultId));
+            }, Executor::GetDefault());
+        }
+        catch (...)
+        {
+            recorder->Abandon();
+            throw;
+        }
+    }
+
+    template <class F>
+    std::shared_ptr<AudioDataStream> StartSpeaking(const std::string& key, F start)
+    {
+        // Only the disk tier can back an AudioDataStream, so without one every request is synthesized.
+        auto cached = m_cache->HasDiskTier() ? m_cache->Find(key) : nullptr;
+        if (cached != nullptr && cached->CanOpenStream())
+        {
+            try
+            {
+                return cached->OpenStream();
+            }
+            catch (const std::exception& e)
+            {
+                // Evicted between the check and the open; synthesize instead.
+                SPX_TRACE_ERROR("CachingSpeechSynthesizer: cached audio could not be opened, synthesizing: %s", e.what());
+            }
+            catch (...)
+            {
+                SPX_TRACE_ERROR("CachingSpeechSynthesizer: cached audio could not be opened, synthesizing.");
+            }
+        }
+
+        m_recorder->Begin();
+        std::shared_ptr<SpeechSynthesisResult> result;
+        try
+        {
+            result = start();
+        }
+        catch (...)
+        {
+            m_recorder->Abandon();
+            throw;
+        }
+
+        // The synthesis may already have completed or been canceled before its result id could be registered.
+        std::shared_ptr<SpeechSynthesisResult> completed;
+        bool finished = result->Reason != ResultReason::SynthesizingAudioStarted;
+        {
+            std::unique_lock<std::mutex> lock(m_recorder->mutex);
+            auto item = m_recorder->recordings.find(result->ResultId);
+            if (item != m_recorder->recordings.end() && (item->second.completed != nullptr || item->second.canceled))
+            {
+                completed = item->second.completed;
+                finished = true;
+            }
+            else if (!finished)
+            {
+                m_recorder->streaming[result->ResultId] = key;
+            }
+        }
+
+        if (completed != nullptr)
+        {
+            StoreCompleted(*m_recorder, key, completed);
+        }
+        else if (finished)
+        {
+            m_recorder->End(result->ResultId);
+        }
+        return AudioDataStream::FromResult(result);
+    }
+
+    std::shared_ptr<SpeechSynthesizer> m_synthesizer;
+    std::shared_ptr<SpeechSynthesisCache> m_cache;
+    std::shared_ptr<Recorder> m_recorder;
+};
+
+} } } // Microsoft::CognitiveServices::Speech
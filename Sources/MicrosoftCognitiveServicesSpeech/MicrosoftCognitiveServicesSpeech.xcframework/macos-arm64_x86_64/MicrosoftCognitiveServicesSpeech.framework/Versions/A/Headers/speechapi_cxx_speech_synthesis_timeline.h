@@ -0,0 +1,564 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// See https://aka.ms/csspeech/license for the full license information.
+//
+// speechapi_cxx_speech_synthesis_timeline.h: Public API declarations for SpeechSynthesisTimeline, a columnar record
+// of the word boundary and viseme events of a SpeechSynthesizer
+//
+
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "speechapi_cxx_common.h"
+#include "speechapi_cxx_string_helpers.h"
+#include "speechapi_cxx_enums.h"
+#include "speechapi_c_synthesizer.h"
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+
+class SpeechSynthesizer;
+
+/// <summary>
+/// Word boundary read from a <see cref="SpeechSynthesisTimeline"/>.
+/// </summary>
+struct SpeechSynthesisTimelineWordBoundary
+{
+    /// <summary>
+    /// Audio offset, in ticks (100 nanoseconds).
+    /// </summary>
+    uint64_t AudioOffset = 0;
+
+    /// <summary>
+    /// Duration of the audio of the word.
+    /// </summary>
+    std::chrono::milliseconds Duration{ 0 };
+
+    /// <summary>
+    /// Offset of the word in the synthesized text.
+    /// </summary>
+    uint32_t TextOffset = 0;
+
+    /// <summary>
+    /// Length of the word in the synthesized text.
+    /// </summary>
+    uint32_t WordLength = 0;
+
+    /// <summary>
+    /// Boundary type.
+    /// </summary>
+    SpeechSynthesisBoundaryType BoundaryType = SpeechSynthesisBoundaryType::Word;
+
+    /// <summary>
+    /// Id of the text, see <see cref="SpeechSynthesisTimeline::GetString"/>.
+    /// </summary>
+    uint32_t TextId = 0;
+};
+
+/// <summary>
+/// Viseme read from a <see cref="SpeechSynthesisTimeline"/>.
+/// </summary>
+struct SpeechSynthesisTimelineViseme
+{
+    /// <summary>
+    /// Audio offset, in ticks (100 nanoseconds).
+    /// </summary>
+    uint64_t AudioOffset = 0;
+
+    /// <summary>
+    /// Viseme id.
+    /// </summary>
+    uint32_t VisemeId = 0;
+
+    /// <summary>
+    /// Id of the animation, see <see cref="SpeechSynthesisTimeline::GetString"/>; 0 if there is none.
+    /// </summary>
+    uint32_t AnimationId = 0;
+};
+
+/// <summary>
+/// Record of the word boundary and viseme events of a SpeechSynthesizer, kept in one array per field rather than
+/// one object per event, for lip-sync and highlighting that look events up by playback position.
+/// Attach it with <see cref="SpeechSynthesizer::SetTimeline"/>.
+/// </summary>
+/// <remarks>
+/// Events are grouped into segments, one per synthesis result, in arrival order. Texts, animations and result ids
+/// are interned, so repeated words are stored once; with capacity reserved through <see cref="Reserve"/>, recording
+/// an event whose text is already known does not allocate. Lookups by audio offset are binary searches and assume
+/// that the service reports the events of a result in audio order, which it does.
+/// A timeline records one synthesizer; all methods are thread-safe.
+/// </remarks>
+class SpeechSynthesisTimeline
+{
+public:
+
+    /// <summary>
+    /// Creates an empty timeline.
+    /// </summary>
+    /// <param name="wordBoundaries">Number of word boundaries to reserve space for.</param>
+    /// <param name="visemes">Number of visemes to reserve space for.</param>
+    /// <returns>A shared pointer to the timeline.</returns>
+    static std::shared_ptr<SpeechSynthesisTimeline> Create(size_t wordBoundaries = 0, size_t visemes = 0)
+    {
+        auto timeline = std::shared_ptr<SpeechSynthesisTimeline>(new SpeechSynthesisTimeline());
+        timeline->Reserve(wordBoundaries, visemes);
+        return timeline;
+    }
+
+    /// <summary>
+    /// Reserves space for events, e.g. roughly 3 word boundaries and 12 visemes per second of speech.
+    /// </summary>
+    /// <param name="wordBoundaries">Total number of word boundaries to reserve space for.</param>
+    /// <param name="visemes">Total number of visemes to reserve space for.</param>
+    void Reserve(size_t wordBoundaries, size_t visemes)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wordAudioOffsets.reserve(wordBoundaries);
+        m_wordDurations.reserve(wordBoundaries);
+        m_wordTextOffsets.reserve(wordBoundaries);
+        m_wordLengths.reserve(wordBoundaries);
+        m_wordTextIds.reserve(wordBoundaries);
+        m_wordTypes.reserve(wordBoundaries);
+        m_visemeAudioOffsets.reserve(visemes);
+        m_visemeIds.reserve(visemes);
+        m_visemeAnimationIds.reserve(visemes);
+    }
+
+    /// <summary>
+    /// Removes all events and strings.
+    /// </summary>
+    void Clear()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_segments.clear();
+        m_wordAudioOffsets.clear();
+        m_wordDurations.clear();
+        m_wordTextOffsets.clear();
+        m_wordLengths.clear();
+        m_wordTextIds.clear();
+        m_wordTypes.clear();
+        m_visemeAudioOffsets.clear();
+        m_visemeIds.clear();
+        m_visemeAnimationIds.clear();
+        m_chars.clear();
+        m_stringEnds.clear();
+        std::fill(m_buckets.begin(), m_buckets.end(), 0u);
+        InternLocked("", 0);
+    }
+
+    /// <summary>
+    /// Gets the number of segments, one per synthesis result.
+    /// </summary>
+    /// <returns>Number of segments.</returns>
+    size_t GetSegmentCount() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_segments.size();
+    }
+
+    /// <summary>
+    /// Gets the id of the synthesis result of a segment.
+    /// </summary>
+    /// <param name="segment">Index of the segment.</param>
+    /// <returns>The result id.</returns>
+    SPXSTRING GetResultId(size_t segment) const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return GetStringLocked(GetSegmentLocked(segment).resultId);
+    }
+
+    /// <summary>
+    /// Finds the latest segment of a synthesis result.
+    /// </summary>
+    /// <param name="resultId">Id of the result, see <see cref="SpeechSynthesisResult::ResultId"/>.</param>
+    /// <param name="segment">Receives the index of the segment.</param>
+    /// <returns>true if the result has events in the timeline.</returns>
+    bool FindSegment(const SPXSTRING& resultId, size_t& segment) const
+    {
+        auto id = Utils::ToUTF8(resultId);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (auto i = m_segments.size(); i > 0; i--)
+        {
+            if (EqualsLocked(m_segments[i - 1].resultId, id.data(), id.size()))
+            {
+                segment = i - 1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// <summary>
+    /// Gets the number of word boundaries of a segment.
+    /// </summary>
+    /// <param name="segment">Index of the segment.</param>
+    /// <returns>Number of word boundaries.</returns>
+    size_t GetWordBoundaryCount(size_t segment) const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const auto& s = GetSegmentLocked(segment);
+        return s.wordEnd - s.wordBegin;
+    }
+
+    /// <summary>
+    /// Gets a word boundary of a segment.
+    /// </summary>
+    /// <param name="segment">Index of the segment.</param>
+    /// <param name="index">Index of the word boundary within the segment.</param>
+    /// <returns>The word boundary.</returns>
+    SpeechSynthesisTimelineWordBoundary GetWordBoundary(size_t segment, size_t index) const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const auto& s = GetSegmentLocked(segment);
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, index >= s.wordEnd - s.wordBegin);
+        return GetWordBoundaryLocked(s.wordBegin + index);
+    }
+
+    /// <summary>
+    /// Gets the number of word boundaries of a segment that start at or before an audio offset; the word being
+    /// spoken at that offset, if any, is the one before that index.
+    /// </summary>
+    /// <param name="segment">Index of the segment.</param>
+    /// <param name="audioOffset">Audio offset, in ticks (100 nanoseconds).</param>
+    /// <returns>Number of word boundaries up to the offset.</returns>
+    size_t UpperBoundWordBoundary(size_t segment, uint64_t audioOffset) const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const auto& s = GetSegmentLocked(segment);
+        return UpperBoundLocked(m_wordAudioOffsets, s.wordBegin, s.wordEnd, audioOffset);
+    }
+
+    /// <summary>
+    /// Finds the last word boundary of a segment that starts at or before an audio offset.
+    /// </summary>
+    /// <param name="segment">Index of the segment.</param>
+    /// <param name="audioOffset">Audio offset, in ticks (100 nanoseconds).</param>
+    /// <param name="boundary">Receives the word boundary.</param>
+    /// <returns>true if there is such a word boundary.</returns>
+    bool FindWordBoundary(size_t segment, uint64_t audioOffset, SpeechSynthesisTimelineWordBoundary& boundary) const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const auto& s = GetSegmentLocked(segment);
+        auto count = UpperBoundLocked(m_wordAudioOffsets, s.wordBegin, s.wordEnd, audioOffset);
+        if (count == 0)
+        {
+            return false;
+        }
+        boundary = GetWordBoundaryLocked(s.wordBegin + count - 1);
+        return true;
+    }
+
+    /// <summary>
+    /// Gets the number of visemes of a segment.
+    /// </summary>
+    /// <param name="segment">Index of the segment.</param>
+    /// <returns>Number of visemes.</returns>
+    size_t GetVisemeCount(size_t segment) const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const auto& s = GetSegmentLocked(segment);
+        return s.visemeEnd - s.visemeBegin;
+    }
+
+    /// <summary>
+    /// Gets a viseme of a segment.
+    /// </summary>
+    /// <param name="segment">Index of the segment.</param>
+    /// <param name="index">Index of the viseme within the segment.</param>
+    /// <returns>The viseme.</returns>
+    SpeechSynthesisTimelineViseme GetViseme(size_t segment, size_t index) const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const auto& s = GetSegmentLocked(segment);
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, index >= s.visemeEnd - s.visemeBegin);
+        return GetVisemeLocked(s.visemeBegin + index);
+    }
+
+    /// <summary>
+    /// Gets the number of visemes of a segment that start at or before an audio offset.
+    /// </summary>
+    /// <param name="segment">Index of the segment.</param>
+    /// <param name="audioOffset">Audio offset, in ticks (100 nanoseconds).</param>
+    /// <returns>Number of visemes up to the offset.</returns>
+    size_t UpperBoundViseme(size_t segment, uint64_t audioOffset) const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const auto& s = GetSegmentLocked(segment);
+        return UpperBoundLocked(m_visemeAudioOffsets, s.visemeBegin, s.visemeEnd, audioOffset);
+    }
+
+    /// <summary>
+    /// Finds the viseme of a segment shown at an audio offset, i.e. the last one starting at or before it.
+    /// </summary>
+    /// <param name="segment">Index of the segment.</param>
+    /// <param name="audioOffset">Audio offset, in ticks (100 nanoseconds).</param>
+    /// <param name="viseme">Receives the viseme.</param>
+    /// <returns>true if there is such a viseme.</returns>
+    bool FindViseme(size_t segment, uint64_t audioOffset, SpeechSynthesisTimelineViseme& viseme) const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const auto& s = GetSegmentLocked(segment);
+        auto count = UpperBoundLocked(m_visemeAudioOffsets, s.visemeBegin, s.visemeEnd, audioOffset);
+        if (count == 0)
+        {
+            return false;
+        }
+        viseme = GetVisemeLocked(s.visemeBegin + count - 1);
+        return true;
+    }
+
+    /// <summary>
+    /// Gets an interned text or animation.
+    /// </summary>
+    /// <param name="id">Id of the string, from a word boundary or viseme.</param>
+    /// <returns>The string.</returns>
+    SPXSTRING GetString(uint32_t id) const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, id >= m_stringEnds.size());
+        return GetStringLocked(id);
+    }
+
+    /// <summary>
+    /// Gets the number of bytes allocated by the timeline.
+    /// </summary>
+    /// <returns>Allocated size in bytes.</returns>
+    size_t GetAllocatedSize() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_segments.capacity() * sizeof(Segment) +
+            m_wordAudioOffsets.capacity() * sizeof(uint64_t) + m_wordDurations.capacity() * sizeof(uint32_t) +
+            m_wordTextOffsets.capacity() * sizeof(uint32_t) + m_wordLengths.capacity() * sizeof(uint32_t) +
+            m_wordTextIds.capacity() * sizeof(uint32_t) + m_wordTypes.capacity() * sizeof(uint8_t) +
+            m_visemeAudioOffsets.capacity() * sizeof(uint64_t) + m_visemeIds.capacity() * sizeof(uint32_t) +
+            m_visemeAnimationIds.capacity() * sizeof(uint32_t) +
+            m_chars.capacity() + m_stringEnds.capacity() * sizeof(uint32_t) + m_buckets.capacity() * sizeof(uint32_t);
+    }
+
+private:
+
+    DISABLE_COPY_AND_MOVE(SpeechSynthesisTimeline);
+
+    friend class SpeechSynthesizer;
+
+    struct Segment
+    {
+        uint32_t resultId;
+        size_t wordBegin;
+        size_t wordEnd;
+        size_t visemeBegin;
+        size_t visemeEnd;
+    };
+
+    // Strings returned by the C API are released with this deleter; they are only read to intern them.
+    using PropertyString = std::unique_ptr<const char, void(*)(const char*)>;
+
+    static PropertyString MakePropertyString(const char* value)
+    {
+        return PropertyString(value, [](const char* p) { property_bag_free_string(p); });
+    }
+
+    SpeechSynthesisTimeline() : m_buckets(64, 0u)
+    {
+        InternLocked("", 0);
+    }
+
+    void AddWordBoundary(SPXEVENTHANDLE hevent)
+    {
+        uint64_t audioOffset = 0;
+        uint64_t durationTicks = 0;
+        uint32_t textOffset = 0;
+        uint32_t wordLength = 0;
+        SpeechSynthesis_BoundaryType boundaryType = SpeechSynthesis_BoundaryType_Word;
+        SPX_THROW_ON_FAIL(synthesizer_word_boundary_event_get_values(hevent, &audioOffset, &durationTicks, &textOffset, &wordLength, &boundaryType));
+
+        const size_t maxCharCount = 256;
+        char resultId[maxCharCount + 1];
+        SPX_THROW_ON_FAIL(synthesizer_event_get_result_id(hevent, resultId, maxCharCount));
+        auto text = MakePropertyString(synthesizer_event_get_text(hevent));
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto& segment = GetCurrentSegmentLocked(resultId);
+        auto textId = text == nullptr ? 0u : InternLocked(text.get(), std::strlen(text.get()));
+        m_wordAudioOffsets.push_back(audioOffset);
+        m_wordDurations.push_back(static_cast<uint32_t>(std::min<uint64_t>(durationTicks, UINT32_MAX)));
+        m_wordTextOffsets.push_back(textOffset);
+        m_wordLengths.push_back(wordLength);
+        m_wordTextIds.push_back(textId);
+        m_wordTypes.push_back(static_cast<uint8_t>(boundaryType));
+        segment.wordEnd = m_wordAudioOffsets.size();
+    }
+
+    void AddViseme(SPXEVENTHANDLE hevent)
+    {
+        uint64_t audioOffset = 0;
+        uint32_t visemeId = 0;
+        SPX_THROW_ON_FAIL(synthesizer_viseme_event_get_values(hevent, &audioOffset, &visemeId));
+
+        const size_t maxCharCount = 256;
+        char resultId[maxCharCount + 1];
+        SPX_THROW_ON_FAIL(synthesizer_event_get_result_id(hevent, resultId, maxCharCount));
+        auto animation = MakePropertyString(synthesizer_viseme_event_get_animation(hevent));
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto& segment = GetCurrentSegmentLocked(resultId);
+        auto animationId = animation == nullptr ? 0u : InternLocked(animation.get(), std::strlen(animation.get()));
+        m_visemeAudioOffsets.push_back(audioOffset);
+        m_visemeIds.push_back(visemeId);
+        m_visemeAnimationIds.push_back(animationId);
+        segment.visemeEnd = m_visemeAudioOffsets.size();
+    }
+
+    Segment& GetCurrentSegmentLocked(const char* resultId)
+    {
+        auto length = std::strlen(resultId);
+        if (m_segments.empty() || !EqualsLocked(m_segments.back().resultId, resultId, length))
+        {
+            m_segments.push_back(Segment{ InternLocked(resultId, length), m_wordAudioOffsets.size(), m_wordAudioOffsets.size(), m_visemeAudioOffsets.size(), m_visemeAudioOffsets.size() });
+        }
+        return m_segments.back();
+    }
+
+    const Segment& GetSegmentLocked(size_t segment) const
+    {
+        SPX_THROW_HR_IF(SPXERR_INVALID_ARG, segment >= m_segments.size());
+        return m_segments[segment];
+    }
+
+    static size_t UpperBoundLocked(const std::vector<uint64_t>& offsets, size_t begin, size_t end, uint64_t audioOffset)
+    {
+        auto first = offsets.begin() + static_cast<std::ptrdiff_t>(begin);
+        auto last = offsets.begin() + static_cast<std::ptrdiff_t>(end);
+        return static_cast<size_t>(std::upper_bound(first, last, audioOffset) - first);
+    }
+
+    SpeechSynthesisTimelineWordBoundary GetWordBoundaryLocked(size_t i) const
+    {
+        SpeechSynthesisTimelineWordBoundary boundary;
+        boundary.AudioOffset = m_wordAudioOffsets[i];
+        boundary.Duration = std::chrono::milliseconds(m_wordDurations[i] / 10000);
+        boundary.TextOffset = m_wordTextOffsets[i];
+        boundary.WordLength = m_wordLengths[i];
+        boundary.BoundaryType = static_cast<SpeechSynthesisBoundaryType>(m_wordTypes[i]);
+        boundary.TextId = m_wordTextIds[i];
+        return boundary;
+    }
+
+    SpeechSynthesisTimelineViseme GetVisemeLocked(size_t i) const
+    {
+        SpeechSynthesisTimelineViseme viseme;
+        viseme.AudioOffset = m_visemeAudioOffsets[i];
+        viseme.VisemeId = m_visemeIds[i];
+        viseme.AnimationId = m_visemeAnimationIds[i];
+        return viseme;
+    }
+
+    // Interned strings are stored back to back in m_chars; string i ends at m_stringEnds[i]. The open addressing
+    // table m_buckets holds string id + 1, or 0 for an empty bucket, and is kept at most half full.
+
+    static uint32_t Hash(const char* data, size_t length)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619u;
+        }
+        return hash;
+    }
+
+    size_t GetStringBeginLocked(uint32_t id) const
+    {
+        return id == 0 ? 0 : m_stringEnds[id - 1];
+    }
+
+    bool EqualsLocked(uint32_t id, const char* data, size_t length) const
+    {
+        auto begin = GetStringBeginLocked(id);
+        return m_stringEnds[id] - begin == length && std::equal(data, data + length, m_chars.begin() + static_cast<std::ptrdiff_t>(begin));
+    }
+
+    SPXSTRING GetStringLocked(uint32_t id) const
+    {
+        auto begin = m_chars.begin() + static_cast<std::ptrdiff_t>(GetStringBeginLocked(id));
+        auto end = m_chars.begin() + static_cast<std::ptrdiff_t>(m_stringEnds[id]);
+        return Utils::ToSPXString(std::string(begin, end));
+    }
+
+    uint32_t InternLocked(const char* data, size_t length)
+    {
+        auto mask = m_buckets.size() - 1;
+        for (auto i = Hash(data, length) & mask; ; i = (i + 1) & mask)
+        {
+            auto bucket = m_buckets[i];
+            if (bucket == 0)
+            {
+                break;
+            }
+            if (EqualsLocked(bucket - 1, data, length))
+            {
+                return bucket - 1;
+            }
+        }
+
+        SPX_THROW_HR_IF(SPXERR_BUFFER_TOO_SMALL, m_chars.size() + length > UINT32_MAX);
+        auto id = static_cast<uint32_t>(m_stringEnds.size());
+        m_chars.insert(m_chars.end(), data, data + length);
+        m_stringEnds.push_back(static_cast<uint32_t>(m_chars.size()));
+        if (m_stringEnds.size() * 2 > m_buckets.size())
+        {
+            RehashLocked(m_buckets.size() * 2);
+        }
+        else
+        {
+            InsertBucketLocked(id, Hash(data, length));
+        }
+        return id;
+    }
+
+    void InsertBucketLocked(uint32_t id, uint32_t hash)
+    {
+        auto mask = m_buckets.size() - 1;
+        auto i = hash & mask;
+        while (m_buckets[i] != 0)
+        {
+            i = (i + 1) & mask;
+        }
+        m_buckets[i] = id + 1;
+    }
+
+    void RehashLocked(size_t bucketCount)
+    {
+        m_buckets.assign(bucketCount, 0u);
+        for (uint32_t id = 0; id < m_stringEnds.size(); id++)
+        {
+            auto begin = GetStringBeginLocked(id);
+            InsertBucketLocked(id, Hash(m_chars.data() + begin, m_stringEnds[id] - begin));
+        }
+    }
+
+    mutable std::mutex m_mutex;
+    std::vector<Segment> m_segments;
+
+    std::vector<uint64_t> m_wordAudioOffsets;
+    std::vector<uint32_t> m_wordDurations;
+    std::vector<uint32_t> m_wordTextOffsets;
+    std::vector<uint32_t> m_wordLengths;
+    std::vector<uint32_t> m_wordTextIds;
+    std::vector<uint8_t> m_wordTypes;
+
+    std::vector<uint64_t> m_visemeAudioOffsets;
+    std::vector<uint32_t> m_visemeIds;
+    std::vector<uint32_t> m_visemeAnimationIds;
+
+    std::vector<char> m_chars;
+    std::vector<uint32_t> m_stringEnds;
+    std::vector<uint32_t> m_buckets;
+};
+
+} } } // Microsoft::CognitiveServices::Speech